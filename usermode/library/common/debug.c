@@ -45,26 +45,14 @@
                                           PSEGMENT_RESERVED_REGION_SIZE)
 
 /* Tracing infrastructure */
-__thread struct timeval mtm_time;
-__thread int mtm_tid = -1;
-
 __thread char tstr[TSTR_SZ];
 __thread int tsz = 0;
-__thread unsigned long long tbuf_ptr = 0;
 __thread int reg_write = 0;
 __thread unsigned long long n_epoch = 0;
 
-/* Can we make these thread local ? */
-char *tbuf;
-pthread_spinlock_t tbuf_lock;
 pthread_spinlock_t tot_epoch_lock;
-unsigned long long tbuf_sz;
 int mtm_enable_trace = 0;
-int mtm_debug_buffer = 1;
 int trace_marker = -1, tracing_on = -1;
-struct timeval glb_time;
-unsigned long long start_buf_drain = 0, end_buf_drain = 0, buf_drain_period = 0;
-unsigned long long glb_tv_sec = 0, glb_tv_usec = 0, glb_start_time = 0;
 unsigned long long tot_epoch = 0;
 
 /*
@@ -81,7 +69,7 @@ unsigned long long tot_epoch = 0;
  *
  */
 #include <pm_instr.h>
-void __pm_trace_print(char* format, ...)
+void __pm_trace_print(const char* format, ...)
 {
 	va_list __va_list;
 	va_start(__va_list, format);
@@ -0,0 +1,376 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Collection and reporting of the per-thread latency histograms.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lathist.h"
+
+int m_lathist_enabled;
+__thread m_lathist_set_t *m_lathist_thread_set;
+
+static const char *lathist_names[] = {
+#define LATHIST_NAME(name) #name,
+	FOREACH_LATHIST (LATHIST_NAME)
+#undef LATHIST_NAME
+};
+
+static pthread_mutex_t  sets_lock = PTHREAD_MUTEX_INITIALIZER;
+static m_lathist_set_t  *sets;          /* sets of live threads */
+static m_lathist_set_t  *free_sets;     /* sets of exited threads, for reuse */
+static m_lathist_t      retired[m_lathist_num]; /* totals of exited threads */
+static unsigned int     nthreads;      /* number of live threads */
+static pthread_key_t    set_key;
+
+/* TSC and clock at initialization, to convert cycles to nanoseconds. */
+static uint64_t         base_tsc;
+static struct timespec  base_time;
+
+static int              dump_signum;
+static char             *dump_file;
+static struct sigaction dump_oldact;
+static sem_t            dump_sem;
+static pthread_t        dump_thread;
+static volatile int     dump_stop;
+
+
+void
+m_lathist_reset(m_lathist_t *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT64_MAX;
+}
+
+
+void
+m_lathist_merge(m_lathist_t *dest, const m_lathist_t *src)
+{
+	int i;
+
+	for (i=0; i<M_LATHIST_BUCKETS; i++) {
+		dest->bucket[i] += src->bucket[i];
+	}
+	dest->count += src->count;
+	dest->sum += src->sum;
+	if (src->min < dest->min) {
+		dest->min = src->min;
+	}
+	if (src->max > dest->max) {
+		dest->max = src->max;
+	}
+}
+
+
+static void
+set_reset(m_lathist_set_t *set)
+{
+	int i;
+
+	for (i=0; i<m_lathist_num; i++) {
+		m_lathist_reset(&set->hist[i]);
+	}
+}
+
+
+/* Folds the histograms of an exiting thread into the retired totals. */
+static void
+set_destroy(void *arg)
+{
+	m_lathist_set_t *set = (m_lathist_set_t *) arg;
+	m_lathist_set_t **setp;
+	int             i;
+
+	pthread_mutex_lock(&sets_lock);
+	for (setp = &sets; *setp != set; setp = &(*setp)->next);
+	*setp = set->next;
+	for (i=0; i<m_lathist_num; i++) {
+		m_lathist_merge(&retired[i], &set->hist[i]);
+	}
+	set->next = free_sets;
+	free_sets = set;
+	nthreads--;
+	pthread_mutex_unlock(&sets_lock);
+	m_lathist_thread_set = NULL;
+}
+
+
+/**
+ * \brief Creates the histograms of the calling thread.
+ *
+ * \return the histograms, or NULL if histograms are disabled
+ */
+m_lathist_set_t *
+m_lathist_set_create(void)
+{
+	m_lathist_set_t *set;
+
+	if (!m_lathist_enabled) {
+		return NULL;
+	}
+	pthread_mutex_lock(&sets_lock);
+	if ((set = free_sets) != NULL) {
+		free_sets = set->next;
+	} else if ((set = (m_lathist_set_t *) malloc(sizeof(*set))) == NULL) {
+		pthread_mutex_unlock(&sets_lock);
+		return NULL;
+	}
+	set_reset(set);
+	set->next = sets;
+	sets = set;
+	nthreads++;
+	pthread_mutex_unlock(&sets_lock);
+	pthread_setspecific(set_key, set);
+	m_lathist_thread_set = set;
+	return set;
+}
+
+
+/**
+ * \brief Merges one histogram of all threads, live or exited, into dest.
+ *
+ * Threads keep recording while their histograms are read, so the result
+ * is a snapshot that may miss the latencies being recorded meanwhile.
+ */
+void
+m_lathist_collect(m_lathist_id_t id, m_lathist_t *dest)
+{
+	m_lathist_set_t *set;
+
+	m_lathist_reset(dest);
+	pthread_mutex_lock(&sets_lock);
+	m_lathist_merge(dest, &retired[id]);
+	for (set = sets; set != NULL; set = set->next) {
+		m_lathist_merge(dest, &set->hist[id]);
+	}
+	pthread_mutex_unlock(&sets_lock);
+}
+
+
+/**
+ * \brief Returns the value at or below which the given percentage of the
+ * recorded values fall, in cycles, rounded up to the end of its bucket.
+ */
+uint64_t
+m_lathist_percentile(const m_lathist_t *hist, double percentile)
+{
+	uint64_t total = 0;
+	uint64_t target;
+	uint64_t seen = 0;
+	uint64_t high;
+	int      i;
+
+	for (i=0; i<M_LATHIST_BUCKETS; i++) {
+		total += hist->bucket[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	target = (uint64_t) (percentile / 100.0 * total + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+	for (i=0; i<M_LATHIST_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= target) {
+			break;
+		}
+	}
+	high = i + 1 < M_LATHIST_BUCKETS ? m_lathist_bucket_low(i + 1) - 1 : UINT64_MAX;
+	return high < hist->max ? high : hist->max;
+}
+
+
+/* Nanoseconds per cycle, measured against the clock since initialization. */
+static double
+ns_per_cycle(void)
+{
+	struct timespec now;
+	uint64_t        tsc = hrtime_cycles();
+	double          ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - base_time.tv_sec) * 1e9 + (now.tv_nsec - base_time.tv_nsec);
+	if (ns < 1e7 || tsc <= base_tsc) {
+		return 1000.0 / _HRTIME_CPUFREQ;
+	}
+	return ns / (tsc - base_tsc);
+}
+
+
+/**
+ * \brief Prints a summary of the histograms of all threads, in nanoseconds.
+ */
+void
+m_lathist_print(FILE *fout)
+{
+	m_lathist_t *hist;
+	double      scale = ns_per_cycle();
+	int         i;
+
+	if ((hist = (m_lathist_t *) malloc(sizeof(*hist))) == NULL) {
+		return;
+	}
+	fprintf(fout, "LATENCY HISTOGRAMS (ns): pid %d, %u live threads, %llu ms\n",
+	        (int) getpid(), nthreads, 
+	        (unsigned long long) (scale * (hrtime_cycles() - base_tsc) / 1000000));
+	fprintf(fout, "%-12s%12s%12s%12s%12s%12s%12s%12s%12s\n", "", "count", 
+	        "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+	for (i=0; i<m_lathist_num; i++) {
+		m_lathist_collect((m_lathist_id_t) i, hist);
+		if (hist->count == 0) {
+			fprintf(fout, "%-12s%12d\n", lathist_names[i], 0);
+			continue;
+		}
+		fprintf(fout, "%-12s%12llu%12.0f%12.0f%12.0f%12.0f%12.0f%12.0f%12.0f\n",
+		        lathist_names[i],
+		        (unsigned long long) hist->count,
+		        scale * hist->min,
+		        scale * hist->sum / hist->count,
+		        scale * m_lathist_percentile(hist, 50.0),
+		        scale * m_lathist_percentile(hist, 90.0),
+		        scale * m_lathist_percentile(hist, 99.0),
+		        scale * m_lathist_percentile(hist, 99.9),
+		        scale * hist->max);
+	}
+	fflush(fout);
+	free(hist);
+}
+
+
+static void
+dump_signal_handler(int signum)
+{
+	int saved_errno = errno;
+
+	sem_post(&dump_sem);
+	errno = saved_errno;
+}
+
+
+/* Prints the histograms each time the dump signal is received. */
+static void *
+dump_loop(void *arg)
+{
+	FILE *fout;
+
+	for (;;) {
+		while (sem_wait(&dump_sem) != 0 && errno == EINTR);
+		if (dump_stop) {
+			break;
+		}
+		if ((fout = fopen(dump_file, "a")) != NULL) {
+			m_lathist_print(fout);
+			fclose(fout);
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * \brief Enables the histograms.
+ *
+ * If signum is not 0, the histograms are appended to dump_file each time 
+ * the process receives signum. The signal is left alone if the 
+ * application already handles it.
+ *
+ * \return 0 on success, -1 if the dump signal cannot be set up
+ */
+int
+m_lathist_init(int signum, const char *file)
+{
+	struct sigaction act;
+	int              i;
+
+	if (m_lathist_enabled) {
+		return 0;
+	}
+	base_tsc = hrtime_cycles();
+	clock_gettime(CLOCK_MONOTONIC, &base_time);
+	for (i=0; i<m_lathist_num; i++) {
+		m_lathist_reset(&retired[i]);
+	}
+	pthread_key_create(&set_key, set_destroy);
+	m_lathist_enabled = 1;
+
+	if (signum == 0) {
+		return 0;
+	}
+	if (sigaction(signum, NULL, &dump_oldact) != 0 ||
+	    dump_oldact.sa_handler != SIG_DFL) 
+	{
+		return -1;
+	}
+	dump_file = strdup(file);
+	sem_init(&dump_sem, 0, 0);
+	dump_stop = 0;
+	if (pthread_create(&dump_thread, NULL, dump_loop, NULL) != 0) {
+		sem_destroy(&dump_sem);
+		free(dump_file);
+		return -1;
+	}
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = dump_signal_handler;
+	act.sa_flags = SA_RESTART;
+	sigemptyset(&act.sa_mask);
+	sigaction(signum, &act, NULL);
+	dump_signum = signum;
+	return 0;
+}
+
+
+void
+m_lathist_fini(void)
+{
+	if (dump_signum == 0) {
+		return;
+	}
+	sigaction(dump_signum, &dump_oldact, NULL);
+	dump_signum = 0;
+	dump_stop = 1;
+	sem_post(&dump_sem);
+	pthread_join(dump_thread, NULL);
+	sem_destroy(&dump_sem);
+	free(dump_file);
+	dump_file = NULL;
+}
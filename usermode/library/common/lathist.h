@@ -0,0 +1,185 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Per-thread transaction latency histograms.
+ *
+ * Latencies are recorded in TSC cycles into log-linear buckets in the 
+ * style of HdrHistogram: values below M_LATHIST_SUB get a bucket each, 
+ * and every power of two above that is split into M_LATHIST_SUB equal 
+ * buckets, so any value is known to within 1/M_LATHIST_SUB of itself.
+ *
+ * Each thread records into its own set of histograms without locking or
+ * allocating; the set is allocated at its first use and recycled when the
+ * thread exits. Collecting merges the sets of all live threads with the 
+ * totals of the threads that exited. A snapshot may be printed on demand 
+ * with m_lathist_print or by sending the process the signal given to 
+ * m_lathist_init.
+ */
+
+#ifndef _LATHIST_H
+#define _LATHIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hrtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The latencies recorded. */
+#define FOREACH_LATHIST(ACTION)                                                \
+  ACTION(commit)      /* transaction begin to commit, retries included */      \
+  ACTION(log_flush)   /* making the redo log of a transaction durable */       \
+  ACTION(write_back)  /* writing back and flushing the write set */            \
+  ACTION(trunc_wait)  /* waiting for the log to be truncated */
+
+typedef enum {
+#define LATHIST_ENTRY(name) m_lathist_##name,
+	FOREACH_LATHIST (LATHIST_ENTRY)
+#undef LATHIST_ENTRY
+	m_lathist_num
+} m_lathist_id_t;
+
+#define M_LATHIST_SUB_BITS 4
+#define M_LATHIST_SUB      (1 << M_LATHIST_SUB_BITS)
+#define M_LATHIST_BUCKETS  ((64 - M_LATHIST_SUB_BITS + 1) * M_LATHIST_SUB)
+
+typedef struct m_lathist_s {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[M_LATHIST_BUCKETS];
+} m_lathist_t;
+
+typedef struct m_lathist_set_s {
+	m_lathist_t            hist[m_lathist_num];
+	struct m_lathist_set_s *next;
+} m_lathist_set_t;
+
+extern int m_lathist_enabled;
+extern __thread m_lathist_set_t *m_lathist_thread_set;
+
+int m_lathist_init(int signum, const char *file);
+void m_lathist_fini(void);
+m_lathist_set_t *m_lathist_set_create(void);
+void m_lathist_reset(m_lathist_t *hist);
+void m_lathist_merge(m_lathist_t *dest, const m_lathist_t *src);
+void m_lathist_collect(m_lathist_id_t id, m_lathist_t *dest);
+uint64_t m_lathist_percentile(const m_lathist_t *hist, double percentile);
+void m_lathist_print(FILE *fout);
+
+
+/** \brief Returns the bucket of a value. */
+static inline
+unsigned int
+m_lathist_bucket(uint64_t val)
+{
+	unsigned int shift;
+
+	if (val < M_LATHIST_SUB) {
+		return (unsigned int) val;
+	}
+	shift = 63 - __builtin_clzll(val) - M_LATHIST_SUB_BITS;
+	return (shift + 1) * M_LATHIST_SUB + (unsigned int) (val >> shift) - M_LATHIST_SUB;
+}
+
+
+/** \brief Returns the smallest value of a bucket. */
+static inline
+uint64_t
+m_lathist_bucket_low(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < M_LATHIST_SUB) {
+		return bucket;
+	}
+	shift = bucket / M_LATHIST_SUB - 1;
+	return (uint64_t) (M_LATHIST_SUB + bucket % M_LATHIST_SUB) << shift;
+}
+
+
+static inline
+void
+m_lathist_record(m_lathist_t *hist, uint64_t cycles)
+{
+	hist->bucket[m_lathist_bucket(cycles)]++;
+	hist->count++;
+	hist->sum += cycles;
+	if (cycles < hist->min) {
+		hist->min = cycles;
+	}
+	if (cycles > hist->max) {
+		hist->max = cycles;
+	}
+}
+
+
+/** 
+ * \brief Returns the histograms of the calling thread, or NULL if 
+ * histograms are disabled. 
+ */
+static inline
+m_lathist_set_t *
+m_lathist_thread_get(void)
+{
+	m_lathist_set_t *set = m_lathist_thread_set;
+
+	if (__builtin_expect(set == NULL, 0) && m_lathist_enabled) {
+		set = m_lathist_set_create();
+	}
+	return set;
+}
+
+
+/** \brief Records a latency of the calling thread. */
+static inline
+void
+m_lathist_add(m_lathist_id_t id, uint64_t cycles)
+{
+	m_lathist_set_t *set = m_lathist_thread_get();
+
+	if (set) {
+		m_lathist_record(&set->hist[id], cycles);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LATHIST_H */
@@ -66,59 +66,31 @@
 
 
 #ifdef _ENABLE_TRACE
-#define time_since_start							\
-	({									\
-		gettimeofday(&mtm_time, NULL);					\
-		(((1000000*mtm_time.tv_sec + 					\
-				mtm_time.tv_usec)				\
-		- (glb_start_time)) - buf_drain_period);			\
-	})
-
-#define TENTRY_ID								\
-	(mtm_tid == -1 ? 							\
-		({mtm_tid = syscall(SYS_gettid); mtm_tid;}) : mtm_tid), 	\
-	(time_since_start)				
+#include "pm_trace.h"
+/* 
+ * Events are recorded in binary into per-thread rings (see pm_trace.h).
+ * The thread id and time are taken by the ring, so TENTRY_ID is only a 
+ * placeholder, and the events are told apart by their number of 
+ * arguments: 5 for markers, 7 for one numeric argument, 8 for two.
+ */
+#define TENTRY_ID (int)0, (unsigned long long)0
+
+#define PM_TRACE_NARGS(args ...) PM_TRACE_NARGS_(args, 8, 7, 6, 5, 4, 3, 2, 1)
+#define PM_TRACE_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define PM_TRACE_CAT(a, b) PM_TRACE_CAT_(a, b)
+#define PM_TRACE_CAT_(a, b) a ## b
+
+#define pm_trace_event_5(id, t, marker, func, line)				\
+	pm_trace_event(marker, 0, 0, 0, -1, func, line)
+#define pm_trace_event_7(id, t, marker, addr, arg0, func, line)		\
+	pm_trace_event(marker, (uintptr_t) (addr), arg0, 0, 1, func, line)
+#define pm_trace_event_8(id, t, marker, addr, arg0, arg1, func, line)	\
+	pm_trace_event(marker, (uintptr_t) (addr), arg0, arg1, 2, func, line)
 
 #define pm_trace_print(format, args ...)					\
     {										\
 	if(mtm_enable_trace) {							\
-	pthread_spin_lock(&tbuf_lock);						\
-       	sprintf(tstr, format, args);    					\
-	tsz = strlen(tstr);							\
-	if(tsz < MAX_TBUF_SZ - tbuf_sz)						\
-	{									\
-		memcpy(tbuf+tbuf_sz, 						\
-				tstr, tsz);					\
-		tbuf_sz += tsz;							\
-	}									\
-	else {									\
-		tbuf_ptr = 0;							\
-		if(mtm_debug_buffer)						\
-		{								\
-			fprintf(m_err, 						\
-			"start_buf_drain - %llu us\n",				\
-			(start_buf_drain = time_since_start));			\
-		}								\
-		while(tbuf_ptr < tbuf_sz)					\
-		{								\
-			tbuf_ptr = tbuf_ptr + 1 + 				\
-				fprintf(m_out,"%s", 				\
-				tbuf + tbuf_ptr);				\
-		}								\
-		tbuf_sz = 0; 							\
-		memset(tbuf,'\0', MAX_TBUF_SZ);					\
-		if(mtm_debug_buffer)						\
-		{								\
-			fprintf(m_err, 						\
-			"end_buf_drain - %llu us\n",				\
-			(end_buf_drain = time_since_start));			\
-		}								\
-		memcpy(tbuf, tstr, tsz);					\
-		tbuf_sz += tsz;							\
-		buf_drain_period += (end_buf_drain -				\
-					start_buf_drain) + 1;			\
-	}									\
-	pthread_spin_unlock(&tbuf_lock);					\
+		PM_TRACE_CAT(pm_trace_event_, PM_TRACE_NARGS(args))(args);	\
 	}									\
     }
 #elif _ENABLE_FTRACE
@@ -193,6 +165,19 @@
             pm_dst = y;                                 \
     })
 
+/* Atomically replaces pm_dst with y if it still holds old */
+#define PM_CAS_DW(pm_dst, old, y)                       \
+    ({                                                  \
+            PM_TRACE("%d:%llu:%s:%p:%lu:%s:%d\n",       \
+                        TENTRY_ID,                      \
+                        PM_DWRT_MARKER,                 \
+                        &(pm_dst),                      \
+                        sizeof((pm_dst)),               \
+                        LOC1,                           \
+                        LOC2);                          \
+            __sync_bool_compare_and_swap(&(pm_dst), old, y); \
+    })
+
 #define PM_EQU_DI(pm_dst, y)                            \
     ({                                                  \
             PM_TRACE("%d:%llu:%s:%p:%lu:%s:%d\n",       \
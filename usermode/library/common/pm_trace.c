@@ -0,0 +1,350 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Per-thread binary trace rings and their drain thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include "pm_trace.h"
+
+/* Events converted and written per chunk. */
+#define PM_TRACE_BATCH 4096
+
+typedef struct strtbl_entry_s {
+	const char *str;
+	uint32_t   id;
+} strtbl_entry_t;
+
+__thread pm_trace_ring_t *pm_trace_ring;
+static __thread int      ring_destroyed;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pm_trace_ring_t *rings;
+static pthread_key_t   ring_key;
+static pthread_t       drain_thread;
+static volatile int    drain_stop;
+static volatile int    tracing;
+static FILE            *trace_fp;
+
+/* 
+ * Strings already written to the trace, by address. Only the drain 
+ * thread touches these.
+ */
+static strtbl_entry_t  *strtbl;
+static uint32_t        strtbl_size;
+static uint32_t        strtbl_count;
+static pm_trace_rec_t  recbuf[PM_TRACE_BATCH];
+
+
+static void
+write_chunk(uint32_t type, uint32_t tid, uint64_t n, uint64_t arg0, uint64_t arg1)
+{
+	pm_trace_chunk_t chunk;
+
+	chunk.type = type;
+	chunk.tid = tid;
+	chunk.n = n;
+	chunk.arg[0] = arg0;
+	chunk.arg[1] = arg1;
+	fwrite(&chunk, sizeof(chunk), 1, trace_fp);
+}
+
+
+static void
+write_sync(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	write_chunk(PM_TRACE_CHUNK_SYNC, 0, 0, hrtime_cycles(), 
+	            1000000ULL * tv.tv_sec + tv.tv_usec);
+}
+
+
+static uint32_t
+strtbl_hash(const char *str)
+{
+	uintptr_t h = (uintptr_t) str;
+
+	h ^= h >> 17;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return (uint32_t) (h >> 32);
+}
+
+
+static void
+strtbl_insert(const char *str, uint32_t id)
+{
+	uint32_t i;
+
+	for (i = strtbl_hash(str) & (strtbl_size - 1); strtbl[i].str; i = (i + 1) & (strtbl_size - 1));
+	strtbl[i].str = str;
+	strtbl[i].id = id;
+}
+
+
+/* Returns the id of a string, writing it to the trace the first time. */
+static uint32_t
+intern(const char *str)
+{
+	strtbl_entry_t *old;
+	uint32_t       old_size;
+	uint32_t       i;
+	size_t         len;
+
+	for (i = strtbl_hash(str) & (strtbl_size - 1); strtbl[i].str; i = (i + 1) & (strtbl_size - 1)) {
+		if (strtbl[i].str == str) {
+			return strtbl[i].id;
+		}
+	}
+	if (2 * (strtbl_count + 1) > strtbl_size) {
+		old = strtbl;
+		old_size = strtbl_size;
+		strtbl_size *= 2;
+		strtbl = (strtbl_entry_t *) calloc(strtbl_size, sizeof(*strtbl));
+		for (i = 0; i < old_size; i++) {
+			if (old[i].str) {
+				strtbl_insert(old[i].str, old[i].id);
+			}
+		}
+		free(old);
+	}
+	strtbl_insert(str, ++strtbl_count);
+	len = strlen(str);
+	write_chunk(PM_TRACE_CHUNK_STRING, 0, len, strtbl_count, 0);
+	fwrite(str, 1, len, trace_fp);
+	return strtbl_count;
+}
+
+
+/* Writes out the events of a ring. Returns the number of events. */
+static uint64_t
+drain_ring(pm_trace_ring_t *ring)
+{
+	pm_trace_event_t *e;
+	uint64_t         head;
+	uint64_t         tail;
+	uint64_t         dropped;
+	uint64_t         total = 0;
+	int              i;
+	int              n;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+	while (tail != head) {
+		n = head - tail < PM_TRACE_BATCH ? head - tail : PM_TRACE_BATCH;
+		for (i = 0; i < n; i++) {
+			e = &ring->events[(tail + i) & (PM_TRACE_RING_SIZE - 1)];
+			recbuf[i].tsc = e->tsc;
+			recbuf[i].addr = e->addr;
+			recbuf[i].arg[0] = e->arg[0];
+			recbuf[i].arg[1] = e->arg[1];
+			recbuf[i].marker = intern(e->marker);
+			recbuf[i].func = intern(e->func);
+			recbuf[i].line = e->line;
+			recbuf[i].nargs = e->nargs;
+		}
+		write_chunk(PM_TRACE_CHUNK_EVENTS, ring->tid, n, 0, 0);
+		fwrite(recbuf, sizeof(pm_trace_rec_t), n, trace_fp);
+		tail += n;
+		total += n;
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+	dropped = ring->dropped;
+	if (dropped != ring->dropped_reported) {
+		write_chunk(PM_TRACE_CHUNK_DROPS, ring->tid, dropped - ring->dropped_reported, 0, 0);
+		ring->dropped_reported = dropped;
+	}
+	return total;
+}
+
+
+/* Drains all rings. Returns the largest number of events in one ring. */
+static uint64_t
+drain_rings(void)
+{
+	pm_trace_ring_t **pp;
+	pm_trace_ring_t *ring;
+	uint64_t        total = 0;
+	uint64_t        max = 0;
+	uint64_t        n;
+	int             dead;
+
+	pthread_mutex_lock(&rings_lock);
+	for (pp = &rings; (ring = *pp) != NULL; ) {
+		/* a ring found dead has no more events coming after this drain */
+		dead = ring->dead;
+		n = drain_ring(ring);
+		total += n;
+		max = n > max ? n : max;
+		if (dead) {
+			*pp = ring->next;
+			munmap(ring, sizeof(*ring));
+		} else {
+			pp = &ring->next;
+		}
+	}
+	pthread_mutex_unlock(&rings_lock);
+	if (total) {
+		write_sync();
+		fflush(trace_fp);
+	}
+	return max;
+}
+
+
+static void *
+drain_loop(void *arg)
+{
+	uint64_t n = 0;
+
+	while (!drain_stop) {
+		/* keep up with a thread that fills its ring faster than the period */
+		if (n < PM_TRACE_RING_SIZE / 4) {
+			usleep(PM_TRACE_DRAIN_PERIOD_US);
+		}
+		n = drain_rings();
+	}
+	return NULL;
+}
+
+
+static void
+ring_destroy(void *arg)
+{
+	pm_trace_ring_t *ring = (pm_trace_ring_t *) arg;
+
+	/* 
+	 * The drain thread unmaps the ring once it is dead. Events the thread
+	 * emits after this point, e.g. from other thread-specific data 
+	 * destructors, are not recorded.
+	 */
+	pm_trace_ring = NULL;
+	ring_destroyed = 1;
+	ring->dead = 1;
+}
+
+
+/**
+ * \brief Creates the trace ring of the calling thread.
+ *
+ * Rings are mapped directly rather than malloc'ed to avoid interacting
+ * with the application's allocator.
+ *
+ * \return the ring, or NULL if tracing is not initialized or the thread 
+ * is exiting
+ */
+pm_trace_ring_t *
+pm_trace_ring_create(void)
+{
+	pm_trace_ring_t *ring;
+
+	if (!tracing || ring_destroyed) {
+		return NULL;
+	}
+	ring = (pm_trace_ring_t *) mmap(0, sizeof(*ring), PROT_READ | PROT_WRITE, 
+	                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) {
+		return NULL;
+	}
+	ring->tid = syscall(SYS_gettid);
+	pthread_setspecific(ring_key, ring);
+	pthread_mutex_lock(&rings_lock);
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&rings_lock);
+	pm_trace_ring = ring;
+	return ring;
+}
+
+
+/**
+ * \brief Starts writing trace events to a file.
+ *
+ * \return 0 on success, -1 if the file cannot be created
+ */
+int
+pm_trace_init(const char *path)
+{
+	pm_trace_file_hdr_t hdr;
+
+	if (tracing) {
+		return 0;
+	}
+	if ((trace_fp = fopen(path, "w")) == NULL) {
+		return -1;
+	}
+	hdr.magic = PM_TRACE_MAGIC;
+	hdr.version = PM_TRACE_VERSION;
+	hdr.rec_size = sizeof(pm_trace_rec_t);
+	fwrite(&hdr, sizeof(hdr), 1, trace_fp);
+	write_sync();
+	strtbl_size = 1024;
+	strtbl_count = 0;
+	strtbl = (strtbl_entry_t *) calloc(strtbl_size, sizeof(*strtbl));
+	pthread_key_create(&ring_key, ring_destroy);
+	drain_stop = 0;
+	tracing = 1;
+	pthread_create(&drain_thread, NULL, drain_loop, NULL);
+	return 0;
+}
+
+
+/**
+ * \brief Drains all rings and closes the trace file.
+ */
+void
+pm_trace_fini(void)
+{
+	if (!tracing) {
+		return;
+	}
+	tracing = 0;
+	drain_stop = 1;
+	pthread_join(drain_thread, NULL);
+	drain_rings();
+	write_sync();
+	fclose(trace_fp);
+	trace_fp = NULL;
+	free(strtbl);
+	strtbl = NULL;
+}
@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Per-thread binary trace rings for the PM_* instrumentation.
+ *
+ * Each thread records events into its own fixed-size ring without taking
+ * any lock. A background thread drains all rings into a trace file, which
+ * pm-trace-decode turns back into the text format of pm_instr.h. When a 
+ * ring is full, events are dropped and counted rather than blocking the 
+ * thread.
+ *
+ * A trace file is a pm_trace_file_hdr_t followed by chunks. Each chunk is
+ * a pm_trace_chunk_t, followed for PM_TRACE_CHUNK_EVENTS by n records of
+ * pm_trace_rec_t, and for PM_TRACE_CHUNK_STRING by n bytes of text.
+ * Marker and function names are written once as strings and referred to
+ * by id from the records.
+ */
+
+#ifndef _PM_TRACE_H
+#define _PM_TRACE_H
+
+#include <stdint.h>
+#include "hrtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Events per thread ring. Must be a power of 2. */
+#define PM_TRACE_RING_SIZE     (64*1024)
+
+/** How often the drain thread empties the rings. */
+#define PM_TRACE_DRAIN_PERIOD_US 1000
+
+#define PM_TRACE_MAGIC         0x31454341525450ULL /* "PTRACE1" */
+#define PM_TRACE_VERSION       1
+
+enum {
+	PM_TRACE_CHUNK_EVENTS = 1, /* tid: thread; n: number of records */
+	PM_TRACE_CHUNK_STRING,     /* arg[0]: string id; n: length */
+	PM_TRACE_CHUNK_DROPS,      /* tid: thread; n: events dropped */
+	PM_TRACE_CHUNK_SYNC        /* arg[0]: TSC; arg[1]: microseconds */
+};
+
+typedef struct pm_trace_file_hdr_s {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t rec_size;
+} pm_trace_file_hdr_t;
+
+typedef struct pm_trace_chunk_s {
+	uint32_t type;
+	uint32_t tid;
+	uint64_t n;
+	uint64_t arg[2];
+} pm_trace_chunk_t;
+
+/** 
+ * An event as stored in the trace file. nargs is the number of numeric
+ * arguments printed after the address, or -1 for events without an 
+ * address such as fences and commits.
+ */
+typedef struct pm_trace_rec_s {
+	uint64_t tsc;
+	uint64_t addr;
+	uint32_t arg[2];
+	uint32_t marker;
+	uint32_t func;
+	int32_t  line;
+	int32_t  nargs;
+} pm_trace_rec_t;
+
+/** An event as recorded in a ring, naming strings by address. */
+typedef struct pm_trace_event_s {
+	uint64_t   tsc;
+	uint64_t   addr;
+	const char *marker;
+	const char *func;
+	uint32_t   arg[2];
+	int32_t    line;
+	int32_t    nargs;
+} pm_trace_event_t;
+
+/** 
+ * Single-producer single-consumer ring. Only the owning thread advances
+ * head and only the drain thread advances tail.
+ */
+typedef struct pm_trace_ring_s {
+	volatile uint64_t      head __attribute__((aligned(64)));
+	volatile uint64_t      tail __attribute__((aligned(64)));
+	volatile uint64_t      dropped;
+	uint64_t               dropped_reported;
+	int                    tid;
+	volatile int           dead;
+	struct pm_trace_ring_s *next;
+	pm_trace_event_t       events[PM_TRACE_RING_SIZE];
+} pm_trace_ring_t;
+
+extern __thread pm_trace_ring_t *pm_trace_ring;
+
+int pm_trace_init(const char *path);
+void pm_trace_fini(void);
+pm_trace_ring_t *pm_trace_ring_create(void);
+
+
+static inline
+void
+pm_trace_event(const char *marker, uintptr_t addr, uint32_t arg0, uint32_t arg1, 
+               int nargs, const char *func, int line)
+{
+	pm_trace_ring_t  *ring = pm_trace_ring;
+	pm_trace_event_t *e;
+	uint64_t         head;
+
+	if (__builtin_expect(ring == NULL, 0)) {
+		if ((ring = pm_trace_ring_create()) == NULL) {
+			return;
+		}
+	}
+	head = ring->head;
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= PM_TRACE_RING_SIZE) {
+		ring->dropped++;
+		return;
+	}
+	e = &ring->events[head & (PM_TRACE_RING_SIZE - 1)];
+	e->tsc = hrtime_cycles();
+	e->addr = addr;
+	e->marker = marker;
+	e->func = func;
+	e->arg[0] = arg0;
+	e->arg[1] = arg1;
+	e->line = line;
+	e->nargs = nargs;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PM_TRACE_H */
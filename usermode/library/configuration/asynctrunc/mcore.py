@@ -0,0 +1 @@
+../default/mcore.py
\ No newline at end of file
@@ -0,0 +1 @@
+../default/mnemosyne.py
\ No newline at end of file
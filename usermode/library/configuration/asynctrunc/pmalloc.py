@@ -0,0 +1 @@
+../default/pmalloc.py
\ No newline at end of file
@@ -0,0 +1 @@
+../default/test.py
\ No newline at end of file
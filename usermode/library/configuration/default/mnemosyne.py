@@ -19,22 +19,23 @@ M_PCM_EMULATE_CRASH = False
 M_PCM_EMULATE_LATENCY = False
 
 ########################################################################
-# M_PCM_CPUFREQ: CPU frequency in GHz used by the PCM emulation layer to 
-#   calculate latencies
+# M_PCM_CPUFREQ: CPU frequency in MHz used by the PCM emulation layer to 
+#   calculate latencies when the TSC frequency cannot be calibrated
 ########################################################################
 
 M_PCM_CPUFREQ = 2500
 
 ########################################################################
 # M_PCM_LATENCY_WRITE: Latency of a PCM write in nanoseconds. This 
-#   latency is in addition to the DRAM latency.
+#   latency is in addition to the DRAM latency. Default of the mcore
+#   pcm_write_latency_ns runtime setting.
 ########################################################################
 
 M_PCM_LATENCY_WRITE = 150
 
 ########################################################################
-# M_PCM_BANDWIDTH_MB: Bandwidth to PCM in MB/s. This is used to model 
-# sequential writes.
+# M_PCM_BANDWIDTH_MB: Bandwidth to PCM in MB/s, shared by all threads.
+#   Default of the mcore pcm_bandwidth_mb runtime setting.
 ########################################################################
 
 M_PCM_BANDWIDTH_MB = 1200
@@ -31,6 +31,10 @@ SYNC_TRUNCATION = True
 # TMLOG_TYPE_TORNBIT: a log that reserves a torn bit per 64-bit word to 
 #   detect writes that did not make it to persistent storage. Does not
 #   require updating the tail on each transaction commit/abort.
+#
+# TMLOG_TYPE_COMPACT: same physical log as TMLOG_TYPE_TORNBIT but with a
+#   denser record format. Writes to consecutive words of a cacheline are
+#   coalesced into one record and full masks are not logged.
 ########################################################################
 
 TMLOG_TYPE = 'TMLOG_TYPE_BASE'
@@ -83,6 +87,25 @@ ROLLOVER_CLOCK = True
 
 CLOCK_IN_CACHE_LINE = True
 
+########################################################################
+# CLOCK_TYPE: Determines the time base that orders transactions. Commit
+#   timestamps are also the order in which recovery replays the logs.
+#
+# CLOCK_TYPE_GLOBAL: each update transaction increments a global 
+#   clock, whose cacheline every commit contends on.
+#
+# CLOCK_TYPE_GV4: a committer increments the global clock only if no 
+#   other committer did so first, and shares that committer's timestamp 
+#   otherwise. This bounds contention on the clock to one attempt per 
+#   commit, at the cost of a commit-time validation more often.
+#
+# CLOCK_TYPE_TSC: the time-stamp counter is the clock, so committers 
+#   share no cacheline at all. Requires an invariant TSC that is 
+#   synchronized across all sockets.
+########################################################################
+
+CLOCK_TYPE = 'CLOCK_TYPE_GLOBAL'
+
 ########################################################################
 # Prevent duplicate entries in read/write sets when accessing the same
 # address multiple times.  Enabling this option may reduce performance
@@ -132,10 +132,10 @@ class Environment(SCons.Environment.Environment):
 	
 	#: Build variables which have numerical values
 	_mnemosyne_numerical_directive_vars = [
-		('M_PCM_CPUFREQ',            'CPU frequency in GHz used by the PCM emulation layer to calculate latencies', 
+		('M_PCM_CPUFREQ',            'CPU frequency in MHz used by the PCM emulation layer when the TSC cannot be calibrated', 
 			2500), 
 		('M_PCM_LATENCY_WRITE',      'Latency of a PCM write in nanoseconds. This latency is in addition to the DRAM latency.', 
 			150), 
-		('M_PCM_BANDWIDTH_MB',       'Bandwidth to PCM in MB/s. This is used to model sequential writes.', 
+		('M_PCM_BANDWIDTH_MB',       'Bandwidth to PCM in MB/s, shared by all threads.', 
 			1200), 
 	]
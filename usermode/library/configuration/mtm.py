@@ -77,7 +77,11 @@ class Environment(mnemosyne.Environment):
 		('TMLOG_TYPE',
 		                 'Determines the type of the persistent log used.',
 		                 'TMLOG_TYPE_BASE',
-		                 ['TMLOG_TYPE_BASE', 'TMLOG_TYPE_TORNBIT'])
+		                 ['TMLOG_TYPE_BASE', 'TMLOG_TYPE_TORNBIT', 'TMLOG_TYPE_COMPACT']),
+		('CLOCK_TYPE',
+		                 'Determines the time base that orders transactions.',
+		                 'CLOCK_TYPE_GLOBAL',
+		                 ['CLOCK_TYPE_GLOBAL', 'CLOCK_TYPE_GV4', 'CLOCK_TYPE_TSC'])
 	]
 	
 	#: Build directives which have numerical values
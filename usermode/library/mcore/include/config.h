@@ -39,11 +39,48 @@
 #define FOREACH_RUNTIME_CONFIG_SETTING(ACTION, group, config, values)          \
   ACTION(config, values, group, reset_segments, bool, int, 0,                  \
          CONFIG_NO_CHECK, 0)                                                   \
-  ACTION(config, values, group, segments_dir, string, char *, "/tmp/segments", \
-         CONFIG_NO_CHECK, 0)                                                   \
+  ACTION(config, values, group, segments_dir, string, const char *,            \
+         "/tmp/segments", CONFIG_NO_CHECK, 0)                                  \
   ACTION(config, values, group, stats, bool, int, 0, CONFIG_NO_CHECK, 0)       \
-  ACTION(config, values, group, stats_file, string, char *, "mcore.stats",     \
-         CONFIG_NO_CHECK, 0)
+  ACTION(config, values, group, stats_file, string, const char *,              \
+         "mcore.stats", CONFIG_NO_CHECK, 0)                                    \
+  ACTION(config, values, group, stats_socket, string, const char *, "",        \
+         CONFIG_NO_CHECK, 0)                                                   \
+  ACTION(config, values, group, trace_file, string, const char *,              \
+         "mnemosyne.trace", CONFIG_NO_CHECK, 0)                                \
+  ACTION(config, values, group, latency_hist, bool, int, 1, CONFIG_NO_CHECK, 0)\
+  ACTION(config, values, group, latency_hist_signal, int, int, 0,             \
+         CONFIG_RANGE_CHECK, 0, 64)                                            \
+  ACTION(config, values, group, latency_hist_file, string, const char *,       \
+         "mnemosyne.hist", CONFIG_NO_CHECK, 0)                                 \
+  ACTION(config, values, group, flush_insn, string, const char *, "auto",      \
+         CONFIG_NO_CHECK, 0)                                                   \
+  ACTION(config, values, group, pcm_backend, string, const char *, "persist",  \
+         CONFIG_NO_CHECK, 0)                                                   \
+  ACTION(config, values, group, pcm_write_latency_ns, int, int,                \
+         M_PCM_LATENCY_WRITE, CONFIG_RANGE_CHECK, 0, 1000000)                  \
+  ACTION(config, values, group, pcm_read_latency_ns, int, int, 0,              \
+         CONFIG_RANGE_CHECK, 0, 1000000)                                       \
+  ACTION(config, values, group, pcm_bandwidth_mb, int, int,                    \
+         M_PCM_BANDWIDTH_MB, CONFIG_RANGE_CHECK, 0, 1000000)                   \
+  ACTION(config, values, group, log_num, int, int, 32,                         \
+         CONFIG_RANGE_CHECK, 1, 4096)                                          \
+  ACTION(config, values, group, log_entries_log2, int, int, 20,                \
+         CONFIG_RANGE_CHECK, 10, 26)                                           \
+  ACTION(config, values, group, log_align, int, int, 4096,                     \
+         CONFIG_RANGE_CHECK, 4096, 2097152)                                    \
+  ACTION(config, values, group, recovery_threads, int, int, 1,                 \
+         CONFIG_RANGE_CHECK, 1, 64)                                            \
+  ACTION(config, values, group, trunc_threads, int, int, 1,                    \
+         CONFIG_RANGE_CHECK, 1, 64)                                            \
+  ACTION(config, values, group, trunc_cpus, string, const char *, "1",         \
+         CONFIG_NO_CHECK, 0)                                                   \
+  ACTION(config, values, group, trunc_period_ms, int, int, 10000,              \
+         CONFIG_RANGE_CHECK, 1, 3600000)                                       \
+  ACTION(config, values, group, trunc_low_watermark, int, int, 25,             \
+         CONFIG_RANGE_CHECK, 1, 100)                                           \
+  ACTION(config, values, group, trunc_high_watermark, int, int, 75,            \
+         CONFIG_RANGE_CHECK, 1, 100)
 
 
 typedef CONFIG_GROUP_STRUCT(mcore) mcore_config_t;
@@ -39,7 +39,9 @@
 #ifndef _PCM_INTERNAL_H
 #define _PCM_INTERNAL_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <mmintrin.h>
 #include <list.h>
 #include <spinlock.h>
@@ -52,19 +54,6 @@ extern "C" {
 #endif
 
 
-/** 
- * Stores may block wait to find space in the cache (write buffer is full and 
- * must wait to evict other cacheline from the cache) or to find an empty 
- * write-combining buffer.
- * 
- * For write-back, we emulate by using some probability to block-wait.
- * For write-combining, we keep track of the number of WC buffers being 
- * used. We conservatively assume that no implicit evictions happen.
- */
-//#define M_PCM_EMULATE_LATENCY_BLOCKING_STORES 0x1
-#undef M_PCM_EMULATE_LATENCY_BLOCKING_STORES
-
-
 /** 
  * Machine has the RDTSCP instruction. 
  * 
@@ -85,6 +74,12 @@ extern "C" {
 /** The memory banking factor. Must be a power of 2. */
 #define MEMORY_BANKING_FACTOR 8
 
+/** 
+ * Emulated bandwidth left unused is saved up to this many nanoseconds 
+ * worth, so that short bursts of writes are not throttled.
+ */
+#define PCM_EMULATE_BURST_NS 10000
+
 
 /* 
  * Probabilities are derived using total number of outcomes equal to 
@@ -97,8 +92,8 @@ extern "C" {
 #endif
 
 
-#define NS2CYCLE(__ns) ((__ns) * M_PCM_CPUFREQ / 1000)
-#define CYCLE2NS(__cycles) ((__cycles) * 1000 / M_PCM_CPUFREQ)
+#define NS2CYCLE(__ns) ((__ns) * pcm_emul.tsc_khz / 1000000)
+#define CYCLE2NS(__cycles) ((__cycles) * 1000000 / pcm_emul.tsc_khz)
 
 
 #define likely(x)	__builtin_expect(!!(x), 1)
@@ -143,6 +138,38 @@ typedef struct pcm_storeset_s pcm_storeset_t;
 typedef struct cacheline_tbl_s cacheline_tbl_t;
 
 
+/** 
+ * Cacheline write-back instructions, in order of preference. 
+ *
+ * CLFLUSH is ordered with respect to other stores and flushes. CLFLUSHOPT 
+ * and CLWB are not, so a batch of them is completed with a single SFENCE.
+ * CLWB may also leave the line valid in the cache.
+ */
+enum {
+	PCM_FLUSH_CLFLUSH = 0,
+	PCM_FLUSH_CLFLUSHOPT,
+	PCM_FLUSH_CLWB,
+	PCM_FLUSH_NTYPES
+};
+
+
+/**
+ * Persistence backends, selected once at startup.
+ *
+ * PERSIST writes back and fences with the real instructions. EMULATE does
+ * the same and adds the latency and bandwidth of slower NVM on top of 
+ * DRAM. DRAM turns write-backs and fences into compiler barriers and 
+ * non-temporal stores into plain stores, which gives an upper bound on
+ * performance without any persistence cost.
+ */
+enum {
+	PCM_BACKEND_PERSIST = 0,
+	PCM_BACKEND_EMULATE,
+	PCM_BACKEND_DRAM,
+	PCM_BACKEND_NTYPES
+};
+
+
 
 /** 
  * Per client bookkeeping data structure that keeps several information
@@ -156,13 +183,34 @@ struct pcm_storeset_s {
 	uint16_t              wcbuf_hashtbl[WCBUF_HASHTBL_SIZE];
 	uint16_t              wcbuf_hashtbl_count;
 	uint32_t              seqstream_len;
+	uint64_t              seqstream_start;              /* timestamp of first write of the stream */
 	cacheline_tbl_t       *cacheline_tbl;
 	struct list_head      list;
 	volatile unsigned int in_crash_emulation_code;
-	uint64_t              seqstream_write_TS_array[8]; /* timestamp of writes */
-	int                   seqstream_write_TS_index; 
+	uint64_t              flush_stat[PCM_FLUSH_NTYPES]; /* cachelines written back, per instruction */
+	uint64_t              drain_stat;                   /* fences completing a batch of write-backs */
+	uint64_t              wb_pending;                   /* write-backs since last drain (emulate backend) */
+	uintptr_t             rd_last_line;                 /* last cacheline loaded (emulate backend) */
 };
 
+/**
+ * Calibrated NVM emulator shared by all threads (emulate backend).
+ *
+ * Write bandwidth is a token bucket over TSC time. Writing n bytes moves
+ * bw_horizon forward by the cycles n bytes take at the emulated 
+ * bandwidth, and the writer waits until the horizon has passed. The 
+ * horizon may lag the current time by at most bw_burst_cycles, which is
+ * the depth of the bucket.
+ */
+typedef struct pcm_emulator_s {
+	uint64_t          tsc_khz;              /* calibrated TSC frequency */
+	uint64_t          write_latency_cycles;
+	uint64_t          read_latency_cycles;
+	uint64_t          bw_cycles_per_kb;     /* 0 if bandwidth is not limited */
+	uint64_t          bw_burst_cycles;
+	volatile uint64_t bw_horizon __attribute__((aligned(CACHELINE_SIZE)));
+} pcm_emulator_t;
+
 /*
  * Locally defined global variables.
  */ 
@@ -171,8 +219,12 @@ struct pcm_storeset_s {
  * Externally defined global variables.
  */ 
 
-extern unsigned int pcm_likelihood_store_blockwaits;  
 extern volatile arch_spinlock_t ticket_lock;
+extern int pcm_flush_insn;
+extern const char *pcm_flush_insn_name[PCM_FLUSH_NTYPES];
+extern int pcm_backend;
+extern const char *pcm_backend_name[PCM_BACKEND_NTYPES];
+extern pcm_emulator_t pcm_emul;
 
 /* 
  * Prototypes
@@ -186,6 +238,10 @@ void pcm_wb_store_emulate_crash(pcm_storeset_t *set, volatile pcm_word_t *addr,
 void pcm_wb_flush_emulate_crash(pcm_storeset_t *set, volatile pcm_word_t *addr);
 void pcm_nt_store_emulate_crash(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val);
 void pcm_nt_flush_emulate_crash(pcm_storeset_t *set);
+int pcm_flush_init(const char *insn);
+int pcm_backend_init(const char *name);
+void pcm_emulate_init(int write_latency_ns, int read_latency_ns, int bandwidth_mb);
+void pcm_flush_stats_print(FILE *fout);
 
 
 /*
@@ -267,6 +323,21 @@ static inline unsigned long long asm_rdtscp(void)
 #define asm_clflush(addr) {;}
 */
 
+/* 
+ * CLFLUSHOPT and CLWB are encoded by hand as older assemblers don't know 
+ * them: CLFLUSHOPT is CLFLUSH with a 0x66 prefix and CLWB is XSAVEOPT 
+ * with a 0x66 prefix.
+ */
+#define asm_clflushopt(addr)					\
+({								\
+	__asm__ __volatile__ (".byte 0x66; clflush %0" : "+m"(*(volatile char *)(addr)));	\
+})
+
+#define asm_clwb(addr)						\
+({								\
+	__asm__ __volatile__ (".byte 0x66; xsaveopt %0" : "+m"(*(volatile char *)(addr)));	\
+})
+
 // static inline void asm_mfence(void)
 #define asm_mfence()				\
 ({						\
@@ -358,8 +429,10 @@ emulate_latency_ns(int ns)
  * its mask does not overlap with any other conrcurrent masked store.
  * Normally there is no race because we touch different parts. However
  * because we do word-size writes we introduce non-existing races. We
- * resolve this problem by writing each byte individually in the case
- * when we don't write the whole word. 
+ * resolve this problem by writing each byte the mask covers individually
+ * when the mask is made of whole bytes. A mask that splits a byte (e.g. 
+ * a single bitmap bit) is merged in with a compare-and-swap on the word,
+ * so disjoint bits of the same byte written concurrently are not lost.
  * 
  * Note: Mask MUST not be zero.
  */
@@ -369,227 +442,164 @@ emulate_latency_ns(int ns)
 #define write_aligned_masked(addr, val, mask)						\
 (											\
 	{										\
-		uintptr_t a;								\
-		int       i;								\
-		int       trailing_0bytes;						\
-		int       leading_0bytes;						\
+		uintptr_t __a;								\
+		int       __i;								\
+		int       __trailing_0bytes;						\
+		int       __leading_0bytes;						\
+		pcm_word_t __mask = (mask);						\
 											\
 		union convert_u {							\
 			pcm_word_t w;							\
 			uint8_t    b[sizeof(pcm_word_t)];				\
-		} valu;									\
+		} __valu;								\
 											\
 		/* Complete write? */							\
-		if (mask == ((uint64_t) -1)) {						\
+		if (__mask == ((uint64_t) -1)) {					\
 			PM_EQU_DW(*addr, val);						\
-		} else {								\
-			valu.w = val;							\
-			a = (uintptr_t) addr;						\
-			trailing_0bytes = __builtin_ctzll(mask) >> 3;			\
-			leading_0bytes = __builtin_clzll(mask) >> 3;			\
-			for (i = trailing_0bytes; i<8-leading_0bytes;i++) {		\
-				PM_EQU_DW(*((uint8_t *) (a+i)), valu.b[i]);		\
+		} else if ((__mask & 0x0101010101010101ULL) * 0xff == __mask) {	\
+			__valu.w = val;							\
+			__a = (uintptr_t) addr;						\
+			__trailing_0bytes = __builtin_ctzll(__mask) >> 3;		\
+			__leading_0bytes = __builtin_clzll(__mask) >> 3;		\
+			for (__i = __trailing_0bytes; __i<8-__leading_0bytes;__i++) {	\
+				if ((__mask >> (__i << 3)) & 0xff) {			\
+					PM_EQU_DW(*((uint8_t *) (__a+__i)), __valu.b[__i]);	\
+				}							\
 			}								\
+		} else {								\
+			do {								\
+				__valu.w = *(addr);					\
+			} while (!PM_CAS_DW(*(addr), __valu.w,				\
+			                    (__valu.w & ~__mask) | ((val) & __mask)));	\
 		}									\
 	}										\
 )		
 
-#define PCM_WB_STORE_MASKED(set, addr, val, mask)				\
-		write_aligned_masked(addr, val, mask);				
-
-#define PCM_WB_STORE_ALIGNED_MASKED(set, addr, val, mask)			\
-		PCM_WB_STORE_MASKED(set, addr, val, mask);
-
-#define PCM_WB_FENCE(set)							\
-	asm_mfence(); 
-
-#define PCM_WB_FLUSH(set, addr)							\
-	asm_clflush(addr); 							\
-
-#define PCM_NT_STORE(set, addr, val)						\
-	asm_movnti(addr, val);
-
-#define PCM_NT_FLUSH(set)							\
-	asm_sfence();
-
-#define PCM_SEQSTREAM_STORE(set, addr, val)					\
-	asm_movnti(addr, val);
-
-#define PCM_SEQSTREAM_STORE_64B_FIRST_WORD(set, addr, val)			\
-	asm_movnti(addr, val);
-
-#define PCM_SEQSTREAM_STORE_64B_NEXT_WORD(set, addr, val)			\
-	asm_movnti(addr, val);
-
-#define PCM_SEQSTREAM_STORE_64B(set, addr, val)					\
-	asm_sse_write_block64(addr, val);
-
-#define PCM_SEQSTREAM_FLUSH(set)						\
-	asm_sfence();
-
-#define PCM_SEQSTREAM_INIT(set) {;}
-
-
-/****************************** DO NOT SCROLL ***************************************/
-
-
-
-
-
-#if 0
-
 /*
- * WRITE BACK CACHE MODE
+ * Persistence backend helpers.
+ *
+ * The emulate backend runs the real instructions and then spins for the
+ * extra time slower NVM would take. Its bookkeeping lives here rather
+ * than in the macros below so that the macros stay small at every call
+ * site.
+ *
+ * Write latency is paid once per group of MEMORY_BANKING_FACTOR lines
+ * written back together, as writes to different banks overlap. Write
+ * bandwidth is shared by all threads through pcm_emul.bw_horizon (see 
+ * pcm_emulator_s). A write completes when both its latency and its share
+ * of the bandwidth have elapsed, whichever is later.
  */
 
+/* Compiler-only barrier used by the dram backend in place of fences. */
+#define pcm_compiler_barrier()					\
+({								\
+	__asm__ __volatile__ ("" ::: "memory");			\
+})
 
-/**
- * Emulates the latency of a write to PCM. In reality, this method simply stores to an address and
- * spins to emulate a nonzero latency.
- *
- * \param set is the client's pcm storeset where outstanding stores are kept.
- * \param addr is the address being written.
- * \param val is the word written at address.
- */
 static inline
 void
-PCM_WB_STORE(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val)
+emulate_latency_until(pcm_hrtime_t deadline)
 {
-	//printf("PCM_WB_STORE: (0x%lx, %lx)\n", addr, val);
-#ifdef M_PCM_EMULATE_CRASH
-	pcm_wb_store_emulate_crash(set, addr, val);
-#endif	
-
-	*addr = val;
-
-#ifdef M_PCM_EMULATE_LATENCY
-# ifdef M_PCM_EMULATE_LATENCY_BLOCKING_STORES
-	if (pcm_likelihood_store_blockwaits > 0) {
-		int random_number = rand_int(&set->rand_seed) % TOTAL_OUTCOMES_NUM;
-		if (random_number < pcm_likelihood_store_blockwaits) {
-			emulate_latency_ns(M_PCM_LATENCY_WRITE);
-		}
+	while (asm_rdtsc() < deadline) {
+		__asm__ __volatile__ ("pause");
 	}
-# endif
-#endif
 }
 
 
+/*
+ * Takes nbytes worth of tokens from the shared bandwidth bucket for a 
+ * write issued since start and returns the time at which they are 
+ * available.
+ */
 static inline
-void
-PCM_WB_STORE_MASKED(pcm_storeset_t *set, 
-                    volatile pcm_word_t *addr, 
-                    pcm_word_t val, 
-                    pcm_word_t mask)
+pcm_hrtime_t
+pcm_emulate_bandwidth(pcm_hrtime_t start, uint64_t nbytes)
 {
-	//printf("PCM_WB_STORE_MASKED: (0x%lx, %lx, %lx)\n", addr, val, mask);
-#ifdef M_PCM_EMULATE_CRASH
-	pcm_wb_store_emulate_crash(set, addr, val);
-#endif	
-
-	write_aligned_masked((pcm_word_t *) addr, val, mask);
-
-#ifdef M_PCM_EMULATE_LATENCY
-# ifdef M_PCM_EMULATE_LATENCY_BLOCKING_STORES
-	if (pcm_likelihood_store_blockwaits > 0) {
-		int random_number = rand_int(&set->rand_seed) % TOTAL_OUTCOMES_NUM;
-		if (random_number < pcm_likelihood_store_blockwaits) {
-			emulate_latency_ns(M_PCM_LATENCY_WRITE);
-		}
+	pcm_hrtime_t cost;
+	pcm_hrtime_t old;
+	pcm_hrtime_t horizon;
+
+	cost = nbytes * pcm_emul.bw_cycles_per_kb / 1024;
+	if (cost == 0) {
+		return start;
 	}
-# endif
-#endif
+	do {
+		old = pcm_emul.bw_horizon;
+		/* tokens unused for longer than the bucket depth are lost */
+		if (old + pcm_emul.bw_burst_cycles < start) {
+			horizon = start - pcm_emul.bw_burst_cycles + cost;
+		} else {
+			horizon = old + cost;
+		}
+	} while (!__sync_bool_compare_and_swap(&pcm_emul.bw_horizon, old, horizon));
+	return horizon;
 }
 
 
+/*
+ * Waits for nlines cachelines to be written to NVM, issued in one batch.
+ */
 static inline
 void
-PCM_WB_STORE_ALIGNED_MASKED(pcm_storeset_t *set, 
-                            volatile pcm_word_t *addr, 
-                            pcm_word_t val, 
-                            pcm_word_t mask)
+pcm_emulate_write(uint64_t nlines)
 {
-	PCM_WB_STORE_MASKED(set, addr, val, mask);
-}
-
+	pcm_hrtime_t now;
+	pcm_hrtime_t done;
+	pcm_hrtime_t bw_done;
+	uint64_t     nbanks;
 
-static inline
-void
-PCM_WB_FENCE(pcm_storeset_t *set)
-{
-		asm_mfence(); 
+	if (nlines == 0) {
+		return;
+	}
+	now = asm_rdtsc();
+	nbanks = (nlines + MEMORY_BANKING_FACTOR - 1) / MEMORY_BANKING_FACTOR;
+	done = now + nbanks * pcm_emul.write_latency_cycles;
+	bw_done = pcm_emulate_bandwidth(now, nlines * CACHELINE_SIZE);
+	emulate_latency_until(bw_done > done ? bw_done : done);
 }
 
+
 /*
- * Flush the cacheline containing address addr.
+ * Waits for a load from NVM. Repeated loads from the same cacheline are
+ * assumed to hit in the cache.
  */
 static inline
 void
-PCM_WB_FLUSH(pcm_storeset_t *set, volatile pcm_word_t *addr)
+pcm_emulate_read(pcm_storeset_t *set, volatile void *addr)
 {
-#ifdef M_PCM_EMULATE_CRASH
-	pcm_wb_flush_emulate_crash(set, addr);
-#endif
+	uintptr_t line = (uintptr_t) addr >> CACHELINE_SIZE_LOG;
 
-	/* 
-	 * Need mfence first to ensure that previous stores are included 
-	 * in the write-back 
-	 * But as this interface is used by transactions that may have many
-	 * clflush we required them to have issued the mfence themselves
-	 * otherwise we would unnecessarily issue multiple mfences
-	 */
-#ifdef M_PCM_EMULATE_LATENCY
-	{
-#ifdef HAS_RDTSCP
-		/* Measure the latency of a clflush and add an additional delay to
-		 * meet the latency to write to PCM */
-		pcm_hrtime_t start;
-		pcm_hrtime_t stop;
-
-		start = asm_rdtscp();
-		asm_clflush(addr); 	
-		stop = asm_rdtscp();
-		emulate_latency_ns(M_PCM_LATENCY_WRITE - CYCLE2NS(stop-start));
-#else
-		asm_clflush(addr); 	
-		emulate_latency_ns(M_PCM_LATENCY_WRITE);
-#endif		
-		asm_mfence(); 
-	}	
+	if (line != set->rd_last_line && pcm_emul.read_latency_cycles) {
+		set->rd_last_line = line;
+		emulate_latency_until(asm_rdtsc() + pcm_emul.read_latency_cycles);
+	}
+}
 
-#else /* !M_PCM_EMULATE_LATENCY */ 
-	asm_clflush(addr); 	
-	asm_mfence(); 
-#endif /* !M_PCM_EMULATE_LATENCY */ 
 
+static inline
+void
+pcm_emulate_wb_drain(pcm_storeset_t *set)
+{
+	pcm_emulate_write(set->wb_pending);
+	set->wb_pending = 0;
 }
 
 
 /*
- * NON-TEMPORAL STREAM MODE
- *
- * Stores are non-cacheable but go through the write-combining buffers instead.
+ * Keeps track of the write-combining buffers used by non-temporal stores.
+ * When all of them are in use, they are drained and the store waits for
+ * them to be written.
  */
-
 static inline
 void
-PCM_NT_STORE(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val)
+pcm_emulate_nt_store(pcm_storeset_t *set, volatile pcm_word_t *addr)
 {
-#ifdef M_PCM_EMULATE_CRASH
-	pcm_nt_store_emulate_crash(set, addr, val);
-#endif	
-
-	asm_movnti(addr, val);
-
-#ifdef M_PCM_EMULATE_LATENCY
 	uint16_t  i;
 	uint16_t  index_addr;
 	uint16_t  index_i;
-	uintptr_t byte_addr;
 	uintptr_t block_byte_addr;
-	
-	byte_addr = (uintptr_t) addr;
-	block_byte_addr = (uintptr_t) BLOCK_ADDR(byte_addr);
+
+	block_byte_addr = (uintptr_t) BLOCK_ADDR(addr);
 	index_addr = (uint16_t) ((block_byte_addr >> CACHELINE_SIZE_LOG)  & ((uint16_t) (-1)));
 
 retry:
@@ -606,197 +616,232 @@ retry:
 			}	
 		}
 	} else {
-		memset(set->wcbuf_hashtbl, 0, WCBUF_HASHTBL_SIZE);
-		emulate_latency_ns(M_PCM_LATENCY_WRITE * set->wcbuf_hashtbl_count);
+		pcm_emulate_write(set->wcbuf_hashtbl_count);
+		memset(set->wcbuf_hashtbl, 0, sizeof(set->wcbuf_hashtbl));
 		set->wcbuf_hashtbl_count = 0;
 		goto retry;
 	}
-
-#endif
 }
 
 
 static inline
 void
-PCM_NT_FLUSH(pcm_storeset_t *set)
+pcm_emulate_nt_flush(pcm_storeset_t *set)
 {
-#ifdef M_PCM_EMULATE_CRASH
-	pcm_nt_flush_emulate_crash(set);
-#endif	
-
-	asm_sfence();
-#ifdef M_PCM_EMULATE_LATENCY
-	emulate_latency_ns(M_PCM_LATENCY_WRITE * set->wcbuf_hashtbl_count);
-	memset(set->wcbuf_hashtbl, 0, WCBUF_HASHTBL_SIZE);
+	pcm_emulate_write(set->wcbuf_hashtbl_count);
+	memset(set->wcbuf_hashtbl, 0, sizeof(set->wcbuf_hashtbl));
 	set->wcbuf_hashtbl_count = 0;
-#endif
 }
 
 
-/*
- * NON-TEMPORAL SEQUENTIAL STREAM MODE
- *
- * Used when we know that stream accesses are sequential so that we 
- * emulate bandwidth and hide some latency. For example, stores to the log
- * are sequential. 
- *
- */
-
- 
 static inline
 void
-PCM_SEQSTREAM_INIT(pcm_storeset_t *set)
+pcm_emulate_seqstream_store(pcm_storeset_t *set, int nbytes)
 {
-#ifdef M_PCM_EMULATE_CRASH
-
-#endif	
-
-#ifdef M_PCM_EMULATE_LATENCY
-	set->seqstream_len = 0;
-	set->seqstream_write_TS_index = 0;
-#endif
+	if (set->seqstream_len == 0) {
+		set->seqstream_start = asm_rdtsc();
+	}
+	set->seqstream_len = set->seqstream_len + nbytes;
 }
 
 
+/*
+ * Completes a sequential stream. The stream is written in one pipelined
+ * batch, so it pays the write latency once and otherwise is limited by
+ * bandwidth. The bandwidth has been in use since the first store of the
+ * stream, not just since the flush.
+ */
 static inline
 void
-PCM_SEQSTREAM_STORE(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val)
+pcm_emulate_seqstream_flush(pcm_storeset_t *set)
 {
-	//printf("PCM_SEQSTREAM_STORE: set=%p, addr=%p, val=%llX\n", set, addr, val);
-#ifdef M_PCM_EMULATE_CRASH
-#endif	
-
-	asm_movnti(addr, val);
-
-#ifdef M_PCM_EMULATE_LATENCY
-	set->seqstream_len = set->seqstream_len + 8;
-
-	/* NOTE: Well, we want to always set the TS of the first write of a 
-	 * sequence. We could use an if-statement but this adds a branch.
-	 * I am not entirely convinced that the branch-predictor will work
-	 * well as the condition whether the branch is taken or not really 
-	 * depends on the length of the sequence of stores which varies.
-	 * I prefer to use a trick that relies on two stores that are likely
-	 * to hit the L1-D cache.
-	 */
-	set->seqstream_write_TS_array[set->seqstream_write_TS_index] = asm_rdtsc();
-	set->seqstream_write_TS_index |= 1;
-#endif
+	pcm_hrtime_t now;
+	pcm_hrtime_t done;
+	pcm_hrtime_t bw_done;
+
+	asm_sfence();
+	now = asm_rdtsc();
+	done = now + pcm_emul.write_latency_cycles;
+	bw_done = pcm_emulate_bandwidth(set->seqstream_len ? set->seqstream_start : now, 
+	                                set->seqstream_len);
+	emulate_latency_until(bw_done > done ? bw_done : done);
+	set->seqstream_len = 0;
 }
 
 
-static inline
-void
-PCM_SEQSTREAM_STORE_64B_FIRST_WORD(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val)
-{
-	//printf("PCM_SEQSTREAM_STORE: set=%p, addr=%p, val=%llX\n", set, addr, val);
-#ifdef M_PCM_EMULATE_CRASH
-#endif	
-
-	asm_movnti(addr, val);
-
-#ifdef M_PCM_EMULATE_LATENCY
-	set->seqstream_len = set->seqstream_len + 64;
-
-	/* NOTE: Well, we want to always set the TS of the first write of a 
-	 * sequence. We could use an if-statement but this adds a branch.
-	 * I am not entirely convinced that the branch-predictor will work
-	 * well as the condition whether the branch is taken or not really 
-	 * depends on the length of the sequence of stores which varies.
-	 * I prefer to use a trick that relies on two stores that are likely
-	 * to hit the L1-D cache.
-	 */
-	set->seqstream_write_TS_array[set->seqstream_write_TS_index] = asm_rdtsc();
-	set->seqstream_write_TS_index |= 1;
-#endif
-}
+/*
+ * The HAL macros branch on pcm_backend, which is set once by 
+ * pcm_backend_init before any persistent store and never changes after,
+ * so the branch is always predicted and there is no indirect call on the
+ * fast path. The persist backend is the fall-through case.
+ */
+#define PCM_BACKEND_IS_PERSIST() likely(pcm_backend == PCM_BACKEND_PERSIST)
 
+#define PCM_WB_STORE_MASKED(set, addr, val, mask)				\
+		write_aligned_masked(addr, val, mask);				
 
-static inline
-void
-PCM_SEQSTREAM_STORE_64B_NEXT_WORD(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t val)
-{
-	//printf("PCM_SEQSTREAM_STORE: set=%p, addr=%p, val=%llX\n", set, addr, val);
-#ifdef M_PCM_EMULATE_CRASH
-#endif	
+#define PCM_WB_STORE_ALIGNED_MASKED(set, addr, val, mask)			\
+		PCM_WB_STORE_MASKED(set, addr, val, mask);
 
-	asm_movnti(addr, val);
-}
+/* Accounts for a load from persistent memory. */
+#define PCM_RD_ACCESS(set, addr)						\
+({										\
+	if (unlikely(pcm_backend == PCM_BACKEND_EMULATE)) {			\
+		pcm_emulate_read(set, addr);					\
+	}									\
+})
 
+/* Set may be NULL. */
+#define PCM_WB_FENCE(set)							\
+({										\
+	if (likely(pcm_backend != PCM_BACKEND_DRAM)) {				\
+		asm_mfence();							\
+	} else {								\
+		pcm_compiler_barrier();						\
+	}									\
+})
 
-static inline
-void
-PCM_SEQSTREAM_STORE_64B(pcm_storeset_t *set, volatile pcm_word_t *addr, pcm_word_t *val)
-{
-	//printf("PCM_SEQSTREAM_STORE: set=%p, addr=%p, val=%llX\n", set, addr, val);
-#ifdef M_PCM_EMULATE_CRASH
-#endif	
-
-	asm_sse_write_block64(addr, val);
-
-#ifdef M_PCM_EMULATE_LATENCY
-	set->seqstream_len = set->seqstream_len + 64;
-	/* HACK: Well, we want to always set the TS of the first write of a 
-	 * sequence. We could use an if-statement but this adds a branch.
-	 * I am not entirely convinced that the branch-predictor will work
-	 * well as the condition whether the branch is taken or not really 
-	 * depends on the length of the sequence of stores
-	 * I prefer to use a trick that relies on two stores that are likely
-	 * to hit the L1-D cache.
-	 */
-	set->seqstream_write_TS_array[set->seqstream_write_TS_index] = asm_rdtsc();
-	set->seqstream_write_TS_index |= 1;
-#endif
-}
-#define RAM_SYSTEM_PEAK_BANDWIDTH_MB 7000
+/* Set may be NULL. */
+#define PCM_WB_FLUSH(set, addr)							\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_clflush(addr);						\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_clflush(addr);						\
+		pcm_emulate_write(1);						\
+	}									\
+})
+
+/* 
+ * Writes back a cacheline using the best instruction the CPU supports
+ * without waiting for it to complete. A batch of write-backs must be
+ * completed with PCM_WB_DRAIN. Set must not be NULL.
+ */
+#define PCM_WB_FLUSH_ASYNC(set, addr)						\
+({										\
+	if (likely(pcm_backend != PCM_BACKEND_DRAM)) {				\
+		switch (pcm_flush_insn) {					\
+			case PCM_FLUSH_CLWB:					\
+				asm_clwb(addr);					\
+				break;						\
+			case PCM_FLUSH_CLFLUSHOPT:				\
+				asm_clflushopt(addr);				\
+				break;						\
+			default:						\
+				asm_clflush(addr);				\
+		}								\
+		(set)->flush_stat[pcm_flush_insn]++;				\
+		if (unlikely(pcm_backend == PCM_BACKEND_EMULATE)) {		\
+			(set)->wb_pending++;					\
+		}								\
+	}									\
+})
+
+#define PCM_WB_DRAIN(set)							\
+({										\
+	if (likely(pcm_backend != PCM_BACKEND_DRAM)) {				\
+		if (pcm_flush_insn == PCM_FLUSH_CLFLUSH) {			\
+			asm_mfence();						\
+		} else {							\
+			asm_sfence();						\
+		}								\
+		if (unlikely(pcm_backend == PCM_BACKEND_EMULATE)) {		\
+			pcm_emulate_wb_drain(set);				\
+		}								\
+		(set)->drain_stat++;						\
+	} else {								\
+		pcm_compiler_barrier();						\
+	}									\
+})
+
+#define PCM_NT_STORE(set, addr, val)						\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_movnti(addr, val);						\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_movnti(addr, val);						\
+		pcm_emulate_nt_store(set, addr);				\
+	} else {								\
+		*(addr) = (val);						\
+	}									\
+})
+
+#define PCM_NT_FLUSH(set)							\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_sfence();							\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_sfence();							\
+		pcm_emulate_nt_flush(set);					\
+	} else {								\
+		pcm_compiler_barrier();						\
+	}									\
+})
+
+#define PCM_SEQSTREAM_STORE(set, addr, val)					\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_movnti(addr, val);						\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_movnti(addr, val);						\
+		pcm_emulate_seqstream_store(set, sizeof(pcm_word_t));		\
+	} else {								\
+		*(addr) = (val);						\
+	}									\
+})
+
+#define PCM_SEQSTREAM_STORE_64B_FIRST_WORD(set, addr, val)			\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_movnti(addr, val);						\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_movnti(addr, val);						\
+		pcm_emulate_seqstream_store(set, CACHELINE_SIZE);		\
+	} else {								\
+		*(addr) = (val);						\
+	}									\
+})
+
+#define PCM_SEQSTREAM_STORE_64B_NEXT_WORD(set, addr, val)			\
+({										\
+	if (likely(pcm_backend != PCM_BACKEND_DRAM)) {				\
+		asm_movnti(addr, val);						\
+	} else {								\
+		*(addr) = (val);						\
+	}									\
+})
+
+#define PCM_SEQSTREAM_STORE_64B(set, addr, val)					\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_sse_write_block64((addr), (val));			\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		asm_sse_write_block64((addr), (val));			\
+		pcm_emulate_seqstream_store(set, CACHELINE_SIZE);		\
+	} else {								\
+		memcpy((void *) (addr), (val), CACHELINE_SIZE);			\
+	}									\
+})
+
+#define PCM_SEQSTREAM_FLUSH(set)						\
+({										\
+	if (PCM_BACKEND_IS_PERSIST()) {						\
+		asm_sfence();							\
+	} else if (pcm_backend == PCM_BACKEND_EMULATE) {			\
+		pcm_emulate_seqstream_flush(set);				\
+	} else {								\
+		pcm_compiler_barrier();						\
+	}									\
+})
+
+#define PCM_SEQSTREAM_INIT(set)							\
+({										\
+	if (unlikely(pcm_backend == PCM_BACKEND_EMULATE)) {			\
+		(set)->seqstream_len = 0;					\
+	}									\
+})
 
 
-static inline
-void
-PCM_SEQSTREAM_FLUSH(pcm_storeset_t *set)
-{
-#ifdef M_PCM_EMULATE_CRASH
-
-#endif	
-
-#ifdef M_PCM_EMULATE_LATENCY
-	int          pcm_bandwidth_MB = M_PCM_BANDWIDTH_MB;
-	int          ram_system_peak_bandwidth_MB = RAM_SYSTEM_PEAK_BANDWIDTH_MB;
-	int          size;
-	pcm_hrtime_t handicap_latency;
-	pcm_hrtime_t extra_latency;
-	pcm_hrtime_t elapsed_time_ns;
-	pcm_hrtime_t elapsed_time_cycles;
-	pcm_hrtime_t current_TS;
-
-	if ((size = set->seqstream_len) > 64) {
-		current_TS = asm_rdtsc();
-		elapsed_time_cycles = current_TS - set->seqstream_write_TS_array[0];
-		elapsed_time_ns = CYCLE2NS(elapsed_time_cycles);
-		
-		handicap_latency = (int) size * (1-(float) (((float) pcm_bandwidth_MB)/1000)/(((float) ram_system_peak_bandwidth_MB)/1000))/(((float)pcm_bandwidth_MB)/1000);
-		if (handicap_latency > elapsed_time_ns) {
-			extra_latency = handicap_latency - elapsed_time_ns;
-			asm_sfence();  
-			__ticket_spin_lock(&ticket_lock);
-			emulate_latency_ns(extra_latency);
-			__ticket_spin_unlock(&ticket_lock);
-			asm_cpuid();
-		} else {
-			asm_sfence();
-			emulate_latency_ns(M_PCM_LATENCY_WRITE);
-		}
-	} else {
-		asm_sfence();
-		emulate_latency_ns(M_PCM_LATENCY_WRITE);
-	}
-	set->seqstream_write_TS_index = 0;
-	set->seqstream_len = 0;
-#else	
-	asm_sfence();
-#endif
-}
-#endif // #if 0
 #ifdef __cplusplus
 }
 #endif
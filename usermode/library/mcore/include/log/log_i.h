@@ -45,6 +45,7 @@
 #include <result.h>
 #include <list.h>
 #include "hrtime.h"
+#include "lathist.h"
 #include "../hal/pcm_i.h"
 
 #ifdef __cplusplus
@@ -55,10 +56,18 @@ extern "C" {
 /* 
  * Physical log size is power of 2 to implement arithmetic efficiently 
  * e.g. modulo using bitwise operations: x % 2^n == x & (2^n - 1) 
+ *
+ * These are the geometry of pools created before the geometry was 
+ * recorded in the pool header. The geometry of new pools is taken from
+ * the runtime settings when the pool is first formatted.
  */
 #define PHYSICAL_LOG_NUM_ENTRIES_LOG2 20
 #define PHYSICAL_LOG_NUM_ENTRIES      (1 << PHYSICAL_LOG_NUM_ENTRIES_LOG2)
 #define PHYSICAL_LOG_SIZE             (PHYSICAL_LOG_NUM_ENTRIES * sizeof(pcm_word_t)) /* in bytes */
+#define LOG_NUM                       32
+
+/* Upper bound on the number of logs a pool can grow to */
+#define LOG_POOL_MAX_LOGS             4096
 
 
 /* Masks for the 64-bit non-volatile generic_flags field. */
@@ -87,6 +96,8 @@ typedef struct m_log_s        m_log_t;
 typedef struct m_log_ops_s    m_log_ops_t;
 typedef struct m_log_dsc_s    m_log_dsc_t;
 typedef struct m_log_nvmd_s   m_log_nvmd_t;
+typedef struct m_log_fragment_s m_log_fragment_t;
+typedef struct m_log_stats_s  m_log_stats_t;
 
 
 struct m_log_ops_s {
@@ -99,9 +110,55 @@ struct m_log_ops_s {
 	m_result_t (*recovery_prepare_next)(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 	m_result_t (*recovery_do)(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 	m_result_t (*report_stats)(m_log_dsc_t *log_dsc);
+	m_result_t (*recovery_decode)(pcm_storeset_t *set, m_log_dsc_t *log_dsc, m_log_fragment_t **fragmentsp, uint64_t *nfragmentsp); /**< optional */
+	m_result_t (*truncation_flush)(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t *dropposp); /**< optional */
+	m_result_t (*truncation_drop)(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t droppos);    /**< optional */
+	m_result_t (*get_stats)(m_log_dsc_t *log_dsc, m_log_stats_t *stats);                            /**< optional */
 };
 
 
+/** 
+ * Current state of a log, as read by threads other than its writer. 
+ * Values may be slightly stale.
+ */
+struct m_log_stats_s {
+	uint64_t fill;                 /**< words written but not truncated yet */
+	uint64_t size;                 /**< words in the physical log */
+	uint64_t wait_for_trunc;       /**< number of times the writer waited for truncation */
+	uint64_t wait_time_for_trunc;  /**< total time the writer waited for truncation, in ns */
+};
+
+
+/**
+ * Summary of an atomic log fragment found during recovery.
+ *
+ * Log types that can decode their recovery region ahead of time return
+ * one of these per fragment through recovery_decode. The footprint is a
+ * signature of the cachelines the fragment writes to. Two fragments whose
+ * footprints do not intersect can be replayed concurrently. False positives
+ * only cost parallelism.
+ */
+#define LOG_FRAGMENT_FOOTPRINT_NWORDS 8
+#define LOG_FRAGMENT_FOOTPRINT_NBITS  (LOG_FRAGMENT_FOOTPRINT_NWORDS * 64)
+
+struct m_log_fragment_s {
+	uint64_t logorder;                                  /**< order number of the fragment */
+	uint64_t footprint[LOG_FRAGMENT_FOOTPRINT_NWORDS];  /**< signature of cachelines written */
+};
+
+
+static inline
+void
+m_log_fragment_footprint_add(m_log_fragment_t *fragment, uintptr_t addr)
+{
+	uint64_t bit;
+
+	bit = ((addr >> CACHELINE_SIZE_LOG) * 0x9E3779B97F4A7C15LLU) >> 55;
+	bit &= (LOG_FRAGMENT_FOOTPRINT_NBITS - 1);
+	fragment->footprint[bit >> 6] |= (1LLU << (bit & 63));
+}
+
+
 /** 
  * Generic descriptor non-volatile log metadata. 
  * Each log type should define its own struct type.
@@ -114,14 +171,31 @@ struct m_log_nvmd_s {
         // char padding[32];
 };
 
+/** 
+ * A log fragment whose data has been flushed by a truncation worker but
+ * which has not been dropped from the log yet. 
+ */
+#define LOG_TRUNC_PENDING_MAX 64
+
+typedef struct m_log_trunc_pending_s m_log_trunc_pending_t;
+struct m_log_trunc_pending_s {
+	uint64_t logorder;                 /**< order number of the fragment */
+	uint64_t droppos;                  /**< log specific position right after the fragment */
+};
+
 struct m_log_dsc_s {
 	m_log_ops_t      *ops;             /**< log operations */
 	m_log_t          *log;             /**< descriptor structure specific to log type */
 	m_log_nvmd_t     *nvmd;            /**< non-volatile log metadata */
 	pcm_word_t       *nvphlog;         /**< non-volatile physical log */
+	uint64_t         nvphlog_nentries; /**< number of words in the physical log */
 	uint64_t         flags;            /**< array of flags */
 	uint64_t         logorder;         /**< log order number */
 	struct list_head list;
+	/* asynchronous truncation */
+	int                   trunc_owner;     /**< truncation worker owning this log, -1 if none yet */
+	uint64_t              trunc_npending;  /**< number of valid entries in trunc_pending */
+	m_log_trunc_pending_t trunc_pending[LOG_TRUNC_PENDING_MAX];
 };
 
 extern m_log_ops_t *m_log_ops[];
@@ -132,11 +206,18 @@ struct m_logmgr_s {
 	struct list_head pending_logs_list;     /**< logs which are not free but not recovered yet because of unknown type */
 	struct list_head active_logs_list;      /**< actively used logs (could be dirty or not) */
 	struct list_head known_logtypes_list;   /**< log types known (registered) to the log manager */
+	/* log pool geometry */
+	uint64_t         log_nentries;          /**< number of words in each physical log */
+	int              nlogs;                 /**< number of logs in the pool */
 	/* log truncation */
 	pthread_cond_t   logtrunc_cond;
 	pthread_t        logtrunc_thread;
-	uint64_t         trunc_time;
-	uint64_t         trunc_count;
+	uint64_t         trunc_time;            /**< total time spent in truncation rounds, in us */
+	uint64_t         trunc_count;           /**< number of truncation rounds */
+	uint64_t         trunc_last;            /**< time the last truncation round ended, in us */
+	/* log recovery */
+	uint64_t         recovery_nfragments;   /**< number of fragments replayed by the last recovery */
+	uint64_t         recovery_nbatches;     /**< number of batches the last recovery replayed them in */
 };
 
 
@@ -177,6 +258,31 @@ do {                                                                          \
 } while (0);
 
 
+/*
+ * Truncation scheduling.
+ *
+ * Writers of asynchronously truncated logs check the fill level of their 
+ * log when they flush it at commit. Crossing the low watermark requests a 
+ * truncation round without blocking. A writer whose log is above the high 
+ * watermark waits at transaction begin for truncation to bring the log back 
+ * below it (see PHLOG_BACKPRESSURE_ASYNCTRUNC), so that logs rarely fill up 
+ * in the middle of a transaction. The wait must not happen at commit: 
+ * locks are still held there and the values of the just stabilized 
+ * fragment have not reached their home locations yet, so a round started 
+ * by the wait could drop a fragment whose data was never written back.
+ * If a log does fill up, the writer blocks until the next truncation round 
+ * completes instead of spinning.
+ *
+ * Watermarks are expressed in log entries.
+ */
+extern uint64_t     m_logtrunc_low_watermark;
+extern uint64_t     m_logtrunc_high_watermark;
+extern volatile int m_logtrunc_requested;
+
+void m_logtrunc_request(void);
+void m_logtrunc_wait(void);
+
+
 #define PHLOG_WRITE_ASYNCTRUNC(logtype, set, phlog, val)                       \
 do {                                                                           \
 	hrtime_t __start;                                                          \
@@ -184,9 +290,12 @@ do {                                                                           \
     if (m_phlog_##logtype##_write(set, (phlog), (val)) != M_R_SUCCESS) {       \
         (phlog)->stat_wait_for_trunc++;                                        \
         __start = hrtime_cycles();                                             \
-        while (m_phlog_##logtype##_write(set, (phlog), (val)) != M_R_SUCCESS); \
+        while (m_phlog_##logtype##_write(set, (phlog), (val)) != M_R_SUCCESS) {\
+            m_logtrunc_wait();                                                 \
+        }                                                                      \
         __end = hrtime_cycles();                                               \
 	    phlog->stat_wait_time_for_trunc += (HRTIME_CYCLE2NS(__end - __start)); \
+        m_lathist_add(m_lathist_trunc_wait, __end - __start);                  \
     }                                                                          \
 } while (0);
 
@@ -198,9 +307,34 @@ do {                                                                           \
     if (m_phlog_##logtype##_flush(set, (phlog)) != M_R_SUCCESS) {              \
         (phlog)->stat_wait_for_trunc++;                                        \
         __start = hrtime_cycles();                                             \
-        while (m_phlog_##logtype##_flush(set, (phlog)) != M_R_SUCCESS);        \
+        while (m_phlog_##logtype##_flush(set, (phlog)) != M_R_SUCCESS) {       \
+            m_logtrunc_wait();                                                 \
+        }                                                                      \
         __end = hrtime_cycles();                                               \
 	    phlog->stat_wait_time_for_trunc += (HRTIME_CYCLE2NS(__end - __start)); \
+        m_lathist_add(m_lathist_trunc_wait, __end - __start);                  \
+    }                                                                          \
+    if (m_phlog_##logtype##_fill(phlog) >= m_logtrunc_low_watermark &&        \
+        !m_logtrunc_requested)                                                 \
+    {                                                                          \
+        m_logtrunc_request();                                                  \
+    }                                                                          \
+} while (0);
+
+
+#define PHLOG_BACKPRESSURE_ASYNCTRUNC(logtype, phlog)                          \
+do {                                                                           \
+	hrtime_t __start;                                                          \
+	hrtime_t __end;                                                            \
+    if (m_phlog_##logtype##_fill(phlog) >= m_logtrunc_high_watermark) {        \
+        (phlog)->stat_wait_for_trunc++;                                        \
+        __start = hrtime_cycles();                                             \
+        while (m_phlog_##logtype##_fill(phlog) >= m_logtrunc_high_watermark) { \
+            m_logtrunc_wait();                                                 \
+        }                                                                      \
+        __end = hrtime_cycles();                                               \
+	    (phlog)->stat_wait_time_for_trunc += (HRTIME_CYCLE2NS(__end - __start)); \
+        m_lathist_add(m_lathist_trunc_wait, __end - __start);                  \
     }                                                                          \
 } while (0);
 
@@ -104,6 +104,7 @@ struct m_phlog_base_s {
 	uint64_t                buffer[CHUNK_SIZE/sizeof(uint64_t)];    /**< software buffer to collect log writes till we form a complete chunk */
 	uint64_t                buffer_count;                           /**< number of valid words in the buffer */
 	uint64_t                *nvphlog;                               /**< points to the non-volatile physical log */
+	uint64_t                nentries_mask;                          /**< number of words in the physical log minus one; the size is a power of 2 */
 	m_phlog_base_nvmd_t     *nvmd;                                  /**< points to the non-volatile metadata */
 	uint64_t                head;
 	uint64_t                tail;
@@ -129,7 +130,7 @@ base_write_buffer2log(pcm_storeset_t *set, m_phlog_base_t *log)
 {
 	/* 
 	 * Modulo arithmetic is implemented using the most efficient equivalent:
-	 * (log->tail + k) % PHYSICAL_LOG_NUM_ENTRIES == (log->tail + k) & (PHYSICAL_LOG_NUM_ENTRIES-1)
+	 * (log->tail + k) % (log->nentries_mask+1) == (log->tail + k) & log->nentries_mask
 	 */
 	PCM_SEQSTREAM_STORE_64B_FIRST_WORD(set, (volatile pcm_word_t *) &log->nvphlog[(log->tail+0)], 
 	                                   (pcm_word_t) log->buffer[0]);
@@ -148,7 +149,22 @@ base_write_buffer2log(pcm_storeset_t *set, m_phlog_base_t *log)
 	PCM_SEQSTREAM_STORE_64B_NEXT_WORD(set, (volatile pcm_word_t *) &log->nvphlog[(log->tail+7)], 
 	                                  (pcm_word_t) log->buffer[7]);
 	log->buffer_count=0;
-	log->tail = (log->tail+8) & (PHYSICAL_LOG_NUM_ENTRIES-1);
+	log->tail = (log->tail+8) & log->nentries_mask;
+}
+
+
+/**
+ * \brief Returns the number of log entries between head and tail.
+ *
+ * Published for the truncation scheduler. Head and tail are word sized, 
+ * so the value can be read without locking, though it may be slightly 
+ * stale when read by a thread other than the writer.
+ */
+static inline
+uint64_t
+m_phlog_base_fill(m_phlog_base_t *log)
+{
+	return (log->tail - log->head) & log->nentries_mask;
 }
 
 
@@ -174,7 +190,7 @@ m_phlog_base_write(pcm_storeset_t *set, m_phlog_base_t *log, pcm_word_t value)
 	/* Will new write fill buffer and require flushing out to log? */
 	if (log->buffer_count+1 > CHUNK_SIZE/sizeof(pcm_word_t)-1) {
 		/* Will log overflow? */
-		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1))
+		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask)
 		    == log->head)
 		{
 			return M_R_FAILURE;
@@ -230,7 +246,7 @@ m_phlog_base_read(m_phlog_base_t *log, uint64_t *valuep)
 	/* Are there any stable data to read? */
 	if (log->read_index != log->nvmd->tail) {
 		value = log->nvphlog[log->read_index];
-		log->read_index = (log->read_index + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+		log->read_index = (log->read_index + 1) & log->nentries_mask;
 		*valuep = value;
 		return M_R_SUCCESS;
 	}
@@ -273,7 +289,7 @@ m_phlog_base_next_chunk(m_phlog_base_t *log)
 	 * then we are already in the next chunk so we don't need to advance.
 	 */
 	if (read_index != log->read_index) {
-		log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1); 
+		log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask; 
 	}
 }
 
@@ -322,10 +338,10 @@ m_phlog_base_truncate_sync(pcm_storeset_t *set, m_phlog_base_t *phlog)
 }
 
 
-m_result_t m_phlog_base_format (pcm_storeset_t *set, m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog, int type);
+m_result_t m_phlog_base_format (pcm_storeset_t *set, m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries, int type);
 m_result_t m_phlog_base_alloc (m_phlog_base_t **phlog_basep);
-m_result_t m_phlog_base_init (m_phlog_base_t *phlog, m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog);
-m_result_t m_phlog_base_check_consistency(m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t *stable_tail);
+m_result_t m_phlog_base_init (m_phlog_base_t *phlog, m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries);
+m_result_t m_phlog_base_check_consistency(m_phlog_base_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries, uint64_t *stable_tail);
 m_result_t m_phlog_base_truncate_async(pcm_storeset_t *set, m_phlog_base_t *phlog);
 
 
@@ -147,6 +147,7 @@ struct m_phlog_tornbit_s {
 	uint64_t                read_remainder;                         /**< the remainder bits after the decoding operation */
 	uint64_t                read_remainder_nbits;                   /**< number of the valid least-significant bits of the read_remainder buffer */
 	uint64_t                *nvphlog;                               /**< points to the non-volatile physical log */
+	uint64_t                nentries_mask;                          /**< number of words in the physical log minus one; the size is a power of 2 */
 	m_phlog_tornbit_nvmd_t  *nvmd;                                  /**< points to the non-volatile metadata */
 	uint64_t                head;
 	uint64_t                tail;
@@ -190,7 +191,7 @@ tornbit_write_buffer2log(pcm_storeset_t *set, m_phlog_tornbit_t *log)
 {
 	/* 
 	 * Modulo arithmetic is implemented using the most efficient equivalent:
-	 * (log->tail + k) % PHYSICAL_LOG_NUM_ENTRIES == (log->tail + k) & (PHYSICAL_LOG_NUM_ENTRIES-1)
+	 * (log->tail + k) % (log->nentries_mask+1) == (log->tail + k) & log->nentries_mask
 	 */
 #ifdef _DEBUG_THIS		
 	printf("tornbit_write_buffer2log: log->tail = %llu\n", log->tail);	 
@@ -214,7 +215,7 @@ tornbit_write_buffer2log(pcm_storeset_t *set, m_phlog_tornbit_t *log)
 	                                  log->tornbit | (pcm_word_t) log->buffer[7]);
 
 	log->buffer_count=0;
-	log->tail = (log->tail+8) & (PHYSICAL_LOG_NUM_ENTRIES-1);
+	log->tail = (log->tail+8) & log->nentries_mask;
 
 	/* Flip tornbit if wrap around */
 	if (log->tail == 0x0) {
@@ -223,6 +224,21 @@ tornbit_write_buffer2log(pcm_storeset_t *set, m_phlog_tornbit_t *log)
 }
 
 
+/**
+ * \brief Returns the number of log entries between head and tail.
+ *
+ * Published for the truncation scheduler. Head and tail are word sized, 
+ * so the value can be read without locking, though it may be slightly 
+ * stale when read by a thread other than the writer.
+ */
+static inline
+uint64_t
+m_phlog_tornbit_fill(m_phlog_tornbit_t *log)
+{
+	return (log->tail - log->head) & log->nentries_mask;
+}
+
+
 /** 
  * \brief Writes a given value to the physical log. 
  *
@@ -251,7 +267,7 @@ m_phlog_tornbit_write(pcm_storeset_t *set, m_phlog_tornbit_t *log, pcm_word_t va
 	if (log->buffer_count+1 > CHUNK_SIZE/sizeof(pcm_word_t)-1) {
 		/* UNCOMMON PATH */
 		/* Will log overflow? */
-		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1))
+		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask)
 		    == log->head)
 		{
 #ifdef _DEBUG_THIS
@@ -342,7 +358,7 @@ m_phlog_tornbit_flush(pcm_storeset_t *set, m_phlog_tornbit_t *log)
 #endif	
 	if (log->write_remainder_nbits > 0) {
 		/* Will log overflow? */
-		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1))
+		if (((log->tail + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask)
 		    == log->head) 
 		{
 #ifdef _DEBUG_THIS		
@@ -406,14 +422,14 @@ m_phlog_tornbit_read(m_phlog_tornbit_t *log, uint64_t *valuep)
 		printf("[%04lu]: 0x%016llX\n", log->read_index, ~TORN_MASK & log->nvphlog[log->read_index]);
 #endif		
 		value = (~TORN_MASK & log->nvphlog[log->read_index]) >> log->read_remainder_nbits;
-		log->read_index = (log->read_index + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+		log->read_index = (log->read_index + 1) & log->nentries_mask;
 #ifdef _DEBUG_THIS		
 		printf("[%04lu]: 0x%016llX\n", log->read_index, ~TORN_MASK & log->nvphlog[log->read_index]);
 #endif		
 		value |= log->nvphlog[log->read_index] << (63 - log->read_remainder_nbits);
 		log->read_remainder_nbits = (log->read_remainder_nbits + 1) & (64 - 1);
 		if (log->read_remainder_nbits == 63) {
-			log->read_index = (log->read_index + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+			log->read_index = (log->read_index + 1) & log->nentries_mask;
 			log->read_remainder_nbits = 0;
 		}
 		*valuep = value;
@@ -448,7 +464,7 @@ m_phlog_tornbit_read(m_phlog_tornbit_t *log, uint64_t *valuep)
 #endif		
 		tmp = load_nt_word(&log->nvphlog[log->read_index]);
 		value = (~TORN_MASK & tmp) >> log->read_remainder_nbits;
-		log->read_index = (log->read_index + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+		log->read_index = (log->read_index + 1) & log->nentries_mask;
 #ifdef _DEBUG_THIS		
 		printf("[%04lu]: 0x%016llX\n", log->read_index, ~TORN_MASK & log->nvphlog[log->read_index]);
 #endif		
@@ -456,7 +472,7 @@ m_phlog_tornbit_read(m_phlog_tornbit_t *log, uint64_t *valuep)
 		value |= tmp << (63 - log->read_remainder_nbits);
 		log->read_remainder_nbits = (log->read_remainder_nbits + 1) & (64 - 1);
 		if (log->read_remainder_nbits == 63) {
-			log->read_index = (log->read_index + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+			log->read_index = (log->read_index + 1) & log->nentries_mask;
 			log->read_remainder_nbits = 0;
 		}
 		*valuep = value;
@@ -504,7 +520,7 @@ m_phlog_tornbit_next_chunk(m_phlog_tornbit_t *log)
 	if (log->read_remainder_nbits > 0) {
 		log->read_remainder_nbits = 0;
 		read_index = log->read_index & ~(CHUNK_SIZE/sizeof(pcm_word_t) - 1);
-		log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1); 
+		log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask; 
 	} else {
 		log->read_remainder_nbits = 0;
 		read_index = log->read_index & ~(CHUNK_SIZE/sizeof(pcm_word_t) - 1);
@@ -513,7 +529,7 @@ m_phlog_tornbit_next_chunk(m_phlog_tornbit_t *log)
 		 * then we are already in the next chunk so we don't need to advance.
 		 */
 		if (read_index != log->read_index) {
-			log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & (PHYSICAL_LOG_NUM_ENTRIES-1); 
+			log->read_index = (read_index + CHUNK_SIZE/sizeof(pcm_word_t)) & log->nentries_mask; 
 		}
 	}
 }
@@ -566,12 +582,13 @@ m_phlog_tornbit_truncate_sync(pcm_storeset_t *set, m_phlog_tornbit_t *phlog)
 	return M_R_SUCCESS;
 }
 
-m_result_t m_phlog_tornbit_format (pcm_storeset_t *set, m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog, int type);
+m_result_t m_phlog_tornbit_format (pcm_storeset_t *set, m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries, int type);
 m_result_t m_phlog_tornbit_alloc (m_phlog_tornbit_t **phlog_tornbitp);
-m_result_t m_phlog_tornbit_init (m_phlog_tornbit_t *phlog, m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog);
-m_result_t m_phlog_tornbit_check_consistency(m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t *stable_tail);
+m_result_t m_phlog_tornbit_init (m_phlog_tornbit_t *phlog, m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries);
+m_result_t m_phlog_tornbit_check_consistency(m_phlog_tornbit_nvmd_t *nvmd, pcm_word_t *nvphlog, uint64_t nentries, uint64_t *stable_tail);
 m_result_t m_phlog_tornbit_prepare_truncate(m_log_dsc_t *log_dsc);
 m_result_t m_phlog_tornbit_truncate_async(pcm_storeset_t *set, m_phlog_tornbit_t *phlog);
+m_result_t m_phlog_tornbit_truncate_async_upto(pcm_storeset_t *set, m_phlog_tornbit_t *phlog, uint64_t index);
 
 
 #ifdef __cplusplus
@@ -66,7 +66,10 @@
                                              SEGMENT_TABLE_START +            \
                                              SEGMENT_TABLE_HOLE +             \
                                              SEGMENT_TABLE_SIZE)
-/* Log pool */										  
+/* 
+ * Log pool. This reserves room for the first extent of the pool only; 
+ * the pool grows by mapping further extents as regular segments. 
+ */
 #define LOG_POOL_START                   SEGMENT_TABLE_END 
 #define LOG_POOL_SIZE                    (32*16*1024*1024+32*32*64)
 #define LOG_POOL_HOLE                    0x10000
@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Live statistics endpoint.
+ *
+ * Components register a report function that writes their current 
+ * statistics as lines of the Prometheus text format:
+ *
+ *   name{label="value",...} number
+ *
+ * When the stats_socket setting names a path, a background thread 
+ * listens on a Unix stream socket there and answers each connection 
+ * with the reports of all components, then closes it, e.g.
+ *
+ *   socat - UNIX-CONNECT:/tmp/mnemosyne.stats
+ *
+ * Counters are totals since the process started; rates are left to the 
+ * scraper, which can divide the difference of two reads by the difference
+ * of their mnemosyne_uptime_seconds.
+ */
+
+#ifndef _MNEMOSYNE_STATSRV_H
+#define _MNEMOSYNE_STATSRV_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*m_statsrv_report_t)(FILE *fout);
+
+void m_statsrv_register(const char *name, m_statsrv_report_t report);
+void m_statsrv_report(FILE *fout);
+int m_statsrv_init(const char *path);
+void m_statsrv_fini(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MNEMOSYNE_STATSRV_H */
@@ -32,7 +32,10 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include <cpuid.h>
 #include <mmintrin.h>
 #include <list.h>
 #include <spinlock.h>
@@ -109,14 +112,28 @@ pcm_storeset_list_t pcm_storeset_list = { 0,
 cacheline_crash_cdf_t cacheline_crash_cdf = NO_PARTIAL_CRASH;
 
 
-/* Likelihood a store will block wait. */
-unsigned int pcm_likelihood_store_blockwaits = 1000;  
-
 /* Likelihood a cacheline has been evicted. */
 unsigned int pcm_likelihood_evicted_cacheline = 10000;  
 
 volatile arch_spinlock_t ticket_lock = {0};
 
+/* Cacheline write-back instruction used by PCM_WB_FLUSH_ASYNC. */
+int pcm_flush_insn = PCM_FLUSH_CLFLUSH;
+
+const char *pcm_flush_insn_name[PCM_FLUSH_NTYPES] = { "clflush", "clflushopt", "clwb" };
+
+/* Persistence backend used by the PCM_* macros. */
+int pcm_backend = PCM_BACKEND_PERSIST;
+
+const char *pcm_backend_name[PCM_BACKEND_NTYPES] = { "persist", "emulate", "dram" };
+
+/* Parameters of the emulate backend, until calibrated by pcm_emulate_init. */
+pcm_emulator_t pcm_emul = { M_PCM_CPUFREQ * 1000ULL, 0, 0, 0, 0, 0 };
+
+/* Write-back statistics of destroyed storesets. */
+static uint64_t pcm_flush_stat[PCM_FLUSH_NTYPES];
+static uint64_t pcm_drain_stat;
+
 
 __thread pcm_storeset_t* _thread_pcm_storeset;
 
@@ -154,7 +171,12 @@ pcm_storeset_create(pcm_storeset_t **setp)
 	PM_MEMSET(set->wcbuf_hashtbl, 0, WCBUF_HASHTBL_SIZE);
 	set->wcbuf_hashtbl_count = 0;
 	set->seqstream_len = 0;
+	set->seqstream_start = 0;
 	set->in_crash_emulation_code = 0;
+	memset(set->flush_stat, 0, sizeof(set->flush_stat));
+	set->drain_stat = 0;
+	set->wb_pending = 0;
+	set->rd_last_line = 0;
 	/* Initialize reentrant random generator */
 	set->rand_seed = pthread_self();
 	rand_int(&set->rand_seed);
@@ -166,9 +188,15 @@ pcm_storeset_create(pcm_storeset_t **setp)
 void
 pcm_storeset_destroy(pcm_storeset_t *set)
 {
+	int i;
+
 	pthread_mutex_lock(&pcm_storeset_list.lock);
 	pcm_storeset_list.count--;
 	list_del(&set->list);
+	for (i=0; i<PCM_FLUSH_NTYPES; i++) {
+		pcm_flush_stat[i] += set->flush_stat[i];
+	}
+	pcm_drain_stat += set->drain_stat;
 	pthread_mutex_unlock(&pcm_storeset_list.lock);
 	PointerHash_free(set->hashtbl);
 	free(set);
@@ -204,6 +232,170 @@ pcm_storeset_put(void)
 
 
 
+/**
+ * \brief Selects the cacheline write-back instruction.
+ *
+ * Picks the best instruction the CPU supports according to CPUID. A
+ * preference other than "auto" caps the choice to the given instruction, 
+ * which is useful to compare instructions on the same machine.
+ *
+ * \return the selected instruction
+ */
+int
+pcm_flush_init(const char *insn)
+{
+	unsigned int eax, ebx, ecx, edx;
+	int          supported = PCM_FLUSH_CLFLUSH;
+	int          i;
+
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if (ebx & (1 << 24)) {
+			supported = PCM_FLUSH_CLWB;
+		} else if (ebx & (1 << 23)) {
+			supported = PCM_FLUSH_CLFLUSHOPT;
+		}
+	}
+	pcm_flush_insn = supported;
+	if (insn) {
+		for (i=0; i<PCM_FLUSH_NTYPES; i++) {
+			if (strcmp(insn, pcm_flush_insn_name[i]) == 0 && i < supported) {
+				pcm_flush_insn = i;
+			}
+		}
+	}
+	return pcm_flush_insn;
+}
+
+
+/**
+ * \brief Selects the persistence backend by name.
+ *
+ * Must be called before any persistent store, as the backends keep 
+ * different per-storeset state. An unknown name keeps the persist backend.
+ *
+ * \return the selected backend
+ */
+int
+pcm_backend_init(const char *name)
+{
+	int i;
+
+	pcm_backend = PCM_BACKEND_PERSIST;
+	if (name) {
+		for (i=0; i<PCM_BACKEND_NTYPES; i++) {
+			if (strcmp(name, pcm_backend_name[i]) == 0) {
+				pcm_backend = i;
+			}
+		}
+	}
+	return pcm_backend;
+}
+
+
+/* Length of each TSC calibration run. */
+#define TSC_CALIBRATION_NS 10000000
+
+/* 
+ * Measures the TSC frequency against the monotonic clock. Returns the 
+ * median of a few short runs, or 0 if the TSC looks unusable.
+ */
+static uint64_t
+tsc_calibrate_khz(void)
+{
+	struct timespec    t0;
+	struct timespec    t1;
+	unsigned long long c0;
+	unsigned long long c1;
+	uint64_t           ns;
+	uint64_t           khz[3];
+	uint64_t           tmp;
+	int                i;
+
+	for (i=0; i<3; i++) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &t0);
+		c0 = asm_rdtsc();
+		do {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &t1);
+			ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL + t1.tv_nsec - t0.tv_nsec;
+		} while (ns < TSC_CALIBRATION_NS);
+		c1 = asm_rdtsc();
+		khz[i] = c1 > c0 ? (c1 - c0) * 1000000ULL / ns : 0;
+	}
+	if (khz[0] > khz[1]) { tmp = khz[0]; khz[0] = khz[1]; khz[1] = tmp; }
+	if (khz[1] > khz[2]) { tmp = khz[1]; khz[1] = khz[2]; khz[2] = tmp; }
+	if (khz[0] > khz[1]) { tmp = khz[0]; khz[0] = khz[1]; khz[1] = tmp; }
+	return khz[1];
+}
+
+
+/**
+ * \brief Calibrates the emulate backend.
+ *
+ * Measures the TSC frequency, falling back to M_PCM_CPUFREQ, and converts
+ * the emulated latencies and bandwidth to cycles. A bandwidth of 0 does 
+ * not limit bandwidth.
+ */
+void
+pcm_emulate_init(int write_latency_ns, int read_latency_ns, int bandwidth_mb)
+{
+	uint64_t khz;
+
+	khz = tsc_calibrate_khz();
+	if (khz == 0) {
+		khz = M_PCM_CPUFREQ * 1000ULL;
+	}
+	pcm_emul.tsc_khz = khz;
+	pcm_emul.write_latency_cycles = NS2CYCLE((uint64_t) write_latency_ns);
+	pcm_emul.read_latency_cycles = NS2CYCLE((uint64_t) read_latency_ns);
+	/* cycles/KB = (khz * 1000 cycles/s) * 1024 B / (bandwidth_mb * 10^6 B/s) */
+	pcm_emul.bw_cycles_per_kb = bandwidth_mb > 0 ? khz * 1024 / (bandwidth_mb * 1000ULL) : 0;
+	pcm_emul.bw_burst_cycles = NS2CYCLE((uint64_t) PCM_EMULATE_BURST_NS);
+	pcm_emul.bw_horizon = asm_rdtsc();
+}
+
+
+/**
+ * \brief Prints the write-back statistics of all storesets.
+ */
+void
+pcm_flush_stats_print(FILE *fout)
+{
+	pcm_storeset_t *set;
+	uint64_t       flush_stat[PCM_FLUSH_NTYPES];
+	uint64_t       drain_stat;
+	int            i;
+
+	pthread_mutex_lock(&pcm_storeset_list.lock);
+	for (i=0; i<PCM_FLUSH_NTYPES; i++) {
+		flush_stat[i] = pcm_flush_stat[i];
+	}
+	drain_stat = pcm_drain_stat;
+	list_for_each_entry(set, &pcm_storeset_list.list, list) {
+		for (i=0; i<PCM_FLUSH_NTYPES; i++) {
+			flush_stat[i] += set->flush_stat[i];
+		}
+		drain_stat += set->drain_stat;
+	}
+	pthread_mutex_unlock(&pcm_storeset_list.lock);
+
+	fprintf(fout, "PCM WRITE-BACK STATISTICS (using %s, %s backend)\n", 
+	        pcm_flush_insn_name[pcm_flush_insn], pcm_backend_name[pcm_backend]);
+	for (i=0; i<PCM_FLUSH_NTYPES; i++) {
+		fprintf(fout, "%-12s %llu\n", pcm_flush_insn_name[i], 
+		        (unsigned long long) flush_stat[i]);
+	}
+	fprintf(fout, "%-12s %llu\n", "drains", (unsigned long long) drain_stat);
+	if (pcm_backend == PCM_BACKEND_EMULATE) {
+		fprintf(fout, "%-12s %llu kHz, write %llu cycles, read %llu cycles, %llu cycles/KB\n", 
+		        "emulation", (unsigned long long) pcm_emul.tsc_khz, 
+		        (unsigned long long) pcm_emul.write_latency_cycles,
+		        (unsigned long long) pcm_emul.read_latency_cycles,
+		        (unsigned long long) pcm_emul.bw_cycles_per_kb);
+	}
+}
+
+
 void 
 pcm_check_crash(pcm_storeset_t *set)
 {
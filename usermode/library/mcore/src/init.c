@@ -38,6 +38,9 @@
 #include "log/log_i.h"
 #include "thrdesc.h"
 #include "debug.h"
+#include "pm_trace.h"
+#include "lathist.h"
+#include "statsrv.h"
 #include "config.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -70,17 +73,7 @@ do_global_init(void)
 	}
 	
 	#ifdef _ENABLE_TRACE
-        gettimeofday(&glb_time, NULL);          
-        glb_tv_sec  = glb_time.tv_sec;
-        glb_tv_usec = glb_time.tv_usec;
-	glb_start_time = glb_tv_sec * 1000000 + glb_tv_usec;
-
-	pthread_spin_init(&tbuf_lock, PTHREAD_PROCESS_SHARED);
-	/* tbuf = (char*)malloc(MAX_TBUF_SZ); To avoid interaction with M's hoard */
-	tbuf = (char*)mmap(0, MAX_TBUF_SZ, PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-	/* MAZ_TBUF_SZ influences how often we compress and hence the overall execution speed. */
-	if(!tbuf)
-		M_WARNING("Failed to allocate trace buffer. Abort now.");
+	/* The trace file is opened below, once the configuration is read. */
 	#elif _ENABLE_FTRACE
         int debug_fd = -1, ret = 0;
         assert(trace_marker == -1);
@@ -131,6 +124,24 @@ fail:
 	pthread_mutex_lock(&global_init_lock);
 	if (!mnemosyne_initialized) {
 		mcore_config_init();
+#ifdef _ENABLE_TRACE
+		if (pm_trace_init(mcore_runtime_settings.trace_file) < 0) {
+			M_WARNING("failed to create trace file %s.\n", mcore_runtime_settings.trace_file);
+		}
+#endif
+		if (mcore_runtime_settings.latency_hist &&
+		    m_lathist_init(mcore_runtime_settings.latency_hist_signal,
+		                   mcore_runtime_settings.latency_hist_file) < 0)
+		{
+			M_WARNING("cannot dump latency histograms on signal %d.\n", 
+			          mcore_runtime_settings.latency_hist_signal);
+		}
+		pcm_flush_init(mcore_runtime_settings.flush_insn);
+		if (pcm_backend_init(mcore_runtime_settings.pcm_backend) == PCM_BACKEND_EMULATE) {
+			pcm_emulate_init(mcore_runtime_settings.pcm_write_latency_ns,
+			                 mcore_runtime_settings.pcm_read_latency_ns,
+			                 mcore_runtime_settings.pcm_bandwidth_mb);
+		}
 #ifdef _M_STATS_BUILD
 		gettimeofday(&start_time, NULL);
 #endif
@@ -144,6 +155,10 @@ fail:
 		fprintf(stderr, "reincarnation_latency = %llu (us)\n", op_time);
 #endif
 		m_logmgr_init(pcm_storeset);
+		if (m_statsrv_init(mcore_runtime_settings.stats_socket) < 0) {
+			M_WARNING("cannot serve statistics on %s.\n", 
+			          mcore_runtime_settings.stats_socket);
+		}
 		M_WARNING("Initialize\n");
 	}	
 	pthread_mutex_unlock(&global_init_lock);
@@ -159,28 +174,16 @@ do_global_fini(void)
 
 	pthread_mutex_lock(&global_init_lock);
 	if (mnemosyne_initialized) {
+#ifdef _M_STATS_BUILD
+		pcm_flush_stats_print(stderr);
+#endif
+		m_statsrv_fini();
 		m_logmgr_fini();
 		m_segmentmgr_fini();
 		mtm_fini_global();
+		m_lathist_fini();
 		#ifdef _ENABLE_TRACE
-		pthread_spin_lock(&tbuf_lock);
-		if(tbuf_sz && mtm_enable_trace)
-		{
-		        tbuf_ptr = 0; 
-        	        while(tbuf_ptr < tbuf_sz)       
-	                {
-				/* 
-				 * for some reason tbuf[tbuf] doesn't work
-				 * although i thot tbuf + tbuf is same as 
-				 * tbuf[tbuf];
-				 */
-	                        tbuf_ptr = tbuf_ptr + 1 + fprintf(m_out, "%s", tbuf + tbuf_ptr); 
-				/* tbuf_ptr += TSTR_SZ; */
-                	}
-			tbuf_sz = 0;
-		}
-		pthread_spin_unlock(&tbuf_lock);
-		pthread_spin_destroy(&tbuf_lock);
+		pm_trace_fini();
 		#elif _ENABLE_FTRACE
 		#else
 		pthread_spin_destroy(&tot_epoch_lock);
@@ -34,11 +34,48 @@
  * \file 
  *
  * Implements asynchronous log truncation.
+ *
+ * Truncation is performed by a pool of workers (runtime setting 
+ * trunc_threads) each pinned to a CPU taken from the list in the runtime
+ * setting trunc_cpus. Every asynchronously truncated log is owned by 
+ * exactly one worker.
+ *
+ * Truncation proceeds in rounds. In the first phase of a round each worker
+ * flushes the data of the stable fragments of the logs it owns and queues 
+ * them as pending to be dropped. Workers never touch each other's logs so 
+ * this phase needs no synchronization. Flushing out of order is safe as 
+ * long as the fragments remain in the log.
+ *
+ * Dropping is what must respect the log order: a fragment can be dropped 
+ * only after every older fragment that may write the same cachelines has 
+ * been dropped, otherwise recovery could replay the older one on top of 
+ * the newer data. In the second phase the leader (worker zero) drops the 
+ * pending fragments of all logs in log order up to the oldest fragment 
+ * that is still not flushed. Dropping a run of consecutive fragments of 
+ * one log costs a single metadata store, so this phase is cheap compared
+ * to flushing.
+ *
+ * Log types that do not provide truncation_flush and truncation_drop are
+ * truncated by the leader alone, one fragment at a time in log order.
+ *
+ * Rounds are triggered by writers crossing the low watermark of their log
+ * (see PHLOG_FLUSH_ASYNCTRUNC) and otherwise every trunc_period_ms 
+ * milliseconds. The leader keeps running rounds back to back as long as 
+ * writers keep requesting them.
+ *
+ * The log manager mutex is held only while the leader snapshots the list 
+ * of active logs at the start of a round, so that allocating a log or 
+ * reporting statistics does not wait for truncation. Waits for round 
+ * completion synchronize on logtrunc_round_mutex alone. Requests only set 
+ * a flag and signal the leader, which checks the flag at least every 
+ * LOGTRUNC_REQUEST_POLL_MS milliseconds while it sleeps.
  */
 
 #include <pthread.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 #include <sched.h>
@@ -46,46 +83,138 @@
 #include "logtrunc.h"
 #include "hal/pcm_i.h"
 #include "phlog_tornbit.h"
+#include "config.h"
+
+#define LOGTRUNC_MAX_THREADS 64
+#define LOGTRUNC_MAX_LOGS    LOG_POOL_MAX_LOGS
+
+/* Longest the leader sleeps before checking for a request again, in ms */
+#define LOGTRUNC_REQUEST_POLL_MS 10
+
+typedef struct logtrunc_worker_s logtrunc_worker_t;
+struct logtrunc_worker_s {
+	int       id;
+	int       cpu;
+	pthread_t thread;
+};
+
+static m_logmgr_t        *logmgr;
+static int               logtrunc_nthreads;
+static logtrunc_worker_t logtrunc_workers[LOGTRUNC_MAX_THREADS];
+static pthread_barrier_t logtrunc_start_barrier;
+static pthread_barrier_t logtrunc_done_barrier;
+static int               logtrunc_next_owner;
+
+/* Snapshot of the asynchronously truncated logs taken at each round */
+static m_log_dsc_t       *logtrunc_logs[LOGTRUNC_MAX_LOGS];
+static int               logtrunc_nlogs;
+
+/* 
+ * Protects round requests and completions. The leader sleeps on 
+ * logmgr->logtrunc_cond and writers wait on logtrunc_round_cond, both 
+ * with this mutex.
+ */
+static pthread_mutex_t   logtrunc_round_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t    logtrunc_round_cond = PTHREAD_COND_INITIALIZER;
+static volatile uint64_t logtrunc_round;
 
-static m_logmgr_t *logmgr;
+/* Watermarks stay disabled until the truncation threads are up */
+uint64_t                 m_logtrunc_low_watermark = UINT64_MAX;
+uint64_t                 m_logtrunc_high_watermark = UINT64_MAX;
+volatile int             m_logtrunc_requested = 0;
 
 static void *log_truncation_main (void *arg);
+static void *log_truncation_worker_main (void *arg);
+
+
+/**
+ * \brief Parses the comma separated list of CPUs the truncation workers 
+ * are pinned to. Worker i is pinned to the (i mod n)-th listed CPU.
+ */
+static
+void
+parse_cpu_list(const char *cpu_list, logtrunc_worker_t *workers, int nworkers)
+{
+	int  cpus[LOGTRUNC_MAX_THREADS];
+	int  ncpus = 0;
+	const char *str;
+	char *endptr;
+	int  i;
+
+	for (str = cpu_list; str && *str != '\0' && ncpus < LOGTRUNC_MAX_THREADS; ) {
+		cpus[ncpus] = (int) strtol(str, &endptr, 10);
+		if (endptr == str) {
+			break;
+		}
+		ncpus++;
+		str = (*endptr == ',') ? endptr + 1 : endptr;
+	}
+	for (i=0; i<nworkers; i++) {
+		workers[i].cpu = (ncpus > 0) ? cpus[i % ncpus] : -1;
+	}
+}
+
 
 m_result_t
 m_logtrunc_init(m_logmgr_t *mgr)
 {
+	int i;
+
 	logmgr = mgr;
 	pthread_cond_init(&(logmgr->logtrunc_cond), NULL);
+	logtrunc_nthreads = mcore_runtime_settings.trunc_threads;
+	if (logtrunc_nthreads < 1) {
+		logtrunc_nthreads = 1;
+	} else if (logtrunc_nthreads > LOGTRUNC_MAX_THREADS) {
+		logtrunc_nthreads = LOGTRUNC_MAX_THREADS;
+	}
+	for (i=0; i<logtrunc_nthreads; i++) {
+		logtrunc_workers[i].id = i;
+	}
+	parse_cpu_list(mcore_runtime_settings.trunc_cpus, logtrunc_workers, 
+	               logtrunc_nthreads);
 	//FIXME: Don't create asynchronous trunc thread when doing synchronous truncations
 	//FIXME: SYNC_TRUNCATION preprocessor flag is not passed here
 #ifndef SYNC_TRUNCATION
-	pthread_create (&(logmgr->logtrunc_thread), NULL, &log_truncation_main, (void *) 0);
+	pthread_barrier_init(&logtrunc_start_barrier, NULL, logtrunc_nthreads);
+	pthread_barrier_init(&logtrunc_done_barrier, NULL, logtrunc_nthreads);
+	pthread_create (&(logmgr->logtrunc_thread), NULL, &log_truncation_main, 
+	                (void *) &logtrunc_workers[0]);
+	m_logtrunc_low_watermark = logmgr->log_nentries / 100 * 
+	                           mcore_runtime_settings.trunc_low_watermark;
+	m_logtrunc_high_watermark = logmgr->log_nentries / 100 * 
+	                            mcore_runtime_settings.trunc_high_watermark;
+	if (m_logtrunc_high_watermark < m_logtrunc_low_watermark) {
+		m_logtrunc_high_watermark = m_logtrunc_low_watermark;
+	}
 #endif
 	return M_R_SUCCESS;
 }
 
+
+/**
+ * \brief Truncates the snapshotted logs one fragment at a time in log order.
+ *
+ * Used for log types that do not support sharded truncation.
+ */
 static 
 m_result_t
-truncate_logs (pcm_storeset_t *set, int lock)
+truncate_logs (pcm_storeset_t *set)
 {
 	m_log_dsc_t       *log_dsc;
 	m_log_dsc_t       *log_dsc_to_truncate;
-
-	if (lock) {
-		pthread_mutex_lock(&(logmgr->mutex));
-	}	
+	int               i;
 
 	/* 
 	 * First prepare each log for truncation.
 	 * A log might then pass back a log truncation order number if it cares about 
 	 * the order the truncation is performed with respect to other logs.
 	 */
-	list_for_each_entry(log_dsc, &(logmgr->active_logs_list), list) {
-		if (log_dsc->flags & LF_ASYNC_TRUNCATION) {
-			assert(log_dsc->ops);
-			assert(log_dsc->ops->truncation_init);
-			log_dsc->ops->truncation_init(set, log_dsc);
-		}
+	for (i=0; i<logtrunc_nlogs; i++) {
+		log_dsc = logtrunc_logs[i];
+		assert(log_dsc->ops);
+		assert(log_dsc->ops->truncation_init);
+		log_dsc->ops->truncation_init(set, log_dsc);
 	}
 	/* 
 	 * Find the next log to truncate, truncate it, update its truncation 
@@ -97,10 +226,8 @@ truncate_logs (pcm_storeset_t *set, int lock)
 	 */
 	do {
 		log_dsc_to_truncate = NULL; 
-		list_for_each_entry(log_dsc, &(logmgr->active_logs_list), list) {
-			if (!(log_dsc->flags & LF_ASYNC_TRUNCATION)) {
-				continue;
-			}
+		for (i=0; i<logtrunc_nlogs; i++) {
+			log_dsc = logtrunc_logs[i];
 			if (log_dsc->logorder == INV_LOG_ORDER) {
 				continue;
 			}
@@ -121,37 +248,236 @@ truncate_logs (pcm_storeset_t *set, int lock)
 		}	
 	} while(log_dsc_to_truncate);
 
-	if (lock) {
-		pthread_mutex_unlock(&(logmgr->mutex));
-	}	
-
 	return M_R_SUCCESS;
 }
 
 
 /**
- * \brief Routine executed by the log truncation thread to truncate log
+ * \brief Takes a snapshot of the asynchronously truncated logs and assigns
+ * an owner to any log seen for the first time.
+ *
+ * Returns 1 if every log supports sharded truncation. Logs are never 
+ * removed from the active list so the snapshot remains valid after the
+ * log manager mutex is dropped.
+ */
+static
+int
+snapshot_logs(void)
+{
+	m_log_dsc_t *log_dsc;
+	int         sharded = 1;
+
+	pthread_mutex_lock(&(logmgr->mutex));
+	logtrunc_nlogs = 0;
+	list_for_each_entry(log_dsc, &(logmgr->active_logs_list), list) {
+		if (!(log_dsc->flags & LF_ASYNC_TRUNCATION)) {
+			continue;
+		}
+		assert(logtrunc_nlogs < LOGTRUNC_MAX_LOGS);
+		if (log_dsc->trunc_owner < 0) {
+			log_dsc->trunc_owner = logtrunc_next_owner++ % logtrunc_nthreads;
+		}
+		if (!log_dsc->ops->truncation_flush || !log_dsc->ops->truncation_drop) {
+			sharded = 0;
+		}
+		logtrunc_logs[logtrunc_nlogs++] = log_dsc;
+	}
+	pthread_mutex_unlock(&(logmgr->mutex));
+	return sharded;
+}
+
+
+/**
+ * \brief First phase of a round: flushes the stable fragments of the logs
+ * owned by a worker and queues them to be dropped.
+ */
+static
+void
+flush_owned_logs(pcm_storeset_t *set, int owner)
+{
+	m_log_dsc_t *log_dsc;
+	uint64_t    droppos;
+	int         i;
+
+	for (i=0; i<logtrunc_nlogs; i++) {
+		log_dsc = logtrunc_logs[i];
+		if (log_dsc->trunc_owner != owner) {
+			continue;
+		}
+		/* A fragment might have already been prepared in the previous round. */
+		if (log_dsc->logorder == INV_LOG_ORDER) {
+			log_dsc->ops->truncation_init(set, log_dsc);
+		}
+		while (log_dsc->logorder != INV_LOG_ORDER && 
+		       log_dsc->trunc_npending < LOG_TRUNC_PENDING_MAX) 
+		{
+			log_dsc->ops->truncation_flush(set, log_dsc, &droppos);
+			log_dsc->trunc_pending[log_dsc->trunc_npending].logorder = log_dsc->logorder;
+			log_dsc->trunc_pending[log_dsc->trunc_npending].droppos = droppos;
+			log_dsc->trunc_npending++;
+			log_dsc->ops->truncation_prepare_next(set, log_dsc);
+		}
+	}
+}
+
+
+/**
+ * \brief Second phase of a round: drops flushed fragments in log order.
+ *
+ * Must be called when no worker is flushing. 
+ */
+static
+void
+drop_flushed_logs(pcm_storeset_t *set)
+{
+	m_log_dsc_t *log_dsc;
+	m_log_dsc_t *min_log_dsc;
+	uint64_t    frontier;
+	uint64_t    limit;
+	uint64_t    n;
+	int         i;
+
+	/* 
+	 * Find the oldest fragment that is stable but not flushed. A log whose
+	 * worker found nothing to flush is checked again here because a 
+	 * fragment might have become stable since. Any older fragment writing 
+	 * the same cachelines as a flushed one must have been stable before
+	 * the flushed one was written, so it is accounted for.
+	 */
+	frontier = INV_LOG_ORDER;
+	for (i=0; i<logtrunc_nlogs; i++) {
+		log_dsc = logtrunc_logs[i];
+		if (log_dsc->logorder == INV_LOG_ORDER) {
+			log_dsc->ops->truncation_prepare_next(set, log_dsc);
+		}
+		if (log_dsc->logorder < frontier) {
+			frontier = log_dsc->logorder;
+		}
+	}
+
+	/* 
+	 * Repeatedly pick the log with the oldest pending fragment and drop 
+	 * all its consecutive fragments older than the next log's oldest one.
+	 */
+	while (1) {
+		min_log_dsc = NULL;
+		limit = frontier;
+		for (i=0; i<logtrunc_nlogs; i++) {
+			log_dsc = logtrunc_logs[i];
+			if (log_dsc->trunc_npending == 0) {
+				continue;
+			}
+			if (min_log_dsc == NULL || 
+			    log_dsc->trunc_pending[0].logorder < min_log_dsc->trunc_pending[0].logorder) 
+			{
+				if (min_log_dsc && min_log_dsc->trunc_pending[0].logorder < limit) {
+					limit = min_log_dsc->trunc_pending[0].logorder;
+				}
+				min_log_dsc = log_dsc;
+			} else if (log_dsc->trunc_pending[0].logorder < limit) {
+				limit = log_dsc->trunc_pending[0].logorder;
+			}
+		}
+		if (min_log_dsc == NULL || min_log_dsc->trunc_pending[0].logorder >= frontier) {
+			break;
+		}
+		for (n=1; n < min_log_dsc->trunc_npending && 
+		          min_log_dsc->trunc_pending[n].logorder < limit; n++);
+		min_log_dsc->ops->truncation_drop(set, min_log_dsc, 
+		                                  min_log_dsc->trunc_pending[n-1].droppos);
+		min_log_dsc->trunc_npending -= n;
+		memmove(&min_log_dsc->trunc_pending[0], &min_log_dsc->trunc_pending[n], 
+		        min_log_dsc->trunc_npending * sizeof(m_log_trunc_pending_t));
+	}
+}
+
+
+/**
+ * \brief Performs one truncation round. Called by the leader.
+ */
+static
+void
+truncation_round(pcm_storeset_t *set)
+{
+	if (!snapshot_logs()) {
+		truncate_logs(set);
+		return;
+	}
+	if (logtrunc_nthreads > 1) {
+		pthread_barrier_wait(&logtrunc_start_barrier);
+		flush_owned_logs(set, 0);
+		pthread_barrier_wait(&logtrunc_done_barrier);
+	} else {
+		flush_owned_logs(set, 0);
+	}
+	drop_flushed_logs(set);
+}
+
+
+static
+void
+pin_worker(logtrunc_worker_t *worker)
+{
+	cpu_set_t cpu_set;
+
+	if (worker->cpu < 0) {
+		return;
+	}
+	CPU_ZERO(&cpu_set);
+	CPU_SET(worker->cpu, &cpu_set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+}
+
+
+/**
+ * \brief Routine executed by the truncation workers other than the leader.
+ */
+static
+void *
+log_truncation_worker_main (void *arg)
+{
+	logtrunc_worker_t *worker = (logtrunc_worker_t *) arg;
+	pcm_storeset_t    *set;
+
+	set = pcm_storeset_get();
+	pin_worker(worker);
+
+	while (1) {
+		pthread_barrier_wait(&logtrunc_start_barrier);
+		flush_owned_logs(set, worker->id);
+		pthread_barrier_wait(&logtrunc_done_barrier);
+	}
+
+	return 0;
+}
+
+
+/**
+ * \brief Routine executed by the leader truncation thread to truncate logs
  * in the background.
  */
 static
 void *
 log_truncation_main (void *arg)
 {
+	logtrunc_worker_t  *worker = (logtrunc_worker_t *) arg;
 	struct timeval     start_time;
 	struct timeval     stop_time;
 	struct timeval     tp;
 	struct timespec    ts;
+	uint64_t           deadline;
+	uint64_t           now;
+	uint64_t           wakeup;
 	pcm_storeset_t     *set;
 	unsigned long long measured_time;
+	int                i;
 
 	set = pcm_storeset_get();
-
-	cpu_set_t          cpu_set;
-
-	CPU_ZERO(&cpu_set);
-	CPU_SET(1 % 4, &cpu_set);
-	sched_setaffinity(0, 4, &cpu_set);
-
+	pin_worker(worker);
+	for (i=1; i<logtrunc_nthreads; i++) {
+		pthread_create (&(logtrunc_workers[i].thread), NULL, 
+		                &log_truncation_worker_main, (void *) &logtrunc_workers[i]);
+	}
 
 /*
  * In the past, we tried to periodically wake-up and truncate the logs
@@ -162,37 +488,52 @@ log_truncation_main (void *arg)
 	/* reset trunc statistics */
 	logmgr->trunc_count=0;									 
 	logmgr->trunc_time = 0;									 
-#if 1
-	pthread_mutex_lock(&(logmgr->mutex));
+	gettimeofday(&tp, NULL);
+	logmgr->trunc_last = 1000000ULL * tp.tv_sec + tp.tv_usec;
 
 	while (1) {
+		pthread_mutex_lock(&logtrunc_round_mutex);
+		/* 
+		 * Writers signal without the mutex (see m_logtrunc_request), so 
+		 * a signal sent between the check of m_logtrunc_requested and 
+		 * the wait is lost. Sleep in slices of at most 
+		 * LOGTRUNC_REQUEST_POLL_MS and check the flag again after each, 
+		 * so such a request is served late but never skipped.
+		 */
 		gettimeofday(&tp, NULL);
-		ts.tv_sec = tp.tv_sec;
-		ts.tv_nsec = tp.tv_usec * 1000; 
-		ts.tv_sec += 10; // sleep time 
-		pthread_cond_timedwait(&logmgr->logtrunc_cond, &logmgr->mutex, &ts);
-		//pthread_mutex_unlock(&(logmgr->mutex));
-		//pthread_mutex_lock(&(logmgr->mutex));
+		deadline = 1000ULL * tp.tv_sec + tp.tv_usec / 1000 + 
+		           mcore_runtime_settings.trunc_period_ms;
+		while (!m_logtrunc_requested) {
+			gettimeofday(&tp, NULL);
+			now = 1000ULL * tp.tv_sec + tp.tv_usec / 1000;
+			if (now >= deadline) {
+				break;
+			}
+			wakeup = now + LOGTRUNC_REQUEST_POLL_MS;
+			if (wakeup > deadline) {
+				wakeup = deadline;
+			}
+			ts.tv_sec = wakeup / 1000;
+			ts.tv_nsec = (wakeup % 1000) * 1000000;
+			pthread_cond_timedwait(&logmgr->logtrunc_cond, &logtrunc_round_mutex, &ts);
+		}
+		m_logtrunc_requested = 0;
+		pthread_mutex_unlock(&logtrunc_round_mutex);
 
 		gettimeofday(&start_time, NULL);
-		truncate_logs(set, 0);
+		truncation_round(set);
 		gettimeofday(&stop_time, NULL);
 		measured_time = 1000000 * (stop_time.tv_sec - start_time.tv_sec) +
 		                                     stop_time.tv_usec - start_time.tv_usec;
 		logmgr->trunc_count++;									 
 		logmgr->trunc_time += measured_time;									 
-	}	
+		logmgr->trunc_last = 1000000ULL * stop_time.tv_sec + stop_time.tv_usec;
 
-	pthread_mutex_unlock(&(logmgr->mutex));
-#endif
-
-#if 0
-	while (1) {
-		pthread_mutex_lock(&(logmgr->mutex));
-		truncate_logs(set, 0);
-		pthread_mutex_unlock(&(logmgr->mutex));
+		pthread_mutex_lock(&logtrunc_round_mutex);
+		logtrunc_round++;
+		pthread_cond_broadcast(&logtrunc_round_cond);
+		pthread_mutex_unlock(&logtrunc_round_mutex);
 	}	
-#endif
 
 	return 0;
 }
@@ -205,7 +546,7 @@ m_result_t
 m_logtrunc_truncate(pcm_storeset_t *set)
 {
 	assert(0 && "m_logtrunc_truncate no longer used");
-	//return truncate_logs(set, 1);
+	return M_R_FAILURE;
 }
 
 
@@ -214,5 +555,43 @@ m_logtrunc_signal()
 {
 	// We don't worry about lost signals, as if the signal is lost, then 
 	// the async trunc thread was already truncating the log 
+	m_logtrunc_requested = 1;
+	pthread_cond_signal(&logmgr->logtrunc_cond);
+	return M_R_SUCCESS;
+}
+
+
+/**
+ * \brief Requests a truncation round.
+ *
+ * Called by writers on their fast path, so it never blocks: it signals 
+ * the leader without taking the round mutex. The signal is lost if the 
+ * leader has checked m_logtrunc_requested but is not waiting yet. The 
+ * leader then sees the flag when its current wait slice ends, at most 
+ * LOGTRUNC_REQUEST_POLL_MS later.
+ */
+void
+m_logtrunc_request(void)
+{
+	m_logtrunc_requested = 1;
 	pthread_cond_signal(&logmgr->logtrunc_cond);
 }
+
+
+/**
+ * \brief Requests a truncation round and blocks until a round completes.
+ */
+void
+m_logtrunc_wait(void)
+{
+	uint64_t round;
+
+	pthread_mutex_lock(&logtrunc_round_mutex);
+	round = logtrunc_round;
+	m_logtrunc_requested = 1;
+	pthread_cond_signal(&logmgr->logtrunc_cond);
+	while (round == logtrunc_round) {
+		pthread_cond_wait(&logtrunc_round_cond, &logtrunc_round_mutex);
+	}
+	pthread_mutex_unlock(&logtrunc_round_mutex);
+}
@@ -41,6 +41,8 @@
 #include <pthread.h>
 #include <malloc.h>
 #include <stdint.h>
+#include <string.h>
+#include <assert.h>
 #include <result.h>
 #include <debug.h>
 #include <list.h>
@@ -50,10 +52,51 @@
 #include "../segment.h"
 #include "../pregionlayout.h"
 #include "phlog_tornbit.h"
+#include "config.h"
+#include "statsrv.h"
+#include "mnemosyne.h"
 
 __attribute__ ((section("PERSISTENT"))) pcm_word_t log_pool = 0x0;
 
-#define LOG_NUM 32
+
+/*
+ * Log pool
+ *
+ * The pool is made of one or more extents. The first extent lives at 
+ * LOG_POOL_START in the region reserved by the persistent region layout. 
+ * Further extents are mapped as ordinary persistent segments when the 
+ * pool runs out of free logs. All extents share the same layout:
+ *
+ *   +----------+-------------------------+---------+---------+-----+
+ *   | reserved | nvmd[logs_per_extent]   |  log 0  |  log 1  | ... |
+ *   +----------+-------------------------+---------+---------+-----+
+ *   ^          ^ metadata_offset         ^ aligned to log_align
+ *
+ * The geometry is recorded in the pool header, which lives in the first 
+ * page of the first extent. It is chosen from the runtime settings when 
+ * the pool is first formatted and never changes afterwards.
+ *
+ * Pools created before the header existed keep their metadata at offset 
+ * zero and have no header magic. They are adopted using the geometry they
+ * were created with; the header offset lies past their metadata.
+ */
+
+#define LOG_POOL_MAGIC         0x314C4F4F50474F4CLLU /* "LOGPOOL1" */
+#define LOG_POOL_HEADER_OFFSET 2048
+#define LOG_POOL_MAX_EXTENTS   64
+
+typedef struct m_log_pool_hdr_s m_log_pool_hdr_t;
+struct m_log_pool_hdr_s {
+	pcm_word_t magic;                         /**< written last, marks the header valid */
+	pcm_word_t logs_per_extent;
+	pcm_word_t nentries_log2;                 /**< physical log size in words, log2 */
+	pcm_word_t log_align;                     /**< alignment of physical logs in bytes */
+	pcm_word_t metadata_offset;               /**< offset of the metadata within an extent */
+	pcm_word_t nextents;
+	pcm_word_t extent[LOG_POOL_MAX_EXTENTS];  /**< start address of each extent */
+};
+
+#define LOG_POOL_HEADER ((m_log_pool_hdr_t *) (LOG_POOL_START + LOG_POOL_HEADER_OFFSET))
 
 
 typedef struct m_logtype_entry_s m_logtype_entry_t;
@@ -85,6 +128,184 @@ static m_result_t register_static_logtypes(m_logmgr_t *mgr);
 static m_result_t do_recovery(pcm_storeset_t *set, m_logmgr_t *mgr);
 
 
+static inline
+uint64_t
+log_pool_log_stride(m_log_pool_hdr_t *hdr)
+{
+	uint64_t size = (1LLU << hdr->nentries_log2) * sizeof(pcm_word_t);
+
+	return (size + hdr->log_align - 1) & ~(hdr->log_align - 1);
+}
+
+
+/**
+ * \brief Returns the size of an extent holding logs_per_extent logs. 
+ *
+ * Extents are page aligned, so aligning the first log to a larger 
+ * boundary costs at most log_align - PAGE_SIZE bytes.
+ */
+static
+uint64_t
+log_pool_extent_size(m_log_pool_hdr_t *hdr, uint64_t logs_per_extent)
+{
+	return hdr->metadata_offset + 
+	       PAGE_ALIGN(logs_per_extent * sizeof(m_log_nvmd_t)) +
+	       hdr->log_align - PAGE_SIZE +
+	       logs_per_extent * log_pool_log_stride(hdr);
+}
+
+
+/**
+ * \brief Creates the volatile log descriptors for the logs of an extent.
+ */
+static
+m_result_t
+log_pool_attach_extent(m_logmgr_t *mgr, m_log_pool_hdr_t *hdr, uintptr_t extent)
+{
+	uintptr_t   metadata_start_addr;
+	uintptr_t   logs_start_addr;
+	uint64_t    log_stride;
+	m_log_dsc_t *log_dscs;
+	int         nlogs;
+	int         i;
+
+	/* 
+	 * Physical logs should be page aligned to get maximum bandwidth from the 
+	 * system. Since sizeof(metadata) much smaller than sizeof(PAGE) we 
+	 * aggregate all the metadata together.
+	 */
+	nlogs = hdr->logs_per_extent;
+	if (mgr->nlogs + nlogs > LOG_POOL_MAX_LOGS) {
+		nlogs = LOG_POOL_MAX_LOGS - mgr->nlogs;
+	}
+	metadata_start_addr = extent + hdr->metadata_offset; 
+	logs_start_addr = metadata_start_addr + 
+	                  PAGE_ALIGN(hdr->logs_per_extent * sizeof(m_log_nvmd_t));
+	logs_start_addr = (logs_start_addr + hdr->log_align - 1) & ~(hdr->log_align - 1);
+	log_stride = log_pool_log_stride(hdr);
+	if (!(log_dscs = (m_log_dsc_t *) calloc(nlogs, sizeof(m_log_dsc_t)))) {
+		return M_R_NOMEMORY;
+	}
+	for (i=0; i<nlogs; i++) {
+		log_dscs[i].nvmd = (m_log_nvmd_t *) (metadata_start_addr + 
+		                                        sizeof(m_log_nvmd_t)*i);
+		log_dscs[i].nvphlog = (pcm_word_t *) (logs_start_addr + 
+		                                         log_stride*i);
+		log_dscs[i].nvphlog_nentries = mgr->log_nentries;
+		log_dscs[i].log = NULL;
+		log_dscs[i].ops = NULL;
+		log_dscs[i].logorder = INV_LOG_ORDER;
+		log_dscs[i].trunc_owner = -1;
+		log_dscs[i].trunc_npending = 0;
+		if ((log_dscs[i].nvmd->generic_flags & LF_TYPE_MASK) == 
+		    LF_TYPE_FREE) 
+		{
+			list_add_tail(&(log_dscs[i].list), &(mgr->free_logs_list));
+		} else {
+			list_add_tail(&(log_dscs[i].list), &(mgr->pending_logs_list));
+		}
+	}
+	mgr->nlogs += nlogs;
+
+	return M_R_SUCCESS;
+}
+
+
+/**
+ * \brief Grows the log pool by one extent.
+ *
+ * The extent is mapped as a new persistent segment and is published by
+ * making it persistent in the header before bumping the extent count.
+ * A crash in between leaks the segment but leaves the pool consistent.
+ *
+ * Caller must hold the log manager mutex.
+ */
+static
+m_result_t
+log_pool_grow(pcm_storeset_t *set, m_logmgr_t *mgr)
+{
+	m_log_pool_hdr_t *hdr = LOG_POOL_HEADER;
+	uint64_t         nextents = hdr->nextents;
+	void             *addr;
+
+	if (nextents >= LOG_POOL_MAX_EXTENTS || mgr->nlogs >= LOG_POOL_MAX_LOGS) {
+		return M_R_FAILURE;
+	}
+	addr = m_pmap(NULL, log_pool_extent_size(hdr, hdr->logs_per_extent), 
+	              PROT_READ|PROT_WRITE, 0);
+	if (addr == MAP_FAILED) {
+		return M_R_FAILURE;
+	}
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->extent[nextents], (pcm_word_t) addr);
+	PCM_NT_FLUSH(set);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->nextents, nextents + 1);
+	PCM_NT_FLUSH(set);
+
+	return log_pool_attach_extent(mgr, hdr, (uintptr_t) addr);
+}
+
+
+/**
+ * \brief Writes the pool header of a newly created pool.
+ *
+ * The geometry comes from the runtime settings. The first extent must fit
+ * in the region reserved for it, so a pool with more logs than fit there
+ * is grown right away by mapping additional extents.
+ */
+static
+void
+log_pool_format_header(pcm_storeset_t *set, m_log_pool_hdr_t *hdr)
+{
+	uint64_t log_align;
+	uint64_t logs_per_extent;
+
+	for (log_align = PAGE_SIZE; 
+	     log_align < mcore_runtime_settings.log_align; 
+	     log_align <<= 1);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->nentries_log2, 
+	             mcore_runtime_settings.log_entries_log2);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->log_align, log_align);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->metadata_offset, PAGE_SIZE);
+	logs_per_extent = mcore_runtime_settings.log_num;
+	while (logs_per_extent > 0 && 
+	       log_pool_extent_size(hdr, logs_per_extent) > LOG_POOL_SIZE) 
+	{
+		logs_per_extent--;
+	}
+	if (logs_per_extent == 0) {
+		M_INTERNALERROR("Physical log does not fit in the log pool.\n");
+	}
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->logs_per_extent, logs_per_extent);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->extent[0], LOG_POOL_START);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->nextents, 1);
+	PCM_NT_FLUSH(set);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->magic, LOG_POOL_MAGIC);
+	PCM_NT_FLUSH(set);
+}
+
+
+/**
+ * \brief Records the geometry of a pool created before the geometry was
+ * kept in the pool header.
+ */
+static
+void
+log_pool_adopt_legacy_header(pcm_storeset_t *set, m_log_pool_hdr_t *hdr)
+{
+	assert(LOG_NUM * sizeof(m_log_nvmd_t) <= LOG_POOL_HEADER_OFFSET);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->nentries_log2, 
+	             PHYSICAL_LOG_NUM_ENTRIES_LOG2);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->log_align, PAGE_SIZE);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->metadata_offset, 0);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->logs_per_extent, LOG_NUM);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->extent[0], LOG_POOL_START);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->nextents, 1);
+	PCM_NT_FLUSH(set);
+	PCM_NT_STORE(set, (volatile pcm_word_t *) &hdr->magic, LOG_POOL_MAGIC);
+	PCM_NT_FLUSH(set);
+}
+
+
 /**
  * \brief Creates the log pool if doesn't exist and then initializes the
  * necessary volatile data structures to access the log pool. 
@@ -97,14 +318,11 @@ static
 m_result_t
 create_log_pool(pcm_storeset_t *set, m_logmgr_t *mgr)
 {
-	uintptr_t        metadata_start_addr;
-	uintptr_t        logs_start_addr;
-	int              metadata_section_size;
-	int              physical_log_size;
-	void             *addr;
-	m_log_dsc_t      *log_dscs;
+	void             *addr = (void *) LOG_POOL_START;
+	m_log_pool_hdr_t *hdr = LOG_POOL_HEADER;
 	m_segidx_entry_t *segidx_entry;
-	int              i;
+	m_result_t       rv;
+	uint64_t         i;
 
 	if (!log_pool) {
 		/* 
@@ -121,37 +339,24 @@ create_log_pool(pcm_storeset_t *set, m_logmgr_t *mgr)
 				M_INTERNALERROR("Could not allocate logs pool segment.\n");
 			}
 		}
+		log_pool_format_header(set, hdr);
 		PCM_NT_STORE(set, (volatile pcm_word_t *) &log_pool, (pcm_word_t) addr);
 		PCM_NT_FLUSH(set);
+	} else if (hdr->magic != LOG_POOL_MAGIC) {
+		log_pool_adopt_legacy_header(set, hdr);
 	}
 	
-	/* 
-	 * Now read the non-volatile log metadata and non-volatile physical logs.
-	 * 
-	 * Physical logs should be page aligned to get maximum bandwidth from the 
-	 * system. Since sizeof(metadata) much smaller than sizeof(PAGE) we 
-	 * aggregate all the metadata together.
-	 */
-	metadata_start_addr = LOG_POOL_START; /* this is already page aligned */
-	metadata_section_size = PAGE_ALIGN(LOG_NUM * sizeof(m_log_nvmd_t));
-	logs_start_addr = metadata_start_addr + metadata_section_size;
-   	physical_log_size = PAGE_ALIGN(PHYSICAL_LOG_SIZE);
-	assert(metadata_section_size + LOG_NUM*physical_log_size <= LOG_POOL_SIZE);
-	log_dscs = (m_log_dsc_t *) calloc(LOG_NUM, sizeof(m_log_dsc_t));
-	for (i=0; i<LOG_NUM; i++) {
-		log_dscs[i].nvmd = (m_log_nvmd_t *) (metadata_start_addr + 
-		                                        sizeof(m_log_nvmd_t)*i);
-		log_dscs[i].nvphlog = (pcm_word_t *) (logs_start_addr + 
-		                                         physical_log_size*i);
-		log_dscs[i].log = NULL;
-		log_dscs[i].ops = NULL;
-		log_dscs[i].logorder = INV_LOG_ORDER;
-		if ((log_dscs[i].nvmd->generic_flags & LF_TYPE_MASK) == 
-		    LF_TYPE_FREE) 
-		{
-			list_add_tail(&(log_dscs[i].list), &(mgr->free_logs_list));
-		} else {
-			list_add_tail(&(log_dscs[i].list), &(mgr->pending_logs_list));
+	/* Now read the non-volatile log metadata and non-volatile physical logs. */
+	mgr->log_nentries = 1LLU << hdr->nentries_log2;
+	mgr->nlogs = 0;
+	for (i=0; i<hdr->nextents; i++) {
+		if ((rv = log_pool_attach_extent(mgr, hdr, hdr->extent[i])) != M_R_SUCCESS) {
+			return rv;
+		}
+	}
+	while (mgr->nlogs < mcore_runtime_settings.log_num) {
+		if (log_pool_grow(set, mgr) != M_R_SUCCESS) {
+			break;
 		}
 	}
 
@@ -159,6 +364,60 @@ create_log_pool(pcm_storeset_t *set, m_logmgr_t *mgr)
 }
 
 
+/**
+ * \brief Reports the fill of the active logs and the progress of truncation.
+ *
+ * Log fill is the part of a log written but not truncated yet; 
+ * mcore_trunc_last_round_age_us is how long ago the last truncation round
+ * ended.
+ */
+static
+void
+logmgr_stats_report(FILE *fout)
+{
+	m_log_dsc_t    *log_dsc;
+	m_log_stats_t  stats;
+	struct timeval now;
+	int            i = 0;
+
+	pthread_mutex_lock(&(logmgr->mutex));
+	list_for_each_entry(log_dsc, &(logmgr->active_logs_list), list) {
+		if (log_dsc->ops->get_stats == NULL ||
+		    log_dsc->ops->get_stats(log_dsc, &stats) != M_R_SUCCESS) 
+		{
+			continue;
+		}
+		fprintf(fout, "mcore_log_fill_words{log=\"%d\"} %llu\n", i, 
+		        (unsigned long long) stats.fill);
+		fprintf(fout, "mcore_log_size_words{log=\"%d\"} %llu\n", i, 
+		        (unsigned long long) stats.size);
+		fprintf(fout, "mcore_log_trunc_pending_fragments{log=\"%d\"} %llu\n", i, 
+		        (unsigned long long) log_dsc->trunc_npending);
+		fprintf(fout, "mcore_log_trunc_waits_total{log=\"%d\"} %llu\n", i, 
+		        (unsigned long long) stats.wait_for_trunc);
+		fprintf(fout, "mcore_log_trunc_wait_ns_total{log=\"%d\"} %llu\n", i, 
+		        (unsigned long long) stats.wait_time_for_trunc);
+		i++;
+	}
+	gettimeofday(&now, NULL);
+	fprintf(fout, "mcore_trunc_low_watermark_words %llu\n", 
+	        (unsigned long long) m_logtrunc_low_watermark);
+	fprintf(fout, "mcore_trunc_high_watermark_words %llu\n", 
+	        (unsigned long long) m_logtrunc_high_watermark);
+	fprintf(fout, "mcore_trunc_rounds_total %llu\n", 
+	        (unsigned long long) logmgr->trunc_count);
+	fprintf(fout, "mcore_trunc_time_us_total %llu\n", 
+	        (unsigned long long) logmgr->trunc_time);
+	fprintf(fout, "mcore_trunc_last_round_age_us %llu\n", 
+	        (unsigned long long) (1000000ULL * now.tv_sec + now.tv_usec - logmgr->trunc_last));
+	fprintf(fout, "mcore_recovery_fragments %llu\n", 
+	        (unsigned long long) logmgr->recovery_nfragments);
+	fprintf(fout, "mcore_recovery_batches %llu\n", 
+	        (unsigned long long) logmgr->recovery_nbatches);
+	pthread_mutex_unlock(&(logmgr->mutex));
+}
+
+
 /**
  * \brief Reincarnates the pool of logs and recovers and log types known when
  * to the log manager when it was compiled.
@@ -167,8 +426,9 @@ static
 m_result_t
 logmgr_init(pcm_storeset_t *set)
 {
-	m_result_t rv = M_R_FAILURE;
-	m_logmgr_t *mgr;
+	m_result_t     rv = M_R_FAILURE;
+	m_logmgr_t     *mgr;
+	struct timeval now;
 
 	pthread_mutex_lock(&logmgr_init_lock);
 	if (logmgr_initialized) {
@@ -185,6 +445,12 @@ logmgr_init(pcm_storeset_t *set)
 	INIT_LIST_HEAD(&(mgr->free_logs_list));
 	INIT_LIST_HEAD(&(mgr->active_logs_list));
 	INIT_LIST_HEAD(&(mgr->pending_logs_list));
+	gettimeofday(&now, NULL);
+	mgr->trunc_time = 0;
+	mgr->trunc_count = 0;
+	mgr->trunc_last = 1000000ULL * now.tv_sec + now.tv_usec;
+	mgr->recovery_nfragments = 0;
+	mgr->recovery_nbatches = 0;
 	create_log_pool(set, mgr);
 	register_static_logtypes(mgr);
 	do_recovery(set, mgr); /* will recover any known log types so far. */
@@ -200,6 +466,7 @@ logmgr_init(pcm_storeset_t *set)
 	logmgr_initialized = 1; 
 
 	m_logtrunc_init((m_logmgr_t *) logmgr);
+	m_statsrv_register("log manager", logmgr_stats_report);
 	rv = M_R_SUCCESS;
 
 out:
@@ -312,6 +579,378 @@ m_logmgr_register_logtype(pcm_storeset_t *set, int type, m_log_ops_t *ops)
 }
 
 
+/*
+ * Recovery
+ *
+ * Recovery replays atomic log fragments across all pending logs in 
+ * increasing log order. Logs are kept in a min-heap keyed by the order 
+ * of their next fragment so picking the next fragment costs O(log L) 
+ * instead of a scan over all logs.
+ *
+ * When the runtime setting recovery_threads is larger than one, the 
+ * logs are prepared (and decoded, if their type supports recovery_decode)
+ * in parallel. If every log could be decoded, fragments are then merged
+ * into a single schedule and replayed in batches: a batch is a run of 
+ * consecutive fragments in log order that belong to distinct logs and 
+ * whose cacheline footprints do not intersect. Fragments within a batch 
+ * commute so they are replayed concurrently; batches are replayed in order.
+ */
+
+typedef struct recovery_run_s recovery_run_t;
+struct recovery_run_s {
+	m_log_dsc_t      *log_dsc;
+	m_log_fragment_t *fragments;     /**< decoded fragments, NULL if log type cannot decode */
+	uint64_t         nfragments;
+	uint64_t         next;           /**< next fragment to schedule */
+	uint64_t         key;            /**< heap key: order of next fragment */
+	int              in_batch;
+};
+
+typedef struct recovery_pool_s recovery_pool_t;
+typedef void (*recovery_work_t)(pcm_storeset_t *set, void *items, uint64_t i);
+
+struct recovery_pool_s {
+	int               nthreads;
+	pthread_t         *threads;
+	pthread_barrier_t start_barrier;
+	pthread_barrier_t done_barrier;
+	recovery_work_t   work;
+	void              *items;
+	uint64_t          nitems;
+	volatile uint64_t next_item;
+	volatile int      quit;
+};
+
+
+static
+void
+recovery_pool_work(recovery_pool_t *pool, pcm_storeset_t *set)
+{
+	uint64_t i;
+
+	while ((i = __sync_fetch_and_add(&pool->next_item, 1)) < pool->nitems) {
+		pool->work(set, pool->items, i);
+	}
+}
+
+
+static
+void *
+recovery_worker_main(void *arg)
+{
+	recovery_pool_t *pool = (recovery_pool_t *) arg;
+	pcm_storeset_t  *set;
+
+	set = pcm_storeset_get();
+	while (1) {
+		pthread_barrier_wait(&pool->start_barrier);
+		if (pool->quit) {
+			break;
+		}
+		recovery_pool_work(pool, set);
+		pthread_barrier_wait(&pool->done_barrier);
+	}
+	return NULL;
+}
+
+
+static
+m_result_t
+recovery_pool_create(recovery_pool_t *pool, int nthreads)
+{
+	int i;
+
+	pool->nthreads = nthreads;
+	pool->threads = NULL;
+	pool->quit = 0;
+	if (nthreads <= 1) {
+		return M_R_SUCCESS;
+	}
+	if (!(pool->threads = (pthread_t *) malloc(sizeof(pthread_t) * (nthreads-1)))) {
+		pool->nthreads = 1;
+		return M_R_NOMEMORY;
+	}
+	pthread_barrier_init(&pool->start_barrier, NULL, nthreads);
+	pthread_barrier_init(&pool->done_barrier, NULL, nthreads);
+	/* The calling thread acts as worker zero. */
+	for (i=0; i<nthreads-1; i++) {
+		if (pthread_create(&pool->threads[i], NULL, recovery_worker_main, pool) != 0) {
+			M_INTERNALERROR("Could not create log recovery thread.\n");
+		}
+	}
+	return M_R_SUCCESS;
+}
+
+
+static
+void
+recovery_pool_run(recovery_pool_t *pool, pcm_storeset_t *set,
+                  recovery_work_t work, void *items, uint64_t nitems)
+{
+	uint64_t i;
+
+	if (pool->nthreads <= 1 || nitems == 1) {
+		for (i=0; i<nitems; i++) {
+			work(set, items, i);
+		}
+		return;
+	}
+	pool->work = work;
+	pool->items = items;
+	pool->nitems = nitems;
+	pool->next_item = 0;
+	pthread_barrier_wait(&pool->start_barrier);
+	recovery_pool_work(pool, set);
+	pthread_barrier_wait(&pool->done_barrier);
+}
+
+
+static
+void
+recovery_pool_destroy(recovery_pool_t *pool)
+{
+	int i;
+
+	if (pool->nthreads <= 1) {
+		return;
+	}
+	pool->quit = 1;
+	pthread_barrier_wait(&pool->start_barrier);
+	for (i=0; i<pool->nthreads-1; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_barrier_destroy(&pool->start_barrier);
+	pthread_barrier_destroy(&pool->done_barrier);
+	free(pool->threads);
+}
+
+
+static inline
+void
+recovery_heap_push(recovery_run_t **heap, int *nheap, recovery_run_t *run)
+{
+	int            i;
+	int            parent;
+	recovery_run_t *tmp;
+
+	i = (*nheap)++;
+	heap[i] = run;
+	while (i > 0) {
+		parent = (i-1) / 2;
+		if (heap[parent]->key <= heap[i]->key) {
+			break;
+		}
+		tmp = heap[parent]; heap[parent] = heap[i]; heap[i] = tmp;
+		i = parent;
+	}
+}
+
+
+static inline
+recovery_run_t *
+recovery_heap_pop(recovery_run_t **heap, int *nheap)
+{
+	int            i;
+	int            child;
+	recovery_run_t *min;
+	recovery_run_t *tmp;
+
+	if (*nheap == 0) {
+		return NULL;
+	}
+	min = heap[0];
+	heap[0] = heap[--(*nheap)];
+	i = 0;
+	while ((child = 2*i + 1) < *nheap) {
+		if (child + 1 < *nheap && heap[child+1]->key < heap[child]->key) {
+			child++;
+		}
+		if (heap[i]->key <= heap[child]->key) {
+			break;
+		}
+		tmp = heap[child]; heap[child] = heap[i]; heap[i] = tmp;
+		i = child;
+	}
+	return min;
+}
+
+
+/** \brief Prepares a log for recovery and decodes its fragments if possible. */
+static
+void
+recovery_init_work(pcm_storeset_t *set, void *items, uint64_t i)
+{
+	recovery_run_t *run = &((recovery_run_t *) items)[i];
+	m_log_dsc_t    *log_dsc = run->log_dsc;
+
+	log_dsc->ops->recovery_init(set, log_dsc);
+	if (log_dsc->ops->recovery_decode) {
+		if (log_dsc->ops->recovery_decode(set, log_dsc, &run->fragments, 
+		                                  &run->nfragments) != M_R_SUCCESS) 
+		{
+			run->fragments = NULL;
+			run->nfragments = 0;
+		}
+	}
+}
+
+
+/** \brief Replays the current fragment of a log and moves to the next one. */
+static
+void
+recovery_do_work(pcm_storeset_t *set, void *items, uint64_t i)
+{
+	m_log_dsc_t *log_dsc = ((m_log_dsc_t **) items)[i];
+
+	log_dsc->ops->recovery_do(set, log_dsc);
+	log_dsc->ops->recovery_prepare_next(set, log_dsc);
+}
+
+
+static inline
+int
+recovery_footprint_conflict(uint64_t *batch_footprint, m_log_fragment_t *fragment)
+{
+	int i;
+
+	for (i=0; i<LOG_FRAGMENT_FOOTPRINT_NWORDS; i++) {
+		if (batch_footprint[i] & fragment->footprint[i]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/**
+ * \brief Replays fragments one at a time in log order.
+ */
+static
+unsigned int
+recover_serial(pcm_storeset_t *set, recovery_run_t *runs, int nruns)
+{
+	recovery_run_t **heap;
+	recovery_run_t *run;
+	int            nheap = 0;
+	int            i;
+	unsigned int   nlogfragments_recovered = 0;
+
+	if (!(heap = (recovery_run_t **) malloc(sizeof(recovery_run_t *) * (nruns+1)))) {
+		M_INTERNALERROR("Could not allocate log recovery heap.\n");
+	}
+	for (i=0; i<nruns; i++) {
+		if (runs[i].log_dsc->logorder != INV_LOG_ORDER) {
+			runs[i].key = runs[i].log_dsc->logorder;
+			recovery_heap_push(heap, &nheap, &runs[i]);
+		}
+	}
+	while ((run = recovery_heap_pop(heap, &nheap))) {
+		assert(run->log_dsc->ops->recovery_do);
+		assert(run->log_dsc->ops->recovery_prepare_next);
+		recovery_do_work(set, &run->log_dsc, 0);
+		nlogfragments_recovered++;
+		if (run->log_dsc->logorder != INV_LOG_ORDER) {
+			run->key = run->log_dsc->logorder;
+			recovery_heap_push(heap, &nheap, run);
+		}
+	}
+	free(heap);
+
+	return nlogfragments_recovered;
+}
+
+
+/**
+ * \brief Merges the decoded fragment runs into a single schedule and 
+ * replays it in batches of non-conflicting fragments.
+ */
+static
+unsigned int
+recover_parallel(pcm_storeset_t *set, recovery_pool_t *pool, 
+                 recovery_run_t *runs, int nruns, unsigned int *nbatchesp)
+{
+	recovery_run_t   **heap;
+	recovery_run_t   **schedule;
+	m_log_dsc_t      **batch;
+	recovery_run_t   *run;
+	m_log_fragment_t *fragment;
+	uint64_t         batch_footprint[LOG_FRAGMENT_FOOTPRINT_NWORDS];
+	uint64_t         nfragments = 0;
+	uint64_t         nscheduled = 0;
+	uint64_t         i;
+	uint64_t         j;
+	int              nheap = 0;
+	int              nbatch = 0;
+	unsigned int     nbatches = 0;
+
+	for (i=0; i<nruns; i++) {
+		nfragments += runs[i].nfragments;
+	}
+	heap = (recovery_run_t **) malloc(sizeof(recovery_run_t *) * (nruns+1));
+	schedule = (recovery_run_t **) malloc(sizeof(recovery_run_t *) * (nfragments+1));
+	batch = (m_log_dsc_t **) malloc(sizeof(m_log_dsc_t *) * (nruns+1));
+	if (!heap || !schedule || !batch) {
+		M_INTERNALERROR("Could not allocate log recovery schedule.\n");
+	}
+
+	/* Merge the per-log runs into a single schedule ordered by log order. */
+	for (i=0; i<nruns; i++) {
+		runs[i].next = 0;
+		if (runs[i].nfragments > 0) {
+			runs[i].key = runs[i].fragments[0].logorder;
+			recovery_heap_push(heap, &nheap, &runs[i]);
+		}
+	}
+	while ((run = recovery_heap_pop(heap, &nheap))) {
+		schedule[nscheduled++] = run;
+		if (++run->next < run->nfragments) {
+			run->key = run->fragments[run->next].logorder;
+			recovery_heap_push(heap, &nheap, run);
+		}
+	}
+	assert(nscheduled == nfragments);
+
+	/* Replay the schedule in batches of commuting fragments. */
+	for (i=0; i<nruns; i++) {
+		runs[i].next = 0;
+		runs[i].in_batch = 0;
+	}
+	memset(batch_footprint, 0, sizeof(batch_footprint));
+	for (i=0; i<nscheduled; i++) {
+		run = schedule[i];
+		fragment = &run->fragments[run->next];
+		/* A non-empty batch is closed by the first fragment that conflicts */
+		if (run->in_batch || recovery_footprint_conflict(batch_footprint, fragment)) {
+			recovery_pool_run(pool, set, recovery_do_work, batch, nbatch);
+			nbatches++;
+			for (j=0; j<nruns; j++) {
+				runs[j].in_batch = 0;
+			}
+			memset(batch_footprint, 0, sizeof(batch_footprint));
+			nbatch = 0;
+		}
+		assert(run->log_dsc->logorder == fragment->logorder);
+		for (j=0; j<LOG_FRAGMENT_FOOTPRINT_NWORDS; j++) {
+			batch_footprint[j] |= fragment->footprint[j];
+		}
+		run->in_batch = 1;
+		run->next++;
+		batch[nbatch++] = run->log_dsc;
+	}
+	if (nbatch > 0) {
+		recovery_pool_run(pool, set, recovery_do_work, batch, nbatch);
+		nbatches++;
+	}
+
+	free(batch);
+	free(schedule);
+	free(heap);
+	*nbatchesp = nbatches;
+
+	return nscheduled;
+}
+
+
 /**
  * \brief It checks the unknown logs list and recovers any newly known 
  * log types.
@@ -322,9 +961,14 @@ do_recovery(pcm_storeset_t *set, m_logmgr_t *mgr)
 {
 	m_log_dsc_t        *log_dsc;
 	m_log_dsc_t        *log_dsc_tmp;
-	m_log_dsc_t        *log_dsc_to_recover;
 	struct list_head   recovery_list;
-	unsigned int       nlogfragments_recovered;
+	recovery_run_t     *runs;
+	recovery_pool_t    pool;
+	int                nruns;
+	int                nthreads;
+	int                decoded;
+	int                i;
+	unsigned int       nbatches = 0;
 #ifdef _M_STATS_BUILD
 	struct timeval     start_time;
 	struct timeval     stop_time;
@@ -340,59 +984,78 @@ do_recovery(pcm_storeset_t *set, m_logmgr_t *mgr)
 	 */
 	/* FIXME: Collect and recover logs by type. */
 	INIT_LIST_HEAD(&recovery_list);
+	nruns = 0;
 	list_for_each_entry_safe(log_dsc, log_dsc_tmp, &(mgr->pending_logs_list), list) {
 		if (log_dsc->ops && log_dsc->ops->recovery_init) {
-			log_dsc->ops->recovery_init(set, log_dsc);
 			list_del_init(&(log_dsc->list));
 			list_add(&(log_dsc->list), &recovery_list);
+			nruns++;
 		}
 	}
+	if (nruns == 0) {
+		return M_R_SUCCESS;
+	}
+	if (!(runs = (recovery_run_t *) calloc(nruns, sizeof(recovery_run_t)))) {
+		return M_R_NOMEMORY;
+	}
+	i = 0;
+	list_for_each_entry(log_dsc, &recovery_list, list) {
+		runs[i++].log_dsc = log_dsc;
+	}
+
+	nthreads = mcore_runtime_settings.recovery_threads;
+	if (nthreads > nruns) {
+		nthreads = nruns;
+	}
+	recovery_pool_create(&pool, nthreads);
 
 #ifdef _M_STATS_BUILD
 	gettimeofday(&start_time, NULL);
 #endif
 
+	recovery_pool_run(&pool, set, recovery_init_work, runs, nruns);
+
 	/* 
-	 * Find the next log to recover, recover it, update its recovery
-	 * order, and repeat until there are no more logs to recover.
+	 * Fragments can be replayed concurrently only if every log told us 
+	 * in advance which fragments it holds and what they write.
 	 */
-	nlogfragments_recovered = 0;
-	do {
-		log_dsc_to_recover = NULL; 
-		list_for_each_entry(log_dsc, &recovery_list, list) {
-			if (log_dsc->logorder == INV_LOG_ORDER) {
-				continue;
-			}
-			if (log_dsc_to_recover == NULL) {
-				log_dsc_to_recover = log_dsc;
-			} else {
-				if (log_dsc_to_recover->logorder > log_dsc->logorder) {
-					log_dsc_to_recover = log_dsc;
-				}
-			}
+	decoded = 1;
+	for (i=0; i<nruns; i++) {
+		if (runs[i].fragments == NULL && 
+		    runs[i].log_dsc->logorder != INV_LOG_ORDER) 
+		{
+			decoded = 0;
 		}
-		if (log_dsc_to_recover) {
-			assert(log_dsc_to_recover->ops);
-			assert(log_dsc_to_recover->ops->recovery_do);
-			assert(log_dsc_to_recover->ops->recovery_prepare_next);
-			log_dsc_to_recover->ops->recovery_do(set, log_dsc_to_recover);
-			log_dsc_to_recover->ops->recovery_prepare_next(set, log_dsc_to_recover);
-			nlogfragments_recovered++;
-		}	
-	} while(log_dsc_to_recover);
+	}
+	if (pool.nthreads > 1 && decoded) {
+		mgr->recovery_nfragments = recover_parallel(set, &pool, runs, nruns, 
+		                                            &nbatches);
+	} else {
+		mgr->recovery_nfragments = recover_serial(set, runs, nruns);
+		/* every fragment is a batch of its own */
+		nbatches = mgr->recovery_nfragments;
+	}
+	mgr->recovery_nbatches = nbatches;
+
+	recovery_pool_destroy(&pool);
+	for (i=0; i<nruns; i++) {
+		assert(runs[i].log_dsc->logorder == INV_LOG_ORDER);
+		free(runs[i].fragments);
+	}
+	free(runs);
 
 	/* Make the recovered logs available for reuse */
 	list_splice(&recovery_list, &(mgr->free_logs_list));
 
-#ifdef _M_STATS_BUILD
-	gettimeofday(&stop_time, NULL);
-#endif
 #ifdef _M_STATS_BUILD
 	gettimeofday(&stop_time, NULL);
 	op_time = 1000000 * (stop_time.tv_sec - start_time.tv_sec) +
 	                     stop_time.tv_usec - start_time.tv_usec;
 	fprintf(stderr, "log_recovery_latency    = %llu (us)\n", op_time);
-	fprintf(stderr, "nlogfragments_recovered = %u \n", nlogfragments_recovered);
+	fprintf(stderr, "nlogfragments_recovered = %llu \n", 
+	        (unsigned long long) mgr->recovery_nfragments);
+	fprintf(stderr, "log_recovery_threads    = %d \n", pool.nthreads);
+	fprintf(stderr, "log_recovery_batches    = %u \n", nbatches);
 #endif
 	return M_R_SUCCESS;
 }
@@ -418,6 +1081,7 @@ m_logmgr_alloc_log(pcm_storeset_t *set, int type, uint64_t flags, m_log_dsc_t **
 	m_logtype_entry_t *logtype_entry;
 
 	pthread_mutex_lock(&(logmgr->mutex));
+retry:
 	list_for_each_entry(log_dsc, &(logmgr->free_logs_list), list) {
 		if (((log_dsc->nvmd->generic_flags & LF_TYPE_MASK) ==  type) &&
 		    free_log_dsc == NULL) 
@@ -454,6 +1118,9 @@ m_logmgr_alloc_log(pcm_storeset_t *set, int type, uint64_t flags, m_log_dsc_t **
 		 * be of different type. Need to get one out of the free list 
 		 * and clean it.
 		 */
+		if (log_pool_grow(set, logmgr) == M_R_SUCCESS) {
+			goto retry;
+		}
 		rv = M_R_FAILURE;
 		goto out;
 	}
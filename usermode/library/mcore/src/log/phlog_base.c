@@ -55,6 +55,7 @@
 m_result_t
 m_phlog_base_check_consistency(m_phlog_base_nvmd_t *nvmd, 
                                   pcm_word_t *nvphlog,
+                                  uint64_t nentries,
                                   uint64_t *stable_tail)
 {
 	*stable_tail = nvmd->tail;
@@ -70,6 +71,7 @@ m_result_t
 m_phlog_base_format (pcm_storeset_t *set, 
                      m_phlog_base_nvmd_t *nvmd, 
                      pcm_word_t *nvphlog, 
+                     uint64_t nentries,
                      int type)
 {
 	PCM_NT_STORE(set, (volatile pcm_word_t *) &nvmd->head, 0);
@@ -105,10 +107,12 @@ m_phlog_base_alloc (m_phlog_base_t **phlog_basep)
 m_result_t
 m_phlog_base_init(m_phlog_base_t *phlog, 
                   m_phlog_base_nvmd_t *nvmd,
-                  pcm_word_t *nvphlog)					  
+                  pcm_word_t *nvphlog,
+                  uint64_t nentries)
 {
 	phlog->nvmd = nvmd;
 	phlog->nvphlog = nvphlog;
+	phlog->nentries_mask = nentries - 1;
 	phlog->buffer_count = 0;
 	phlog->head = phlog->nvmd->head;
 	phlog->tail = phlog->nvmd->tail;
@@ -77,6 +77,7 @@ uint64_t load_nt_word(void *addr)
 m_result_t
 m_phlog_tornbit_check_consistency(m_phlog_tornbit_nvmd_t *nvmd, 
                                   pcm_word_t *nvphlog,
+                                  uint64_t nentries,
                                   uint64_t *stable_tail)
 {
 	uint64_t          head_index;
@@ -93,7 +94,7 @@ m_phlog_tornbit_check_consistency(m_phlog_tornbit_nvmd_t *nvmd,
 			*stable_tail = i;
 			break;
 		}
-		i = (i + 1) & (PHYSICAL_LOG_NUM_ENTRIES - 1);
+		i = (i + 1) & (nentries - 1);
 		if (i==0) {
 			flip_tornbit = 1;
 			valid_tornbit = TORN_MASK & ~valid_tornbit;
@@ -113,12 +114,13 @@ tornbit_format_nvlog (pcm_storeset_t *set,
                       uint32_t head_index, 
                       uint64_t tornbit, 
                       m_phlog_tornbit_nvmd_t *nvmd, 
-                      pcm_word_t *nvphlog)
+                      pcm_word_t *nvphlog,
+                      uint64_t nentries)
 {
-	int i;
+	uint64_t i;
 
 	PCM_NT_STORE(set, (volatile pcm_word_t *) &nvmd->flags, head_index | tornbit);
-	for (i=0; i<PHYSICAL_LOG_NUM_ENTRIES; i++) {
+	for (i=0; i<nentries; i++) {
 		if (i<head_index) {
 			if ((nvphlog[i] & TORN_MASK) != tornbit) {
 				PCM_NT_STORE(set, (volatile pcm_word_t *) &nvphlog[i], tornbit);
@@ -142,6 +144,7 @@ m_result_t
 m_phlog_tornbit_format (pcm_storeset_t *set, 
                         m_phlog_tornbit_nvmd_t *nvmd, 
                         pcm_word_t *nvphlog, 
+                        uint64_t nentries,
                         int type)
 {
 	m_result_t             rv = M_R_FAILURE;
@@ -151,12 +154,12 @@ m_phlog_tornbit_format (pcm_storeset_t *set,
 		 * TODO: Optimization: check consistency and perform a quick format 
 		 * instead.
 		 */
-		rv = tornbit_format_nvlog (set, 0, TORNBIT_ONE, nvmd, nvphlog);
+		rv = tornbit_format_nvlog (set, 0, TORNBIT_ONE, nvmd, nvphlog, nentries);
 		if (rv != M_R_SUCCESS) {
 			goto out;
 		}
 	} else {
-		rv = tornbit_format_nvlog (set, 0, TORNBIT_ONE, nvmd, nvphlog);
+		rv = tornbit_format_nvlog (set, 0, TORNBIT_ONE, nvmd, nvphlog, nentries);
 		if (rv != M_R_SUCCESS) {
 			goto out;
 		}
@@ -192,12 +195,14 @@ m_phlog_tornbit_alloc (m_phlog_tornbit_t **phlog_tornbitp)
 m_result_t
 m_phlog_tornbit_init (m_phlog_tornbit_t *phlog, 
                       m_phlog_tornbit_nvmd_t *nvmd,
-                      pcm_word_t *nvphlog)					  
+                      pcm_word_t *nvphlog,
+                      uint64_t nentries)
 {
 	pcm_word_t             tornbit;
 
 	phlog->nvmd = nvmd;
 	phlog->nvphlog = nvphlog;
+	phlog->nentries_mask = nentries - 1;
 	tornbit = LF_TORNBIT & phlog->nvmd->flags;
 	phlog->tornbit = tornbit;
 	phlog->buffer_count = 0;
@@ -219,20 +224,32 @@ m_phlog_tornbit_init (m_phlog_tornbit_t *phlog,
  */
 m_result_t
 m_phlog_tornbit_truncate_async(pcm_storeset_t *set, m_phlog_tornbit_t *phlog) 
+{
+	return m_phlog_tornbit_truncate_async_upto(set, phlog, phlog->read_index);
+}
+
+
+/**
+ * \brief Truncates the log up to the given index. 
+ *
+ * The index must lie between the current head and the read_index point.
+ */
+m_result_t
+m_phlog_tornbit_truncate_async_upto(pcm_storeset_t *set, m_phlog_tornbit_t *phlog, uint64_t index) 
 {
 	pcm_word_t        tornbit;
 
 	tornbit = LF_TORNBIT & phlog->nvmd->flags;
 	/*
-	 * If head is larger than the current read_index point, then the assignment
-	 * of read_index to the head will cause head to wrap around, thus the 
+	 * If head is larger than the index point, then the assignment
+	 * of index to the head will cause head to wrap around, thus the 
 	 * torn bit stored in the non-volatile metadata is flipped.
 	 */
-	if (phlog->head > phlog->read_index) {
+	if (phlog->head > index) {
 		tornbit = ~tornbit & TORN_MASK;
 	}
 
-	phlog->head = phlog->read_index;
+	phlog->head = index;
 
 	//FIXME: do we need a flush? PCM_NT_FLUSH(set);
 	PCM_NT_STORE(set, (volatile pcm_word_t *) &phlog->nvmd->flags, (pcm_word_t) (phlog->head | tornbit));
@@ -0,0 +1,252 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Serves the registered statistics reports on a Unix socket.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <list.h>
+#include "statsrv.h"
+
+/*! A registered report, part of theStatsReports. */
+struct statsrv_provider
+{
+	const char         *name;
+	m_statsrv_report_t report;
+	struct list_head   list;
+};
+typedef struct statsrv_provider statsrv_provider_t;
+
+static LIST_HEAD(theStatsReports);
+static pthread_mutex_t  providers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec  start_time;
+static int              listen_fd = -1;
+static char             *socket_path;
+static pthread_t        server_thread;
+
+
+/**
+ * \brief Adds a report to those written by m_statsrv_report.
+ *
+ * May be called before or after the endpoint is started.
+ */
+void
+m_statsrv_register(const char *name, m_statsrv_report_t report)
+{
+	statsrv_provider_t *provider;
+
+	if ((provider = (statsrv_provider_t *) malloc(sizeof(*provider))) == NULL) {
+		return;
+	}
+	provider->name = name;
+	provider->report = report;
+	pthread_mutex_lock(&providers_lock);
+	list_add_tail(&provider->list, &theStatsReports);
+	pthread_mutex_unlock(&providers_lock);
+}
+
+
+/**
+ * \brief Writes the reports of all registered components.
+ */
+void
+m_statsrv_report(FILE *fout)
+{
+	statsrv_provider_t *provider;
+	struct timespec    now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(fout, "mnemosyne_pid %d\n", (int) getpid());
+	fprintf(fout, "mnemosyne_uptime_seconds %.6f\n", 
+	        (now.tv_sec - start_time.tv_sec) + (now.tv_nsec - start_time.tv_nsec) / 1e9);
+	pthread_mutex_lock(&providers_lock);
+	list_for_each_entry(provider, &theStatsReports, list) {
+		fprintf(fout, "# %s\n", provider->name);
+		provider->report(fout);
+	}
+	pthread_mutex_unlock(&providers_lock);
+}
+
+
+/* Writes the whole report, without raising SIGPIPE if the reader has gone. */
+static void
+serve(int fd)
+{
+	FILE    *fout;
+	char    *buf = NULL;
+	size_t  len = 0;
+	size_t  off;
+	ssize_t n;
+
+	if ((fout = open_memstream(&buf, &len)) == NULL) {
+		return;
+	}
+	m_statsrv_report(fout);
+	fclose(fout);
+	for (off = 0; off < len; off += n) {
+		if ((n = send(fd, buf + off, len - off, MSG_NOSIGNAL)) <= 0) {
+			if (n < 0 && errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			break;
+		}
+	}
+	free(buf);
+}
+
+
+static void *
+server_loop(void *arg)
+{
+	int fd;
+
+	for (;;) {
+		if ((fd = accept(listen_fd, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break;
+		}
+		serve(fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+
+/* Returns 0 only if nothing listens on the socket at addr any more. */
+static int
+socket_is_stale(const struct sockaddr_un *addr)
+{
+	int fd;
+	int rv;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		return -1;
+	}
+	if (connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) == 0) {
+		rv = -1;
+	} else {
+		rv = (errno == ECONNREFUSED) ? 0 : -1;
+	}
+	close(fd);
+	return rv;
+}
+
+
+/**
+ * \brief Starts answering connections to a Unix socket at path.
+ *
+ * Only the owner of the process may connect. An empty path starts no 
+ * endpoint, though m_statsrv_report still works. A socket left at path
+ * by a process that has exited is replaced; one that is still served is
+ * left alone and the endpoint is not started.
+ *
+ * \return 0 on success, -1 if the socket cannot be set up
+ */
+int
+m_statsrv_init(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat        st;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	if (path == NULL || path[0] == '\0' || listen_fd >= 0) {
+		return 0;
+	}
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		return -1;
+	}
+	/* 
+	 * A socket left behind by an earlier run, but nothing else. A socket 
+	 * that still accepts connections belongs to a live process. 
+	 */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		if (socket_is_stale(&addr) != 0) {
+			close(listen_fd);
+			listen_fd = -1;
+			return -1;
+		}
+		unlink(path);
+	}
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	if (chmod(path, 0600) != 0 ||
+	    listen(listen_fd, 8) != 0 ||
+	    pthread_create(&server_thread, NULL, server_loop, NULL) != 0)
+	{
+		close(listen_fd);
+		listen_fd = -1;
+		unlink(path);
+		return -1;
+	}
+	socket_path = strdup(path);
+	return 0;
+}
+
+
+void
+m_statsrv_fini(void)
+{
+	if (listen_fd < 0) {
+		return;
+	}
+	/* wakes up the server thread blocked in accept */
+	shutdown(listen_fd, SHUT_RDWR);
+	pthread_join(server_thread, NULL);
+	close(listen_fd);
+	listen_fd = -1;
+	unlink(socket_path);
+	free(socket_path);
+	socket_path = NULL;
+}
@@ -69,7 +69,7 @@ cm_conflict(mtm_tx_t *tx, volatile mtm_word_t *lock, mtm_word_t *l)
 	if (tx->retries >= cm_threshold) {
 		if (LOCK_GET_PRIORITY(*l) < tx->priority ||
 			(LOCK_GET_PRIORITY(*l) == tx->priority &&
-			*l < (mtm_word_t)modedata->w_set.entries
+			*l < (mtm_word_t)modedata->w_set.chunk[0]
 			&& !LOCK_GET_WAIT(*l))) 
 		{
 			/* We have higher priority */
@@ -81,10 +81,10 @@ cm_conflict(mtm_tx_t *tx, volatile mtm_word_t *lock, mtm_word_t *l)
 		/* Wait until lock is free or another transaction waits for one of our locks */
 		while (1) {
 			int        nb;
+			int        c;
 			mtm_word_t lw;
 
-			w = modedata->w_set.entries;
-			for (nb = modedata->w_set.nb_entries; nb > 0; nb--, w++) {
+			for (w = mtm_ws_first(modedata, &c), nb = modedata->w_set.nb_entries; nb > 0; nb--, w = mtm_ws_next(modedata, w, &c)) {
 				lw = ATOMIC_LOAD(w->lock);
 				if (LOCK_GET_WAIT(lw)) {
 					/* Another transaction waits for one of our locks */
@@ -38,8 +38,9 @@
 
 #define FOREACH_RUNTIME_CONFIG_SETTING(ACTION, group, config, values)                        \
   ACTION(config, values, group, stats, bool, int, 0, CONFIG_NO_CHECK, 0)                     \
-  ACTION(config, values, group, force_mode, string, char *, "pwbetl", CONFIG_NO_CHECK, 0)     \
-  ACTION(config, values, group, stats_file, string, char *, "mtm.stats", CONFIG_NO_CHECK, 0)
+  ACTION(config, values, group, force_mode, string, const char *, "pwbetl", CONFIG_NO_CHECK, 0) \
+  ACTION(config, values, group, stats_file, string, const char *, "mtm.stats", CONFIG_NO_CHECK, 0) \
+  ACTION(config, values, group, wset_keep_chunks, int, int, 4, CONFIG_RANGE_CHECK, 1, 32)
 
 
 typedef CONFIG_GROUP_STRUCT(mtm) mtm_config_t;
@@ -62,6 +62,56 @@
 #ifndef _RWSET_H
 #define _RWSET_H
 
+#define R_SET_BLOOM_BITS       (R_SET_BLOOM_WORDS * sizeof(mtm_word_t) * 8)
+
+/*
+ * Read set Bloom filter. Each lock read sets two bits picked from a single 
+ * multiplicative hash of the lock address, so that looking up a stripe that 
+ * was never read normally costs two bit tests instead of a read set scan.
+ */
+static inline
+mtm_word_t
+mtm_bloom_hash(volatile mtm_word_t *lock)
+{
+	return ((mtm_word_t) lock >> 3) * 0x9E3779B97F4A7C15LLU;
+}
+
+#define MTM_BLOOM_BIT(h, n)    (((h) >> (64 - 16 * (n))) & (R_SET_BLOOM_BITS - 1))
+#define MTM_BLOOM_WORD(b)      ((b) / (sizeof(mtm_word_t) * 8))
+#define MTM_BLOOM_MASK(b)      ((mtm_word_t) 1 << ((b) % (sizeof(mtm_word_t) * 8)))
+
+static inline
+void
+mtm_bloom_add(mode_data_t *modedata, volatile mtm_word_t *lock)
+{
+	mtm_word_t h = mtm_bloom_hash(lock);
+	mtm_word_t b1 = MTM_BLOOM_BIT(h, 1);
+	mtm_word_t b2 = MTM_BLOOM_BIT(h, 2);
+
+	modedata->r_set.bloom[MTM_BLOOM_WORD(b1)] |= MTM_BLOOM_MASK(b1);
+	modedata->r_set.bloom[MTM_BLOOM_WORD(b2)] |= MTM_BLOOM_MASK(b2);
+}
+
+static inline
+int
+mtm_bloom_may_contain(mode_data_t *modedata, volatile mtm_word_t *lock)
+{
+	mtm_word_t h = mtm_bloom_hash(lock);
+	mtm_word_t b1 = MTM_BLOOM_BIT(h, 1);
+	mtm_word_t b2 = MTM_BLOOM_BIT(h, 2);
+
+	return (modedata->r_set.bloom[MTM_BLOOM_WORD(b1)] & MTM_BLOOM_MASK(b1)) &&
+	       (modedata->r_set.bloom[MTM_BLOOM_WORD(b2)] & MTM_BLOOM_MASK(b2));
+}
+
+static inline
+void
+mtm_bloom_clear(mode_data_t *modedata)
+{
+	memset(modedata->r_set.bloom, 0, sizeof(modedata->r_set.bloom));
+}
+
+
 /*
  * Check if stripe has been read previously.
  */
@@ -78,11 +128,15 @@ mtm_has_read(mtm_tx_t *tx, mode_data_t *modedata, volatile mtm_word_t *lock)
 	/* Check status */
 	assert(tx->status == TX_ACTIVE);
 
-	/* Look for read */
-	r = modedata->r_set.entries;
-	for (i = modedata->r_set.nb_entries; i > 0; i--, r++) {
+	/* Filter out stripes never read */
+	if (!mtm_bloom_may_contain(modedata, lock)) {
+		return NULL;
+	}
+
+	/* Look for read (most recent first: repeated reads tend to be close) */
+	r = modedata->r_set.entries + modedata->r_set.nb_entries - 1;
+	for (i = modedata->r_set.nb_entries; i > 0; i--, r--) {
 		if (r->lock == lock) {
-			/* Return first match*/
 			return r;
 		}
 	}
@@ -90,6 +144,24 @@ mtm_has_read(mtm_tx_t *tx, mode_data_t *modedata, volatile mtm_word_t *lock)
 }
 
 
+/*
+ * Check if w is an entry of the write set (avoids non-faulting load).
+ */
+static inline 
+int 
+mtm_ws_contains(mode_data_t *data, w_entry_t *w)
+{
+	int i;
+
+	for (i = 0; i < data->w_set.cur_chunk; i++) {
+		if (data->w_set.chunk[i] <= w && w < data->w_set.chunk[i] + W_SET_CHUNK_SIZE(i)) {
+			return 1;
+		}
+	}
+	return data->w_set.chunk[i] <= w && w < data->w_set.next_free;
+}
+
+
 /*
  * Validate read set (check if all read addresses are still valid now).
  */
@@ -120,8 +192,7 @@ mtm_validate(mtm_tx_t *tx, mode_data_t *modedata)
 #else /* DESIGN != WRITE_THROUGH */
 			w_entry_t *w = (w_entry_t *)LOCK_GET_ADDR(l);
 			/* Simply check if address falls inside our write set (avoids non-faulting load) */
-			if (!(modedata->w_set.entries <= w && 
-			    w < modedata->w_set.entries + modedata->w_set.nb_entries))
+			if (!mtm_ws_contains(modedata, w))
 #endif /* DESIGN != WRITE_THROUGH */
 			{
 				/* Locked by another transaction: cannot validate */
@@ -174,55 +245,149 @@ mtm_allocate_rs_entries(mtm_tx_t *tx, mode_data_t *data, int extend)
 
 
 /*
- * (Re)allocate write set entries.
+ * Allocate write set chunk i.
  */
 static inline 
 void 
-mtm_allocate_ws_entries(mtm_tx_t *tx, mode_data_t *data, int extend)
+mtm_allocate_ws_chunk(mtm_tx_t *tx, mode_data_t *data, int i)
 {
+	w_entry_t *chunk;
+	size_t    size = W_SET_CHUNK_SIZE(i) * sizeof(w_entry_t);
 #if defined(READ_LOCKED_DATA) || defined(CONFLICT_TRACKING)
-	int i;
-	int first = (extend ? data->w_set.size : 0);
+	long      j;
 #endif /* defined(READ_LOCKED_DATA) || defined(CONFLICT_TRACKING) */
 
-	if (extend) {
-		/* Extend write set */
-		data->w_set.size *= 2;
-		PRINT_DEBUG("==> reallocate write set (%p[%lu-%lu],%d)\n", tx, 
-		            (unsigned long)data->start, (unsigned long)data->end, data->w_set.size);
-		if ((data->w_set.entries = 
-		     (w_entry_t *)realloc(data->w_set.entries, 
-		                          data->w_set.size * sizeof(w_entry_t))) == NULL) 
-		{
-			perror("realloc");
-			exit(1);
-		}
-	} else {
-		/* Allocate write set */
+	if (i >= W_SET_MAX_CHUNKS) {
+		fprintf(stderr, "Error: write set exceeds %ld entries\n", 
+		        W_SET_CHUNK_SIZE(W_SET_MAX_CHUNKS) - RW_SET_SIZE);
+		exit(1);
+	}
+	PRINT_DEBUG("==> allocate write set chunk (%p[%lu-%lu],%d)\n", tx, 
+	            (unsigned long)data->start, (unsigned long)data->end, i);
 #if ALIGNMENT == 1 /* no alignment requirement */
-		if ((data->w_set.entries = 
-		     (w_entry_t *)malloc(data->w_set.size * sizeof(w_entry_t))) == NULL)
-		{
-			perror("malloc");
-			exit(1);
-		}
+	if ((chunk = (w_entry_t *)malloc(size)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
 #else
-		if (posix_memalign((void **)&data->w_set.entries, 
-		                   ALIGNMENT, 
-		                   data->w_set.size * sizeof(w_entry_t)) != 0) 
-		{
-			fprintf(stderr, "Error: cannot allocate aligned memory\n");
-			exit(1);
-		}
-#endif
+	if (posix_memalign((void **)&chunk, ALIGNMENT, size) != 0) {
+		fprintf(stderr, "Error: cannot allocate aligned memory\n");
+		exit(1);
 	}
+#endif
 
 #if defined(READ_LOCKED_DATA) || defined(CONFLICT_TRACKING)
 	/* Initialize fields */
-	for (i = first; i < data->w_set.size; i++) {
-		data->w_set.entries[i].tx = tx;
+	for (j = 0; j < W_SET_CHUNK_SIZE(i); j++) {
+		chunk[j].tx = tx;
 	}	
 #endif /* defined(READ_LOCKED_DATA) || defined(CONFLICT_TRACKING) */
+
+	data->w_set.chunk[i] = chunk;
+	data->w_set.nb_chunks = i + 1;
+	data->w_set.size += W_SET_CHUNK_SIZE(i);
+}
+
+
+/*
+ * Free write set chunks from chunk i on.
+ */
+static inline 
+void 
+mtm_free_ws_chunks(mode_data_t *data, int i)
+{
+#ifdef EPOCH_GC
+	mtm_word_t t = GET_CLOCK;
+#endif /* EPOCH_GC */
+
+	for (; data->w_set.nb_chunks > i; data->w_set.nb_chunks--) {
+		data->w_set.size -= W_SET_CHUNK_SIZE(data->w_set.nb_chunks - 1);
+#ifdef EPOCH_GC
+		gc_free(data->w_set.chunk[data->w_set.nb_chunks - 1], t);
+#else /* ! EPOCH_GC */
+		free(data->w_set.chunk[data->w_set.nb_chunks - 1]);
+#endif /* ! EPOCH_GC */
+	}
+}
+
+
+/*
+ * Empty the write set, keeping at most keep_chunks chunks allocated.
+ */
+static inline 
+void 
+mtm_reset_ws_entries(mode_data_t *data, int keep_chunks)
+{
+	if (keep_chunks < 1) {
+		keep_chunks = 1;
+	}
+	mtm_free_ws_chunks(data, keep_chunks);
+	data->w_set.cur_chunk = 0;
+	data->w_set.next_free = data->w_set.chunk[0];
+	data->w_set.chunk_end = data->w_set.chunk[0] + W_SET_CHUNK_SIZE(0);
+	data->w_set.nb_entries = 0;
+}
+
+
+/*
+ * Allocate the write set.
+ */
+static inline 
+void 
+mtm_allocate_ws_entries(mtm_tx_t *tx, mode_data_t *data)
+{
+	data->w_set.nb_chunks = 0;
+	data->w_set.size = 0;
+	mtm_allocate_ws_chunk(tx, data, 0);
+	mtm_reset_ws_entries(data, 1);
+}
+
+
+/*
+ * Return the entry the next write set insertion fills, moving on to the 
+ * next chunk when the current one is full. Entries already handed out are 
+ * never moved, so lock words may keep pointing to them.
+ */
+static inline 
+w_entry_t *
+mtm_ws_next_entry(mtm_tx_t *tx, mode_data_t *data)
+{
+	int i;
+
+	if (data->w_set.next_free == data->w_set.chunk_end) {
+		i = data->w_set.cur_chunk + 1;
+		if (i == data->w_set.nb_chunks) {
+			mtm_allocate_ws_chunk(tx, data, i);
+		}
+		data->w_set.cur_chunk = i;
+		data->w_set.next_free = data->w_set.chunk[i];
+		data->w_set.chunk_end = data->w_set.chunk[i] + W_SET_CHUNK_SIZE(i);
+	}
+	return data->w_set.next_free;
+}
+
+
+/*
+ * Iterate over the write set in insertion order: 
+ *
+ *   for (w = mtm_ws_first(data, &c), i = data->w_set.nb_entries; i > 0; i--, w = mtm_ws_next(data, w, &c))
+ */
+static inline 
+w_entry_t *
+mtm_ws_first(mode_data_t *data, int *c)
+{
+	*c = 0;
+	return data->w_set.chunk[0];
+}
+
+static inline 
+w_entry_t *
+mtm_ws_next(mode_data_t *data, w_entry_t *w, int *c)
+{
+	if (++w == data->w_set.chunk[*c] + W_SET_CHUNK_SIZE(*c) && *c < data->w_set.cur_chunk) {
+		w = data->w_set.chunk[++*c];
+	}
+	return w;
 }
 
 #endif
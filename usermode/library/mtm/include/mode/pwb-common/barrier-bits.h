@@ -60,8 +60,8 @@
  *
  */
 
-#include <cm.h>
 #include <rwset.h>
+#include <cm.h>
 #include <mask.h>
 
 
@@ -143,6 +143,7 @@ w_entry_t* initialize_write_set_entry(w_entry_t* entry,
 	entry->version = version;
 	entry->next = NULL;
 	entry->next_cache_neighbor = NULL;
+	entry->tail = entry;
 	entry->is_nonvolatile = is_nonvolatile;
 	
 	return entry;
@@ -188,6 +189,7 @@ void insert_write_set_entry_after(w_entry_t* new_entry,
 	/* Update the total number of entries. */
 	mode_data_t* modedata = (mode_data_t *) transaction->modedata[transaction->mode];
 	modedata->w_set.nb_entries++;
+	modedata->w_set.next_free++;
 
 	/* Write the new entry to the persistent TM log as well? */
 	if (new_entry->is_nonvolatile) {
@@ -196,53 +198,6 @@ void insert_write_set_entry_after(w_entry_t* new_entry,
 }
 
 
-/*!
- * Searches a given linked list of write-set entries for a reference to the given address.
- *
- * \param list_head is the beginning of a singly-linked list of write-set entries
- *  which may or may not contain a reference to addr. This must not be NULL.
- * \param address is an address whose membership in the write-set is in question.
- * \param list_tail if the address in question is not found in the given write-set,
- *  this output parameter is set to the tail of the write-set to aid in the appending
- *  of a new entry. If the given parameter is NULL or a matching entry is located,
- *  this value is undefined.
- * \param last_cache_neighbor is written with the last entry discovered whose address
- *  would be stored in the same cache line. This may be useful if entries are flushed
- *  to persistent storage by cache line (instead of by word). This parameter may be NULL.
- *
- * \return NULL, if the address is not referenced in the write set. Otherwise, returns
- *  a pointer to the write-set entry that contained that address.
- */
-static inline
-w_entry_t *
-matching_write_set_entry(w_entry_t* const list_head,
-                         volatile mtm_word_t* address,
-                         w_entry_t** list_tail,
-                         w_entry_t** last_cache_neighbor)
-{
-	w_entry_t* this_entry = list_head;  // The entry examined in "this" iteration of the loop.
-	while (true) {
-		if (last_cache_neighbor != NULL  &&  BLOCK_ADDR(address) == BLOCK_ADDR(this_entry->addr))
-			*last_cache_neighbor = this_entry;
-		
-		if (address == this_entry->addr) {
-			// Found a matching entry!
-			return this_entry;
-		}
-		else if (this_entry->next == NULL) {
-			// EOL: Could not find a matching write-set entry.
-			if (list_tail != NULL) {
-				*list_tail = this_entry;
-			}
-			return NULL;
-		}
-		else {
-			this_entry = this_entry->next;
-		}
-	}
-}
-
-
 /**
  * \brief Store a masked value of size less than or equal to a word, creating or
  * updating a write-set entry as necessary.
@@ -283,7 +238,6 @@ pwb_write_internal(mtm_tx_t *tx,
 	mtm_word_t          l;
 	mtm_word_t          version;
 	w_entry_t           *w;
-	w_entry_t           *write_set_tail = NULL;
 	int                 ret;
 	int                 access_is_nonvolatile;
 
@@ -417,14 +371,11 @@ restart_no_load:
 		write_set_head = (w_entry_t *)LOCK_GET_ADDR(l);
 		
 		/* Simply check if address falls inside our write set (avoids non-faulting load) */
-		if (modedata->w_set.entries <= write_set_head &&
-		    write_set_head < modedata->w_set.entries + modedata->w_set.nb_entries) 
+		if (mtm_ws_contains(modedata, write_set_head)) 
 		{
 			/* The written address already hashes into our write set. */
 			/* Did we previously write the exact same address? */
-			w_entry_t* write_set_tail = NULL;
-			w_entry_t* last_entry_in_same_cache_block = NULL;
-			w_entry_t* matching_entry = matching_write_set_entry(write_set_head, addr, &write_set_tail, &last_entry_in_same_cache_block);
+			w_entry_t* matching_entry = pwb_windex_lookup(&modedata->w_set.index, WINDEX_WORD_KEY(addr));
 			if (matching_entry != NULL) {
 				if (matching_entry->mask != 0) {
 					mask_new_value(matching_entry, addr, value, mask);
@@ -435,38 +386,32 @@ restart_no_load:
 				}
 				return matching_entry;
 			} else {
-				if (modedata->w_set.nb_entries == modedata->w_set.size) {
-					/* Extend write set (invalidate pointers to write set entries => abort and reallocate) */
-					modedata->w_set.size *= 2;
-					modedata->w_set.reallocate = 1;
 #ifdef _M_STATS_BUILD
-					m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, aborts, 1);
-#endif					
-					#ifdef INTERNAL_STATS
-						tx->aborts_reallocate++;
-					#endif
-					
-					mtm_pwb_restart_transaction (tx, RESTART_REALLOCATE);  // Does not return!
+				m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, writes_distinct, 1);
+				if (access_is_nonvolatile) {
+					m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, nvwrites_distinct, 1);
 				} else {
-#ifdef _M_STATS_BUILD
-					m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, writes_distinct, 1);
-					if (access_is_nonvolatile) {
-						m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, nvwrites_distinct, 1);
-					} else {
-						m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, vwrites_distinct, 1);
-					}
+					m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, vwrites_distinct, 1);
+				}
 #endif					
-					// Build a new write set entry
-					w = &modedata->w_set.entries[modedata->w_set.nb_entries];
-					version = write_set_tail->version;  // Get version from previous write set entry (all
-					                                    // entries in linked list have same version)
-					w_entry_t* initialized_entry = initialize_write_set_entry(w, addr, value, mask, version, lock, access_is_nonvolatile);
-
-	
-					// Add entry to the write set
-					insert_write_set_entry_after(initialized_entry, write_set_tail, tx, last_entry_in_same_cache_block);					
-					return initialized_entry;
+				// Build a new write set entry
+				w = mtm_ws_next_entry(tx, modedata);
+				version = write_set_head->version;  // Get version from the head write set entry (all
+				                                    // entries in linked list have same version)
+				w_entry_t* initialized_entry = initialize_write_set_entry(w, addr, value, mask, version, lock, access_is_nonvolatile);
+
+				// The last entry written to the same cache block is chained to this lock
+				// unless another lock aliases the block.
+				w_entry_t* last_entry_in_same_cache_block = pwb_windex_lookup(&modedata->w_set.index, WINDEX_BLOCK_KEY(addr));
+				if (last_entry_in_same_cache_block != NULL && last_entry_in_same_cache_block->lock != lock) {
+					last_entry_in_same_cache_block = NULL;
 				}
+
+				// Add entry to the write set
+				insert_write_set_entry_after(initialized_entry, write_set_head->tail, tx, last_entry_in_same_cache_block);					
+				write_set_head->tail = initialized_entry;
+				pwb_windex_insert(&modedata->w_set.index, initialized_entry);
+				return initialized_entry;
 			}
 		}
 		/* If isolation is off and the pseudo-lock was set then we should have already 
@@ -517,19 +462,7 @@ restart_no_load:
 		}
 		
 		/* Acquire lock (ETL) */
-		if (modedata->w_set.nb_entries == modedata->w_set.size) {
-			/* Extend write set (invalidate pointers to write set entries => abort and reallocate) */
-			modedata->w_set.size *= 2;
-			modedata->w_set.reallocate = 1;
-#ifdef _M_STATS_BUILD
-			m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, aborts, 1);
-#endif					
-# ifdef INTERNAL_STATS
-			tx->aborts_reallocate++;
-# endif /* INTERNAL_STATS */
-			mtm_pwb_restart_transaction (tx, RESTART_REALLOCATE);
-		}
-	    w = &modedata->w_set.entries[modedata->w_set.nb_entries];
+		w = mtm_ws_next_entry(tx, modedata);
 		if (enable_isolation) {
 # ifdef READ_LOCKED_DATA
 			w->version = version;
@@ -555,7 +488,8 @@ restart_no_load:
 		}
 		
 		w_entry_t* initialized_entry = 	initialize_write_set_entry(w, addr, value, mask, version, lock, access_is_nonvolatile);
-		insert_write_set_entry_after(initialized_entry, write_set_tail, tx, NULL);					
+		insert_write_set_entry_after(initialized_entry, NULL, tx, NULL);					
+		pwb_windex_insert(&modedata->w_set.index, initialized_entry);
 #ifdef _M_STATS_BUILD
 		m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, writes_distinct, 1);
 		if (access_is_nonvolatile) {
@@ -607,6 +541,7 @@ pwb_load_internal(mtm_tx_t *tx, volatile mtm_word_t *addr, int enable_isolation)
 	     (uintptr_t) addr < (PSEGMENT_RESERVED_REGION_START + PSEGMENT_RESERVED_REGION_SIZE)))
 	{
 		/* Access is non-volatile */
+		PCM_RD_ACCESS(tx->pcm_storeset, addr);
 		/* Fall through */
 	} else {
 		/* Is it a stack access? */
@@ -667,24 +602,18 @@ restart_no_load:
     	/* Do we own the lock? */
 		w = (w_entry_t *)LOCK_GET_ADDR(l);
 		/* Simply check if address falls inside our write set (avoids non-faulting load) */
-		if (modedata->w_set.entries <= w && 
-		    w < modedata->w_set.entries + modedata->w_set.nb_entries)
+		if (mtm_ws_contains(modedata, w))
 		{
 			/* Yes: did we previously write the same address? */
-			while (1) {
-				if (addr == w->addr) {
-					/* Yes: get value from write set (or from memory if mask was empty) */
-					value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
-					MTM_DEBUG_PRINT("==> mtm_load[OWN LOCK|READ FROM WSET]");
-					break;
-				}
-				if (w->next == NULL) {
-					/* No: get value from memory */
-					value = ATOMIC_LOAD(addr);
-					MTM_DEBUG_PRINT("==> mtm_load[OWN LOCK|READ FROM MEMORY]");
-					break;
-				}
-				w = w->next;
+			w = pwb_windex_lookup(&modedata->w_set.index, WINDEX_WORD_KEY(addr));
+			if (w != NULL) {
+				/* Yes: get value from write set (or from memory if mask was empty) */
+				value = (w->mask == 0 ? ATOMIC_LOAD(addr) : w->value);
+				MTM_DEBUG_PRINT("==> mtm_load[OWN LOCK|READ FROM WSET]");
+			} else {
+				/* No: get value from memory */
+				value = ATOMIC_LOAD(addr);
+				MTM_DEBUG_PRINT("==> mtm_load[OWN LOCK|READ FROM MEMORY]");
 			}
 			/* No need to add to read set (will remain valid) */
 			MTM_DEBUG_PRINT("(t=%p[%lu-%lu],a=%p,l=%p,*l=%lu,d=%p-%lu)\n",
@@ -762,13 +691,21 @@ restart_no_load:
 
 	/* We have a good version: add to read set (update transactions) and return value */
 	if (enable_isolation) {
-		/* Add address and version to read set */
-		if (modedata->r_set.nb_entries == modedata->r_set.size) {
-			mtm_allocate_rs_entries(tx, modedata, 1);
+#ifdef NO_DUPLICATES_IN_RW_SETS
+		/* Stripe already read at this version? */
+		r = mtm_has_read(tx, modedata, lock);
+		if (r == NULL || r->version != version)
+#endif /* NO_DUPLICATES_IN_RW_SETS */
+		{
+			/* Add address and version to read set */
+			if (modedata->r_set.nb_entries == modedata->r_set.size) {
+				mtm_allocate_rs_entries(tx, modedata, 1);
+			}
+			r = &modedata->r_set.entries[modedata->r_set.nb_entries++];
+			r->version = version;
+			r->lock = lock;
+			mtm_bloom_add(modedata, lock);
 		}
-		r = &modedata->r_set.entries[modedata->r_set.nb_entries++];
-		r->version = version;
-		r->lock = lock;
 	}
 
 	MTM_DEBUG_PRINT("==> mtm_pwb_load(t=%p[%lu-%lu],a=%p,l=%p,*l=%lu,d=%p-%lu,v=%lu)\n",
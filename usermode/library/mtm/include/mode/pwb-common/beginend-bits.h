@@ -58,6 +58,7 @@
 #include <pwb_i.h>
 #include <rwset.h>
 #include <cm.h>
+#include "config.h"
 
 //#define PRINT_DEBUG printf
 //#define MTM_DEBUG_PRINT printf
@@ -72,7 +73,12 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 	mode_data_t *modedata = (mode_data_t *) tx->modedata[tx->mode];
 	w_entry_t   *w;
 	mtm_word_t  t;
+	int         t_exclusive;
 	int         i;
+	int         c;
+	uint64_t    tsc_flush;
+	uint64_t    tsc_wb;
+	uint64_t    tsc_end;
 #ifdef READ_LOCKED_DATA
 	mtm_word_t  id;
 #endif /* READ_LOCKED_DATA */
@@ -92,7 +98,7 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 		/* Update transaction */
 
 		/* Get commit timestamp */
-		t = FETCH_INC_CLOCK + 1;
+		t = mtm_clock_commit(&t_exclusive);
 		if (t >= VERSION_MAX) {
 #ifdef ROLLOVER_CLOCK
 			/* Abort: will reset the clock on next transaction start or delete */
@@ -109,9 +115,11 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 #endif /* ! ROLLOVER_CLOCK */
 		}
 
-		/* Try to validate (only if a concurrent transaction has committed since tx->start) */
+		/* Try to validate (only if a concurrent transaction has committed since 
+		 * the read set was last validated, i.e. since tx->start or the last 
+		 * extension of tx->end, or may share our timestamp) */
 		if (enable_isolation) {
-			if (modedata->start != t - 1 && !mtm_validate(tx, modedata)) {
+			if ((!t_exclusive || modedata->end != t - 1) && !mtm_validate(tx, modedata)) {
 				/* Cannot commit */
 				/* Abort caused by invisible reads. */
 				cm_visible_read(tx);
@@ -133,7 +141,9 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 # endif /* READ_LOCKED_DATA */
 
 		/* Make sure the persistent tm log is made stable */
+		tsc_flush = hrtime_cycles();
 		M_TMLOG_COMMIT(tx->pcm_storeset, modedata->ptmlog, t);
+		tsc_wb = hrtime_cycles();
 
 		/* Make sure previous stores are not reordered with the cl-flushes below  freud : unnecessary fence */
 		/* PCM_WB_FENCE(tx->pcm_storeset);  moved this info M_TMLOG_COMMIT. It replaces PCM_NT_FLUSH in m_tmlog_base_? */
@@ -141,9 +151,8 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 		/* Install new versions, drop locks and set new timestamp */
 		/* In the case when isolation is off, the write set contains entries 
 		 * that point to private pseudo-locks. */
-		w = modedata->w_set.entries;
 		int wbflush_cnt=0;
-		for (i = modedata->w_set.nb_entries; i > 0; i--, w++) {
+		for (w = mtm_ws_first(modedata, &c), i = modedata->w_set.nb_entries; i > 0; i--, w = mtm_ws_next(modedata, w, &c)) {
 			MTM_DEBUG_PRINT("==> write(t=%p[%lu-%lu],a=%p,d=%p-%d,m=%llx,v=%d)\n", tx,
 			                (unsigned long)modedata->start, (unsigned long)modedata->end,
 			                w->addr, (void *)w->value, (int)w->value, (unsigned long long) w->mask, (int)w->version);
@@ -164,12 +173,12 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 					if (((uintptr_t) w->addr >= PSEGMENT_RESERVED_REGION_START &&
 						 (uintptr_t) w->addr < (PSEGMENT_RESERVED_REGION_START + PSEGMENT_RESERVED_REGION_SIZE)))
 					{
-						/* access is persistent -- flush, freud : why flush individual entries ? */
-						PCM_WB_FLUSH(tx->pcm_storeset, w->addr);
+						/* access is persistent -- write back without waiting, drained below */
+						PCM_WB_FLUSH_ASYNC(tx->pcm_storeset, w->addr);
 						wbflush_cnt++;
 					}
 				} else {
-					PCM_WB_FLUSH(tx->pcm_storeset, w->addr);
+					PCM_WB_FLUSH_ASYNC(tx->pcm_storeset, w->addr);
 					wbflush_cnt++;
 				}
 			}	
@@ -179,7 +188,17 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 				ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
 			}	
 		}
+# ifdef	SYNC_TRUNCATION
+		/* A single fence completes all the write-backs issued above */
+		PCM_WB_DRAIN(tx->pcm_storeset);
+# else
 		PCM_WB_FENCE(tx->pcm_storeset);
+# endif
+		tsc_end = hrtime_cycles();
+		if (tx->lathist) {
+			m_lathist_record(&tx->lathist->hist[m_lathist_log_flush], tsc_wb - tsc_flush);
+			m_lathist_record(&tx->lathist->hist[m_lathist_write_back], tsc_end - tsc_wb);
+		}
 #ifdef _M_STATS_BUILD
 		m_stats_statset_increment(mtm_statsmgr, tx->statset, XACT, wbflush, wbflush_cnt);
 #endif		
@@ -192,13 +211,19 @@ pwb_trycommit (mtm_tx_t *tx, int enable_isolation)
 
 # ifdef	SYNC_TRUNCATION
 			M_TMLOG_TRUNCATE_SYNC(tx->pcm_storeset, modedata->ptmlog);
+			if (tx->lathist) {
+				m_lathist_record(&tx->lathist->hist[m_lathist_trunc_wait], hrtime_cycles() - tsc_end);
+			}
 # endif
 	}
 
 #ifdef _M_STATS_BUILD	
 	m_stats_threadstat_aggregate(tx->threadstat, tx->statset);
-	assert(m_stats_statset_destroy(&tx->statset) == M_R_SUCCESS);
 #endif	
+	if (tx->lathist) {
+		m_lathist_record(&tx->lathist->hist[m_lathist_commit], hrtime_cycles() - tx->begin_tsc);
+	}
+	tx->stat_commits++;
 
 	cm_reset(tx);
 	return true;
@@ -216,6 +241,7 @@ pwb_rollback(mtm_tx_t *tx)
 	mode_data_t   *modedata = (mode_data_t *) tx->modedata[tx->mode];
 	w_entry_t     *w;
 	int           i;
+	int           c;
 #ifdef READ_LOCKED_DATA
 	mtm_word_t    id;
 #endif /* READ_LOCKED_DATA */
@@ -242,8 +268,7 @@ pwb_rollback(mtm_tx_t *tx)
 		assert(id % 2 == 0);
 		ATOMIC_STORE_REL(&tx->id, id + 1);
 # endif /* READ_LOCKED_DATA */
-		w = modedata->w_set.entries;
-		for (; i > 0; i--, w++) {
+		for (w = mtm_ws_first(modedata, &c); i > 0; i--, w = mtm_ws_next(modedata, w, &c)) {
 			if (w->next == NULL) {
 				/* Only drop lock for last covered address in write set */
 				ATOMIC_STORE(w->lock, LOCK_SET_TIMESTAMP(w->version));
@@ -341,15 +366,12 @@ start:
 	}
 #endif /* ROLLOVER_CLOCK */
 	/* Read/write set */
-	
-	/* Because of the current state of the recoverable write-set block, reallocation is not
-	   possible. This program cannot be run until the recoverable blocks are
-	   somehow extendable. */
-	   //FIXME: What does the above comment mean?
-	assert(modedata->w_set.reallocate == 0);
-	
-	modedata->w_set.nb_entries = 0;
+	mtm_reset_ws_entries(modedata, mtm_runtime_settings.wset_keep_chunks);
+	if (modedata->r_set.nb_entries > 0) {
+		mtm_bloom_clear(modedata);
+	}
 	modedata->r_set.nb_entries = 0;
+	pwb_windex_clear(&modedata->w_set.index);
 	mtm_useraction_clear (tx->commit_action_list);
 	mtm_useraction_clear (tx->undo_action_list);
 
@@ -391,9 +413,11 @@ beginTransaction_internal (mtm_tx_t *tx,
 	/* Initialize transaction descriptor */
 	pwb_prepare_transaction(tx);
 
+	tx->begin_tsc = hrtime_cycles();
+
 #ifdef _M_STATS_BUILD	
-	assert(m_stats_statset_create(&tx->statset) == M_R_SUCCESS);
-	assert(m_stats_statset_init(tx->statset, NULL /*srcloc->psource*/) == M_R_SUCCESS);
+	/* The statset is allocated once per thread, see mtm_init_thread */
+	m_stats_statset_init(tx->statset, NULL /*srcloc->psource*/);
 #endif	
 
 	if ((prop & pr_doesGoIrrevocable) || !(prop & pr_instrumentedCode))
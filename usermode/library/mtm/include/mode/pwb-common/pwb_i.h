@@ -60,11 +60,15 @@ typedef struct mtm_pwb_r_entry_s      mtm_pwb_r_entry_t;
 typedef struct mtm_pwb_r_set_s        mtm_pwb_r_set_t;
 typedef struct mtm_pwb_w_entry_s      mtm_pwb_w_entry_t;
 typedef struct mtm_pwb_w_set_s        mtm_pwb_w_set_t;
+typedef struct mtm_pwb_w_index_slot_s mtm_pwb_w_index_slot_t;
+typedef struct mtm_pwb_w_index_s      mtm_pwb_w_index_t;
 typedef struct mtm_pwb_mode_data_s    mtm_pwb_mode_data_t;
 typedef struct mtm_pwb_r_entry_s      r_entry_t;
 typedef struct mtm_pwb_r_set_s        r_set_t;
 typedef struct mtm_pwb_w_entry_s      w_entry_t;
 typedef struct mtm_pwb_w_set_s        w_set_t;
+typedef struct mtm_pwb_w_index_slot_s w_index_slot_t;
+typedef struct mtm_pwb_w_index_s      w_index_t;
 typedef struct mtm_pwb_mode_data_s    mode_data_t;
 
 
@@ -76,11 +80,16 @@ struct mtm_pwb_r_entry_s {
 };
 
 
+/* Read set Bloom filter size (in words; must be a power of two) */
+#define R_SET_BLOOM_WORDS      16
+
+
 /* Read set */
 struct mtm_pwb_r_set_s {                  
   mtm_pwb_r_entry_t   *entries;         /* Array of entries */
   int                 nb_entries;       /* Number of entries */
   int                 size;             /* Size of array */
+  mtm_word_t          bloom[R_SET_BLOOM_WORDS]; /* Summary of the locks read */
 };
 
 
@@ -99,6 +108,7 @@ struct mtm_pwb_w_entry_s {
 #endif /* defined(CONFLICT_TRACKING) */
 			struct mtm_pwb_w_entry_s    *next;               /* Next address covered by same lock (if any) */
 			struct mtm_pwb_w_entry_s*   next_cache_neighbor; /* Next address covered by same lock and falls within the same cacheline. These entries can be written together with a single cache-line flush. */
+			struct mtm_pwb_w_entry_s    *tail;               /* Last address covered by same lock (valid in the entry the lock points to) */
 		};
 #if CM == CM_PRIORITY
 		mtm_word_t padding[12];                              /* Padding (must be a multiple of 32 bytes) */
@@ -107,12 +117,41 @@ struct mtm_pwb_w_entry_s {
 };
 
 
+/* Write set index slot */
+struct mtm_pwb_w_index_slot_s {
+	mtm_word_t                  key;      /* Tagged word or cacheline address (see wsetindex.h) */
+	struct mtm_pwb_w_entry_s    *entry;
+};
+
+
+/* Write set index */
+struct mtm_pwb_w_index_s {
+	mtm_pwb_w_index_slot_t      *slots;   /* Array of slots */
+	mtm_word_t                  mask;     /* Number of slots minus one */
+	int                         shift;    /* Hash shift producing a slot number */
+	mtm_word_t                  tag;      /* Tag of the current transaction */
+	mtm_word_t                  count;    /* Keys recorded by the current transaction */
+};
+
+
+/* 
+ * The write set is a chain of chunks which are never moved once allocated, 
+ * as lock words point to their entries. Chunk i holds W_SET_CHUNK_SIZE(i) 
+ * entries, so the write set doubles in capacity with every chunk added.
+ */
+#define W_SET_MAX_CHUNKS       32
+#define W_SET_CHUNK_SIZE(i)    ((long) RW_SET_SIZE << (i))
+
 /* Write set */
 struct mtm_pwb_w_set_s {             
-	mtm_pwb_w_entry_t *entries;           /* Array of entries */
+	mtm_pwb_w_entry_t *chunk[W_SET_MAX_CHUNKS]; /* Chunks of entries */
+	int               nb_chunks;          /* Number of chunks allocated */
+	int               cur_chunk;          /* Chunk receiving new entries */
+	mtm_pwb_w_entry_t *next_free;         /* Next entry to fill in the current chunk */
+	mtm_pwb_w_entry_t *chunk_end;         /* End of the current chunk */
 	int               nb_entries;         /* Number of entries */
-	int               size;               /* Size of array */
-	int               reallocate;         /* Reallocate on next start */
+	int               size;               /* Number of entries in all allocated chunks */
+	mtm_pwb_w_index_t index;              /* Index of entries by address */
 };
 
 
@@ -132,4 +171,6 @@ struct mtm_pwb_mode_data_s
 	M_TMLOG_T       *ptmlog;     /**< The persistent tm log; this is to avoid dereferencing ptmlog_dsc in the fast path */
 };
 
+#include "wsetindex.h"
+
 #endif /* _PWB_COMMON_INTERNAL_IOK811_H */
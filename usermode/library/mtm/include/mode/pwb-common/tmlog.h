@@ -35,5 +35,6 @@
 
 #include "tmlog_base.h"
 #include "tmlog_tornbit.h"
+#include "tmlog_compact.h"
 
 #endif
@@ -87,6 +87,9 @@ static inline
 m_result_t
 m_tmlog_base_begin(m_tmlog_base_t *tmlog)
 {
+# ifndef SYNC_TRUNCATION
+	PHLOG_BACKPRESSURE_ASYNCTRUNC(base, &(tmlog->phlog_base));
+# endif
 	return M_R_SUCCESS;
 }
 
@@ -148,6 +151,7 @@ m_result_t m_tmlog_base_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 m_result_t m_tmlog_base_recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 m_result_t m_tmlog_base_recovery_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 m_result_t m_tmlog_base_report_stats(m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_base_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats);
 
 
 #endif /* _TMLOG_BASE_H */
@@ -0,0 +1,264 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * \brief Compact tornbit log for persistent writeback transactions.
+ *
+ * Uses the same physical tornbit log as tmlog_tornbit but a denser record
+ * format. Consecutive writes to words of the same cacheline are coalesced 
+ * into a single run record, and the mask is omitted when every word of 
+ * the run is written in full, which is the common case.
+ *
+ * RECORD FORMAT:
+ *
+ * +---+-----------+---+-------------+-------------------------------+
+ * |b63| b62...b60 |b59| b58 ... b48 |          b47 ... b00          |
+ * +---+-----------+---+-------------+-------------------------------+
+ * | 1 | nwords-1  | M |  reserved   |      address of first word    |
+ * +---+-----------+---+-------------+-------------------------------+
+ *
+ * followed by nwords values when M is 0, or by nwords (value, mask) 
+ * pairs when M is 1. The header always has its most significant bit set 
+ * so it cannot be mistaken for a commit or abort marker.
+ *
+ * A run never crosses a cacheline boundary. User-space addresses on 
+ * x86-64 fit in 48 bits so the address and the run description fit in 
+ * one word.
+ */
+
+#ifndef _TMLOG_COMPACT_H
+#define _TMLOG_COMPACT_H
+
+#include <sys/mman.h>
+#include <mnemosyne.h>
+#include <log.h>
+#include <debug.h>
+#include "mtm_i.h"
+#include "tmlog_tornbit.h"
+
+enum {
+	LF_TYPE_TM_COMPACT = 4
+};
+
+#define COMPACT_RECORD_TAG          0x8000000000000000LLU
+#define COMPACT_RECORD_NWORDS_SHIFT 60
+#define COMPACT_RECORD_NWORDS_MASK  0x7LLU
+#define COMPACT_RECORD_MASKED       0x0800000000000000LLU
+#define COMPACT_RECORD_ADDR_MASK    0x0000FFFFFFFFFFFFLLU
+#define COMPACT_RUN_MAXWORDS        (CACHELINE_SIZE/sizeof(pcm_word_t))
+
+#define COMPACT_RECORD_HEADER(addr, nwords, masked)                            \
+  (COMPACT_RECORD_TAG |                                                        \
+   (((pcm_word_t) (nwords) - 1) << COMPACT_RECORD_NWORDS_SHIFT) |              \
+   ((masked) ? COMPACT_RECORD_MASKED : 0) |                                    \
+   ((pcm_word_t) (addr) & COMPACT_RECORD_ADDR_MASK))
+
+#define COMPACT_RECORD_IS_HEADER(word) (((word) & COMPACT_RECORD_TAG) != 0)
+#define COMPACT_RECORD_NWORDS(header)                                          \
+  ((((header) >> COMPACT_RECORD_NWORDS_SHIFT) & COMPACT_RECORD_NWORDS_MASK) + 1)
+#define COMPACT_RECORD_ADDR(header) ((header) & COMPACT_RECORD_ADDR_MASK)
+
+extern m_log_ops_t tmlog_compact_ops;
+
+typedef struct m_tmlog_compact_s m_tmlog_compact_t;
+
+typedef void compact_flush_set_t;
+
+/* Must ensure that phlog_tornbit is word aligned. */
+struct m_tmlog_compact_s {
+	m_phlog_tornbit_t   phlog_tornbit;
+	compact_flush_set_t *flush_set;
+	/* run being collected; not yet written to the log */
+	uintptr_t           run_addr;                             /**< address of the first word of the run */
+	uint64_t            run_nwords;                           /**< number of words in the run */
+	uint64_t            run_masked;                           /**< whether any word of the run is partially written */
+	pcm_word_t          run_value[COMPACT_RUN_MAXWORDS];
+	pcm_word_t          run_mask[COMPACT_RUN_MAXWORDS];
+	/* statistics */
+	uint64_t            stat_nwords_logged;                   /**< words written to the physical log */
+	uint64_t            stat_nwrites;                         /**< write-set entries logged */
+};
+
+
+#ifdef SYNC_TRUNCATION
+# define COMPACT_PHLOG_WRITE(set, phlog, val) PHLOG_WRITE(tornbit, set, phlog, val)
+# define COMPACT_PHLOG_FLUSH(set, phlog)      PHLOG_FLUSH(tornbit, set, phlog)
+#else
+# define COMPACT_PHLOG_WRITE(set, phlog, val) PHLOG_WRITE_ASYNCTRUNC(tornbit, set, phlog, val)
+# define COMPACT_PHLOG_FLUSH(set, phlog)      PHLOG_FLUSH_ASYNCTRUNC(tornbit, set, phlog)
+#endif
+
+
+/**
+ * \brief Writes the run collected so far to the physical log.
+ */
+static inline
+void
+m_tmlog_compact_write_run(pcm_storeset_t *set, m_tmlog_compact_t *tmlog)
+{
+	m_phlog_tornbit_t *phlog_tornbit = &(tmlog->phlog_tornbit);
+	uint64_t          i;
+
+	if (tmlog->run_nwords == 0) {
+		return;
+	}
+	COMPACT_PHLOG_WRITE(set, phlog_tornbit, 
+	                    COMPACT_RECORD_HEADER(tmlog->run_addr, tmlog->run_nwords, tmlog->run_masked));
+	for (i=0; i<tmlog->run_nwords; i++) {
+		COMPACT_PHLOG_WRITE(set, phlog_tornbit, tmlog->run_value[i]);
+		if (tmlog->run_masked) {
+			COMPACT_PHLOG_WRITE(set, phlog_tornbit, tmlog->run_mask[i]);
+		}
+	}
+	tmlog->stat_nwords_logged += 1 + tmlog->run_nwords * (tmlog->run_masked ? 2 : 1);
+	tmlog->run_nwords = 0;
+}
+
+
+static inline
+m_result_t
+m_tmlog_compact_write(pcm_storeset_t *set, m_tmlog_compact_t *tmlog, uintptr_t addr, pcm_word_t val, pcm_word_t mask)
+{
+	uint64_t index;
+
+	assert((addr & (sizeof(pcm_word_t)-1)) == 0);
+	assert((addr & ~COMPACT_RECORD_ADDR_MASK) == 0);
+
+	tmlog->stat_nwrites++;
+	if (tmlog->run_nwords > 0 && 
+	    BLOCK_ADDR(addr) == BLOCK_ADDR(tmlog->run_addr) &&
+	    addr >= tmlog->run_addr) 
+	{
+		index = (addr - tmlog->run_addr) / sizeof(pcm_word_t);
+		if (index < tmlog->run_nwords) {
+			/* 
+			 * Rewrite of a word already in the run. Write-set entries
+			 * accumulate the value and the mask so the newest ones
+			 * replace the old ones.
+			 */
+			tmlog->run_value[index] = val;
+			tmlog->run_mask[index] = mask;
+			tmlog->run_masked |= (mask != (pcm_word_t) -1);
+			return M_R_SUCCESS;
+		}
+		if (index == tmlog->run_nwords) {
+			tmlog->run_value[index] = val;
+			tmlog->run_mask[index] = mask;
+			tmlog->run_masked |= (mask != (pcm_word_t) -1);
+			tmlog->run_nwords++;
+			return M_R_SUCCESS;
+		}
+	}
+	m_tmlog_compact_write_run(set, tmlog);
+	tmlog->run_addr = addr;
+	tmlog->run_value[0] = val;
+	tmlog->run_mask[0] = mask;
+	tmlog->run_masked = (mask != (pcm_word_t) -1);
+	tmlog->run_nwords = 1;
+
+	return M_R_SUCCESS;
+}
+
+
+static inline
+m_result_t
+m_tmlog_compact_begin(m_tmlog_compact_t *tmlog)
+{
+	tmlog->run_nwords = 0;
+# ifndef SYNC_TRUNCATION
+	PHLOG_BACKPRESSURE_ASYNCTRUNC(tornbit, &(tmlog->phlog_tornbit));
+# endif
+	return M_R_SUCCESS;
+}
+
+
+static inline
+m_result_t
+m_tmlog_compact_commit(pcm_storeset_t *set, m_tmlog_compact_t *tmlog, uint64_t sqn)
+{
+	m_phlog_tornbit_t *phlog_tornbit = &(tmlog->phlog_tornbit);
+
+	m_tmlog_compact_write_run(set, tmlog);
+	COMPACT_PHLOG_WRITE(set, phlog_tornbit, (pcm_word_t) XACT_COMMIT_MARKER);
+	COMPACT_PHLOG_WRITE(set, phlog_tornbit, (pcm_word_t) sqn);
+	COMPACT_PHLOG_FLUSH(set, phlog_tornbit);
+	tmlog->stat_nwords_logged += 2;
+
+	return M_R_SUCCESS;
+}
+
+
+static inline
+m_result_t
+m_tmlog_compact_abort(pcm_storeset_t *set, m_tmlog_compact_t *tmlog, uint64_t sqn)
+{
+	m_phlog_tornbit_t *phlog_tornbit = &(tmlog->phlog_tornbit);
+
+	/* The pending run has not reached the log; simply drop it. */
+	tmlog->run_nwords = 0;
+	COMPACT_PHLOG_WRITE(set, phlog_tornbit, (pcm_word_t) XACT_ABORT_MARKER);
+	COMPACT_PHLOG_WRITE(set, phlog_tornbit, (pcm_word_t) sqn);
+	COMPACT_PHLOG_FLUSH(set, phlog_tornbit);
+
+	return M_R_SUCCESS;
+}
+
+
+static inline
+m_result_t
+m_tmlog_compact_truncate_sync(pcm_storeset_t *set, m_tmlog_compact_t *tmlog)
+{
+	m_phlog_tornbit_truncate_sync(set, &tmlog->phlog_tornbit);
+
+	return M_R_SUCCESS;
+}
+
+
+
+m_result_t m_tmlog_compact_alloc (m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_init (pcm_storeset_t *set, m_log_t *log, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_truncation_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_truncation_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_recovery_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_report_stats(m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_compact_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats);
+m_result_t m_tmlog_compact_truncation_flush(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t *dropposp);
+m_result_t m_tmlog_compact_truncation_drop(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t droppos);
+m_result_t m_tmlog_compact_recovery_decode(pcm_storeset_t *set, m_log_dsc_t *log_dsc, m_log_fragment_t **fragmentsp, uint64_t *nfragmentsp);
+
+
+#endif /* _TMLOG_COMPACT_H */
@@ -82,6 +82,9 @@ static inline
 m_result_t
 m_tmlog_tornbit_begin(m_tmlog_tornbit_t *tmlog)
 {
+# ifndef SYNC_TRUNCATION
+	PHLOG_BACKPRESSURE_ASYNCTRUNC(tornbit, &(tmlog->phlog_tornbit));
+# endif
 	return M_R_SUCCESS;
 }
 
@@ -145,6 +148,10 @@ m_result_t m_tmlog_tornbit_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_d
 m_result_t m_tmlog_tornbit_recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 m_result_t m_tmlog_tornbit_recovery_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc);
 m_result_t m_tmlog_tornbit_report_stats(m_log_dsc_t *log_dsc);
+m_result_t m_tmlog_tornbit_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats);
+m_result_t m_tmlog_tornbit_truncation_flush(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t *dropposp);
+m_result_t m_tmlog_tornbit_truncation_drop(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t droppos);
+m_result_t m_tmlog_tornbit_recovery_decode(pcm_storeset_t *set, m_log_dsc_t *log_dsc, m_log_fragment_t **fragmentsp, uint64_t *nfragmentsp);
 
 
 #endif /* _TMLOG_TORNBIT_H */
@@ -0,0 +1,203 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department,
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory,
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file wsetindex.h
+ *
+ * \brief Open-addressing index over the write set.
+ *
+ * Maps the address of each written word to its write-set entry, and the
+ * address of each written cacheline to the last entry written in it, so
+ * read-after-write lookups and cache-neighbor tracking do not have to walk
+ * the per-lock list of entries.
+ *
+ * Keys carry a tag of the owning transaction in their upper 16 bits, which
+ * user-space addresses never use. Bumping the tag at transaction start
+ * turns every slot stale, so the index is cleared in constant time. Slots
+ * are only zeroed when the tag wraps around. Entries are never removed
+ * during a transaction, so linear probing can stop at the first stale slot.
+ * The index doubles whenever it becomes half full, as the write set it 
+ * covers may grow without bound.
+ */
+
+#ifndef _PWB_COMMON_WSETINDEX_H
+#define _PWB_COMMON_WSETINDEX_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDEX_TAG_SHIFT        48
+#define WINDEX_TAG_ONE          ((mtm_word_t) 1 << WINDEX_TAG_SHIFT)
+#define WINDEX_TAG_MASK         (~(WINDEX_TAG_ONE - 1))
+#define WINDEX_LOAD_FACTOR      4       /* slots per write-set entry (two keys each) */
+
+/* Words are aligned so the lowest bit tells cacheline keys apart. */
+#define WINDEX_WORD_KEY(addr)   ((mtm_word_t) (addr))
+#define WINDEX_BLOCK_KEY(addr)  ((mtm_word_t) BLOCK_ADDR(addr) | 1)
+
+
+static inline
+mtm_word_t
+pwb_windex_hash(mtm_word_t key)
+{
+	return (key >> 3) * 0x9E3779B97F4A7C15LLU;
+}
+
+
+/*
+ * Allocate an index able to hold the records of nb_entries write-set entries.
+ */
+static inline
+void
+pwb_windex_create(w_index_t *index, int nb_entries)
+{
+	mtm_word_t nslots;
+
+	for (nslots = 1; nslots < (mtm_word_t) nb_entries * WINDEX_LOAD_FACTOR; nslots <<= 1);
+	if ((index->slots = (w_index_slot_t *) calloc(nslots, sizeof(w_index_slot_t))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	index->mask = nslots - 1;
+	index->shift = 64 - __builtin_ctzll(nslots);
+	index->tag = WINDEX_TAG_ONE;
+	index->count = 0;
+}
+
+
+static inline
+void
+pwb_windex_destroy(w_index_t *index)
+{
+	free(index->slots);
+	index->slots = NULL;
+}
+
+
+/*
+ * Forget all records.
+ */
+static inline
+void
+pwb_windex_clear(w_index_t *index)
+{
+	index->count = 0;
+	index->tag += WINDEX_TAG_ONE;
+	if (index->tag == 0) {
+		memset(index->slots, 0, (index->mask + 1) * sizeof(w_index_slot_t));
+		index->tag = WINDEX_TAG_ONE;
+	}
+}
+
+
+static inline
+w_entry_t *
+pwb_windex_lookup(w_index_t *index, mtm_word_t key)
+{
+	w_index_slot_t *slot;
+	mtm_word_t     i;
+
+	key |= index->tag;
+	for (i = pwb_windex_hash(key) >> index->shift; ; i = (i + 1) & index->mask) {
+		slot = &index->slots[i];
+		if (slot->key == key) {
+			return slot->entry;
+		}
+		if ((slot->key & WINDEX_TAG_MASK) != index->tag) {
+			return NULL;
+		}
+	}
+}
+
+
+/*
+ * Map key to entry, replacing any previous record of key.
+ */
+static inline
+void
+pwb_windex_put(w_index_t *index, mtm_word_t key, w_entry_t *entry)
+{
+	w_index_slot_t *slot;
+	mtm_word_t     i;
+
+	key |= index->tag;
+	for (i = pwb_windex_hash(key) >> index->shift; ; i = (i + 1) & index->mask) {
+		slot = &index->slots[i];
+		if (slot->key == key || (slot->key & WINDEX_TAG_MASK) != index->tag) {
+			if (slot->key != key) {
+				index->count++;
+			}
+			slot->key = key;
+			slot->entry = entry;
+			return;
+		}
+	}
+}
+
+
+/*
+ * Move the records of the current transaction to an index twice as large.
+ */
+static inline
+void
+pwb_windex_grow(w_index_t *index)
+{
+	w_index_t      old = *index;
+	w_index_slot_t *slot;
+
+	pwb_windex_create(index, (old.mask + 1) * 2 / WINDEX_LOAD_FACTOR);
+	index->tag = old.tag;
+	for (slot = old.slots; slot <= &old.slots[old.mask]; slot++) {
+		if ((slot->key & WINDEX_TAG_MASK) == old.tag) {
+			pwb_windex_put(index, slot->key & ~WINDEX_TAG_MASK, slot->entry);
+		}
+	}
+	pwb_windex_destroy(&old);
+}
+
+
+/*
+ * Record a new write-set entry: it becomes the entry of its word and the
+ * last entry of its cacheline.
+ */
+static inline
+void
+pwb_windex_insert(w_index_t *index, w_entry_t *entry)
+{
+	if ((index->count + 2) * 2 > index->mask + 1) {
+		pwb_windex_grow(index);
+	}
+	pwb_windex_put(index, WINDEX_WORD_KEY(entry->addr), entry);
+	pwb_windex_put(index, WINDEX_BLOCK_KEY(entry->addr), entry);
+}
+
+#endif /* _PWB_COMMON_WSETINDEX_H */
@@ -90,6 +90,7 @@ ACTION (name,__m256,M256)
 /* Persistent log type */
 #define TMLOG_TYPE_BASE    0
 #define TMLOG_TYPE_TORNBIT 1
+#define TMLOG_TYPE_COMPACT 2
 
 #if TMLOG_TYPE == TMLOG_TYPE_BASE
 # define M_TMLOG_WRITE          m_tmlog_base_write
@@ -109,6 +110,15 @@ ACTION (name,__m256,M256)
 # define M_TMLOG_T              m_tmlog_tornbit_t
 # define M_TMLOG_LF_TYPE        LF_TYPE_TM_TORNBIT
 # define M_TMLOG_OPS            tmlog_tornbit_ops
+#elif TMLOG_TYPE == TMLOG_TYPE_COMPACT
+# define M_TMLOG_WRITE          m_tmlog_compact_write
+# define M_TMLOG_TRUNCATE_SYNC  m_tmlog_compact_truncate_sync
+# define M_TMLOG_BEGIN          m_tmlog_compact_begin
+# define M_TMLOG_COMMIT         m_tmlog_compact_commit
+# define M_TMLOG_ABORT          m_tmlog_compact_abort
+# define M_TMLOG_T              m_tmlog_compact_t
+# define M_TMLOG_LF_TYPE        LF_TYPE_TM_COMPACT
+# define M_TMLOG_OPS            tmlog_compact_ops
 #else
 # error "Unknown persistent log type."
 #endif
@@ -154,6 +164,10 @@ struct mtm_tx *mtm_current_tx();
 #define CM_BACKOFF                      2
 #define CM_PRIORITY                     3
 
+#define CLOCK_TYPE_GLOBAL               0
+#define CLOCK_TYPE_GV4                  1
+#define CLOCK_TYPE_TSC                  2
+
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -228,6 +242,7 @@ extern int cm_threshold;
 #include "locks.h"
 #include "local.h"
 #include "stats.h"
+#include "lathist.h"
 
 /**
  * Size of a word (accessible atomically) on the target architecture.
@@ -309,6 +324,11 @@ struct mtm_tx_s {
 	pcm_storeset_t         *pcm_storeset;    /* PCM emulation bookkeeping structure */
 	m_stats_threadstat_t   *threadstat;      /* Thread statistics */
 	m_stats_statset_t      *statset;         /* Per transaction instance statistics */
+	m_lathist_set_t        *lathist;         /* Thread latency histograms; NULL if disabled */
+	uint64_t               begin_tsc;        /* Start time of the outermost transaction */
+	uint64_t               stat_commits;     /* Committed transactions; read by the stats endpoint */
+	uint64_t               stat_restarts[NUM_RESTARTS]; /* Restarts by reason; read by the stats endpoint */
+	struct mtm_tx_s        *stat_next;       /* Link in the list of threads reported by the stats endpoint */
 	mtm_user_action_list_t *commit_action_list;
 	mtm_user_action_list_t *undo_action_list;
 };
@@ -424,9 +444,65 @@ extern void *mtm_null_write_lock (mtm_tx_t *td, uintptr_t);
  * CLOCK
  * ################################################################### */
 
-#define GET_CLOCK                       (ATOMIC_LOAD_ACQ(&CLOCK))
+/*
+ * CLOCK_TYPE_GLOBAL: every update transaction increments the global clock.
+ *
+ * CLOCK_TYPE_GV4: a committer tries once to increment the global clock and, 
+ *   if another committer beat it, shares the timestamp that committer 
+ *   installed (TL2 "pass on failure"). Transactions sharing a timestamp hold
+ *   their write locks at the same time, so their write sets are disjoint.
+ *
+ * CLOCK_TYPE_TSC: timestamps are read from the invariant time-stamp counter,
+ *   which must be synchronized across sockets. Every write lock is acquired 
+ *   before the commit timestamp is read, and the read is fenced, so a 
+ *   transaction that starts later reads a timestamp no smaller than ours 
+ *   and finds either our locks or our new versions. The global clock is 
+ *   never written.
+ *
+ * Commit timestamps double as the order of transactions in the persistent
+ * logs; equal timestamps only ever order transactions with disjoint writes.
+ */
+#if CLOCK_TYPE == CLOCK_TYPE_TSC
+static inline mtm_word_t mtm_tsc_read(void)
+{
+	uint32_t lo, hi;
+
+	/* Do not read the counter before earlier loads and stores complete */
+	__asm__ __volatile__ ("mfence; lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) : : "memory");
+	return ((mtm_word_t) hi << 32) | lo;
+}
+
+# define GET_CLOCK                      (mtm_tsc_read())
+#else /* CLOCK_TYPE != CLOCK_TYPE_TSC */
+# define GET_CLOCK                      (ATOMIC_LOAD_ACQ(&CLOCK))
+#endif /* CLOCK_TYPE != CLOCK_TYPE_TSC */
 #define FETCH_INC_CLOCK                 (ATOMIC_FETCH_INC_FULL(&CLOCK))
 
+/*
+ * Get a commit timestamp. Sets *exclusive if no other transaction can 
+ * commit with the same timestamp.
+ */
+static inline mtm_word_t mtm_clock_commit(int *exclusive)
+{
+#if CLOCK_TYPE == CLOCK_TYPE_GV4
+	mtm_word_t t = ATOMIC_LOAD_ACQ(&CLOCK);
+
+	if (ATOMIC_CAS_FULL(&CLOCK, t, t + 1) != 0) {
+		*exclusive = 1;
+		return t + 1;
+	}
+	/* Someone else incremented the clock past t: share its timestamp */
+	*exclusive = 0;
+	return ATOMIC_LOAD_ACQ(&CLOCK);
+#elif CLOCK_TYPE == CLOCK_TYPE_TSC
+	*exclusive = 0;
+	return mtm_tsc_read();
+#else /* CLOCK_TYPE == CLOCK_TYPE_GLOBAL */
+	*exclusive = 1;
+	return FETCH_INC_CLOCK + 1;
+#endif /* CLOCK_TYPE == CLOCK_TYPE_GLOBAL */
+}
+
 
 /* ################################################################### *
  * STATIC
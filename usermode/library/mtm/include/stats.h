@@ -214,7 +214,7 @@ FOREACH_VOIDSTATPROBE (GENERATE_VOIDSTATPROBES)
                                             val);
 
 
-m_result_t m_statsmgr_create(m_statsmgr_t **statsmgrp, char *output_file);
+m_result_t m_statsmgr_create(m_statsmgr_t **statsmgrp, const char *output_file);
 m_result_t m_statsmgr_destroy(m_statsmgr_t **statsmgrp);
 m_result_t m_stats_threadstat_create(m_statsmgr_t *statsmgr, unsigned int tid, m_stats_threadstat_t **threadstatp);
 m_result_t m_stats_statset_create(m_stats_statset_t **statsetp);
@@ -43,7 +43,7 @@
 #include <setjmp.h>
 
 extern void* mtm_pmalloc(size_t);
-extern void* mtm_pmalloc_undo(size_t);
+extern void mtm_pmalloc_undo(void*);
 extern void* mtm_pcalloc (size_t, size_t);
 extern void mtm_pfree (void*);
 extern void mtm_pfree_prepare (void*);
@@ -489,7 +489,7 @@ void * _ITM_pcalloc(size_t nm, size_t size)
 
   mtm_tx_t *tx = mtm_get_tx();
   if(tx)
-	_ITM_addUserUndoAction(mtm_pfree, ptr);
+	_ITM_addUserUndoAction(mtm_pmalloc_undo, ptr);
 out:
   return ptr;
 }   
@@ -512,6 +512,39 @@ void * _ITM_prealloc (void * ptr, size_t sz)
 { return mtm_prealloc(ptr, sz); }
 */
 
+/*
+ * Copies size bytes from src into buf, a block just allocated by the 
+ * current transaction. The source is read through the transaction so
+ * that its own earlier writes are seen, but the destination is filled 
+ * with streaming stores fenced before returning instead of going through
+ * the write set: nobody else can see buf before commit, and if the 
+ * transaction aborts buf is released anyway.
+ */
+static void
+pcopy_to_new(void *buf, const void *src, size_t size)
+{
+	mtm_tx_t *tx = mtm_get_tx();
+	pcm_storeset_t *set = pcm_storeset_get();
+	volatile pcm_word_t *dst = (volatile pcm_word_t *) buf;
+	size_t nwords = size / sizeof(pcm_word_t);
+	size_t i;
+
+	PCM_SEQSTREAM_INIT(set);
+	for (i = 0; i < nwords; i++) {
+		pcm_word_t val = tx ? _ITM_RU8((const uint64_t *) src + i) : ((const uint64_t *) src)[i];
+		PCM_SEQSTREAM_STORE(set, &dst[i], val);
+	}
+	PCM_SEQSTREAM_FLUSH(set);
+	if (nwords * sizeof(pcm_word_t) < size) {
+		/* the trailing bytes share the cacheline of the word at dst[nwords] */
+		for (i = nwords * sizeof(pcm_word_t); i < size; i++) {
+			((uint8_t *) buf)[i] = tx ? _ITM_RU1((const uint8_t *) src + i) : ((const uint8_t *) src)[i];
+		}
+		PCM_WB_FLUSH(set, &dst[nwords]);
+		PCM_WB_FENCE(set);
+	}
+}
+
 _ITM_TRANSACTION_PURE
 void * _ITM_prealloc (void * ptr, size_t sz)
 {
@@ -527,8 +560,13 @@ void * _ITM_prealloc (void * ptr, size_t sz)
 		return ptr;
 
 	assert(obj_size < sz);
+	if (mtm_prealloc(ptr, sz))
+		return ptr;
+
 	void *buf = _ITM_pmalloc(sz);
-	_ITM_memcpyRtWt (buf, ptr, obj_size);
+	if (!buf)
+		return NULL;
+	pcopy_to_new(buf, ptr, obj_size);
 	_ITM_pfree(ptr);
 
 	return buf;
@@ -61,6 +61,7 @@
 #include "mode/pwb-common/tmlog.h"
 #include "sysdeps/x86/target.h"
 #include "stats.h"
+#include "statsrv.h"
 
 static pthread_mutex_t global_init_lock = PTHREAD_MUTEX_INITIALIZER;
 volatile uint32_t mtm_initialized = 0;
@@ -68,6 +69,62 @@ static int global_num=0;
 
 m_statsmgr_t *mtm_statsmgr;
 
+/* Threads reported by the stats endpoint, and the totals of exited ones */
+static pthread_mutex_t stat_txs_lock = PTHREAD_MUTEX_INITIALIZER;
+static mtm_tx_t        *stat_txs;
+static uint64_t        stat_exited_commits;
+static uint64_t        stat_exited_restarts[NUM_RESTARTS];
+
+static const char *restart_reason_names[NUM_RESTARTS] = {
+	"reallocate",
+	"locked_read",
+	"locked_write",
+	"validate_read",
+	"validate_write",
+	"validate_commit",
+	"not_readonly",
+	"user_retry"
+};
+
+
+static
+void
+stats_report_counters(FILE *fout, const char *thread, uint64_t commits, uint64_t *restarts)
+{
+	int r;
+
+	fprintf(fout, "mtm_commits_total{thread=\"%s\"} %llu\n", thread, 
+	        (unsigned long long) commits);
+	for (r=0; r<NUM_RESTARTS; r++) {
+		fprintf(fout, "mtm_restarts_total{thread=\"%s\",reason=\"%s\"} %llu\n", 
+		        thread, restart_reason_names[r], (unsigned long long) restarts[r]);
+	}
+}
+
+
+/*
+ * Reports commits and restarts by reason of each thread. The counters are
+ * written by their thread only and read here without synchronization.
+ */
+static
+void
+stats_report(FILE *fout)
+{
+	mtm_tx_t *tx;
+	char     thread[16];
+	int      nthreads = 0;
+
+	pthread_mutex_lock(&stat_txs_lock);
+	for (tx = stat_txs; tx != NULL; tx = tx->stat_next) {
+		snprintf(thread, sizeof(thread), "%d", tx->thread_num);
+		stats_report_counters(fout, thread, tx->stat_commits, tx->stat_restarts);
+		nthreads++;
+	}
+	stats_report_counters(fout, "exited", stat_exited_commits, stat_exited_restarts);
+	pthread_mutex_unlock(&stat_txs_lock);
+	fprintf(fout, "mtm_threads %d\n", nthreads);
+}
+
 
 /*
  * Catch signal (to emulate non-faulting load).
@@ -172,6 +229,8 @@ init_global()
 	/* Ask log manager to perform recovery on the new log type */
 	m_logmgr_do_recovery(pcm_storeset);
 
+	m_statsrv_register("mtm", stats_report);
+
 #ifdef _M_STATS_BUILD	
 	/* Create a statistics manager if need to dynamically profile */
 	if (1) {
@@ -397,7 +456,16 @@ mtm_init_thread(void)
 	tx->thread_num = __sync_add_and_fetch (&global_num, 1);
 #ifdef _M_STATS_BUILD	
 	m_stats_threadstat_create(mtm_statsmgr, tx->thread_num, &tx->threadstat);
+	m_stats_statset_create(&tx->statset);
 #endif
+	tx->lathist = m_lathist_thread_get();
+
+	tx->stat_commits = 0;
+	memset(tx->stat_restarts, 0, sizeof(tx->stat_restarts));
+	pthread_mutex_lock(&stat_txs_lock);
+	tx->stat_next = stat_txs;
+	stat_txs = tx;
+	pthread_mutex_unlock(&stat_txs_lock);
 
 	TX_RETURN;
 }
@@ -413,9 +481,20 @@ mtm_fini_thread(void)
 	mtm_word_t t;
 #endif /* EPOCH_GC */
 	mtm_tx_t *tx = mtm_get_tx();
+	mtm_tx_t **txp;
+	int      r;
 
 	PRINT_DEBUG("==> mtm_exit_thread(%p)\n", tx);
 
+	pthread_mutex_lock(&stat_txs_lock);
+	for (txp = &stat_txs; *txp != tx; txp = &(*txp)->stat_next);
+	*txp = tx->stat_next;
+	stat_exited_commits += tx->stat_commits;
+	for (r=0; r<NUM_RESTARTS; r++) {
+		stat_exited_restarts[r] += tx->stat_restarts[r];
+	}
+	pthread_mutex_unlock(&stat_txs_lock);
+
 #if 0
 	/* Callbacks */
 	if (nb_exit_cb != 0) {
@@ -438,6 +517,9 @@ mtm_fini_thread(void)
 #undef ACTION  
 
 	pcm_storeset_put();
+#ifdef _M_STATS_BUILD	
+	m_stats_statset_destroy(&tx->statset);
+#endif
 #ifdef EPOCH_GC
 	t = GET_CLOCK;
 	gc_free(tx, t);
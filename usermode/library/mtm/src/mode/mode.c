@@ -59,7 +59,7 @@ mtm_dtable_group_t *default_dtable_group = NULL;
 
 
 mtm_mode_t 
-mtm_str2mode(char *str)
+mtm_str2mode(const char *str)
 {
 	int i;
 	// freud : fprintf(stderr, "mode = %s\n",str);
@@ -48,6 +48,7 @@ mtm_pwb_restart_transaction (mtm_tx_t *tx, mtm_restart_reason r)
 		assert(0 && "Currently we don't support extending the read/write set size");
 	}
 
+	tx->stat_restarts[r]++;
 	rollback_transaction(tx);
 	cm_delay(tx);
 	/* TODO: decide whether to transition to a different execution mode 
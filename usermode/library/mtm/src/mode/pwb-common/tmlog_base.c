@@ -56,6 +56,10 @@ m_log_ops_t tmlog_base_ops = {
 	m_tmlog_base_recovery_prepare_next,
 	m_tmlog_base_recovery_do,
 	m_tmlog_base_report_stats,
+	NULL,
+	NULL,
+	NULL,
+	m_tmlog_base_get_stats,
 };
 
 /* Print debug messages */
@@ -99,10 +103,12 @@ m_tmlog_base_init(pcm_storeset_t *set, m_log_t *log, m_log_dsc_t *log_dsc)
 	m_phlog_base_format(set, 
 	                    (m_phlog_base_nvmd_t *) log_dsc->nvmd, 
 	                    log_dsc->nvphlog, 
+	                    log_dsc->nvphlog_nentries,
 	                    LF_TYPE_TM_BASE);
 	m_phlog_base_init(phlog_base, 
 	                  (m_phlog_base_nvmd_t *) log_dsc->nvmd, 
-	                  log_dsc->nvphlog);
+	                  log_dsc->nvphlog,
+	                  log_dsc->nvphlog_nentries);
 
 	return M_R_SUCCESS;
 }
@@ -155,6 +161,7 @@ retry:
 						}
 					}
 #endif					
+					PCM_WB_DRAIN(set);
 					m_phlog_base_truncate_async(set, &tmlog->phlog_base);
 					sqn = INV_LOG_ORDER;
 					goto retry;
@@ -170,7 +177,7 @@ retry:
 						                    (void *) 1);
 					}
 #else 					
-					PCM_WB_FLUSH(set, (volatile pcm_word_t *) block_addr);
+					PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
 #endif					
 				}
 			} else {
@@ -218,10 +225,12 @@ m_tmlog_base_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 		PointerHashRecord *r = PointerHashRecords_recordAt_(((PointerHash *) tmlog->flush_set)->records, i);
 		if (block_addr = (uintptr_t) r->k) {
 			PointerHash_removeKey_((PointerHash *) tmlog->flush_set, (void *) block_addr);
-			PCM_WB_FLUSH(set, (volatile pcm_word_t *) block_addr);
+			PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
 		}
 	}
 #endif	
+	/* Complete the write-backs before the log is truncated */
+	PCM_WB_DRAIN(set);
 	m_phlog_base_truncate_async(set, &tmlog->phlog_base);
 
 #ifdef _DEBUG_THIS
@@ -278,6 +287,7 @@ retry:
 					assert(m_phlog_base_read(&(tmlog->phlog_base), &sqn) == M_R_SUCCESS);
 					m_phlog_base_next_chunk(&tmlog->phlog_base);
 					/* Ignore an aborted transaction's log fragment */
+					PCM_WB_DRAIN(set);
 					m_phlog_base_truncate_async(set, &tmlog->phlog_base);
 					sqn = INV_LOG_ORDER;
 					goto retry;
@@ -305,7 +315,8 @@ m_tmlog_base_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 
 	m_phlog_base_init(&tmlog->phlog_base, 
 	                  (m_phlog_base_nvmd_t *) log_dsc->nvmd, 
-	                  log_dsc->nvphlog);
+	                  log_dsc->nvphlog,
+	                  log_dsc->nvphlog_nentries);
 	
 	recovery_prepare_next(set, log_dsc);
 
@@ -385,3 +396,17 @@ m_tmlog_base_report_stats(m_log_dsc_t *log_dsc)
 		printf("AVG(stat_wait_time_for_trunc): %llu\n", phlog->stat_wait_time_for_trunc / phlog->stat_wait_for_trunc);
 	}	
 }
+
+
+m_result_t 
+m_tmlog_base_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats)
+{
+	m_tmlog_base_t *tmlog = (m_tmlog_base_t *) log_dsc->log;
+	m_phlog_base_t *phlog = &(tmlog->phlog_base);
+
+	stats->fill = m_phlog_base_fill(phlog);
+	stats->size = phlog->nentries_mask + 1;
+	stats->wait_for_trunc = phlog->stat_wait_for_trunc;
+	stats->wait_time_for_trunc = phlog->stat_wait_time_for_trunc;
+	return M_R_SUCCESS;
+}
@@ -0,0 +1,508 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * \brief Implements the compact tornbit log for persistent writeback 
+ * transactions. See tmlog_compact.h for the record format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mnemosyne.h>
+#include <pcm.h>
+#include <cuckoo_hash/PointerHashInline.h>
+#include <debug.h>
+#include "tmlog_compact.h"
+
+m_log_ops_t tmlog_compact_ops = {
+	m_tmlog_compact_alloc,
+	m_tmlog_compact_init,
+	m_tmlog_compact_truncation_init,
+	m_tmlog_compact_truncation_prepare_next,
+	m_tmlog_compact_truncation_do,
+	m_tmlog_compact_recovery_init,
+	m_tmlog_compact_recovery_prepare_next,
+	m_tmlog_compact_recovery_do,
+	m_tmlog_compact_report_stats,
+	m_tmlog_compact_recovery_decode,
+	m_tmlog_compact_truncation_flush,
+	m_tmlog_compact_truncation_drop,
+	m_tmlog_compact_get_stats,
+};
+
+#define FLUSH_CACHELINE_ONCE
+
+
+/**
+ * \brief Reads the next record of a fragment.
+ *
+ * On return *headerp holds either a commit/abort marker, in which case 
+ * nothing else is read, or a run header, in which case the run's words 
+ * and masks are read into values and masks.
+ */
+static inline
+m_result_t
+read_record(m_phlog_tornbit_t *phlog, 
+            pcm_word_t *headerp, 
+            pcm_word_t *values, 
+            pcm_word_t *masks)
+{
+	pcm_word_t header;
+	uint64_t   nwords;
+	uint64_t   i;
+
+	if (m_phlog_tornbit_read(phlog, &header) != M_R_SUCCESS) {
+		return M_R_FAILURE;
+	}
+	*headerp = header;
+	if (!COMPACT_RECORD_IS_HEADER(header)) {
+		return M_R_SUCCESS;
+	}
+	nwords = COMPACT_RECORD_NWORDS(header);
+	for (i=0; i<nwords; i++) {
+		if (m_phlog_tornbit_read(phlog, &values[i]) != M_R_SUCCESS) {
+			return M_R_FAILURE;
+		}
+		if (header & COMPACT_RECORD_MASKED) {
+			if (m_phlog_tornbit_read(phlog, &masks[i]) != M_R_SUCCESS) {
+				return M_R_FAILURE;
+			}
+		} else {
+			masks[i] = (pcm_word_t) -1;
+		}
+	}
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_alloc(m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog_compact;
+
+	if (posix_memalign((void **) &tmlog_compact, sizeof(uint64_t), sizeof(m_tmlog_compact_t)) != 0) 
+	{
+		return M_R_FAILURE;
+	}
+	/* 
+	 * The underlying physical log volatile structure requires to be
+	 * word aligned.
+	 */
+	assert((( (uintptr_t) &tmlog_compact->phlog_tornbit) & (sizeof(uint64_t)-1)) == 0);
+	tmlog_compact->flush_set = (compact_flush_set_t *) PointerHash_new();
+	tmlog_compact->run_nwords = 0;
+	tmlog_compact->stat_nwords_logged = 0;
+	tmlog_compact->stat_nwrites = 0;
+	log_dsc->log = (m_log_t *) tmlog_compact;
+
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_init(pcm_storeset_t *set, m_log_t *log, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog_compact = (m_tmlog_compact_t *) log;
+	m_phlog_tornbit_t *phlog_tornbit = &(tmlog_compact->phlog_tornbit);
+
+	m_phlog_tornbit_format(set, 
+	                       (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
+	                       log_dsc->nvphlog, 
+	                       log_dsc->nvphlog_nentries,
+	                       LF_TYPE_TM_COMPACT);
+	m_phlog_tornbit_init(phlog_tornbit, 
+	                     (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
+	                     log_dsc->nvphlog,
+	                     log_dsc->nvphlog_nentries);
+	tmlog_compact->run_nwords = 0;
+
+	return M_R_SUCCESS;
+}
+
+
+static inline
+m_result_t 
+truncation_prepare(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	pcm_word_t        values[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        masks[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        header;
+	uint64_t          sqn = INV_LOG_ORDER;
+	uintptr_t         block_addr;
+
+	/*
+	 * Invariant: If there is a stable region to read from then there is at 
+	 * least one atomic log fragment which corresponds to one logical 
+	 * transaction. 
+	 */
+retry:	 
+	if (m_phlog_tornbit_stable_exists(&(tmlog->phlog_tornbit))) {
+		while(1) {
+			if (read_record(&(tmlog->phlog_tornbit), &header, values, masks) != M_R_SUCCESS) {
+				M_INTERNALERROR("Invariant violation: there must be at least one atomic log fragment.");
+			}
+			if (header == XACT_COMMIT_MARKER) {
+				assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+				m_phlog_tornbit_next_chunk(&tmlog->phlog_tornbit);
+				break;
+			} else if (header == XACT_ABORT_MARKER) {
+				/* 
+				 * Log fragment corresponds to an aborted transaction.
+				 * Drop it together with its sequence number and retry.
+				 * Waiting for the next committed fragment is not enough:
+				 * a writer restarting under backpressure may fill the 
+				 * log with aborted fragments only.
+				 */
+				assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+				m_phlog_tornbit_next_chunk(&tmlog->phlog_tornbit);
+				m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
+				sqn = INV_LOG_ORDER;
+				goto retry;
+			} else {
+				/* A run never crosses a cacheline. */
+				block_addr = (uintptr_t) BLOCK_ADDR(COMPACT_RECORD_ADDR(header));
+#ifdef FLUSH_CACHELINE_ONCE
+				if (!PointerHash_at_((PointerHash *) tmlog->flush_set, (void *) block_addr)) {
+					PointerHash_at_put_((PointerHash *) tmlog->flush_set, 
+					                    (void *) block_addr, 
+					                    (void *) 1);
+				}
+#else 					
+				PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
+#endif					
+			}	
+		}	
+	}
+	log_dsc->logorder = sqn;
+	
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_truncation_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	return truncation_prepare(set, log_dsc);
+}
+
+
+m_result_t 
+m_tmlog_compact_truncation_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	return truncation_prepare(set, log_dsc);
+}
+
+
+static inline
+void
+truncation_flush(pcm_storeset_t *set, m_tmlog_compact_t *tmlog)
+{
+#ifdef FLUSH_CACHELINE_ONCE
+	int               i;
+	uintptr_t         block_addr;
+
+	for(i = 0; i < ((PointerHash *) tmlog->flush_set)->size; i++) {
+		PointerHashRecord *r = PointerHashRecords_recordAt_(((PointerHash *) tmlog->flush_set)->records, i);
+		if ((block_addr = (uintptr_t) r->k)) {
+			PointerHash_removeKey_((PointerHash *) tmlog->flush_set, (void *) block_addr);
+			PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
+		}
+	}
+#endif	
+	/* Complete the write-backs before the log can be dropped */
+	PCM_WB_DRAIN(set);
+}
+
+
+m_result_t 
+m_tmlog_compact_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+
+	truncation_flush(set, tmlog);
+	m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
+
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_truncation_flush(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t *dropposp)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+
+	truncation_flush(set, tmlog);
+	*dropposp = tmlog->phlog_tornbit.read_index;
+
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_truncation_drop(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t droppos)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+
+	return m_phlog_tornbit_truncate_async_upto(set, &tmlog->phlog_tornbit, droppos);
+}
+
+
+static inline
+m_result_t 
+recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	pcm_word_t        values[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        masks[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        header;
+	uint64_t          sqn = INV_LOG_ORDER;
+	uint64_t          readindex_checkpoint;
+
+	/*
+	 * Invariant: If there is a stable region to read from then there is at 
+	 * least one atomic log fragment which corresponds to one logical 
+	 * transaction. 
+	 */
+retry:	 
+	if (m_phlog_tornbit_stable_exists(&(tmlog->phlog_tornbit))) {
+		/* 
+		 * Checkpoint the readindex so that we can restore it after we find 
+		 * the transaction sequence number and be able to recover the 
+		 * transaction.
+		 */
+		assert(m_phlog_tornbit_checkpoint_readindex(&(tmlog->phlog_tornbit), &readindex_checkpoint) == M_R_SUCCESS);
+		while(1) {
+			if (read_record(&(tmlog->phlog_tornbit), &header, values, masks) != M_R_SUCCESS) {
+				M_INTERNALERROR("Invariant violation: there must be at least one atomic log fragment.");
+			}
+			if (header == XACT_COMMIT_MARKER) {
+				assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+				m_phlog_tornbit_restore_readindex(&(tmlog->phlog_tornbit), readindex_checkpoint);
+				break;
+			} else if (header == XACT_ABORT_MARKER) {
+				assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+				m_phlog_tornbit_next_chunk(&tmlog->phlog_tornbit);
+				/* Ignore an aborted transaction's log fragment */
+				m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
+				sqn = INV_LOG_ORDER;
+				goto retry;
+			}
+		}	
+	}
+	log_dsc->logorder = sqn;
+	
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+
+	m_phlog_tornbit_init(&tmlog->phlog_tornbit, 
+	                     (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
+	                     log_dsc->nvphlog,
+	                     log_dsc->nvphlog_nentries);
+	
+	m_phlog_tornbit_check_consistency((m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
+	                                  log_dsc->nvphlog, 
+	                                  log_dsc->nvphlog_nentries,
+	                                  &(tmlog->phlog_tornbit.stable_tail));
+	recovery_prepare_next(set, log_dsc);
+
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	return recovery_prepare_next(set, log_dsc);
+}
+
+
+m_result_t 
+m_tmlog_compact_recovery_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	pcm_word_t        values[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        masks[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        header;
+	uint64_t          sqn;
+	uintptr_t         addr;
+	uint64_t          nwords;
+	uint64_t          i;
+
+	/*
+	 * Invariant: If there is a stable region to read from then there is at 
+	 * least one atomic log fragment which corresponds to one logical 
+	 * transaction. 
+	 */
+	assert (m_phlog_tornbit_stable_exists(&(tmlog->phlog_tornbit))); 
+
+	while(1) {
+		if (read_record(&(tmlog->phlog_tornbit), &header, values, masks) != M_R_SUCCESS) {
+			M_INTERNALERROR("Invariant violation: there must be at least one atomic log fragment.");
+			return M_R_FAILURE;
+		}
+		if (header == XACT_COMMIT_MARKER) {
+			assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+			m_phlog_tornbit_next_chunk(&tmlog->phlog_tornbit);
+			/* Drop the recovered log fragment */
+			m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
+			break;
+		} else if (header == XACT_ABORT_MARKER) {
+			/* 
+			 * Recovery shouldn't be passed a log fragment corresponding to
+			 * an aborted transaction.
+			 */
+			M_INTERNALERROR("Trying to recover an aborted transaction!\n");
+		} else {
+			addr = COMPACT_RECORD_ADDR(header);
+			nwords = COMPACT_RECORD_NWORDS(header);
+			for (i=0; i<nwords; i++) {
+				if (masks[i] != 0) {
+					PCM_WB_STORE_ALIGNED_MASKED(set, 
+					                            (volatile pcm_word_t *) (addr + i*sizeof(pcm_word_t)), 
+					                            values[i], masks[i]);
+				}
+			}
+			/* A run never crosses a cacheline so one flush covers it. */
+			PCM_WB_FLUSH(set, (volatile pcm_word_t *) addr);
+		}	
+	}	
+
+	return M_R_SUCCESS;
+}
+
+
+/**
+ * \brief Decodes the stable region of the log into its atomic fragments.
+ *
+ * See m_tmlog_tornbit_recovery_decode.
+ */
+m_result_t 
+m_tmlog_compact_recovery_decode(pcm_storeset_t *set, 
+                                m_log_dsc_t *log_dsc, 
+                                m_log_fragment_t **fragmentsp, 
+                                uint64_t *nfragmentsp)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	m_phlog_tornbit_t *phlog = &(tmlog->phlog_tornbit);
+	m_log_fragment_t  *fragments = NULL;
+	m_log_fragment_t  *tmp;
+	m_log_fragment_t  fragment;
+	pcm_word_t        values[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        masks[COMPACT_RUN_MAXWORDS];
+	pcm_word_t        header;
+	uint64_t          nfragments = 0;
+	uint64_t          size = 0;
+	uint64_t          readindex_checkpoint;
+	uint64_t          sqn;
+
+	if (m_phlog_tornbit_checkpoint_readindex(phlog, &readindex_checkpoint) != M_R_SUCCESS) {
+		return M_R_FAILURE;
+	}
+	memset(&fragment, 0, sizeof(fragment));
+	while (m_phlog_tornbit_stable_exists(phlog)) {
+		if (read_record(phlog, &header, values, masks) != M_R_SUCCESS) {
+			break;
+		}
+		if (header == XACT_COMMIT_MARKER || header == XACT_ABORT_MARKER) {
+			if (m_phlog_tornbit_read(phlog, &sqn) != M_R_SUCCESS) {
+				break;
+			}
+			m_phlog_tornbit_next_chunk(phlog);
+			if (header == XACT_COMMIT_MARKER) {
+				if (nfragments == size) {
+					size = size ? 2*size : 64;
+					if (!(tmp = realloc(fragments, size * sizeof(m_log_fragment_t)))) {
+						free(fragments);
+						m_phlog_tornbit_restore_readindex(phlog, readindex_checkpoint);
+						return M_R_NOMEMORY;
+					}
+					fragments = tmp;
+				}
+				fragment.logorder = sqn;
+				fragments[nfragments++] = fragment;
+			}
+			memset(&fragment, 0, sizeof(fragment));
+		} else {
+			m_log_fragment_footprint_add(&fragment, COMPACT_RECORD_ADDR(header));
+		}
+	}
+	m_phlog_tornbit_restore_readindex(phlog, readindex_checkpoint);
+
+	*fragmentsp = fragments;
+	*nfragmentsp = nfragments;
+
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_report_stats(m_log_dsc_t *log_dsc)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	m_phlog_tornbit_t *phlog = &(tmlog->phlog_tornbit);
+
+	printf("PRINT COMPACT STATS\n");
+	printf("wait_for_trunc               : %llu\n", 
+	       (unsigned long long) phlog->stat_wait_for_trunc);
+	if (phlog->stat_wait_for_trunc > 0) {
+		printf("AVG(stat_wait_time_for_trunc): %llu\n", 
+		       (unsigned long long) (phlog->stat_wait_time_for_trunc / phlog->stat_wait_for_trunc));
+	}
+	printf("nwrites                      : %llu\n", (unsigned long long) tmlog->stat_nwrites);
+	printf("nwords_logged                : %llu\n", (unsigned long long) tmlog->stat_nwords_logged);
+	return M_R_SUCCESS;
+}
+
+
+m_result_t 
+m_tmlog_compact_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats)
+{
+	m_tmlog_compact_t *tmlog = (m_tmlog_compact_t *) log_dsc->log;
+	m_phlog_tornbit_t *phlog = &(tmlog->phlog_tornbit);
+
+	stats->fill = m_phlog_tornbit_fill(phlog);
+	stats->size = phlog->nentries_mask + 1;
+	stats->wait_for_trunc = phlog->stat_wait_for_trunc;
+	stats->wait_time_for_trunc = phlog->stat_wait_time_for_trunc;
+	return M_R_SUCCESS;
+}
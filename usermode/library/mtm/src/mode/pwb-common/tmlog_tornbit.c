@@ -39,6 +39,8 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <mnemosyne.h>
 #include <pcm.h>
@@ -56,6 +58,10 @@ m_log_ops_t tmlog_tornbit_ops = {
 	m_tmlog_tornbit_recovery_prepare_next,
 	m_tmlog_tornbit_recovery_do,
 	m_tmlog_tornbit_report_stats,
+	m_tmlog_tornbit_recovery_decode,
+	m_tmlog_tornbit_truncation_flush,
+	m_tmlog_tornbit_truncation_drop,
+	m_tmlog_tornbit_get_stats,
 };
 
 #define FLUSH_CACHELINE_ONCE
@@ -127,10 +133,12 @@ m_tmlog_tornbit_init(pcm_storeset_t *set, m_log_t *log, m_log_dsc_t *log_dsc)
 	m_phlog_tornbit_format(set, 
 	                       (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
 	                       log_dsc->nvphlog, 
+	                       log_dsc->nvphlog_nentries,
 	                       LF_TYPE_TM_TORNBIT);
 	m_phlog_tornbit_init(phlog_tornbit, 
 	                     (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
-	                     log_dsc->nvphlog);
+	                     log_dsc->nvphlog,
+	                     log_dsc->nvphlog_nentries);
 
 	return M_R_SUCCESS;
 }
@@ -170,8 +178,13 @@ retry:
 					/* 
 					 * Log fragment corresponds to an aborted transaction.
 					 * Ignore it, truncate the log up to here, and retry.
+					 * Its data never reached memory so there is nothing
+					 * to write back.
 					 */
-					//FIXME: truncate the log up to here
+					assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &sqn) == M_R_SUCCESS);
+					m_phlog_tornbit_next_chunk(&tmlog->phlog_tornbit);
+					m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
+					sqn = INV_LOG_ORDER;
 					goto retry;
 				} else {
 					assert(m_phlog_tornbit_read(&(tmlog->phlog_tornbit), &value) == M_R_SUCCESS);
@@ -190,7 +203,7 @@ retry:
 						                    (void *) 1);
 					}
 #else 					
-					PCM_WB_FLUSH(set, (volatile pcm_word_t *) block_addr);
+					PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
 #endif					
 				}	
 			} else {
@@ -220,28 +233,39 @@ m_tmlog_tornbit_truncation_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_ds
 }
 
 
-m_result_t 
-m_tmlog_tornbit_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+static inline
+void
+truncation_flush(pcm_storeset_t *set, m_tmlog_tornbit_t *tmlog)
 {
+#ifdef FLUSH_CACHELINE_ONCE
 	int               i;
-	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
 	uintptr_t         block_addr;
 
-#ifdef _DEBUG_THIS
-	printf("m_tmlog_tornbit_truncation_do: START\n");
-	_DEBUG_PRINT_TMLOG(tmlog)
-#endif
-
-#ifdef FLUSH_CACHELINE_ONCE
 	for(i = 0; i < ((PointerHash *) tmlog->flush_set)->size; i++) {
 		PointerHashRecord *r = PointerHashRecords_recordAt_(((PointerHash *) tmlog->flush_set)->records, i);
 		if (block_addr = (uintptr_t) r->k) {
 			//PointerHash_removeKey_noshrink((PointerHash *) tmlog->flush_set, (void *) block_addr);
 			PointerHash_removeKey_((PointerHash *) tmlog->flush_set, (void *) block_addr);
-			PCM_WB_FLUSH(set, (volatile pcm_word_t *) block_addr);
+			PCM_WB_FLUSH_ASYNC(set, (volatile pcm_word_t *) block_addr);
 		}
 	}
 #endif	
+	/* Complete the write-backs before the log can be dropped */
+	PCM_WB_DRAIN(set);
+}
+
+
+m_result_t 
+m_tmlog_tornbit_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
+{
+	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
+
+#ifdef _DEBUG_THIS
+	printf("m_tmlog_tornbit_truncation_do: START\n");
+	_DEBUG_PRINT_TMLOG(tmlog)
+#endif
+
+	truncation_flush(set, tmlog);
 	m_phlog_tornbit_truncate_async(set, &tmlog->phlog_tornbit);
 
 #ifdef _DEBUG_THIS
@@ -252,6 +276,37 @@ m_tmlog_tornbit_truncation_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 	return M_R_SUCCESS;
 }
 
+
+/**
+ * \brief Flushes the data of the prepared fragment without dropping it.
+ *
+ * Returns the position right after the fragment, which can later be
+ * passed to m_tmlog_tornbit_truncation_drop.
+ */
+m_result_t 
+m_tmlog_tornbit_truncation_flush(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t *dropposp)
+{
+	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
+
+	truncation_flush(set, tmlog);
+	*dropposp = tmlog->phlog_tornbit.read_index;
+
+	return M_R_SUCCESS;
+}
+
+
+/**
+ * \brief Drops all fragments up to a position returned by 
+ * m_tmlog_tornbit_truncation_flush.
+ */
+m_result_t 
+m_tmlog_tornbit_truncation_drop(pcm_storeset_t *set, m_log_dsc_t *log_dsc, uint64_t droppos)
+{
+	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
+
+	return m_phlog_tornbit_truncate_async_upto(set, &tmlog->phlog_tornbit, droppos);
+}
+
 static inline
 m_result_t 
 recovery_prepare_next(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
@@ -320,10 +375,12 @@ m_tmlog_tornbit_recovery_init(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 
 	m_phlog_tornbit_init(&tmlog->phlog_tornbit, 
 	                     (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
-	                     log_dsc->nvphlog);
+	                     log_dsc->nvphlog,
+	                     log_dsc->nvphlog_nentries);
 	
 	m_phlog_tornbit_check_consistency((m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
 	                                  log_dsc->nvphlog, 
+	                                  log_dsc->nvphlog_nentries,
 	                                  &(tmlog->phlog_tornbit.stable_tail));
 	recovery_prepare_next(set, log_dsc);
 
@@ -398,6 +455,81 @@ m_tmlog_tornbit_recovery_do(pcm_storeset_t *set, m_log_dsc_t *log_dsc)
 }
 
 
+/**
+ * \brief Decodes the stable region of the log into its atomic fragments.
+ *
+ * Must be called right after recovery_init. Walks every fragment without
+ * replaying it, recording its transaction sequence number and the 
+ * cachelines it writes, and then rewinds the read pointer so that 
+ * recovery_do starts from the first fragment again. Aborted fragments are
+ * skipped the same way recovery_prepare_next skips them.
+ */
+m_result_t 
+m_tmlog_tornbit_recovery_decode(pcm_storeset_t *set, 
+                                m_log_dsc_t *log_dsc, 
+                                m_log_fragment_t **fragmentsp, 
+                                uint64_t *nfragmentsp)
+{
+	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
+	m_phlog_tornbit_t *phlog = &(tmlog->phlog_tornbit);
+	m_log_fragment_t  *fragments = NULL;
+	m_log_fragment_t  *tmp;
+	m_log_fragment_t  fragment;
+	uint64_t          nfragments = 0;
+	uint64_t          size = 0;
+	uint64_t          readindex_checkpoint;
+	uint64_t          sqn;
+	uintptr_t         addr;
+	pcm_word_t        value;
+	pcm_word_t        mask;
+
+	if (m_phlog_tornbit_checkpoint_readindex(phlog, &readindex_checkpoint) != M_R_SUCCESS) {
+		return M_R_FAILURE;
+	}
+	memset(&fragment, 0, sizeof(fragment));
+	while (m_phlog_tornbit_stable_exists(phlog)) {
+		if (m_phlog_tornbit_read(phlog, &addr) != M_R_SUCCESS) {
+			break;
+		}
+		if (addr == XACT_COMMIT_MARKER || addr == XACT_ABORT_MARKER) {
+			if (m_phlog_tornbit_read(phlog, &sqn) != M_R_SUCCESS) {
+				break;
+			}
+			m_phlog_tornbit_next_chunk(phlog);
+			if (addr == XACT_COMMIT_MARKER) {
+				if (nfragments == size) {
+					size = size ? 2*size : 64;
+					if (!(tmp = realloc(fragments, size * sizeof(m_log_fragment_t)))) {
+						free(fragments);
+						m_phlog_tornbit_restore_readindex(phlog, readindex_checkpoint);
+						return M_R_NOMEMORY;
+					}
+					fragments = tmp;
+				}
+				fragment.logorder = sqn;
+				fragments[nfragments++] = fragment;
+			}
+			memset(&fragment, 0, sizeof(fragment));
+		} else {
+			if (m_phlog_tornbit_read(phlog, &value) != M_R_SUCCESS ||
+			    m_phlog_tornbit_read(phlog, &mask) != M_R_SUCCESS) 
+			{
+				break;
+			}
+			if (mask != 0) {
+				m_log_fragment_footprint_add(&fragment, addr);
+			}
+		}
+	}
+	m_phlog_tornbit_restore_readindex(phlog, readindex_checkpoint);
+
+	*fragmentsp = fragments;
+	*nfragmentsp = nfragments;
+
+	return M_R_SUCCESS;
+}
+
+
 m_result_t 
 m_tmlog_tornbit_report_stats(m_log_dsc_t *log_dsc)
 {
@@ -410,3 +542,17 @@ m_tmlog_tornbit_report_stats(m_log_dsc_t *log_dsc)
 		printf("AVG(stat_wait_time_for_trunc): %llu\n", phlog->stat_wait_time_for_trunc / phlog->stat_wait_for_trunc);
 	}
 }
+
+
+m_result_t 
+m_tmlog_tornbit_get_stats(m_log_dsc_t *log_dsc, m_log_stats_t *stats)
+{
+	m_tmlog_tornbit_t *tmlog = (m_tmlog_tornbit_t *) log_dsc->log;
+	m_phlog_tornbit_t *phlog = &(tmlog->phlog_tornbit);
+
+	stats->fill = m_phlog_tornbit_fill(phlog);
+	stats->size = phlog->nentries_mask + 1;
+	stats->wait_for_trunc = phlog->stat_wait_for_trunc;
+	stats->wait_time_for_trunc = phlog->stat_wait_time_for_trunc;
+	return M_R_SUCCESS;
+}
@@ -78,12 +78,11 @@ mtm_pwbetl_create(mtm_tx_t *tx, mtm_mode_data_t **datap)
 	data->r_set.nb_entries = 0;
 	data->r_set.size = RW_SET_SIZE;
 	mtm_allocate_rs_entries(tx, data, 0);
+	mtm_bloom_clear(data);
 
 	/* Volatile write set */
-	data->w_set.nb_entries = 0;
-	data->w_set.size = RW_SET_SIZE;
-	data->w_set.reallocate = 0;
-	mtm_allocate_ws_entries(tx, data, 0);
+	mtm_allocate_ws_entries(tx, data);
+	pwb_windex_create(&data->w_set.index, data->w_set.size);
 
 	/* Non-volatile log */
 #ifdef SYNC_TRUNCATION	
@@ -112,9 +111,9 @@ mtm_pwbetl_destroy(mtm_mode_data_t *_data)
 #ifdef EPOCH_GC
 	t = GET_CLOCK;
 	gc_free(data->r_set.entries, t);
-	gc_free(data->w_set.entries, t);
 #else /* ! EPOCH_GC */
 	free(data->r_set.entries);
-	free(data->w_set.entries);
 #endif /* ! EPOCH_GC */
+	mtm_free_ws_chunks(data, 0);
+	pwb_windex_destroy(&data->w_set.index);
 }
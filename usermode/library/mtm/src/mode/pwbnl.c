@@ -52,3 +52,15 @@ void _ITM_nl_store_bytes(const void *src, void *dest, size_t size)
     volatile uint8_t *daddr=((volatile uint8_t *) dest);
     mtm_pwbnl_store_bytes(tx, daddr, (uint8_t*) src, size);
 }
+
+/*
+ * Stores only the bits of value selected by mask into the aligned word at dest.
+ * Unlike _ITM_nl_store_bytes, bits outside the mask are left untouched at
+ * write-back, so concurrent non-isolated updates to disjoint bits of the same
+ * word (e.g. allocator bitmaps) are not lost.
+ */
+void _ITM_nl_store_masked(void *dest, uint64_t value, uint64_t mask)
+{
+    mtm_tx_t *tx = mtm_get_tx();
+    mtm_pwbnl_store2(tx, (volatile mtm_word_t *) dest, (mtm_word_t) value, (mtm_word_t) mask);
+}
@@ -74,7 +74,7 @@ struct m_stats_threadstat_s {
 /** Statistics manager */
 struct m_statsmgr_s {
 	m_mutex_t            mutex;                       /**< Serializes accesses to this structure */
-	char                 *output_file;
+	const char           *output_file;
 	unsigned int         alloc_threadstat_num;        /**< Number of threads collecting statistics for */
 	m_stats_threadstat_t *alloc_threadstat_list_head; /**< Head of the thread statistics list */
 	m_stats_threadstat_t *alloc_threadstat_list_tail; /**< Tail of the thread statistics list */
@@ -82,7 +82,7 @@ struct m_statsmgr_s {
 
 
 m_result_t
-m_statsmgr_create(m_statsmgr_t **statsmgrp, char *output_file)
+m_statsmgr_create(m_statsmgr_t **statsmgrp, const char *output_file)
 {
 	*statsmgrp = (m_statsmgr_t *) MALLOC(sizeof(m_statsmgr_t));
 	if (*statsmgrp == NULL) {
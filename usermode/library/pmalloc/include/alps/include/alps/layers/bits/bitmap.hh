@@ -19,20 +19,34 @@
 
 #include <stdint.h>
 
+/**
+ * @brief Persistent bitmap updated at 64-bit word granularity
+ *
+ * @details
+ * Bit i lives in bit (i % 64) of word (i / 64). On little-endian targets
+ * this is the same memory bit as the original byte-granular layout, so 
+ * existing heaps load unchanged.
+ *
+ * Single-bit updates are masked stores. Under a transaction the word is
+ * logged with the mask of the bit, and both write-back and log replay 
+ * merge the bit into the word with a compare-and-swap, so commits that 
+ * update different bits of the same word do not lose each other's 
+ * updates. Outside a transaction the bit is merged the same way.
+ */
 template<typename Context>
 struct nvBitMap {
-    static const int kEntrySizeLog2 = 3;
+    static const int kEntrySizeLog2 = 6;
     static const int kEntrySize = 1 << kEntrySizeLog2;
 
-    uint8_t  bv_[0];
+    uint64_t  bv_[0];
 
     static nvBitMap* make(Context& ctx, size_t length, void* ptr)
     {
         nvBitMap* bm = static_cast<nvBitMap*>(ptr);
         // we have at least one entry
-        for (unsigned int i=0; i<size_of(length); i++) {
-            uint8_t tmp = 0;
-            ctx.store(&tmp, &bm->bv_[i], sizeof(bm->bv_[i]));
+        for (unsigned int i=0; i<nwords(length); i++) {
+            uint64_t tmp = 0;
+            ctx.store((uint8_t*) &tmp, (uint8_t*) &bm->bv_[i], sizeof(bm->bv_[i]));
         }
         return bm;  
     } 
@@ -43,7 +57,7 @@ struct nvBitMap {
         return bm;  
     } 
 
-    static size_t size_of(size_t bitmap_len)
+    static size_t nwords(size_t bitmap_len)
     {
         if (bitmap_len % nvBitMap::kEntrySize > 0) {
             return 1 + bitmap_len / kEntrySize;
@@ -51,40 +65,42 @@ struct nvBitMap {
         return bitmap_len / kEntrySize;
     }
 
+    // size in bytes
+    static size_t size_of(size_t bitmap_len)
+    {
+        return nwords(bitmap_len) * sizeof(uint64_t);
+    }
+
     size_t elt(int bit_index) 
     {
         return bit_index >> kEntrySizeLog2;
     }
 
-    uint8_t mask(int bit_index) 
+    uint64_t mask(int bit_index) 
+    {
+        return 1ULL << (bit_index & ((1 << kEntrySizeLog2) - 1));
+    }
+
+    uint64_t word(Context& ctx, size_t word_index)
     {
-        return 1 << (bit_index & ((1 << kEntrySizeLog2) - 1));
+        uint64_t tmp;
+        ctx.load((uint8_t*) &bv_[word_index], (uint8_t*) &tmp, sizeof(bv_[word_index]));
+        return tmp;
     }
 
     void clear(Context& ctx, int bit_index) 
     {
-        // bv_[elt(bit_index)] = bv_[elt(bit_index)] & ~mask(bit_index);
-        uint8_t tmp;
-        ctx.load(&bv_[elt(bit_index)], &tmp, sizeof(bv_[elt(bit_index)]));
-        tmp = tmp & ~mask(bit_index);
-        ctx.store(&tmp, &bv_[elt(bit_index)], sizeof(bv_[elt(bit_index)]));
+        ctx.store_masked(&bv_[elt(bit_index)], 0, mask(bit_index));
     }
 
     void set(Context& ctx, int bit_index) 
     {
-        // bv_[elt(bit_index)] = bv_[elt(bit_index)] | mask(bit_index);  
-        uint8_t tmp;
-        ctx.load(&bv_[elt(bit_index)], &tmp, sizeof(bv_[elt(bit_index)]));
-        tmp = tmp | mask(bit_index);
-        ctx.store(&tmp, &bv_[elt(bit_index)], sizeof(bv_[elt(bit_index)]));
+        ctx.store_masked(&bv_[elt(bit_index)], ~0ULL, mask(bit_index));
     }
 
     bool is_set(Context& ctx, int bit_index) 
     {
-        //return (bv_[elt(bit_index)] & mask(bit_index)) != 0;
-        uint8_t tmp;
-        ctx.load(&bv_[elt(bit_index)], &tmp, sizeof(bv_[elt(bit_index)]));
-        return (tmp & mask(bit_index)) != 0;
+        return (word(ctx, elt(bit_index)) & mask(bit_index)) != 0;
     }
 };
 
@@ -64,6 +64,12 @@ public:
      */
     int remove_ge(size_t len, ExtentInterval* nex);
 
+    /** 
+     * @brief Remove the first len units of the extent starting exactly at 
+     *        start, if there is one of at least length len
+     */
+    int remove_at(size_t start, size_t len);
+
     /**
      * @brief Returns the number of extents indexed by this ExtentMap
      */
@@ -54,6 +54,11 @@ public:
         return -1;
     }
 
+    int alloc_extent_at(size_t start, size_t size_nblocks)
+    {
+        return remove_at(start, size_nblocks);
+    }
+
     void free_extent(Context& ctx, const ExtentInterval& ex)
     {
         if (ctx.do_v) {
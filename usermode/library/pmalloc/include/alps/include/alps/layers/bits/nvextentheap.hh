@@ -32,7 +32,12 @@ public:
     enum {
         kBlockTypeFree = 0,
         kBlockTypeExtentFirst = 1, // first block of an extent
-        kBlockTypeExtentRun = 2,   // run block of an extent 
+        kBlockTypeExtentRun = 2,   // run block of an extent (no longer written)
+    };
+
+    enum {
+        kExtentTagNone = 0,
+        kExtentTagSlab = 1, // extent formatted as a slab
     };
 
     static TPtr<nvExtentHeader> make(TPtr<nvExtentHeader> header, uint8_t type)
@@ -47,36 +52,59 @@ public:
         return size_;
     }
 
+    uint32_t size(Context& ctx)
+    {
+        uint32_t tmp;
+        ctx.load((uint8_t*) &size_, (uint8_t*) &tmp, sizeof(size_));
+        return tmp;
+    }
+
     bool is_free() {
         return (type_ == kBlockTypeFree);
     }
 
-    void mark_alloc(uint32_t nblocks)
+    uint8_t tag() {
+        return tag_;
+    }
+
+    void set_type(Context& ctx, uint8_t type)
     {
-        size_ = nblocks;
-        nvExtentHeader* this_bh = reinterpret_cast<nvExtentHeader*>(this);
-        for (uint32_t i=1; i<nblocks; i++) {
-            nvExtentHeader* bh = this_bh + i;
-            bh->type_ = nvExtentHeader::kBlockTypeExtentRun;
-            //persist((void*) &bh->type_, sizeof(bh->type_));
-        }
+        ctx.store((uint8_t*) &type, (uint8_t*) &type_, sizeof(type_));
+    }
+
+    // Only the header of the first block of an extent is ever written. 
+    // Headers of the other blocks are meaningless and may hold stale 
+    // values (kBlockTypeExtentRun was written there by older versions),
+    // so allocating, growing and freeing an extent cost a constant number
+    // of persistent writes whatever its length.
+
+    void mark_alloc(Context& ctx, uint32_t nblocks, uint8_t tag = kExtentTagNone)
+    {
+        ctx.store((uint8_t*) &nblocks, (uint8_t*) &size_, sizeof(size_));
+        ctx.store((uint8_t*) &tag, (uint8_t*) &tag_, sizeof(tag_));
 
         // Linearization point (with respect to failures)
         // 
         // Persisting the primary_type of the first block is a single atomic 
         // step that identifies the block group as an extent run.
-        this_bh->type_ = nvExtentHeader::kBlockTypeExtentFirst;
+        // Under a transaction all of the above are redo-logged and reach
+        // the heap together at commit, or not at all.
+        set_type(ctx, nvExtentHeader::kBlockTypeExtentFirst);
         //persist((void*) &this_bh->primary_type, sizeof(this_bh->primary_type));
     }
 
-    void mark_free()
+    void mark_extend(Context& ctx, uint32_t nblocks)
     {
-        uint32_t nblocks = size_;
-        nvExtentHeader* this_bh = reinterpret_cast<nvExtentHeader*>(this);
-        for (uint32_t i=0; i<nblocks; i++) {
-            nvExtentHeader* bh = this_bh + i;
-            bh->type_ = nvExtentHeader::kBlockTypeFree;
-        }
+        // Linearization point (with respect to failures)
+        //
+        // Until the new size is persisted the blocks past the old size 
+        // belong to no extent and are reloaded as free space.
+        ctx.store((uint8_t*) &nblocks, (uint8_t*) &size_, sizeof(size_));
+    }
+
+    void mark_free(Context& ctx)
+    {
+        set_type(ctx, nvExtentHeader::kBlockTypeFree);
     }
 
 //protected:
@@ -87,6 +115,9 @@ public:
 
             /** Extent size in number of blocks */
             uint32_t size_;
+
+            /** What the extent holds, valid in the first block */
+            uint8_t  tag_;
         };
         uint8_t u8_[64];
     };
@@ -106,6 +137,7 @@ struct nvExtentHeapHeader {
             uint64_t  extent_headers_offset_; // extent headers offset relative to payload
             uint64_t  blocks_offset_; // blocks offset relative to payload
             void*     extentheap_; // pointer to the heap's volatile descriptor for quick lookup
+            uint64_t  summary_offset_; // allocated-extent summary offset relative to payload
         };
         uint8_t u8_[64];
     };
@@ -113,41 +145,66 @@ struct nvExtentHeapHeader {
 
 static_assert(sizeof(nvExtentHeapHeader) == 64, "nvExtentHeapHeader must be multiple of cache-line size");
 
+/**
+ * @brief Persistent extent heap
+ *
+ * @details
+ * Heaps made by this version carry a summary bitmap with a bit set for the 
+ * first block of every allocated extent, so that reincarnation reads one
+ * bit per block instead of one extent header per block. The bit is set 
+ * before an extent's headers are marked allocated and cleared after they 
+ * are marked free, so an allocated extent always has its bit set, and a 
+ * bit left set by a crash is dropped when its header says otherwise.
+ * Under a transaction headers and summary bits are updated through the
+ * context and so become durable atomically with the transaction.
+ * Heaps without a summary are still loaded by walking the headers.
+ */
 template<typename Context, template<typename> class TPtr, template<typename> class PPtr>
 struct nvExtentHeap {
 public:
+    static const uint32_t kMagicSummary = 0x414c5053; 
+
     static TPtr<nvExtentHeap> make(TPtr<void> region, size_t region_size, size_t block_log2size)
     {
         // Calculate number of blocks that can fit in the zone and set 
         // the block_header and block pointers accordingly.
+        // Each block also takes a bit of the summary bitmap.
         // The first block must be aligned at cache-line multiple so that it
         // doesn't share a cacheline with the last block-header. 
         size_t block_size = 1LLU << block_log2size;
         size_t effective_region_size = region_size - sizeof(nvExtentHeap);
-        size_t max_nblocks = effective_region_size / (sizeof(nvExtentHeader<Context, TPtr>) + block_size); 
+        size_t max_nblocks = effective_region_size * 8 / (8 * (sizeof(nvExtentHeader<Context, TPtr>) + block_size) + 1); 
         // Adjust (reduce) number of blocks to accomodate extra space needed
         // for alignment.
         size_t extent_headers_aligned_total_size = round_up(max_nblocks * sizeof(nvExtentHeader<Context, TPtr>), kCacheLineSize);
-        size_t blocks_total_size = effective_region_size - extent_headers_aligned_total_size;
+        size_t summary_aligned_total_size = round_up(summary_nwords(max_nblocks) * sizeof(uint64_t), kCacheLineSize);
+        // The first block is aligned to the block size so that extents can
+        // be placed at any larger power-of-two boundary (e.g. huge pages)
+        TPtr<nvExtentHeap<Context, TPtr, PPtr> > exheap = region;
+        uintptr_t blocks_start = reinterpret_cast<uintptr_t>(&exheap->payload_[extent_headers_aligned_total_size + summary_aligned_total_size]);
+        size_t blocks_pad = round_up(blocks_start, block_size) - blocks_start;
+        size_t blocks_total_size = effective_region_size - extent_headers_aligned_total_size - summary_aligned_total_size - blocks_pad;
         size_t nblocks = blocks_total_size / block_size;
 
-        assert((sizeof(nvExtentHeap<Context, TPtr,PPtr>) + (sizeof(nvExtentHeader<Context, TPtr>) + block_size) * nblocks <= region_size)); 
+        assert((sizeof(nvExtentHeap<Context, TPtr,PPtr>) + (sizeof(nvExtentHeader<Context, TPtr>) + block_size) * nblocks + summary_aligned_total_size + blocks_pad <= region_size)); 
 
         // Set and persist header fields
-        TPtr<nvExtentHeap<Context, TPtr, PPtr> > exheap = region;
         exheap->header_.region_size_ = region_size;
         exheap->header_.block_log2size_ = block_log2size;
         exheap->header_.nblocks = nblocks;
         //exheap->extent_headers = &exheap->payload[0];
         //exheap->blocks = static_cast<TPtr<nvBlock>>((nvBlock*)&exheap->payload[extent_headers_aligned_total_size]);
         exheap->header_.extent_headers_offset_ = 0;
-        exheap->header_.blocks_offset_ = extent_headers_aligned_total_size;
+        exheap->header_.summary_offset_ = extent_headers_aligned_total_size;
+        exheap->header_.blocks_offset_ = extent_headers_aligned_total_size + summary_aligned_total_size + blocks_pad;
         //persist((void*)&exheap->header, sizeof(exheap->header));
 
-        // Format block headers
+        // Format block headers and summary
         for (size_t i=0; i<exheap->header_.nblocks; i++) {
             nvExtentHeader<Context, TPtr>::make(exheap->extent_header(i), nvExtentHeader<Context, TPtr>::kBlockTypeFree);
         } 
+        memset(exheap->summary(), 0, summary_nwords(nblocks) * sizeof(uint64_t));
+        exheap->header_.magic = kMagicSummary;
         return exheap;
     }
 
@@ -173,6 +230,76 @@ public:
         return exhdr->is_free();
     }
 
+    static size_t summary_nwords(size_t nblocks)
+    {
+        return (nblocks + 63) / 64;
+    }
+
+    bool has_summary()
+    {
+        return header_.magic == kMagicSummary;
+    }
+
+    uint64_t* summary()
+    {
+        return reinterpret_cast<uint64_t*>(&payload_[header_.summary_offset_]);
+    }
+
+    void summary_set(Context& ctx, size_t idx)
+    {
+        if (has_summary()) {
+            ctx.store_masked(&summary()[idx / 64], ~0ULL, 1ULL << (idx % 64));
+            //persist((void*) &summary()[idx / 64], sizeof(uint64_t));
+        }
+    }
+
+    void summary_clear(Context& ctx, size_t idx)
+    {
+        if (has_summary()) {
+            ctx.store_masked(&summary()[idx / 64], 0, 1ULL << (idx % 64));
+            //persist((void*) &summary()[idx / 64], sizeof(uint64_t));
+        }
+    }
+
+    /**
+     * @brief Call visit(interval, header) for each allocated extent in 
+     * address order
+     *
+     * @details
+     * With a summary this reads one summary word per 64 blocks plus the
+     * header of each allocated extent, dropping summary bits whose header 
+     * is not the first block of an extent. Without one it walks all headers.
+     */
+    template<typename Visitor>
+    void for_each_allocated(Visitor visit)
+    {
+        typedef nvExtentHeader<Context, TPtr> nvExtentHeaderT;
+
+        if (!has_summary()) {
+            for (Iterator it = begin(); it != end(); ++it) {
+                if (!is_free(*it)) {
+                    visit(*it, extent_header((*it).start()));
+                }
+            }
+            return;
+        }
+        uint64_t* words = summary();
+        for (size_t w=0; w<summary_nwords(header_.nblocks); w++) {
+            uint64_t word = words[w];
+            while (word) {
+                size_t idx = w * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                TPtr<nvExtentHeaderT> exhdr = extent_header(idx);
+                if (exhdr->type_ != nvExtentHeaderT::kBlockTypeExtentFirst) {
+                    // allocation or free interrupted by a crash
+                    words[w] &= ~(1ULL << (idx % 64));
+                    continue;
+                }
+                visit(ExtentInterval(idx, exhdr->size()), exhdr);
+            }
+        }
+    }
+
     ExtentHeap<Context, TPtr, PPtr>* extentheap() 
     {
         return reinterpret_cast<ExtentHeap<Context, TPtr, PPtr>*>(header_.extentheap_); // pointer to the heap's volatile descriptor for quick lookup
@@ -192,10 +319,12 @@ private:
         *extent_is_free = false;
         for (i=begin; i<end; i++) {
             TPtr<nvExtentHeader<Context, TPtr> > exh = extent_header(i);
-            if (exh->type_ == nvExtentHeader<Context, TPtr>::kBlockTypeFree) {
+            // The scan never starts inside an allocated extent, so any 
+            // block that does not begin one is free space
+            if (exh->type_ != nvExtentHeader<Context, TPtr>::kBlockTypeExtentFirst) {
                 *extent_is_free = true;
                 ext_end = i + 1;
-            } else if (exh->type_ == nvExtentHeader<Context, TPtr>::kBlockTypeExtentFirst) {
+            } else {
                 if (ext_end > ext_begin) {
                     // report the free extent we found before this one
                     break;
@@ -24,11 +24,13 @@
 #include <algorithm>
 #include <atomic>
 #include <list>
+#include <vector>
 #include <iostream>
 #include <signal.h>
 
 #include "alps/common/debug.hh"
 #include "alps/layers/bits/bitmap.hh"
+#include "alps/layers/pointer.hh"
 
 #include "size_class.hh"
 
@@ -82,8 +84,20 @@ struct nvSlabHeader {
      */
     static size_t max_nblocks(size_t slab_size, size_t block_size) 
     {
-        size_t nblocks_per_bitmap_byte = nvBitMap<Context>::kEntrySize;
-        return (slab_size - size_of() - 1) * nblocks_per_bitmap_byte / (1 + nblocks_per_bitmap_byte * block_size); 
+        size_t nblocks_per_bitmap_byte = 8;
+        // reserve a bitmap word for rounding the bitmap up to whole words
+        return (slab_size - size_of() - sizeof(uint64_t)) * nblocks_per_bitmap_byte / (1 + nblocks_per_bitmap_byte * block_size); 
+    }
+
+    /**
+     * @brief Return the largest block size a slab of slab_size can hold
+     */
+    static size_t max_block_size(size_t slab_size)
+    {
+        // a single block needs a single bitmap word, make rounds the header
+        // up to a cache line, and max_nblocks also counts the block's bit
+        size_t header_sz = align<size_t, kCacheLineSize>(size_of() + sizeof(uint64_t));
+        return std::min(slab_size - header_sz, slab_size - size_of() - sizeof(uint64_t) - 1);
     }
 };
 
@@ -152,11 +166,24 @@ struct nvSlab
     }
 
 
-    size_t nblocks_free() 
+    /**
+     * @brief Return bitmap word word_index with bits set for free blocks
+     */
+    uint64_t free_word(Context& ctx, size_t word_index)
+    {
+        uint64_t free = ~header.block_map.word(ctx, word_index);
+        size_t first = word_index * nvBitMap<Context>::kEntrySize;
+        if (nblocks() - first < (size_t) nvBitMap<Context>::kEntrySize) {
+            free &= (1ULL << (nblocks() - first)) - 1;
+        }
+        return free;
+    }
+
+    size_t nblocks_free(Context& ctx) 
     {
         size_t cnt=0; 
-        for (size_t i=0; i<nblocks(); i++) {
-            cnt = is_free(i) ? cnt + 1: cnt;
+        for (size_t w=0; w<nvBitMap<Context>::nwords(nblocks()); w++) {
+            cnt += __builtin_popcountll(free_word(ctx, w));
         }
         return cnt;
     }
@@ -208,17 +235,25 @@ public:
 
     Slab(TPtr<nvSlab<Context,TPtr>> nvslab)
         : nvslab_(nvslab),
+          nblocks_free_(0),
+          free_hint_(0),
           slab_list_(NULL)
     { }
 
+    /**
+     * @brief Rebuild the volatile free index from the persistent block map,
+     * a word at a time
+     */
     void init(Context& ctx)
     {   
+        free_map_.clear();
+        nblocks_free_ = 0;
+        free_hint_ = 0;
         if (block_size()) {
-            free_list_.clear();
-            for (size_t i=0; i<nblocks(); i++) {
-                if (nvslab_->is_free(ctx, i)) {
-                    free_list_.push_back(i);
-                }
+            free_map_.resize(nvBitMap<Context>::nwords(nblocks()));
+            for (size_t w=0; w<free_map_.size(); w++) {
+                free_map_[w] = nvslab_->free_word(ctx, w);
+                nblocks_free_ += __builtin_popcountll(free_map_[w]);
             }
         }
     }
@@ -234,6 +269,11 @@ public:
         return nvslab_->sizeclass();
     }
 
+    TPtr<void> region() const
+    {
+        return nvslab_;
+    }
+
     size_t block_size() const
     {
         return nvslab_->block_size();
@@ -261,7 +301,7 @@ public:
 
     size_t nblocks_free() const
     {
-        return free_list_.size();
+        return nblocks_free_;
     }
 
     void set_owner(void* owner)
@@ -295,36 +335,90 @@ public:
     }
 
     TPtr<void> alloc_block(Context& ctx)
+    {
+        TPtr<void> ptr = reserve_block();
+        if (ptr != null_ptr) {
+            commit_block(ctx, ptr);
+        }
+        return ptr;
+    }
+
+    /**
+     * @brief Take a block off the volatile free list without marking it
+     * allocated in the persistent block map (see commit_block)
+     */
+    TPtr<void> reserve_block()
     {
         TPtr<void> ptr;
 
-        if (!free_list_.empty()) {
-            int bid = free_list_.front();
-            free_list_.pop_front();
-            nvslab_->set_alloc(ctx, bid);
+        if (nblocks_free_) {
+            // every word below the hint is fully allocated
+            size_t w = free_hint_;
+            while (free_map_[w] == 0) {
+                w++;
+            }
+            size_t bid = w * kFreeMapWordBits + __builtin_ctzll(free_map_[w]);
+            free_map_[w] &= free_map_[w] - 1;
+            free_hint_ = w;
+            nblocks_free_--;
             ptr = nvslab_->block(bid);
-            LOG(info) << "Allocate block: " << "nvslab: " << nvslab_ << " block: " << bid;
+            LOG(info) << "Reserve block: " << "nvslab: " << nvslab_ << " block: " << bid;
         } else {
-            LOG(info) << "Allocate block: FAILED: no free space";
+            LOG(info) << "Reserve block: FAILED: no free space";
             ptr = 0;
         }
         return ptr;
     }
 
-    void free_block(Context& ctx, TPtr<void> ptr)
+    /**
+     * @brief Mark a reserved block allocated in the persistent block map
+     */
+    void commit_block(Context& ctx, TPtr<void> ptr)
     {
-        size_t bid = nvslab_->block_id(ptr);
+        nvslab_->set_alloc(ctx, nvslab_->block_id(ptr));
+    }
 
-        LOG(info) << "Free block: " << "nvslab: " << nvslab_ << " block: " << bid;
+    void free_block(Context& ctx, TPtr<void> ptr)
+    {
         if (ctx.do_v) {
-            free_list_.push_front(bid);
+            release_block(ptr);
         }
         if (ctx.do_nv) {
-            assert(nvslab_->is_free(ctx, bid) == false);
-            nvslab_->set_free(ctx, bid);
+            free_block_nv(ctx, ptr);
         }
     }
 
+    /**
+     * @brief Return a block to the volatile free list
+     */
+    void release_block(TPtr<void> ptr)
+    {
+        size_t bid = nvslab_->block_id(ptr);
+
+        LOG(info) << "Release block: " << "nvslab: " << nvslab_ << " block: " << bid;
+        size_t w = bid / kFreeMapWordBits;
+        assert((free_map_[w] & (1ULL << (bid % kFreeMapWordBits))) == 0);
+        free_map_[w] |= 1ULL << (bid % kFreeMapWordBits);
+        free_hint_ = std::min(free_hint_, w);
+        nblocks_free_++;
+    }
+
+    /**
+     * @brief Mark a block free in the persistent block map
+     *
+     * @details
+     * Touches no volatile state so it may be called by any thread, not 
+     * only the thread owning the slab.
+     */
+    void free_block_nv(Context& ctx, TPtr<void> ptr)
+    {
+        size_t bid = nvslab_->block_id(ptr);
+
+        LOG(info) << "Free block: " << "nvslab: " << nvslab_ << " block: " << bid;
+        assert(nvslab_->is_free(ctx, bid) == false);
+        nvslab_->set_free(ctx, bid);
+    }
+
     void stream_to(std::ostream& os) const 
     {
         os << "(" << block_size() << ", " << nblocks() << ", " << nblocks_free() << ")";
@@ -337,9 +431,13 @@ public:
     }
 
 
+    static const size_t kFreeMapWordBits = 64;
+
     std::atomic<void*>           owner_;
-    std::list<size_t>            free_list_;
+    std::vector<uint64_t>        free_map_; // bit set for each free block
     TPtr<nvSlab<Context, TPtr>>  nvslab_;
+    size_t                       nblocks_free_;
+    size_t                       free_hint_; // lowest word that may have a free block
     SlabList*                    slab_list_; // list this slab belongs to
     typename SlabList::iterator  slab_list_it_; // position in the slab list
 };
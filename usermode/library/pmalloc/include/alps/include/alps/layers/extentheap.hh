@@ -20,6 +20,9 @@
 #include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
 
 #include "alps/common/assorted_func.hh"
@@ -83,22 +86,38 @@ public:
 private:
     void init()
     {
-        TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap = exheap_->nvexheap_;
-        nvextentheader_ = static_cast<TPtr<nvExtentHeader<Context, TPtr>>>(nvexheap->extent_header(interval_.start()));
-        nvextent_ = nvexheap->block(interval_.start());
+        TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap = nvexheap_of();
+        size_t idx = ExtentHeap<Context, TPtr, PPtr>::local_index(interval_.start());
+        nvextentheader_ = static_cast<TPtr<nvExtentHeader<Context, TPtr>>>(nvexheap->extent_header(idx));
+        nvextent_ = nvexheap->block(idx);
     }
 
-    void mark_alloc(Context& ctx)
+    TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap_of()
+    {
+        return exheap_->nvexheaps_[ExtentHeap<Context, TPtr, PPtr>::region_index(interval_.start())];
+    }
+
+    void mark_alloc(Context& ctx, uint8_t tag)
+    {
+        if (ctx.do_nv) {
+            nvexheap_of()->summary_set(ctx, ExtentHeap<Context, TPtr, PPtr>::local_index(interval_.start()));
+            nvextentheader_->mark_alloc(ctx, interval_.len(), tag);
+        }
+    }
+
+    void mark_extend(Context& ctx, size_t nblocks)
     {
         if (ctx.do_nv) {
-            nvextentheader_->mark_alloc(interval_.len());
+            nvextentheader_->mark_extend(ctx, nblocks);
         }
+        interval_ = ExtentInterval(interval_.start(), nblocks);
     }
 
     void mark_free(Context& ctx)
     {
         if (ctx.do_nv) {
-            nvextentheader_->mark_free();
+            nvextentheader_->mark_free(ctx);
+            nvexheap_of()->summary_clear(ctx, ExtentHeap<Context, TPtr, PPtr>::local_index(interval_.start()));
         }
     }
     
@@ -116,20 +135,44 @@ inline std::ostream& operator<<(std::ostream& os, const Extent<Context, TPtr, PP
 }
 
 
+//! regions an extent heap may grow to
+const int kMaxExtentHeapRegions = 64;
+
+//! groups of regions an allocation can ask to be served from, e.g. one
+//! per NUMA node
+const int kMaxExtentHeapArenas = 8;
+
 /**
  * @brief Manages a heap of extents
+ *
+ * @details
+ * The heap spans one or more regions, each formatted as an nvExtentHeap 
+ * with the same block size. Extents are named by a heap-wide block index
+ * whose bits above kRegionIndexShift select the region, so a free space 
+ * map never coalesces extents across regions.
+ *
+ * Each region belongs to an arena, which has its own free space map. An
+ * allocation names the arena it prefers and is served from another arena
+ * only when its own has no room. Frees go back to the arena of the 
+ * extent's region, so extents never migrate between arenas.
+ *
+ * Regions formatted by this process start out zero-filled. The heap keeps
+ * a per-region watermark below which blocks may have been handed out, so
+ * callers that need zeroed memory only clear what lies below it.
  */
 template<typename Context, template<typename> class TPtr, template<typename> class PPtr>
 class ExtentHeap {
     friend Extent<Context, TPtr,PPtr>;
 
 public:
+    static const int kRegionIndexShift = 40;
+
     static ExtentHeap* make(TPtr<void> region, size_t region_size, size_t block_log2size)
     {
         ExtentHeap* exheap = new ExtentHeap;
 
-        exheap->nvexheap_ = nvExtentHeap<Context, TPtr, PPtr>::make(region, region_size, block_log2size);
         exheap->init();
+        exheap->add_region(nvExtentHeap<Context, TPtr, PPtr>::make(region, region_size, block_log2size), true);
 
         return exheap;
     }
@@ -138,15 +181,82 @@ public:
     {
         ExtentHeap* exheap = new ExtentHeap;
 
-        exheap->nvexheap_ = nvExtentHeap<Context, TPtr, PPtr>::load(region);
         exheap->init();
+        exheap->add_region(nvExtentHeap<Context, TPtr, PPtr>::load(region), false);
 
         return exheap;
     }
 
+    /**
+     * @brief Format region and add it to the heap, in arena
+     */
+    ErrorCode make_region(TPtr<void> region, size_t region_size, int arena = 0)
+    {
+        return add_region(nvExtentHeap<Context, TPtr, PPtr>::make(region, region_size, 
+                                                                  nvexheaps_[0]->header_.block_log2size_), true, arena);
+    }
+
+    /**
+     * @brief Add a region formatted by an earlier make_region to the heap,
+     * in arena
+     */
+    ErrorCode load_region(TPtr<void> region, int arena = 0)
+    {
+        return add_region(nvExtentHeap<Context, TPtr, PPtr>::load(region), false, arena);
+    }
+
+    int nregions()
+    {
+        return nregions_.load(std::memory_order_acquire);
+    }
+
+    int region_arena(int r)
+    {
+        return region_arena_[r];
+    }
+
+    size_t region_size(int r)
+    {
+        return nvexheaps_[r]->header_.region_size_;
+    }
+
+    /**
+     * @brief Return the arena of the region holding ptr, or -1 if ptr is
+     * not in the heap
+     */
+    int arena_of(TPtr<void> ptr)
+    {
+        TPtr<nvBlock> nvblock = ptr;
+
+        for (int r=0; r<nregions(); r++) {
+            TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap = nvexheaps_[r];
+            if (nvblock >= nvexheap->block(0) && 
+                nvblock < nvexheap->block(0) + nvexheap->header_.region_size_)
+            {
+                return region_arena_[r];
+            }
+        }
+        return -1;
+    }
+
+    static size_t region_index(size_t idx)
+    {
+        return idx >> kRegionIndexShift;
+    }
+
+    static size_t local_index(size_t idx)
+    {
+        return idx & ((1ULL << kRegionIndexShift) - 1);
+    }
+
+    static size_t heap_index(size_t region, size_t local_idx)
+    {
+        return (region << kRegionIndexShift) | local_idx;
+    }
+
     uint64_t blocksize()
     {
-        return 1 << nvexheap_->header_.block_log2size_;
+        return 1 << nvexheaps_[0]->header_.block_log2size_;
     }
 
     ErrorCode extent(ExtentInterval interval, Extent<Context, TPtr,PPtr>* ex)
@@ -157,27 +267,94 @@ public:
 
     ErrorCode extent(TPtr<void> ptr, Extent<Context, TPtr, PPtr>* ex)
     {
-        TPtr<nvBlock> nvblock = ptr;
-
-        if (nvblock < nvexheap_->block(0) || 
-            nvblock >= nvexheap_->block(0) + nvexheap_->header_.region_size_)
-        {
+        size_t idx;
+        TPtr<nvExtentHeader<Context, TPtr>> exhdr = extent_header(ptr, &idx);
+        if (!exhdr) {
             return kErrorCodeMemoryInvalidAddress;
         }
-        uintptr_t diff = nvblock - nvexheap_->block(0);
-        size_t idx = diff >> nvexheap_->header_.block_log2size_;
-        TPtr<nvExtentHeader<Context, TPtr>> exhdr = nvexheap_->extent_header(idx);
         *ex = Extent<Context, TPtr, PPtr>(this, idx, exhdr->size());
+        return kErrorCodeOk;
+    }
 
+    // Reads the extent size through ctx so that an extent allocated by the
+    // enclosing, not yet committed, transaction is seen with its new size
+    ErrorCode extent(Context& ctx, TPtr<void> ptr, Extent<Context, TPtr, PPtr>* ex)
+    {
+        size_t idx;
+        TPtr<nvExtentHeader<Context, TPtr>> exhdr = extent_header(ptr, &idx);
+        if (!exhdr) {
+            return kErrorCodeMemoryInvalidAddress;
+        }
+        *ex = Extent<Context, TPtr, PPtr>(this, idx, exhdr->size(ctx));
         return kErrorCodeOk;
     }
 
-    ErrorCode alloc_extent(Context& ctx, size_t size_nblocks, Extent<Context, TPtr, PPtr>* ex)
+    TPtr<nvExtentHeader<Context, TPtr>> extent_header(TPtr<void> ptr, size_t* heap_idx)
+    {
+        TPtr<nvBlock> nvblock = ptr;
+
+        for (int r=0; r<nregions(); r++) {
+            TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap = nvexheaps_[r];
+            if (nvblock < nvexheap->block(0) || 
+                nvblock >= nvexheap->block(0) + nvexheap->header_.region_size_)
+            {
+                continue;
+            }
+            uintptr_t diff = nvblock - nvexheap->block(0);
+            size_t idx = diff >> nvexheap->header_.block_log2size_;
+            *heap_idx = heap_index(r, idx);
+            return nvexheap->extent_header(idx);
+        }
+        return TPtr<nvExtentHeader<Context, TPtr>>(NULL);
+    }
+
+    /**
+     * @brief Advance the watermark of the region of exintv past it
+     *
+     * @return number of leading blocks of exintv that may hold stale data
+     */
+    size_t touch(const ExtentInterval& exintv)
+    {
+        size_t r = region_index(exintv.start());
+        size_t start = local_index(exintv.start());
+        size_t end = start + exintv.len();
+        size_t dirty = dirty_nblocks_[r] > start ? std::min(dirty_nblocks_[r], end) - start : 0;
+        dirty_nblocks_[r] = std::max(dirty_nblocks_[r], end);
+        return dirty;
+    }
+
+    FreeSpaceMap<Context, TPtr>& fsmap_of(size_t idx)
+    {
+        return fsmap_[region_arena_[region_index(idx)]];
+    }
+
+    /**
+     * @brief Take size_nblocks free blocks from arena, or from the other
+     * arenas in turn if it has no room
+     */
+    int alloc_interval(size_t size_nblocks, int arena, ExtentInterval* exintv)
+    {
+        ASSERT_ND(arena >= 0 && arena < kMaxExtentHeapArenas);
+        for (int i=0; i<kMaxExtentHeapArenas; i++) {
+            if (fsmap_[(arena + i) % kMaxExtentHeapArenas].alloc_extent(size_nblocks, exintv) == 0) {
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    ErrorCode alloc_extent(Context& ctx, size_t size_nblocks, Extent<Context, TPtr, PPtr>* ex, 
+                           uint8_t tag = nvExtentHeader<Context, TPtr>::kExtentTagNone,
+                           size_t* dirty_nblocks = NULL, int arena = 0)
     {
         ExtentInterval exintv;
-        if (fsmap_.alloc_extent(size_nblocks, &exintv) == 0) {
+        if (alloc_interval(size_nblocks, arena, &exintv) == 0) {
+            size_t dirty = touch(exintv);
+            if (dirty_nblocks) {
+                *dirty_nblocks = dirty;
+            }
             *ex = Extent<Context, TPtr, PPtr>(this, exintv.start(), exintv.len());
-            ex->mark_alloc(ctx);
+            ex->mark_alloc(ctx, tag);
             LOG(info) << "Allocated extent: " << ex;
             return kErrorCodeOk;
         }
@@ -186,7 +363,7 @@ public:
 
     ErrorCode free_extent(Context& ctx, Extent<Context, TPtr, PPtr>& ex)
     {
-        fsmap_.free_extent(ctx, ex.interval());
+        fsmap_of(ex.start()).free_extent(ctx, ex.interval());
         ex.mark_free(ctx);
         return kErrorCodeOk;
     }
@@ -194,11 +371,11 @@ public:
     ErrorCode free_extent(Context& ctx, TPtr<void> ptr)
     {
         Extent<Context,TPtr,PPtr> ex;
-        CHECK_ERROR_CODE(extent(ptr, &ex));
+        CHECK_ERROR_CODE(extent(ctx, ptr, &ex));
         return free_extent(ctx, ex);
     }
 
-    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr)
+    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr, int arena = 0)
     {
         ErrorCode rc;
         Extent<Context,TPtr,PPtr> ex;
@@ -208,7 +385,7 @@ public:
         // round up to next multiple of block_size
         size_t size_nblocks = size_bytes / blocksize() + (size_bytes % blocksize() ? 1: 0);
 
-        rc = alloc_extent(ctx, size_nblocks, &ex);
+        rc = alloc_extent(ctx, size_nblocks, &ex, nvExtentHeader<Context, TPtr>::kExtentTagNone, NULL, arena);
         if (rc == kErrorCodeOk) {
             *ptr = ex.nvextent();
         }
@@ -217,18 +394,184 @@ public:
         return rc;
     }
 
-    void free(Context& ctx, TPtr<void> ptr)
+    /**
+     * @brief Allocate like malloc and report in dirty_bytes how many leading
+     * bytes of the extent may hold stale data; the rest is known zero
+     */
+    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr, size_t* dirty_bytes, int arena = 0)
     {
+        ErrorCode rc;
+        Extent<Context,TPtr,PPtr> ex;
+        size_t dirty_nblocks;
+
         pthread_mutex_lock(&mutex_);
+        size_t size_nblocks = size_bytes / blocksize() + (size_bytes % blocksize() ? 1: 0);
+        rc = alloc_extent(ctx, size_nblocks, &ex, nvExtentHeader<Context, TPtr>::kExtentTagNone, &dirty_nblocks, arena);
+        if (rc == kErrorCodeOk) {
+            *ptr = ex.nvextent();
+            *dirty_bytes = std::min(dirty_nblocks * blocksize(), size_bytes);
+        }
+        pthread_mutex_unlock(&mutex_);
+        return rc;
+    }
+
+    /**
+     * @brief Allocate like malloc with the extent starting at a multiple of
+     * align bytes, a power of two larger than the block size
+     *
+     * @details
+     * The blocks skipped to reach the boundary go back to the free space.
+     * If no free extent can hold an aligned one, or the region's blocks 
+     * are not block aligned (heaps made by older versions), an unaligned
+     * extent is returned instead.
+     */
+    ErrorCode malloc_aligned(Context& ctx, size_t size_bytes, size_t align, TPtr<void>* ptr, size_t* dirty_bytes,
+                             int arena = 0)
+    {
+        ExtentInterval exintv;
+        size_t slack = align / blocksize() - 1;
+
+        pthread_mutex_lock(&mutex_);
+        size_t size_nblocks = size_bytes / blocksize() + (size_bytes % blocksize() ? 1: 0);
+        if (alloc_interval(size_nblocks + slack, arena, &exintv) != 0) {
+            pthread_mutex_unlock(&mutex_);
+            return malloc(ctx, size_bytes, ptr, dirty_bytes, arena);
+        }
+        uintptr_t addr = reinterpret_cast<uintptr_t>(nvexheaps_[region_index(exintv.start())]->block(local_index(exintv.start())).get());
+        size_t skip = 0;
+        if (addr % blocksize() == 0) {
+            skip = ((align - addr % align) % align) / blocksize();
+        }
+        if (skip > 0) {
+            fsmap_of(exintv.start()).insert(ExtentInterval(exintv.start(), skip));
+        }
+        if (slack > skip) {
+            fsmap_of(exintv.start()).insert(ExtentInterval(exintv.start() + skip + size_nblocks, slack - skip));
+        }
+        exintv = ExtentInterval(exintv.start() + skip, size_nblocks);
+        *dirty_bytes = std::min(touch(exintv) * blocksize(), size_bytes);
+        Extent<Context, TPtr, PPtr> ex(this, exintv.start(), exintv.len());
+        ex.mark_alloc(ctx, nvExtentHeader<Context, TPtr>::kExtentTagNone);
+        *ptr = ex.nvextent();
+        pthread_mutex_unlock(&mutex_);
+        return kErrorCodeOk;
+    }
+
+    /**
+     * @brief Mark allocated a persistently free extent that the caller kept
+     * out of the free space map, without taking the heap lock
+     */
+    ErrorCode mark_alloc(Context& ctx, TPtr<void> ptr)
+    {
+        Extent<Context,TPtr,PPtr> ex;
+        CHECK_ERROR_CODE(extent(ptr, &ex));
+        ex.mark_alloc(ctx, nvExtentHeader<Context, TPtr>::kExtentTagNone);
+        return kErrorCodeOk;
+    }
+
+    /**
+     * @brief Grow the extent starting at ptr to at least size_bytes by 
+     * taking the free space that immediately follows it
+     *
+     * @details
+     * On success tail is set to the blocks added, which the caller hands 
+     * back to retract if the enclosing transaction aborts. An extent that
+     * is already large enough is left alone and tail is empty.
+     */
+    ErrorCode extend(Context& ctx, TPtr<void> ptr, size_t size_bytes, ExtentInterval* tail)
+    {
+        Extent<Context,TPtr,PPtr> ex;
+
+        pthread_mutex_lock(&mutex_);
+        ErrorCode rc = extent(ctx, ptr, &ex);
+        if (rc != kErrorCodeOk || ex.nvextent() != ptr) {
+            pthread_mutex_unlock(&mutex_);
+            return kErrorCodeInvalidParameter;
+        }
+        size_t size_nblocks = size_bytes / blocksize() + (size_bytes % blocksize() ? 1: 0);
+        *tail = ExtentInterval(ex.end(), 0);
+        if (size_nblocks > ex.len()) {
+            if (fsmap_of(ex.start()).alloc_extent_at(ex.end(), size_nblocks - ex.len()) != 0) {
+                pthread_mutex_unlock(&mutex_);
+                return kErrorCodeOutofmemory;
+            }
+            *tail = ExtentInterval(ex.end(), size_nblocks - ex.len());
+            touch(*tail);
+            ex.mark_extend(ctx, size_nblocks);
+        }
+        pthread_mutex_unlock(&mutex_);
+        return kErrorCodeOk;
+    }
+
+    /**
+     * @brief Return the tail of an aborted extend to the free space
+     *
+     * @details
+     * The persistent extent header was rolled back with the transaction, 
+     * so only the volatile free space map needs fixing.
+     */
+    void retract(const ExtentInterval& tail)
+    {
+        pthread_mutex_lock(&mutex_);
+        fsmap_of(tail.start()).insert(tail);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    void free(Context& ctx, TPtr<void> ptr)
+    {
+        // Only the free space map needs the lock; the persistent half of
+        // a free touches just the extent's own header and summary bit
+        if (ctx.do_v) {
+            pthread_mutex_lock(&mutex_);
+        }
         ErrorCode rc = free_extent(ctx, ptr);
         ASSERT_ND(rc == kErrorCodeOk);
+        if (ctx.do_v) {
+            pthread_mutex_unlock(&mutex_);
+        }
+    }
+
+    /**
+     * @brief Allocate up to n extents of size_bytes each under a single 
+     * acquisition of the heap lock
+     *
+     * @return the number of extents allocated into ptrs
+     */
+    int malloc_batch(Context& ctx, size_t size_bytes, int n, TPtr<void>* ptrs,
+                     uint8_t tag = nvExtentHeader<Context, TPtr>::kExtentTagNone, int arena = 0)
+    {
+        Extent<Context,TPtr,PPtr> ex;
+        int i;
+
+        pthread_mutex_lock(&mutex_);
+        size_t size_nblocks = size_bytes / blocksize() + (size_bytes % blocksize() ? 1: 0);
+        for (i=0; i<n; i++) {
+            if (alloc_extent(ctx, size_nblocks, &ex, tag, NULL, arena) != kErrorCodeOk) {
+                break;
+            }
+            ptrs[i] = ex.nvextent();
+        }
+        pthread_mutex_unlock(&mutex_);
+        return i;
+    }
+
+    /**
+     * @brief Free n extents under a single acquisition of the heap lock
+     */
+    void free_batch(Context& ctx, TPtr<void>* ptrs, int n)
+    {
+        pthread_mutex_lock(&mutex_);
+        for (int i=0; i<n; i++) {
+            ErrorCode rc = free_extent(ctx, ptrs[i]);
+            ASSERT_ND(rc == kErrorCodeOk);
+        }
         pthread_mutex_unlock(&mutex_);
     }
 
-    size_t getsize(TPtr<void> ptr)
+    size_t getsize(Context& ctx, TPtr<void> ptr)
     {
         Extent<Context,TPtr,PPtr> ex;
-        if (kErrorCodeOk != extent(ptr, &ex)) {
+        if (kErrorCodeOk != extent(ctx, ptr, &ex)) {
             return 0;
         }
         return blocksize() * ex.len();
@@ -272,14 +615,31 @@ public:
         typename nvExtentHeap<Context, TPtr, PPtr>::Iterator nvit_;
     };
 
+    // Iterates over the extents of the first region
     Iterator begin()
     {
-        return Iterator(this, nvexheap_->begin());
+        return Iterator(this, nvexheaps_[0]->begin());
     }
 
     Iterator end()
     {
-        return Iterator(this, nvexheap_->end());
+        return Iterator(this, nvexheaps_[0]->end());
+    }
+
+    /**
+     * @brief Call visit(Extent) for each allocated extent carrying tag
+     */
+    template<typename Visitor>
+    void for_each_allocated(uint8_t tag, Visitor visit)
+    {
+        for (int r=0; r<nregions(); r++) {
+            nvexheaps_[r]->for_each_allocated(
+                [&](ExtentInterval interval, TPtr<nvExtentHeader<Context, TPtr>> exhdr) {
+                    if (exhdr->tag() == tag) {
+                        visit(Extent<Context, TPtr, PPtr>(this, heap_index(r, interval.start()), interval.len()));
+                    }
+                });
+        }
     }
 
 private:
@@ -287,20 +647,67 @@ private:
     ErrorStack init()
     {
         pthread_mutex_init(&mutex_, NULL);
-        typename nvExtentHeap<Context, TPtr, PPtr>::Iterator it;
-        for (it = nvexheap_->begin(); it != nvexheap_->end(); ++it) {
-            if (nvexheap_->is_free(*it)) {
-                LOG(info) << "Load free extent: " << *it;
-                fsmap_.insert(*it);
+        nregions_.store(0, std::memory_order_relaxed);
+        return kRetOk;
+    }
+
+    ErrorCode add_region(TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap, bool zeroed, int arena = 0)
+    {
+        pthread_mutex_lock(&mutex_);
+        int r = nregions_.load(std::memory_order_relaxed);
+        if (r == kMaxExtentHeapRegions || arena < 0 || arena >= kMaxExtentHeapArenas ||
+            (r > 0 && nvexheap->header_.block_log2size_ != nvexheaps_[0]->header_.block_log2size_))
+        {
+            pthread_mutex_unlock(&mutex_);
+            return kErrorCodeInvalidParameter;
+        }
+        nvexheaps_[r] = nvexheap;
+        region_arena_[r] = arena;
+        dirty_nblocks_[r] = zeroed ? 0 : nvexheap->header_.nblocks;
+        load_free_space(r);
+        // publish the region only after its descriptor is in place
+        nregions_.store(r + 1, std::memory_order_release);
+        pthread_mutex_unlock(&mutex_);
+        return kErrorCodeOk;
+    }
+
+    void load_free_space(size_t r)
+    {
+        TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap = nvexheaps_[r];
+        int arena = region_arena_[r];
+
+        if (!nvexheap->has_summary()) {
+            typename nvExtentHeap<Context, TPtr, PPtr>::Iterator it;
+            for (it = nvexheap->begin(); it != nvexheap->end(); ++it) {
+                if (nvexheap->is_free(*it)) {
+                    LOG(info) << "Load free extent: " << *it;
+                    fsmap_[arena].insert(ExtentInterval(heap_index(r, (*it).start()), (*it).len()));
+                }
             }
+            return;
+        }
+
+        // Free extents are the gaps between the allocated extents
+        size_t free_start = 0;
+        nvexheap->for_each_allocated(
+            [&](ExtentInterval interval, TPtr<nvExtentHeader<Context, TPtr>> exhdr) {
+                if (interval.start() > free_start) {
+                    fsmap_[arena].insert(ExtentInterval(heap_index(r, free_start), interval.start() - free_start));
+                }
+                free_start = interval.start() + interval.len();
+            });
+        if (nvexheap->header_.nblocks > free_start) {
+            fsmap_[arena].insert(ExtentInterval(heap_index(r, free_start), nvexheap->header_.nblocks - free_start));
         }
-        return kRetOk;
     }
 
 private:
     pthread_mutex_t mutex_;
-    TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheap_;
-    FreeSpaceMap<Context, TPtr> fsmap_;        
+    TPtr<nvExtentHeap<Context, TPtr, PPtr>> nvexheaps_[kMaxExtentHeapRegions];
+    std::atomic<int> nregions_;
+    int region_arena_[kMaxExtentHeapRegions];
+    size_t dirty_nblocks_[kMaxExtentHeapRegions]; // blocks past this have never been allocated
+    FreeSpaceMap<Context, TPtr> fsmap_[kMaxExtentHeapArenas]; // free space of each arena
 };
 
 
@@ -18,6 +18,7 @@
 #define _ALPS_LAYER_HYBRIDHEAP_HH_
 
 #include "alps/common/assert_nd.hh"
+#include "alps/layers/bits/extentinterval.hh"
 
 namespace alps {
 
@@ -51,22 +52,63 @@ public:
         return rc;
     }
 
+    /**
+     * @brief Allocate like malloc and report in dirty_bytes how many leading
+     * bytes may hold stale data
+     *
+     * @details
+     * Slab blocks are recycled freely so they are always reported dirty.
+     */
+    ErrorCode malloc(Context& ctx, size_t size, TPtr<void>* ptr, size_t* dirty_bytes)
+    {
+        ErrorCode rc;
+
+        if (size < bigsize_) {
+            rc = sh_->malloc(ctx, size, ptr);
+            *dirty_bytes = size;
+        } else {
+            rc = bh_->malloc(ctx, size, ptr, dirty_bytes);
+        }
+
+        return rc;
+    }
+
+    /**
+     * @brief Grow a big object in place to at least size bytes
+     *
+     * @details
+     * Slab blocks cannot grow beyond their sizeclass, so only objects held
+     * by the big heap are extended. See BigHeap::extend for tail.
+     */
+    ErrorCode extend(Context& ctx, TPtr<void> ptr, size_t size, ExtentInterval* tail)
+    {
+        if (size < bigsize_ || sh_->is_block(ctx, ptr)) {
+            return kErrorCodeNotSupported;
+        }
+        return bh_->extend(ctx, ptr, size, tail);
+    }
+
+    void retract(const ExtentInterval& tail)
+    {
+        bh_->retract(tail);
+    }
+
     void free(Context& ctx, TPtr<void> ptr) 
     {
-        LOG(info) << "Free ptr==" << ptr.get() << " size==" << sh_->getsize(ptr);  
+        LOG(info) << "Free ptr==" << ptr.get() << " size==" << sh_->getsize(ctx, ptr);  
 
-        if (sh_->getsize(ptr) < bigsize_) {
+        if (sh_->is_block(ctx, ptr)) {
             return sh_->free(ctx, ptr);
         } else {
             return bh_->free(ctx, ptr);
         }
     }
  
-    size_t getsize(TPtr<void> ptr) 
+    size_t getsize(Context& ctx, TPtr<void> ptr) 
     {
-        size_t size = sh_->getsize(ptr);
+        size_t size = sh_->getsize(ctx, ptr);
         if (size >= bigsize_) {
-            size = bh_->getsize(ptr);
+            size = bh_->getsize(ctx, ptr);
         }
         return size;
     }
@@ -0,0 +1,235 @@
+/*
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ALPS_LAYERS_LARGEHEAP_HH_
+#define _ALPS_LAYERS_LARGEHEAP_HH_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include "alps/common/assert_nd.hh"
+#include "alps/common/error_code.hh"
+
+#include "alps/layers/extentheap.hh"
+
+namespace alps {
+
+//! power-of-two buckets of cached extents, by number of blocks
+const int kLargeHeapBuckets = 48;
+
+//! extents cached per bucket before frees go back to the extent heap
+const size_t kLargeHeapCacheDepth = 8;
+
+//! extents of at least this size are aligned to it
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+/**
+ * @brief Large-object tier in front of an extent heap
+ *
+ * @details
+ * Freed extents are marked free persistently but kept out of the extent
+ * heap's free space map, in a bucket per power of two of their length
+ * with its own lock. A request is served from the bucket of its length
+ * when an extent there is long enough, so repeated allocation of big
+ * buffers of similar sizes does not touch the extent heap's global lock.
+ * Cached extents are persistently free, so they are reloaded as free
+ * space after a restart like any other.
+ *
+ * Extents of kHugePageSize or more come from the extent heap aligned to
+ * kHugePageSize and, if enabled, are advised with MADV_HUGEPAGE so the
+ * kernel can back them with huge pages.
+ *
+ * New extents are taken from the extent heap arena given at construction.
+ * Only extents of that arena are cached; others go straight back to the
+ * extent heap so that they are reused from their own arena.
+ */
+template<typename Context, template<typename> class TPtr, template<typename> class PPtr>
+class LargeHeap
+{
+public:
+    typedef ExtentHeap<Context, TPtr, PPtr> ExtentHeapT;
+
+    LargeHeap(ExtentHeapT* exheap, bool hugepages, int arena = 0)
+        : exheap_(exheap),
+          hugepages_(hugepages),
+          arena_(arena)
+    {
+        for (int b=0; b<kLargeHeapBuckets; b++) {
+            int err = pthread_mutex_init(&bucket_[b].mutex, NULL);
+            ASSERT_ND(err == 0);
+        }
+    }
+
+    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr)
+    {
+        size_t dirty_bytes;
+        return malloc(ctx, size_bytes, ptr, &dirty_bytes);
+    }
+
+    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr, size_t* dirty_bytes)
+    {
+        size_t nblocks = size_nblocks(size_bytes);
+
+        if (reuse(ctx, nblocks, ptr)) {
+            *dirty_bytes = size_bytes;
+            return kErrorCodeOk;
+        }
+        ErrorCode rc = malloc_extent(ctx, size_bytes, ptr, dirty_bytes);
+        if (rc == kErrorCodeOutofmemory && release_cached(ctx) > 0) {
+            rc = malloc_extent(ctx, size_bytes, ptr, dirty_bytes);
+        }
+        return rc;
+    }
+
+    void free(Context& ctx, TPtr<void> ptr)
+    {
+        if (ctx.do_nv) {
+            Context nvctx(ctx);
+            nvctx.do_v = false;
+            exheap_->free(nvctx, ptr);
+        }
+        if (ctx.do_v) {
+            Extent<Context, TPtr, PPtr> ex;
+            ErrorCode rc = exheap_->extent(ctx, ptr, &ex);
+            ASSERT_ND(rc == kErrorCodeOk);
+            Bucket& bucket = bucket_[bucket_index(ex.len())];
+            pthread_mutex_lock(&bucket.mutex);
+            if (bucket.extents.size() < kLargeHeapCacheDepth && exheap_->arena_of(ptr) == arena_) {
+                bucket.extents.push_back(ptr);
+                pthread_mutex_unlock(&bucket.mutex);
+                return;
+            }
+            pthread_mutex_unlock(&bucket.mutex);
+            Context vctx(ctx);
+            vctx.do_nv = false;
+            exheap_->free(vctx, ptr);
+        }
+    }
+
+    size_t getsize(Context& ctx, TPtr<void> ptr)
+    {
+        return exheap_->getsize(ctx, ptr);
+    }
+
+    ErrorCode extend(Context& ctx, TPtr<void> ptr, size_t size_bytes, ExtentInterval* tail)
+    {
+        return exheap_->extend(ctx, ptr, size_bytes, tail);
+    }
+
+    void retract(const ExtentInterval& tail)
+    {
+        exheap_->retract(tail);
+    }
+
+    /**
+     * @brief Return all cached extents to the extent heap's free space
+     *
+     * @return the number of extents released
+     */
+    size_t release_cached(Context& ctx)
+    {
+        Context vctx = ctx.direct();
+        vctx.do_v = true;
+        vctx.do_nv = false;
+        size_t n = 0;
+        for (int b=0; b<kLargeHeapBuckets; b++) {
+            std::vector<TPtr<void>> extents;
+            pthread_mutex_lock(&bucket_[b].mutex);
+            extents.swap(bucket_[b].extents);
+            pthread_mutex_unlock(&bucket_[b].mutex);
+            for (size_t i=0; i<extents.size(); i++) {
+                exheap_->free(vctx, extents[i]);
+            }
+            n += extents.size();
+        }
+        return n;
+    }
+
+private:
+    struct Bucket {
+        pthread_mutex_t         mutex;
+        std::vector<TPtr<void>> extents;
+    };
+
+    size_t size_nblocks(size_t size_bytes)
+    {
+        return size_bytes / exheap_->blocksize() + (size_bytes % exheap_->blocksize() ? 1: 0);
+    }
+
+    static int bucket_index(size_t nblocks)
+    {
+        int b = 63 - __builtin_clzll(nblocks);
+        return b < kLargeHeapBuckets ? b : kLargeHeapBuckets - 1;
+    }
+
+    /**
+     * @brief Take a cached extent of at least nblocks from the bucket of
+     * nblocks and mark it allocated
+     */
+    bool reuse(Context& ctx, size_t nblocks, TPtr<void>* ptr)
+    {
+        Bucket& bucket = bucket_[bucket_index(nblocks)];
+        bool found = false;
+
+        pthread_mutex_lock(&bucket.mutex);
+        for (size_t i=0; i<bucket.extents.size(); i++) {
+            // a free extent keeps the length it was last allocated with
+            Extent<Context, TPtr, PPtr> ex;
+            ErrorCode rc = exheap_->extent(bucket.extents[i], &ex);
+            ASSERT_ND(rc == kErrorCodeOk);
+            if (ex.len() >= nblocks) {
+                *ptr = bucket.extents[i];
+                bucket.extents[i] = bucket.extents.back();
+                bucket.extents.pop_back();
+                found = true;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&bucket.mutex);
+        if (found) {
+            ErrorCode rc = exheap_->mark_alloc(ctx, *ptr);
+            ASSERT_ND(rc == kErrorCodeOk);
+        }
+        return found;
+    }
+
+    ErrorCode malloc_extent(Context& ctx, size_t size_bytes, TPtr<void>* ptr, size_t* dirty_bytes)
+    {
+        size_t size = size_nblocks(size_bytes) * exheap_->blocksize();
+
+        if (size < kHugePageSize || exheap_->blocksize() > kHugePageSize) {
+            return exheap_->malloc(ctx, size_bytes, ptr, dirty_bytes, arena_);
+        }
+        CHECK_ERROR_CODE(exheap_->malloc_aligned(ctx, size_bytes, kHugePageSize, ptr, dirty_bytes, arena_));
+        if (hugepages_ && reinterpret_cast<uintptr_t>(ptr->get()) % kHugePageSize == 0) {
+            // only a hint; the extent is usable whether or not it is honored
+            madvise(ptr->get(), size & ~(kHugePageSize - 1), MADV_HUGEPAGE);
+        }
+        return kErrorCodeOk;
+    }
+
+    ExtentHeapT* exheap_;
+    bool         hugepages_;
+    int          arena_;
+    Bucket       bucket_[kLargeHeapBuckets];
+};
+
+} // namespace alps
+
+#endif // _ALPS_LAYERS_LARGEHEAP_HH_
@@ -17,6 +17,10 @@
 #ifndef _ALPS_LAYER_SLABHEAP_HH_
 #define _ALPS_LAYER_SLABHEAP_HH_
 
+#include <atomic>
+#include <string.h>
+#include <vector>
+
 #include "alps/common/assert_nd.hh"
 
 #include "alps/layers/extentheap.hh"
@@ -25,12 +29,35 @@
 
 namespace alps {
 
+//! blocks cached per sizeclass in a slab heap magazine
+const int kMagazineSize = 64;
+
+//! slabs requested from the extent heap at a time
+const int kSlabBatchSize = 4;
+
+//! empty slabs kept by a slab heap before returning a batch to the extent heap
+const size_t kMaxEmptySlabs = 8;
+
 /**
  * @brief Slab heap organizes slabs in per-sizeclass free lists 
  *
  * @details 
  * This class methods are not-thread safe. User is responsible for proper
  * serialization via lock/unlock.
+ *
+ * The exception is free, which may be called by any thread: a block whose
+ * slab is owned by another slab heap is pushed on that heap's lock-free 
+ * remote-free stack and is returned to its slab when the owner next
+ * refills. Blocks freed to the owning heap go to a per-sizeclass magazine
+ * of blocks reserved in the volatile free lists but not yet marked 
+ * allocated in the persistent block maps, so the common malloc/free pair
+ * touches neither the slab lists nor any lock.
+ *
+ * Block maps are updated through the caller's context, so under a 
+ * transaction a block becomes allocated or free persistently only when 
+ * the transaction commits. Formatting, reformatting and releasing whole
+ * slabs changes state that other threads' transactions build on, so those
+ * go through a direct context and are durable immediately.
  * 
  */
 template<typename Context, template<typename> class TPtr, template<typename> class PPtr>
@@ -39,110 +66,161 @@ class SlabHeap
 public:
     typedef Slab<Context, TPtr, PPtr> SlabT;
     typedef ExtentHeap<Context, TPtr, PPtr> ExtentHeapT;
+    typedef nvExtentHeader<Context, TPtr> nvExtentHeaderT;
 
 public:
     SlabHeap(size_t slabsize)
-        : slabsize_(slabsize)
+        : slabsize_(slabsize),
+          parentslabheap_(NULL),
+          extentheap_(NULL),
+          arena_(0),
+          remote_free_(NULL)
     { 
         int err = pthread_mutex_init(&mutex_, NULL);
         ASSERT_ND(err == 0);
+        memset(magazine_, 0, sizeof(magazine_));
     }
 
-    SlabHeap(size_t slabsize, SlabHeap* parentslabheap, ExtentHeapT* extentheap)
+    SlabHeap(size_t slabsize, SlabHeap* parentslabheap, ExtentHeapT* extentheap, int arena = 0)
         : slabsize_(slabsize),
           parentslabheap_(parentslabheap),
-          extentheap_(extentheap)
+          extentheap_(extentheap),
+          arena_(arena),
+          remote_free_(NULL)
     {
         int err = pthread_mutex_init(&mutex_, NULL);
         ASSERT_ND(err == 0);
+        memset(magazine_, 0, sizeof(magazine_));
     }
 
+    /**
+     * @brief Find the slabs of the extent heap without loading them
+     *
+     * @details
+     * Slabs are only recorded per sizeclass here. Their descriptors and
+     * free block indexes are built the first time their sizeclass is 
+     * requested, or when one of their blocks is freed (see slab_of).
+     */
     ErrorCode init(Context& ctx)
     {
         if (extentheap_) {
-            for (typename ExtentHeapT::Iterator it = extentheap_->begin(); 
-                 it != extentheap_->end(); ++it) 
-            {
-                if ((*it).nvheader()->is_free() && (*it).nvheader()->size() == slabsize_) 
-                {
-                    SlabT* slab = insert_slab(ctx, (*it).nvextent());
-                    if (!slab) {
-                        return kErrorCodeOutofmemory;    
+            extentheap_->for_each_allocated(nvExtentHeaderT::kExtentTagSlab,
+                [&](Extent<Context, TPtr, PPtr> ex) {
+                    TPtr<nvSlab<Context, TPtr>> nvslab = ex.nvextent();
+                    if (nvslab->sizeclass() < (size_t) kSizeClasses) {
+                        // descriptor pointer is stale from a previous run
+                        nvslab->set_slab(NULL);
+                        lazy_slabs_[nvslab->sizeclass()].push_back(nvslab);
                     }
-                }
-            }
+                });
         }
         return kErrorCodeOk;
     }
 
-    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr)
+    /**
+     * @brief Return the extents of recorded but not yet loaded slabs that 
+     * hold no allocated blocks to the extent heap
+     *
+     * @details
+     * Such slabs are left behind by frees before a restart and by 
+     * transactions that never committed their block allocations. Without
+     * this they stay reserved until their sizeclass is requested again.
+     * Loaded slabs are left to the usual empty slab handling. Must be 
+     * called on the root slab heap, which serializes with load_slab.
+     *
+     * @return the number of slabs reclaimed
+     */
+    size_t reclaim_lazy_slabs(Context& ctx)
     {
-        const int szclass = sizeclass(size_bytes);
-
-        lock(); 
-        SlabT* slab = find_slab(szclass);
+        TPtr<void> region[kMaxEmptySlabs];
+        size_t nreclaimed = 0;
 
-        // No slab of requested sizeclass, so try to reuse an empty one.
-        if (!slab) {
-            slab = reuse_empty_slab(ctx, szclass);
+        if (!extentheap_) {
+            return 0;
         }
-
-        // No slab in this heap so try to get a slab from the parent slab 
-        // heap if we have one
-        if (!slab && parentslabheap_) {
-            slab = parentslabheap_->acquire_slab(ctx, szclass);
-            if (slab) {
-                insert_slab(slab, szclass);
+        Context dctx = ctx.direct();
+        dctx.do_nv = true;
+        for (int szclass=0; szclass<kSizeClasses; szclass++) {
+            size_t n = 0;
+            lock();
+            std::vector<TPtr<nvSlab<Context, TPtr>>>& lazy = lazy_slabs_[szclass];
+            for (size_t i=0; i<lazy.size(); ) {
+                TPtr<nvSlab<Context, TPtr>> nvslab = lazy[i];
+                if (nvslab->slab() || nvslab->nblocks_free(dctx) != nvslab->nblocks()) {
+                    i++;
+                    continue;
+                }
+                lazy[i] = lazy.back();
+                lazy.pop_back();
+                region[n++] = nvslab;
+                if (n == kMaxEmptySlabs) {
+                    extentheap_->free_batch(dctx, region, n);
+                    nreclaimed += n;
+                    n = 0;
+                }
             }
+            extentheap_->free_batch(dctx, region, n);
+            nreclaimed += n;
+            unlock();
         }
- 
-        // No slab in parent heap so try to get a new chunk from the extent 
-        // heap and format it as a slab
-        if (!slab && extentheap_) {
-            TPtr<void> region;
-            if (extentheap_->malloc(ctx, slabsize_, &region) == kErrorCodeOk) {
-                slab = SlabT::make(ctx, region, slabsize_, szclass);
-                insert_slab(slab, szclass);
+        return nreclaimed;
+    }
+
+    ErrorCode malloc(Context& ctx, size_t size_bytes, TPtr<void>* ptr)
+    {
+        const int szclass = sizeclass(size_bytes);
+        Magazine* mag = magazine(szclass);
+
+        if (mag->nblocks == 0) {
+            lock(); 
+            drain_remote_frees(ctx);
+            fill_magazine(ctx, szclass, mag);
+            unlock(); 
+            if (mag->nblocks == 0) {
+                return kErrorCodeOutofmemory;
             }
         }
-            
-        if (slab) {
-            *ptr = alloc_block(ctx, slab);
-            assert(*ptr != null_ptr);
-        }
-        unlock(); 
+
+        mag->nblocks--;
+        *ptr = mag->block[mag->nblocks];
+        mag->slab[mag->nblocks]->commit_block(ctx, *ptr);
 
         return kErrorCodeOk;
     }
 
     void free(Context& ctx, TPtr<void> ptr) 
     {
-        Extent<Context,TPtr,PPtr> ex;
-        ErrorCode rc = extentheap_->extent(ptr, &ex);
-        ASSERT_ND(rc == kErrorCodeOk);
+        SlabT* slab = slab_of(ctx, ptr);
 
-        SlabT* slab = SlabT::slab(ex.nvextent());
+        if (ctx.do_nv) {
+            slab->free_block_nv(ctx, ptr);
+        }
+        if (!ctx.do_v) {
+            return;
+        }
 
-        // Expect this to finish after a few iterations as a slab that is 
-        // moved between two slab heaps eventually ends up in a slabheap
-        for (;;) {
-            SlabHeap* owner = reinterpret_cast<SlabHeap*>(slab->owner());
-            if (owner) {
-                owner->lock();
-                if (owner == slab->owner()) {
-                    owner->free_block(ctx, slab, ptr);
-                    owner->unlock();
-                    break;
-                }
-                owner->unlock();
+        SlabHeap* owner = reinterpret_cast<SlabHeap*>(slab->owner());
+        if (owner == this) {
+            Magazine* mag = magazine(slab->sizeclass());
+            if (mag->nblocks == kMagazineSize) {
+                lock();
+                flush_magazine(ctx, mag, kMagazineSize/2);
+                unlock();
             }
+            mag->slab[mag->nblocks] = slab;
+            mag->block[mag->nblocks] = ptr;
+            mag->nblocks++;
+        } else {
+            // A slab in transit between two slab heaps has no owner, so 
+            // park the block with us until the next drain forwards it
+            (owner ? owner : this)->push_remote_free(ptr);
         }
     }
 
-    size_t getsize(TPtr<void> ptr) 
+    size_t getsize(Context& ctx, TPtr<void> ptr) 
     {
         Extent<Context, TPtr, PPtr> ex;
-        ErrorCode rc = extentheap_->extent(ptr, &ex);
+        ErrorCode rc = extentheap_->extent(ctx, ptr, &ex);
         if (rc != kErrorCodeOk) {
             return 0;
         }
@@ -152,12 +230,31 @@ public:
         if (exsz == slabsize_ && 
             (TPtr<char>(ptr) - TPtr<char>(ex.nvextent())) != 0)
         {
-            SlabT* slab = SlabT::slab(ex.nvextent());
-            return slab->block_size();
+            // the slab may not be loaded yet, so ask its persistent header
+            TPtr<nvSlab<Context, TPtr>> nvslab = ex.nvextent();
+            return nvslab->block_size();
         }
         return exsz;
     }
 
+    /**
+     * @brief Return whether ptr is a block within a slab rather than the 
+     * start of an extent
+     *
+     * @details
+     * Block sizes are rounded up to a sizeclass, so the size of a block 
+     * alone does not tell which heap it came from.
+     */
+    bool is_block(Context& ctx, TPtr<void> ptr)
+    {
+        Extent<Context, TPtr, PPtr> ex;
+        if (extentheap_->extent(ctx, ptr, &ex) != kErrorCodeOk) {
+            return false;
+        }
+        return extentheap_->blocksize() * ex.len() == slabsize_ && 
+               (TPtr<char>(ptr) - TPtr<char>(ex.nvextent())) != 0;
+    }
+
     TPtr<void> alloc_block(Context& ctx, SlabT* slab)
     {
         TPtr<void> ptr;
@@ -176,14 +273,43 @@ public:
         return ptr;
     }
 
+    TPtr<void> reserve_block(SlabT* slab)
+    {
+        TPtr<void> ptr;
+
+        bool empty = slab->empty();
+        int old_fullness = slab->fullness();
+        ptr = slab->reserve_block();
+        if (ptr != null_ptr) {
+            int new_fullness = slab->fullness();
+            if (empty || (new_fullness != old_fullness)) {
+                move_slab(slab, slab->sizeclass(), new_fullness);
+            }
+        }
+        return ptr;
+    }
+
     void free_block(Context& ctx, SlabT* slab, TPtr<void> ptr)
+    {
+        if (ctx.do_nv) {
+            slab->free_block_nv(ctx, ptr);
+        }
+        if (ctx.do_v) {
+            release_block(ctx, slab, ptr);
+        }
+    }
+
+    void release_block(Context& ctx, SlabT* slab, TPtr<void> ptr)
     {
         int old_fullness = slab->fullness();
-        slab->free_block(ctx, ptr);
+        slab->release_block(ptr);
         if (slab->empty()) {
             LOG(info) << "Free block: " << "recycle now empty slab";
             slab->remove();
             insert_slab_to_empty(slab);
+            if (empty_slabs_.size() > kMaxEmptySlabs) {
+                release_empty_slabs(ctx, kMaxEmptySlabs/2);
+            }
         } else {
             int new_fullness = slab->fullness();
             int szclass = slab->sizeclass();
@@ -192,31 +318,35 @@ public:
         }
     }
 
-    SlabT* acquire_slab(Context& ctx, int szclass)
+    /**
+     * @brief Hand a slab of szclass to a child slab heap allocating from 
+     * arena
+     *
+     * @details
+     * New slabs are only formatted for children of our own arena, so a
+     * parent with a negative arena passes on just the slabs it already has.
+     */
+    SlabT* acquire_slab(Context& ctx, int szclass, int arena)
     {
         SlabT* slab;
 
         lock();
+        drain_remote_frees(ctx);
         slab = find_slab(szclass);
+        if (!slab && load_lazy_slabs(ctx, szclass)) {
+            slab = find_slab(szclass);
+        }
         if (!slab) {
             slab = reuse_empty_slab(ctx, szclass);
         }
+        if (!slab && extentheap_ && arena == arena_) {
+            slab = make_slabs(ctx, szclass);
+        }
         if (slab) {
             remove_slab(slab);
-            unlock();
-            return slab;
-        }
-
-        if (extentheap_) {
-            TPtr<void> region;
-            if (extentheap_->malloc(ctx, slabsize_, &region) == kErrorCodeOk) {
-                SlabT* slab = SlabT::make(ctx, region, slabsize_, szclass);
-                unlock();
-                return slab;
-            }
         }
         unlock();
-        return NULL;
+        return slab;
     }
 
     SlabT* find_slab(const int szclass)
@@ -242,7 +372,8 @@ public:
     {
         LOG(info) << "Insert slab: " << nvslab;
 
-        SlabT* slab = SlabT::load(ctx, nvslab);
+        Context dctx = ctx.direct();
+        SlabT* slab = SlabT::load(dctx, nvslab);
         insert_slab(slab, nvslab->sizeclass());
         return slab;
     }
@@ -322,6 +453,207 @@ public:
     }
 
 private:
+    struct Magazine {
+        int         nblocks;
+        SlabT*      slab[kMagazineSize];
+        TPtr<void>  block[kMagazineSize];
+    };
+
+    Magazine* magazine(int szclass)
+    {
+        if (!magazine_[szclass]) {
+            magazine_[szclass] = new Magazine();
+        }
+        return magazine_[szclass];
+    }
+
+    SlabT* slab_of(Context& ctx, TPtr<void> ptr)
+    {
+        Extent<Context,TPtr,PPtr> ex;
+        ErrorCode rc = extentheap_->extent(ptr, &ex);
+        ASSERT_ND(rc == kErrorCodeOk);
+        SlabT* slab = SlabT::slab(ex.nvextent());
+        if (!slab) {
+            slab = root()->load_slab(ctx, ex.nvextent());
+        }
+        return slab;
+    }
+
+    SlabHeap* root()
+    {
+        SlabHeap* heap = this;
+        while (heap->parentslabheap_) {
+            heap = heap->parentslabheap_;
+        }
+        return heap;
+    }
+
+    /**
+     * @brief Load a slab not yet loaded by load_lazy_slabs
+     */
+    SlabT* load_slab(Context& ctx, TPtr<void> region)
+    {
+        lock();
+        SlabT* slab = SlabT::slab(region);
+        if (!slab) {
+            slab = insert_slab(ctx, TPtr<nvSlab<Context, TPtr>>(region));
+        }
+        unlock();
+        return slab;
+    }
+
+    /**
+     * @brief Load the slabs of sizeclass found by init 
+     *
+     * @return whether there were any
+     */
+    bool load_lazy_slabs(Context& ctx, int szclass)
+    {
+        std::vector<TPtr<nvSlab<Context, TPtr>>>& lazy = lazy_slabs_[szclass];
+        if (lazy.empty()) {
+            return false;
+        }
+        for (size_t i=0; i<lazy.size(); i++) {
+            if (!lazy[i]->slab()) {
+                insert_slab(ctx, lazy[i]);
+            }
+        }
+        std::vector<TPtr<nvSlab<Context, TPtr>>>().swap(lazy);
+        return true;
+    }
+
+    /**
+     * @brief Reserve up to half a magazine of blocks from our slabs, 
+     * pulling slabs from the parent or the extent heap as needed 
+     */
+    void fill_magazine(Context& ctx, int szclass, Magazine* mag)
+    {
+        while (mag->nblocks < kMagazineSize/2) {
+            SlabT* slab = find_slab(szclass);
+
+            // First request of this sizeclass since init
+            if (!slab && load_lazy_slabs(ctx, szclass)) {
+                slab = find_slab(szclass);
+            }
+
+            // No slab of requested sizeclass, so try to reuse an empty one.
+            if (!slab) {
+                slab = reuse_empty_slab(ctx, szclass);
+            }
+
+            // No slab in this heap so try to get a slab from the parent slab 
+            // heap if we have one
+            if (!slab && parentslabheap_) {
+                slab = parentslabheap_->acquire_slab(ctx, szclass, arena_);
+                if (slab) {
+                    insert_slab(slab, szclass);
+                }
+            }
+
+            // No slab in parent heap so try to get new chunks from the 
+            // extent heap and format them as slabs
+            if (!slab && extentheap_) {
+                slab = make_slabs(ctx, szclass);
+            }
+
+            if (!slab) {
+                break;
+            }
+            while (mag->nblocks < kMagazineSize/2 && !slab->full()) {
+                mag->slab[mag->nblocks] = slab;
+                mag->block[mag->nblocks] = reserve_block(slab);
+                mag->nblocks++;
+            }
+        }
+    }
+
+    void flush_magazine(Context& ctx, Magazine* mag, int nblocks)
+    {
+        for (int i=0; i<nblocks; i++) {
+            mag->nblocks--;
+            release_block(ctx, mag->slab[mag->nblocks], mag->block[mag->nblocks]);
+        }
+    }
+
+    /**
+     * @brief Get a batch of slab-sized chunks from the extent heap, returning
+     * the first formatted as a szclass slab and keeping the rest as empty slabs
+     */
+    SlabT* make_slabs(Context& ctx, int szclass)
+    {
+        TPtr<void> region[kSlabBatchSize];
+        Context dctx = ctx.direct();
+        int n = extentheap_->malloc_batch(dctx, slabsize_, kSlabBatchSize, region, 
+                                          nvExtentHeaderT::kExtentTagSlab, arena_);
+        if (n == 0) {
+            return NULL;
+        }
+        SlabT* slab = SlabT::make(dctx, region[0], slabsize_, szclass);
+        insert_slab(slab, szclass);
+        for (int i=1; i<n; i++) {
+            insert_slab(SlabT::make(dctx, region[i], slabsize_, szclass), szclass);
+        }
+        return slab;
+    }
+
+    void release_empty_slabs(Context& ctx, size_t nslabs)
+    {
+        TPtr<void> region[kMaxEmptySlabs];
+        size_t n = 0;
+
+        if (!extentheap_) {
+            return;
+        }
+        for (; n < nslabs && empty_slabs_.size(); n++) {
+            SlabT* slab = empty_slabs_.back();
+            remove_slab(slab);
+            region[n] = slab->region();
+            delete slab;
+        }
+
+        // Marking extents free is a persistent operation even when we got 
+        // here through the volatile half of a free
+        Context nvctx = ctx.direct();
+        nvctx.do_nv = true;
+        extentheap_->free_batch(nvctx, region, n);
+    }
+
+    void push_remote_free(TPtr<void> ptr)
+    {
+        // The block is free so its first word links the stack
+        void* block = ptr.get();
+        void* head = remote_free_.load(std::memory_order_relaxed);
+        do {
+            *reinterpret_cast<void**>(block) = head;
+        } while (!remote_free_.compare_exchange_weak(head, block,
+                                                     std::memory_order_release,
+                                                     std::memory_order_relaxed));
+    }
+
+    /**
+     * @brief Return blocks freed by other threads to their slabs 
+     *
+     * @details
+     * Only the owner pops, and it takes the whole stack with a single
+     * exchange so there is no ABA hazard.
+     */
+    void drain_remote_frees(Context& ctx)
+    {
+        void* block = remote_free_.exchange(NULL, std::memory_order_acquire);
+        while (block) {
+            void* next = *reinterpret_cast<void**>(block);
+            TPtr<void> ptr(block);
+            SlabT* slab = slab_of(ctx, ptr);
+            SlabHeap* owner = reinterpret_cast<SlabHeap*>(slab->owner());
+            if (owner == this) {
+                release_block(ctx, slab, ptr);
+            } else {
+                (owner ? owner : this)->push_remote_free(ptr);
+            }
+            block = next;
+        }
+    }
+
     void insert_slab_to_empty(SlabT* slab)
     {
         slab->insert(&empty_slabs_);
@@ -335,7 +667,8 @@ private:
             int fullness = slab->fullness();
             move_slab(slab, szclass, fullness);
             if (slab->sizeclass() != szclass) {
-                slab->reset(ctx, slabsize_, szclass);
+                Context dctx = ctx.direct();
+                slab->reset(dctx, slabsize_, szclass);
             }
         }
         return slab;
@@ -345,7 +678,17 @@ protected:
     size_t            slabsize_;
     SlabHeap*         parentslabheap_;
     ExtentHeapT*      extentheap_;
+    int               arena_;      // extent heap arena new slabs come from
     pthread_mutex_t   mutex_;
+
+    //! blocks freed by other threads into slabs we own
+    std::atomic<void*> remote_free_;
+
+    //! per-sizeclass blocks reserved for this heap, allocated on first use
+    Magazine*         magazine_[kSizeClasses];
+
+    //! per-sizeclass slabs found by init but not loaded yet
+    std::vector<TPtr<nvSlab<Context, TPtr>>> lazy_slabs_[kSizeClasses];
     
     //! completely or partially full slabs
     typename SlabT::SlabList full_slabs_[kSizeClasses][kSlabFullnessBins]; 
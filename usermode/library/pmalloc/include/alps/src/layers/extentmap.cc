@@ -207,6 +207,23 @@ int ExtentMap::remove_ge(size_t len, ExtentInterval* nex)
     return 0;
 }
 
+int ExtentMap::remove_at(size_t start, size_t len)
+{
+    MapAddr::iterator ita = map_addr_.find(start);
+    if (ita == map_addr_.end() || ita->second->len() < len) {
+        return -1;
+    }
+    ExtentInterval* ex = ita->second;
+    map_len_.erase(MapLenKey(ex->len(), ex->start()));
+    map_addr_.erase(ita);
+    ExtentInterval rest(ex->start() + len, ex->len() - len);
+    delete ex;
+    if (rest.len() > 0) {
+        insert(rest);
+    }
+    return 0;
+}
+
 void ExtentMap::stream_to(std::ostream& os) const
 {
     for (MapAddr::const_iterator it = map_addr_.begin(); 
@@ -18,6 +18,66 @@
 
 namespace alps {
 
-size_t size_table[kSizeClasses] = {8LLU, 16LLU, 24LLU, 32LLU, 40LLU, 48LLU, 56LLU, 64LLU, 72LLU, 80LLU, 88LLU, 96LLU, 104LLU, 112LLU, 120LLU, 128LLU, 136LLU, 144LLU, 152LLU, 160LLU, 168LLU, 176LLU, 184LLU, 192LLU, 200LLU, 208LLU, 216LLU, 224LLU, 232LLU, 240LLU, 248LLU, 256LLU, 264LLU, 272LLU, 280LLU, 288LLU, 296LLU, 304LLU, 312LLU, 320LLU, 328LLU, 336LLU, 344LLU, 352LLU, 360LLU, 368LLU, 376LLU, 384LLU, 392LLU, 400LLU, 408LLU, 416LLU, 424LLU, 432LLU, 440LLU, 448LLU, 456LLU, 464LLU, 472LLU, 480LLU, 488LLU, 496LLU, 504LLU, 512LLU, 576LLU, 640LLU, 704LLU, 768LLU, 832LLU, 896LLU, 960LLU, 1024LLU, 1536LLU, 2048LLU, 2560LLU, 3072LLU, 3584LLU, 4096LLU, 4608LLU, 5120LLU, 5632LLU, 6144LLU, 6656LLU, 7168LLU, 7680LLU, 8192LLU, 9216LLU, 10240LLU, 11264LLU, 12288LLU, 13312LLU, 14336LLU, 15360LLU, 16384LLU, 18432LLU, 20480LLU, 22528LLU, 24576LLU, 26624LLU, 28672LLU, 30720LLU, 16384LLU, 32768LLU, 49152LLU, 65536LLU, 81920LLU, 98304LLU, 114688LLU, 131072LLU, 147456LLU, 163840LLU, 180224LLU, 196608LLU, 212992LLU, 229376LLU, 245760LLU};
+// Class 102 repeats 30720. It held an out-of-order 16384 that no lookup 
+// could return, so no slab ever recorded it.
+size_t size_table[kSizeClasses] = {8LLU, 16LLU, 24LLU, 32LLU, 40LLU, 48LLU, 56LLU, 64LLU, 72LLU, 80LLU, 88LLU, 96LLU, 104LLU, 112LLU, 120LLU, 128LLU, 136LLU, 144LLU, 152LLU, 160LLU, 168LLU, 176LLU, 184LLU, 192LLU, 200LLU, 208LLU, 216LLU, 224LLU, 232LLU, 240LLU, 248LLU, 256LLU, 264LLU, 272LLU, 280LLU, 288LLU, 296LLU, 304LLU, 312LLU, 320LLU, 328LLU, 336LLU, 344LLU, 352LLU, 360LLU, 368LLU, 376LLU, 384LLU, 392LLU, 400LLU, 408LLU, 416LLU, 424LLU, 432LLU, 440LLU, 448LLU, 456LLU, 464LLU, 472LLU, 480LLU, 488LLU, 496LLU, 504LLU, 512LLU, 576LLU, 640LLU, 704LLU, 768LLU, 832LLU, 896LLU, 960LLU, 1024LLU, 1536LLU, 2048LLU, 2560LLU, 3072LLU, 3584LLU, 4096LLU, 4608LLU, 5120LLU, 5632LLU, 6144LLU, 6656LLU, 7168LLU, 7680LLU, 8192LLU, 9216LLU, 10240LLU, 11264LLU, 12288LLU, 13312LLU, 14336LLU, 15360LLU, 16384LLU, 18432LLU, 20480LLU, 22528LLU, 24576LLU, 26624LLU, 28672LLU, 30720LLU, 30720LLU, 32768LLU, 49152LLU, 65536LLU, 81920LLU, 98304LLU, 114688LLU, 131072LLU, 147456LLU, 163840LLU, 180224LLU, 196608LLU, 212992LLU, 229376LLU, 245760LLU};
+
+uint8_t small_size_index[(kSmallSizeMax >> 3) + 1];
+uint8_t large_size_index[64 << kSizeSubBits];
+
+// Linear scan over size_table, as the lookup tables are built from it
+static int sizeclass_scan(size_t sz, int from)
+{
+    int sizeclass = from;
+    while (sizeclass < kSizeClasses - 1 && size_table[sizeclass] < sz) {
+        sizeclass++;
+    }
+    return sizeclass;
+}
+
+void build_size_class_index()
+{
+    for (size_t i = 0; i <= (kSmallSizeMax >> 3); i++) {
+        small_size_index[i] = sizeclass_scan(i << 3, 0);
+    }
+    for (int msb = 10; msb < 64; msb++) {
+        for (int sub = 0; sub < (1 << kSizeSubBits); sub++) {
+            // smallest size falling in this bucket
+            size_t sz = ((1ULL << msb) | ((size_t) sub << (msb - kSizeSubBits))) + 1;
+            large_size_index[(msb << kSizeSubBits) | sub] = sizeclass_scan(sz, 0);
+        }
+    }
+}
+
+ErrorCode load_size_classes(const size_t* sizes, int nsizes, size_t max_size, size_t max_block_size)
+{
+    if (nsizes <= 0 || nsizes > kSizeClasses) {
+        return kErrorCodeInvalidParameter;
+    }
+    // Classes past the first one holding max_size are never used, so 
+    // they are dropped rather than checked
+    int nused = 0;
+    while (nused < nsizes && sizes[nused] < max_size) {
+        nused++;
+    }
+    if (nused == nsizes || sizes[nused] > max_block_size) {
+        return kErrorCodeInvalidParameter;
+    }
+    nsizes = nused + 1;
+    for (int i = 0; i < nsizes; i++) {
+        if (sizes[i] == 0 || sizes[i] % 8 || (i > 0 && sizes[i] < sizes[i-1])) {
+            return kErrorCodeInvalidParameter;
+        }
+    }
+    for (int i = 0; i < kSizeClasses; i++) {
+        size_table[i] = sizes[i < nsizes ? i : nsizes - 1];
+    }
+    build_size_class_index();
+    return kErrorCodeOk;
+}
+
+static struct SizeClassIndexInit {
+    SizeClassIndexInit() { build_size_class_index(); }
+} size_class_index_init;
 
 } // namespace alps
@@ -17,17 +17,39 @@
 #ifndef _ALPS_SIZECLASS_HH_
 #define _ALPS_SIZECLASS_HH_
 
+#include <stdint.h>
 #include <sys/types.h>
 
+#include "alps/common/error_code.hh"
+
 namespace alps {
 
 const int kSizeClasses = 116;
 
 extern size_t size_table[kSizeClasses];
 
+// Sizes up to kSmallSizeMax map to their class through small_size_index, 
+// indexed by (size + 7) >> 3. Larger sizes map through large_size_index, 
+// indexed by the most significant bit of (size - 1) and the kSizeSubBits 
+// bits below it, which yields the smallest class that may fit the size.
+const size_t kSmallSizeMax = 1024;
+const int kSizeSubBits = 3;
+
+extern uint8_t small_size_index[(kSmallSizeMax >> 3) + 1];
+extern uint8_t large_size_index[64 << kSizeSubBits];
+
+inline int large_size_bucket(size_t sz)
+{
+    int msb = 63 - __builtin_clzll(sz - 1);
+    return (msb << kSizeSubBits) | (((sz - 1) >> (msb - kSizeSubBits)) & ((1 << kSizeSubBits) - 1));
+}
+
 inline int sizeclass(size_t sz)
 {
-    int sizeclass = 0;
+    if (sz <= kSmallSizeMax) {
+        return small_size_index[(sz + 7) >> 3];
+    }
+    int sizeclass = large_size_index[large_size_bucket(sz)];
     while (size_table[sizeclass] < sz) {
         sizeclass++;
     }
@@ -39,6 +61,24 @@ inline size_t size_from_class(const int sizeclass)
     return size_table[sizeclass];
 }
 
+/**
+ * @brief Rebuild the size class lookup tables from size_table
+ */
+void build_size_class_index();
+
+/**
+ * @brief Replace the size class schedule 
+ *
+ * @details
+ * Sizes must be non-decreasing multiples of 8 and at most kSizeClasses 
+ * of them. Some class must hold max_size, the largest size served from 
+ * slabs, and that class must be at most max_block_size, the largest block
+ * a slab can hold. Classes past it are dropped. On error the current 
+ * schedule is kept. Slabs record their size class by index, so a heap 
+ * must always be reopened with the schedule it was created with.
+ */
+ErrorCode load_size_classes(const size_t* sizes, int nsizes, size_t max_size, size_t max_block_size);
+
 } // namespace alps
 
 #endif // _ALPS_SIZECLASS_HH_
@@ -110,6 +110,50 @@ TEST(BitMap, clear)
     test_clear(256);
 }
 
+TEST(BitMap, word)
+{
+    Context ctx;
+    uint64_t buf[4];
+    int bitmap_len = 200;
+
+    nvBitMap_t* bm = nvBitMap_t::make(ctx, bitmap_len, buf);
+
+    bm->set(ctx, 0);
+    bm->set(ctx, 63);
+    bm->set(ctx, 64);
+    bm->set(ctx, 199);
+    EXPECT_EQ(0x8000000000000001ULL, bm->word(ctx, 0));
+    EXPECT_EQ(0x1ULL, bm->word(ctx, 1));
+    EXPECT_EQ(0x0ULL, bm->word(ctx, 2));
+    EXPECT_EQ(1ULL << (199 % 64), bm->word(ctx, 3));
+}
+
+TEST(BitMap, set_clear_leave_other_bits)
+{
+    Context ctx;
+    uint64_t buf[2];
+    int bitmap_len = 128;
+
+    nvBitMap_t* bm = nvBitMap_t::make(ctx, bitmap_len, buf);
+
+    // all-full word
+    for (int i=0; i<64; i++) {
+        bm->set(ctx, i);
+    }
+    EXPECT_EQ(~0ULL, bm->word(ctx, 0));
+    EXPECT_EQ(0ULL, bm->word(ctx, 1));
+    bm->clear(ctx, 5);
+    EXPECT_EQ(~(1ULL << 5), bm->word(ctx, 0));
+    bm->set(ctx, 5);
+    EXPECT_EQ(~0ULL, bm->word(ctx, 0));
+
+    // all-free word
+    bm->set(ctx, 70);
+    bm->clear(ctx, 70);
+    EXPECT_EQ(0ULL, bm->word(ctx, 1));
+    EXPECT_EQ(~0ULL, bm->word(ctx, 0));
+}
+
 int main(int argc, char** argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
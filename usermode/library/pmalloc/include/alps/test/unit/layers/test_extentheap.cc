@@ -17,6 +17,7 @@
 #include <fcntl.h>
 
 #include <cinttypes>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "alps/layers/pointer.hh"
@@ -25,17 +26,9 @@
 #include "allochelper.hh"
 #include "test_common.hh"
 
-using namespace alps;
-
-class Context {
-public:
-    Context()
-        : do_v(true), do_nv(true)
-    { }
+#include "test_layers_common.hh"
 
-    bool do_v;
-    bool do_nv;
-};
+using namespace alps;
 
 typedef nvExtentHeap<Context, TPtr, PPtr> nvExtentHeap_t;
 
@@ -170,7 +163,243 @@ TEST(ExtentHeapTest, load)
     EXPECT_EQ(0, exb.nvheader()->is_free());
 }
 
+// Allocate single blocks until the heap runs out, checking none of them 
+// overlaps an extent in live, and return how many we got
+template<typename ExtentHeapT, typename ExtentT, typename ContextT>
+static size_t alloc_remaining(ContextT& ctx, ExtentHeapT* exheap, ExtentT* live, int nlive)
+{
+    size_t nblocks = 0;
+    ExtentT ex;
+    while (exheap->alloc_extent(ctx, 1, &ex) == kErrorCodeOk) {
+        for (int i=0; i<nlive; i++) {
+            EXPECT_TRUE(ex.start() < live[i].start() || ex.start() >= live[i].end());
+        }
+        nblocks++;
+    }
+    return nblocks;
+}
+
+TEST(ExtentHeapTest, load_summary)
+{
+    Context ctx;
+    TPtr<void> region = malloc(region_size);
+
+    ExtentHeap_t* exheap = ExtentHeap_t::make(region, region_size, block_log2size);
+    TPtr<nvExtentHeap_t> nvexheap = region;
+    EXPECT_TRUE(nvexheap->has_summary());
+
+    Extent_t ex[6];
+    size_t sizes[6] = {10, 3, 14, 1, 64, 7};
+    for (int i=0; i<6; i++) {
+        EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, sizes[i], &ex[i]));
+    }
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[1]));
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[4]));
+    Extent_t live[4] = {ex[0], ex[2], ex[3], ex[5]};
+
+    // the summary lists exactly the live extents, in address order
+    int n = 0;
+    nvexheap->for_each_allocated(
+        [&](ExtentInterval interval, TPtr<nvExtentHeader<Context, TPtr>> exhdr) {
+            ASSERT_LT(n, 4);
+            EXPECT_EQ(live[n].start(), interval.start());
+            EXPECT_EQ(live[n].len(), interval.len());
+            n++;
+        });
+    EXPECT_EQ(4, n);
+
+    // the free space rebuilt from the gaps is everything else
+    ExtentHeap_t* exheapb = ExtentHeap_t::load(region);
+    size_t nlive = 10 + 14 + 1 + 7;
+    EXPECT_EQ(nvexheap->header_.nblocks - nlive, alloc_remaining(ctx, exheapb, live, 4));
+}
+
+TEST(ExtentHeapTest, load_without_summary)
+{
+    Context ctx;
+    TPtr<void> region = malloc(region_size);
+
+    ExtentHeap_t* exheap = ExtentHeap_t::make(region, region_size, block_log2size);
+    Extent_t ex[3];
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 10, &ex[0]));
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 3, &ex[1]));
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 14, &ex[2]));
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[1]));
+    Extent_t live[2] = {ex[0], ex[2]};
+
+    // a heap made before the summary existed is loaded from its headers
+    TPtr<nvExtentHeap_t> nvexheap = region;
+    nvexheap->header_.magic = 0;
+    EXPECT_FALSE(nvexheap->has_summary());
+
+    ExtentHeap_t* exheapb = ExtentHeap_t::load(region);
+    int n = 0;
+    nvexheap->for_each_allocated(
+        [&](ExtentInterval interval, TPtr<nvExtentHeader<Context, TPtr>> exhdr) {
+            ASSERT_LT(n, 2);
+            EXPECT_EQ(live[n].start(), interval.start());
+            n++;
+        });
+    EXPECT_EQ(2, n);
+    EXPECT_EQ(nvexheap->header_.nblocks - 24, alloc_remaining(ctx, exheapb, live, 2));
+}
+
+
+
+template<typename nvExtentHeapT>
+static bool summary_bit(TPtr<nvExtentHeapT> nvexheap, size_t idx)
+{
+    return (nvexheap->summary()[idx / 64] >> (idx % 64)) & 1;
+}
+
+TEST(ExtentHeapTest, summary_alloc_free)
+{
+    Context ctx;
+    TPtr<void> region = malloc(region_size);
+
+    ExtentHeap_t* exheap = ExtentHeap_t::make(region, region_size, block_log2size);
+    TPtr<nvExtentHeap_t> nvexheap = region;
+    Extent_t ex[2];
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 70, &ex[0]));
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 2, &ex[1]));
+
+    // one bit for the first block of each extent
+    EXPECT_TRUE(summary_bit(nvexheap, ex[0].start()));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[1].start()));
+    for (size_t i=ex[0].start()+1; i<ex[0].end(); i++) {
+        EXPECT_FALSE(summary_bit(nvexheap, i));
+    }
+
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[0]));
+    EXPECT_FALSE(summary_bit(nvexheap, ex[0].start()));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[1].start()));
+}
 
+TEST(ExtentHeapTest, summary_stale_bits)
+{
+    Context ctx;
+    TPtr<void> region = malloc(region_size);
+
+    ExtentHeap_t* exheap = ExtentHeap_t::make(region, region_size, block_log2size);
+    TPtr<nvExtentHeap_t> nvexheap = region;
+    Extent_t ex[3];
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 10, &ex[0]));
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 3, &ex[1]));
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 14, &ex[2]));
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[1]));
+
+    // crash between setting the bit and the header of an allocation, 
+    // and a bit on the run block of an extent written by older versions
+    size_t run = ex[2].start() + 1;
+    nvexheap->summary_set(ctx, ex[1].start());
+    nvexheap->summary_set(ctx, run);
+    nvExtentHeader<Context, TPtr>::make(nvexheap->extent_header(run), 
+                                        nvExtentHeader<Context, TPtr>::kBlockTypeExtentRun);
+
+    // loading drops both bits and keeps their blocks out of the live set
+    Extent_t live[2] = {ex[0], ex[2]};
+    ExtentHeap_t* exheapb = ExtentHeap_t::load(region);
+    EXPECT_FALSE(summary_bit(nvexheap, ex[1].start()));
+    EXPECT_FALSE(summary_bit(nvexheap, run));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[0].start()));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[2].start()));
+    EXPECT_EQ(nvexheap->header_.nblocks - 24, alloc_remaining(ctx, exheapb, live, 2));
+}
+
+// Context that holds back persistent stores until commit while in a 
+// transaction, like the redo log does
+class RedoContext: public Context {
+public:
+    RedoContext()
+        : in_tx_(false)
+    { }
+
+    void store(uint8_t* src, uint8_t *dest, size_t size)
+    {
+        if (!in_tx_) {
+            return Context::store(src, dest, size);
+        }
+        for (size_t i=0; i<size; i++) {
+            redo_.push_back(std::make_pair(dest + i, src[i]));
+        }
+    }
+
+    void store_masked(uint64_t* dest, uint64_t value, uint64_t mask)
+    {
+        if (!in_tx_) {
+            return Context::store_masked(dest, value, mask);
+        }
+        masked_.push_back(std::make_pair(dest, std::make_pair(value, mask)));
+    }
+
+    void begin()
+    {
+        in_tx_ = true;
+    }
+
+    void commit()
+    {
+        for (size_t i=0; i<redo_.size(); i++) {
+            *redo_[i].first = redo_[i].second;
+        }
+        for (size_t i=0; i<masked_.size(); i++) {
+            Context::store_masked(masked_[i].first, masked_[i].second.first, masked_[i].second.second);
+        }
+        abort();
+    }
+
+    void abort()
+    {
+        in_tx_ = false;
+        redo_.clear();
+        masked_.clear();
+    }
+
+private:
+    bool in_tx_;
+    std::vector<std::pair<uint8_t*, uint8_t>> redo_;
+    std::vector<std::pair<uint64_t*, std::pair<uint64_t, uint64_t>>> masked_;
+};
+
+typedef nvExtentHeap<RedoContext, TPtr, PPtr> RedoNvExtentHeap_t;
+typedef ExtentHeap<RedoContext, TPtr, PPtr> RedoExtentHeap_t;
+typedef Extent<RedoContext, TPtr, PPtr> RedoExtent_t;
+
+TEST(ExtentHeapTest, summary_redo)
+{
+    RedoContext ctx;
+    TPtr<void> region = malloc(region_size);
+
+    RedoExtentHeap_t* exheap = RedoExtentHeap_t::make(region, region_size, block_log2size);
+    TPtr<RedoNvExtentHeap_t> nvexheap = region;
+    RedoExtent_t ex[2];
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 10, &ex[0]));
+
+    // header and summary bit change together at commit
+    ctx.begin();
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 5, &ex[1]));
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[0]));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[0].start()));
+    EXPECT_FALSE(summary_bit(nvexheap, ex[1].start()));
+    EXPECT_TRUE(ex[1].nvheader()->is_free());
+
+    // a crash before commit reloads the heap as it was
+    ctx.abort();
+    RedoExtentHeap_t* exheapb = RedoExtentHeap_t::load(region);
+    EXPECT_EQ(nvexheap->header_.nblocks - 10, alloc_remaining(ctx, exheapb, ex, 1));
+
+    // and after commit as the transaction left it
+    exheap = RedoExtentHeap_t::make(region, region_size, block_log2size);
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 10, &ex[0]));
+    ctx.begin();
+    EXPECT_EQ(kErrorCodeOk, exheap->alloc_extent(ctx, 5, &ex[1]));
+    EXPECT_EQ(kErrorCodeOk, exheap->free_extent(ctx, ex[0]));
+    ctx.commit();
+    EXPECT_FALSE(summary_bit(nvexheap, ex[0].start()));
+    EXPECT_TRUE(summary_bit(nvexheap, ex[1].start()));
+    exheapb = RedoExtentHeap_t::load(region);
+    EXPECT_EQ(nvexheap->header_.nblocks - 5, alloc_remaining(ctx, exheapb, &ex[1], 1));
+}
 
 int main(int argc, char** argv)
 {
@@ -56,10 +56,10 @@ TEST(HybridHeapTest, alloc_free)
 
     TPtr<void> ptr[16];
     EXPECT_EQ(kErrorCodeOk, hheap.malloc(ctx, bigsize*2, &ptr[0]));
-    EXPECT_EQ(bigsize*2, hheap.getsize(ptr[0]));
+    EXPECT_EQ(bigsize*2, hheap.getsize(ctx, ptr[0]));
 
     EXPECT_EQ(kErrorCodeOk, hheap.malloc(ctx, bigsize/4, &ptr[1]));
-    EXPECT_EQ(bigsize/4, hheap.getsize(ptr[1]));
+    EXPECT_EQ(bigsize/4, hheap.getsize(ctx, ptr[1]));
 
     hheap.free(ctx, ptr[0]);
     hheap.free(ctx, ptr[1]);
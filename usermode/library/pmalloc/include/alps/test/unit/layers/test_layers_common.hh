@@ -36,6 +36,19 @@ public:
         memcpy(dest, src, size);    
     }
 
+    void store_masked(uint64_t* dest, uint64_t value, uint64_t mask)
+    {
+        uint64_t old = __atomic_load_n(dest, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(dest, &old, (old & ~mask) | (value & mask),
+                                            false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+    }
+
+    // No transaction to bypass, so stores are always direct
+    Context direct() const
+    {
+        return *this;
+    }
+
     bool do_v;
     bool do_nv;
 };
@@ -0,0 +1,125 @@
+/* 
+ * (c) Copyright 2016 Hewlett Packard Enterprise Development LP
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "gtest/gtest.h"
+#include "alps/layers/pointer.hh"
+#include "alps/layers/bits/slab.hh"
+
+#include "test_layers_common.hh"
+
+using namespace alps;
+
+typedef nvSlab<Context, TPtr> nvSlab_t;
+typedef nvSlabHeader<Context, TPtr> nvSlabHeader_t;
+
+// Restores the built-in schedule after each test 
+class SizeClassTest: public ::testing::Test {
+public:
+    void SetUp()
+    {
+        memcpy(saved_, size_table, sizeof(saved_));
+    }
+
+    void TearDown()
+    {
+        memcpy(size_table, saved_, sizeof(saved_));
+        build_size_class_index();
+    }
+
+    // Check that each size maps to the smallest class holding it
+    void check_lookup(size_t max_size)
+    {
+        for (size_t sz=1; sz<=max_size; sz++) {
+            int c = sizeclass(sz);
+            ASSERT_LE(sz, size_from_class(c)) << "size " << sz;
+            ASSERT_TRUE(c == 0 || size_from_class(c-1) < sz) << "size " << sz;
+        }
+    }
+
+    size_t saved_[kSizeClasses];
+};
+
+TEST_F(SizeClassTest, lookup)
+{
+    check_lookup(size_table[kSizeClasses-1]);
+}
+
+TEST_F(SizeClassTest, load)
+{
+    size_t sizes[] = {8, 16, 64, 4096, 100000};
+    EXPECT_EQ(kErrorCodeOk, load_size_classes(sizes, 5, 4095, 8000));
+
+    // classes past the one holding max_size are dropped
+    EXPECT_EQ(4096U, size_table[kSizeClasses-1]);
+    EXPECT_EQ(0, sizeclass(1));
+    EXPECT_EQ(1, sizeclass(9));
+    EXPECT_EQ(2, sizeclass(17));
+    EXPECT_EQ(3, sizeclass(65));
+    EXPECT_EQ(3, sizeclass(4095));
+    check_lookup(4096);
+}
+
+TEST_F(SizeClassTest, load_rejects_oversize_class)
+{
+    // the class holding max_size does not fit in a slab
+    size_t sizes[] = {8, 16, 64, 100000};
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(sizes, 4, 4095, 8000));
+    EXPECT_EQ(0, memcmp(saved_, size_table, sizeof(saved_)));
+    check_lookup(size_table[kSizeClasses-1]);
+}
+
+TEST_F(SizeClassTest, load_rejects_invalid)
+{
+    size_t uncovered[] = {8, 16, 64};
+    size_t decreasing[] = {8, 64, 16, 4096};
+    size_t unaligned[] = {8, 12, 4096};
+    size_t zero[] = {0, 8, 4096};
+
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(uncovered, 3, 4095, 8000));
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(decreasing, 4, 4095, 8000));
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(unaligned, 3, 4095, 8000));
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(zero, 3, 4095, 8000));
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(saved_, 0, 4095, 8000));
+    EXPECT_EQ(kErrorCodeInvalidParameter, load_size_classes(saved_, kSizeClasses + 1, 4095, 8000));
+    EXPECT_EQ(0, memcmp(saved_, size_table, sizeof(saved_)));
+}
+
+TEST_F(SizeClassTest, max_block_size)
+{
+    Context ctx;
+    const size_t slab_size = 8192;
+    size_t max_block = nvSlabHeader_t::max_block_size(slab_size) & ~7ULL;
+
+    // the largest class a slab accepts holds exactly one block
+    size_t sizes[] = {8, 64, max_block};
+    EXPECT_EQ(kErrorCodeOk, load_size_classes(sizes, 3, max_block, nvSlabHeader_t::max_block_size(slab_size)));
+    size_t sizesb[] = {8, 64, max_block + 8};
+    EXPECT_EQ(kErrorCodeInvalidParameter, 
+              load_size_classes(sizesb, 3, max_block, nvSlabHeader_t::max_block_size(slab_size)));
+
+    TPtr<nvSlab_t> nvslab = (nvSlab_t*) malloc(slab_size);
+    nvSlab_t::make(ctx, nvslab, slab_size, sizeclass(max_block));
+    EXPECT_EQ(1U, nvslab->nblocks());
+    free(nvslab.get());
+}
+
+int main(int argc, char** argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
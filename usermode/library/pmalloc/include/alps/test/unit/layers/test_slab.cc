@@ -172,6 +172,112 @@ TEST_F(SlabTest, slab_alloc_block)
     delete shadow_slab;
 }
 
+TEST_F(SlabTest, nvslab_free_word)
+{
+    Context ctx;
+    TPtr<nvSlab_t> nvslab = alloc<nvSlab_t>(256*1024);
+
+    int szcl_1K = sizeclass(1024);   
+
+    nvSlab_t::make(ctx, nvslab, slab_size, szcl_1K);
+
+    // the last word only has bits for the blocks it covers
+    size_t nwords = nvBitMap<Context>::nwords(nvslab->nblocks());
+    size_t tail = nvslab->nblocks() % 64;
+    ASSERT_NE(0U, tail);
+    for (size_t w = 0; w<nwords-1; w++) {
+        EXPECT_EQ(~0ULL, nvslab->free_word(ctx, w));
+    }
+    EXPECT_EQ((1ULL << tail) - 1, nvslab->free_word(ctx, nwords-1));
+    EXPECT_EQ(nvslab->nblocks(), nvslab->nblocks_free(ctx));
+
+    for (size_t i = 0; i<nvslab->nblocks(); i++) {
+        nvslab->set_alloc(ctx, i);
+    }
+    for (size_t w = 0; w<nwords; w++) {
+        EXPECT_EQ(0ULL, nvslab->free_word(ctx, w));
+    }
+    EXPECT_EQ(0U, nvslab->nblocks_free(ctx));
+}
+
+TEST_F(SlabTest, slab_reserve_skips_full_words)
+{
+    Context ctx;
+    TPtr<nvSlab_t> nvslab = alloc<nvSlab_t>(256*1024);
+
+    int szcl_1K = sizeclass(1024);   
+
+    nvSlab_t::make(ctx, nvslab, slab_size, szcl_1K);
+
+    // fill words 0 and 1 and the first block of word 2
+    for (size_t i = 0; i<129; i++) {
+        nvslab->set_alloc(ctx, i);
+    }
+
+    Slab_t* slab = Slab_t::load(ctx, nvslab);
+    EXPECT_EQ(slab->nblocks() - 129, slab->nblocks_free());
+    EXPECT_EQ(129U, nvslab->block_id(slab->reserve_block()));
+    EXPECT_EQ(130U, nvslab->block_id(slab->reserve_block()));
+    delete slab;
+}
+
+TEST_F(SlabTest, slab_reserve_after_release)
+{
+    Context ctx;
+    TPtr<nvSlab_t> nvslab = alloc<nvSlab_t>(256*1024);
+
+    int szcl_1K = sizeclass(1024);   
+
+    nvSlab_t::make(ctx, nvslab, slab_size, szcl_1K);
+
+    Slab_t* slab = Slab_t::load(ctx, nvslab);
+    for (size_t i = 0; i<70; i++) {
+        EXPECT_EQ(i, nvslab->block_id(slab->alloc_block(ctx)));
+    }
+
+    // a block freed below the search hint is found again before any 
+    // block past it
+    slab->free_block(ctx, nvslab->block(3));
+    EXPECT_EQ(3U, nvslab->block_id(slab->alloc_block(ctx)));
+    EXPECT_EQ(70U, nvslab->block_id(slab->alloc_block(ctx)));
+
+    slab->free_block(ctx, nvslab->block(64));
+    slab->free_block(ctx, nvslab->block(1));
+    EXPECT_EQ(1U, nvslab->block_id(slab->alloc_block(ctx)));
+    EXPECT_EQ(64U, nvslab->block_id(slab->alloc_block(ctx)));
+    delete slab;
+}
+
+TEST_F(SlabTest, slab_reserve_all)
+{
+    Context ctx;
+    TPtr<nvSlab_t> nvslab = alloc<nvSlab_t>(256*1024);
+
+    int szcl_1K = sizeclass(1024);   
+
+    nvSlab_t::make(ctx, nvslab, slab_size, szcl_1K);
+
+    Slab_t* slab = Slab_t::load(ctx, nvslab);
+    EXPECT_TRUE(slab->empty());
+    for (size_t i = 0; i<slab->nblocks(); i++) {
+        EXPECT_EQ(i, nvslab->block_id(slab->alloc_block(ctx)));
+    }
+    EXPECT_TRUE(slab->full());
+    EXPECT_EQ(null_ptr, slab->alloc_block(ctx));
+
+    // the last block sits in the partial last word
+    size_t last = slab->nblocks() - 1;
+    slab->free_block(ctx, nvslab->block(last));
+    EXPECT_EQ(1U, slab->nblocks_free());
+    EXPECT_EQ(last, nvslab->block_id(slab->alloc_block(ctx)));
+    EXPECT_TRUE(slab->full());
+
+    Slab_t* shadow_slab = Slab_t::load(ctx, nvslab);
+    EXPECT_TRUE(shadow_slab->full());
+    delete slab;
+    delete shadow_slab;
+}
+
 
 #if 0
 TEST_F(ExtentHeapTest, load_nvslab)
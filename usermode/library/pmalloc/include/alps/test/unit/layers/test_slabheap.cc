@@ -119,6 +119,95 @@ TEST(SlabHeapWithExtentHeapTest, alloc)
 
 }
 
+class SlabHeapLoadTest: public ::testing::Test {
+public:
+    static const size_t region_size = 1024*1024;
+    static const size_t block_log2size = 12; // 4KB
+    static const size_t slab_size = 1 << block_log2size;
+    static const size_t block_size = 64;
+
+    // Allocate blocks in a fresh heap, free every other one and reload 
+    // the extent heap as a restart would
+    void SetUp()
+    {
+        region = malloc(region_size);
+        ExtentHeap_t* exheap = ExtentHeap_t::make(region, region_size, block_log2size);
+        SlabHeap_t slabheap(slab_size, NULL, exheap);
+        for (int i=0; i<16; i++) {
+            ASSERT_EQ(kErrorCodeOk, slabheap.malloc(ctx, block_size, &ptr[i]));
+        }
+        for (int i=0; i<16; i+=2) {
+            slabheap.free(ctx, ptr[i]);
+        }
+        exheapb = ExtentHeap_t::load(region);
+    }
+
+    TPtr<nvSlab_t> nvslab_of(TPtr<void> ptr)
+    {
+        Extent<Context, TPtr, PPtr> ex;
+        EXPECT_EQ(kErrorCodeOk, exheapb->extent(ptr, &ex));
+        return ex.nvextent();
+    }
+
+    Context ctx;
+    TPtr<void> region;
+    TPtr<void> ptr[16];
+    ExtentHeap_t* exheapb;
+};
+
+TEST_F(SlabHeapLoadTest, init_defers_slabs)
+{
+    SlabHeap_t slabheap(slab_size, NULL, exheapb);
+    EXPECT_EQ(kErrorCodeOk, slabheap.init(ctx));
+
+    TPtr<nvSlab_t> nvslab = nvslab_of(ptr[1]);
+    EXPECT_EQ((void*) 0, nvslab->slab());
+    EXPECT_EQ(nvslab->nblocks() - 8, nvslab->nblocks_free(ctx));
+
+    // the first request for the sizeclass loads the recorded slab instead
+    // of making a new one, and never hands out a live block
+    TPtr<void> p;
+    EXPECT_EQ(kErrorCodeOk, slabheap.malloc(ctx, block_size, &p));
+    EXPECT_NE((void*) 0, nvslab->slab());
+    EXPECT_EQ(nvslab, nvslab_of(p));
+    for (int i=1; i<16; i+=2) {
+        EXPECT_NE(ptr[i], p);
+    }
+}
+
+TEST_F(SlabHeapLoadTest, free_loads_slab)
+{
+    SlabHeap_t slabheap(slab_size, NULL, exheapb);
+    EXPECT_EQ(kErrorCodeOk, slabheap.init(ctx));
+
+    TPtr<nvSlab_t> nvslab = nvslab_of(ptr[1]);
+    EXPECT_EQ((void*) 0, nvslab->slab());
+    slabheap.free(ctx, ptr[1]);
+    EXPECT_NE((void*) 0, nvslab->slab());
+    EXPECT_EQ(nvslab->nblocks() - 7, nvslab->nblocks_free(ctx));
+}
+
+TEST_F(SlabHeapLoadTest, reclaim_empty_slabs)
+{
+    size_t nslabs = 0;
+    exheapb->for_each_allocated(nvExtentHeader<Context, TPtr>::kExtentTagSlab,
+        [&](Extent<Context, TPtr, PPtr> ex) { nslabs++; });
+    ASSERT_LT(0U, nslabs);
+
+    // only the slab holding live blocks is kept
+    SlabHeap_t slabheap(slab_size, NULL, exheapb);
+    EXPECT_EQ(kErrorCodeOk, slabheap.init(ctx));
+    EXPECT_EQ(nslabs - 1, slabheap.reclaim_lazy_slabs(ctx));
+    EXPECT_EQ(0U, slabheap.reclaim_lazy_slabs(ctx));
+    for (int i=1; i<16; i+=2) {
+        slabheap.free(ctx, ptr[i]);
+    }
+
+    // with all its blocks free it goes back to the extent heap after a restart
+    SlabHeap_t slabheapb(slab_size, NULL, ExtentHeap_t::load(region));
+    EXPECT_EQ(kErrorCodeOk, slabheapb.init(ctx));
+    EXPECT_EQ(1U, slabheapb.reclaim_lazy_slabs(ctx));
+}
 
 int main(int argc, char** argv)
 {
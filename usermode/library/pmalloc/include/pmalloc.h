@@ -33,6 +33,7 @@
 #ifndef _MNEMOSYNE_PMALLOC_H
 #define _MNEMOSYNE_PMALLOC_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #if __cplusplus
@@ -48,6 +49,39 @@ __attribute__((transaction_pure)) void *_ITM_pcalloc(size_t, size_t);
 __attribute__((transaction_pure)) void *_ITM_prealloc(void *, size_t);
 #define prealloc _ITM_prealloc
 
+#define PMALLOC_MAX_NUMA_NODES 8
+
+/* 
+ * Where allocations were placed relative to the NUMA node of the thread 
+ * making them: local[n] counts allocations by threads on node n served 
+ * from node n's arena, remote[n] those that had to come from another 
+ * node's arena. Only collected when the heap spans more than one node.
+ */
+typedef struct pmalloc_numa_stats_s {
+	int      nnodes;
+	uint64_t local[PMALLOC_MAX_NUMA_NODES];
+	uint64_t remote[PMALLOC_MAX_NUMA_NODES];
+} pmalloc_numa_stats_t;
+
+void pmalloc_numa_stats(pmalloc_numa_stats_t *stats);
+
+/* 
+ * Occupancy of the heap: heap_bytes is the size of the regions making up
+ * the heap and allocated_bytes the usable size of the objects allocated 
+ * from it and not freed yet. Objects allocated by transactions that abort
+ * are counted by their size as seen after the abort, so allocated_bytes 
+ * may drift slightly for large objects.
+ */
+typedef struct pmalloc_stats_s {
+	int      nregions;
+	uint64_t heap_bytes;
+	uint64_t allocated_bytes;
+	uint64_t nallocs;
+	uint64_t nfrees;
+} pmalloc_stats_t;
+
+void pmalloc_stats(pmalloc_stats_t *stats);
+
 #if __cplusplus
 }
 #endif
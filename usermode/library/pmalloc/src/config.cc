@@ -0,0 +1,27 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+pmalloc_config_t pmalloc_runtime_settings;
+config_t         pmalloc_cfg;
+
+
+static void config_init_internal(const char *config_file)
+{
+    config_init(&pmalloc_cfg);
+    config_read_file(&pmalloc_cfg, config_file);
+    FOREACH_RUNTIME_CONFIG_SETTING(CONFIG_SETTING_LOOKUP, pmalloc, &pmalloc_cfg, &pmalloc_runtime_settings);
+}
+
+
+void pmalloc_config_init()
+{
+    char *config_file;
+    config_file = getenv("MNEMOSYNE_CONFIG");
+    if (config_file) {
+        config_init_internal(config_file);
+    } else {
+        config_init_internal("mnemosyne.ini");
+    }
+}
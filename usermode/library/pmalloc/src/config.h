@@ -0,0 +1,43 @@
+#ifndef _MNEMOSYNE_PMALLOC_CONFIG_H
+#define _MNEMOSYNE_PMALLOC_CONFIG_H
+
+extern "C" {
+#include "config_generic.h"
+}
+
+/*
+ * size_classes: file listing a custom size-class schedule, one block size 
+ *   per line in non-decreasing order (e.g. derived from an allocation 
+ *   histogram of the workload). Empty selects the built-in schedule. Some 
+ *   class must hold big_size - 1 and fit a slab, or the file is ignored;
+ *   larger classes are dropped. A heap records its schedule when created
+ *   and keeps it when reopened.
+ * heap_size_mb: size of the region the heap is created with
+ * heap_grow_mb: size of each region added when the heap runs out of space,
+ *   0 disables growing
+ * block_log2size: extent block size, which is also the slab size. Fixed 
+ *   when the heap is created.
+ * big_size: smallest allocation served by an extent rather than a slab, 
+ *   capped at half the slab size
+ * hugepages: advise extents of 2MB or more, which are 2MB-aligned, with 
+ *   MADV_HUGEPAGE
+ * numa: split a new heap into one arena per NUMA node, with threads 
+ *   allocating from the arena of their node
+ */
+#define FOREACH_RUNTIME_CONFIG_SETTING(ACTION, group, config, values)                           \
+  ACTION(config, values, group, size_classes, string, const char *, "", CONFIG_NO_CHECK, 0)             \
+  ACTION(config, values, group, heap_size_mb, int, int, 8192, CONFIG_RANGE_CHECK, 16, 1 << 30)    \
+  ACTION(config, values, group, heap_grow_mb, int, int, 1024, CONFIG_RANGE_CHECK, 0, 1 << 30)     \
+  ACTION(config, values, group, block_log2size, int, int, 13, CONFIG_RANGE_CHECK, 12, 21)         \
+  ACTION(config, values, group, big_size, int, int, 4096, CONFIG_RANGE_CHECK, 8, 1 << 20)       \
+  ACTION(config, values, group, hugepages, bool, int, 1, CONFIG_NO_CHECK, 0)                     \
+  ACTION(config, values, group, numa, bool, int, 1, CONFIG_NO_CHECK, 0)
+
+
+typedef CONFIG_GROUP_STRUCT(pmalloc) pmalloc_config_t;
+
+extern pmalloc_config_t pmalloc_runtime_settings;
+
+void pmalloc_config_init();
+
+#endif // _MNEMOSYNE_PMALLOC_CONFIG_H
@@ -1,8 +1,18 @@
 #include "heap.hh"
+#include "config.h"
 
+#include <numa.h>
+#include <numaif.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
 
 #include <mnemosyne.h>
 
@@ -14,75 +24,427 @@
 //MNEMOSYNE_PERSISTENT void* PREGION_BASE = 0;
 __attribute__ ((section("PERSISTENT"))) void* PREGION_BASE = 0;
 
+// Regions added as the heap grows, in the order they were added. A region
+// is recorded only after it has been formatted.
+__attribute__ ((section("PERSISTENT"))) void* PREGION_GROW_BASE[alps::kMaxExtentHeapRegions-1] = {0};
+
+// NUMA node of each region, indexed like the extent heap's regions (the
+// region at PREGION_BASE first). Written before the region is recorded.
+__attribute__ ((section("PERSISTENT"))) int PREGION_NODE[alps::kMaxExtentHeapRegions] = {0};
+
+// Size-class schedule the heap was created with, as slabs record their 
+// size class by index. Empty for heaps created before it was recorded.
+__attribute__ ((section("PERSISTENT"))) size_t PSIZE_CLASSES[alps::kSizeClasses] = {0};
+
+static_assert(alps::kMaxExtentHeapArenas == PMALLOC_MAX_NUMA_NODES, "one extent heap arena per NUMA node");
+
+/* 
+ * Replace the built-in size-class schedule with the one listed in file, 
+ * keeping the built-in one if the file cannot be read or is invalid for 
+ * slabs of slab_size serving sizes up to max_size
+ */
+static void load_size_classes(const char* file, size_t max_size, size_t slab_size)
+{
+    size_t sizes[alps::kSizeClasses];
+    int nsizes = 0;
+
+    FILE* fp = fopen(file, "r");
+    if (!fp) {
+        fprintf(stderr, "pmalloc: cannot open size class file %s\n", file);
+        return;
+    }
+    while (nsizes < alps::kSizeClasses && fscanf(fp, "%zu", &sizes[nsizes]) == 1) {
+        nsizes++;
+    }
+    fclose(fp);
+    if (alps::load_size_classes(sizes, nsizes, max_size, SlabHeader_t::max_block_size(slab_size)) != alps::kErrorCodeOk) {
+        fprintf(stderr, "pmalloc: invalid size class schedule in %s\n", file);
+    }
+}
+
+/*
+ * Number of NUMA nodes the heap is split across, 1 if NUMA placement is
+ * disabled or unavailable
+ */
+static int numa_nodes()
+{
+    if (!pmalloc_runtime_settings.numa || numa_available() < 0) {
+        return 1;
+    }
+    return std::min(numa_max_node() + 1, alps::kMaxExtentHeapArenas);
+}
+
+static int numa_node_self(int nnodes)
+{
+    unsigned int cpu;
+    unsigned int node;
+
+    if (nnodes == 1 || syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return 0;
+    }
+    return node % nnodes;
+}
+
+/*
+ * Prefer node for the pages of a region. Pages already resident keep 
+ * their placement, so a new region is bound before it is formatted. The
+ * policy is not persistent and is set again each time a region is loaded.
+ */
+static void bind_region(void* region, size_t region_size, int node, int nnodes)
+{
+    if (nnodes == 1) {
+        return;
+    }
+    unsigned long nodemask = 1UL << node;
+    if (mbind(region, region_size, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+        fprintf(stderr, "pmalloc: cannot bind region %p to node %d\n", region, node);
+    }
+}
+
 int Heap::init()
 {
     alps::DebugOptions dbgopt;
     dbgopt.log_level = "error"; // Disable logging output
     alps::init_log(dbgopt);
 
+    pmalloc_config_init();
+
     Context ctx;
     /* Clean up multiple definitions of PSEGMENT_* */
-    /*
-     * Do not combine n_gb and region_size in the defn
-     * of region_size. it causes compiler to generate wrong
-     * (my guess), which can actually be observed as an overflow 
-     * during runtime.
-     * splitting the values as n_gb and region_size does not
-     * cause any absurd overflows during runtime.
-     */
-    unsigned long long n_gb = 8;
-    unsigned long long region_size = 1024*1024*1024;
-    region_size *= n_gb; 
-    size_t block_log2size = 13;
-
-    slabsize_ = 1 << block_log2size;
-    //slabsize /= 2; 
-
-    /* Max block allocated from slabheap must be smaller than the slab extent size 
-     * to ensure slab data and metadata fit within the slab extent */
-    bigsize_ = slabsize_/2;
+    unsigned long long region_size = pmalloc_runtime_settings.heap_size_mb;
+    region_size <<= 20; 
+    size_t block_log2size = pmalloc_runtime_settings.block_log2size;
 
+    // A new heap is split evenly across the nodes, one region each. The 
+    // first region, at PREGION_BASE, always belongs to node 0.
+    nnodes_ = numa_nodes();
     if (PREGION_BASE == 0) {
-        PREGION_BASE = (void*) m_pmap((void *) PREGION_BASE, region_size, PROT_READ|PROT_WRITE, 0);
-        void* region = PREGION_BASE;
+        region_size /= nnodes_;
+        void* region = m_pmap((void *) PREGION_BASE, region_size, PROT_READ|PROT_WRITE, 0);
+        if (region == MAP_FAILED) {
+            return -1;
+        }
+        bind_region(region, region_size, 0, nnodes_);
         exheap_ = ExtentHeap_t::make(region, region_size, block_log2size);
+        PREGION_BASE = region;
+        for (int node=1; node<nnodes_; node++) {
+            if (add_region(node, region_size) != 0) {
+                return -1;
+            }
+        }
     } else {
         void* region = PREGION_BASE;
         exheap_ = ExtentHeap_t::load(region);
+        bind_region(region, exheap_->region_size(0), 0, nnodes_);
+        for (int i=0; i<alps::kMaxExtentHeapRegions-1 && PREGION_GROW_BASE[i]; i++) {
+            int node = std::min(std::max(PREGION_NODE[i+1], 0), alps::kMaxExtentHeapArenas-1);
+            exheap_->load_region(PREGION_GROW_BASE[i], node);
+            if (node < nnodes_) {
+                bind_region(PREGION_GROW_BASE[i], exheap_->region_size(i+1), node, nnodes_);
+            }
+        }
+    }
+
+    // The block size of an existing heap wins over the configured one
+    slabsize_ = exheap_->blocksize();
+
+    /* Max block allocated from slabheap must be smaller than the slab extent size 
+     * to ensure slab data and metadata fit within the slab extent */
+    bigsize_ = std::min((size_t) pmalloc_runtime_settings.big_size, slabsize_/2);
+
+    // The schedule of an existing heap wins over the configured one too, 
+    // and bounds the sizes served from slabs
+    if (PSIZE_CLASSES[0] != 0) {
+        bigsize_ = std::min(bigsize_, PSIZE_CLASSES[alps::kSizeClasses-1] + 1);
+        if (alps::load_size_classes(PSIZE_CLASSES, alps::kSizeClasses, bigsize_ - 1, 
+                                    SlabHeader_t::max_block_size(slabsize_)) != alps::kErrorCodeOk) 
+        {
+            fprintf(stderr, "pmalloc: invalid heap size class schedule\n");
+            return -1;
+        }
+    } else {
+        if (pmalloc_runtime_settings.size_classes[0] != '\0') {
+            load_size_classes(pmalloc_runtime_settings.size_classes, bigsize_ - 1, slabsize_);
+        }
+        std::copy(alps::size_table, alps::size_table + alps::kSizeClasses, PSIZE_CLASSES);
     }
 
-    slheap_ = new SlabHeap_t(slabsize_, NULL, exheap_);
+    // The shared slab heap holds the slabs found on the heap and, when the
+    // heap spans several nodes, formats none itself, so threads make their
+    // own slabs from their local arena
+    slheap_ = new SlabHeap_t(slabsize_, NULL, exheap_, nnodes_ > 1 ? -1 : 0);
     slheap_->init(ctx);
+    for (int node=0; node<nnodes_; node++) {
+        lgheap_[node] = new LargeHeap_t(exheap_, pmalloc_runtime_settings.hugepages, node);
+    }
+
+    // Reconcile slabs left empty by the previous run off the startup path
+    std::thread(&Heap::reclaim, this).detach();
+    return 0;
 }
 
-ThreadHeap* Heap::threadheap()
+void Heap::reclaim()
 {
     Context ctx;
 
-    SlabHeap_t* slheap = new SlabHeap_t(slabsize_, NULL, exheap_);
-    slheap_->init(ctx);
+    slheap_->reclaim_lazy_slabs(ctx);
+}
+
+int Heap::nregions()
+{
+    return exheap_->nregions();
+}
+
+/*
+ * Add a region large enough for an sz-byte allocation to node's arena 
+ * unless another thread already grew the heap past nregions regions
+ */
+int Heap::grow(int nregions, size_t sz, int node)
+{
+    std::lock_guard<std::mutex> lock(growmtx_);
+
+    if (exheap_->nregions() != nregions) {
+        return 0;
+    }
+    if (pmalloc_runtime_settings.heap_grow_mb == 0) {
+        return -1;
+    }
+    unsigned long long region_size = pmalloc_runtime_settings.heap_grow_mb;
+    region_size <<= 20;
+    region_size = std::max(region_size, (unsigned long long) 2*sz);
+    return add_region(node, region_size);
+}
 
-    HybridHeap_t* hheap = new HybridHeap_t(bigsize_, slheap, exheap_);
-    ThreadHeap* thp = new ThreadHeap(hheap);
+int Heap::add_region(int node, unsigned long long region_size)
+{
+    int i = exheap_->nregions() - 1;
+    if (i >= alps::kMaxExtentHeapRegions-1) {
+        return -1;
+    }
+    void* region = m_pmap(NULL, region_size, PROT_READ|PROT_WRITE, 0);
+    if (region == MAP_FAILED) {
+        return -1;
+    }
+    bind_region(region, region_size, node, nnodes_);
+    if (exheap_->make_region(region, region_size, node) != alps::kErrorCodeOk) {
+        return -1;
+    }
+    PREGION_NODE[i+1] = node;
+    PREGION_GROW_BASE[i] = region;
+    return 0;
+}
+
+ThreadHeap* Heap::threadheap()
+{
+    int node = numa_node_self(nnodes_);
+
+    // Per-thread slab heaps pull slabs from the shared slab heap, which 
+    // holds the slabs reincarnated by Heap::init, and otherwise from the 
+    // arena of the node the thread first ran on
+    SlabHeap_t* slheap = new SlabHeap_t(slabsize_, slheap_, exheap_, node);
+
+    HybridHeap_t* hheap = new HybridHeap_t(bigsize_, slheap, lgheap_[node]);
+    ThreadHeap* thp = new ThreadHeap(hheap, this, node);
+
+    std::lock_guard<std::mutex> lock(threadheapsmtx_);
+    threadheaps_.push_back(thp);
     return thp;
 }
 
+int Heap::node_of(void* ptr)
+{
+    return exheap_->arena_of(ptr);
+}
+
+void Heap::numa_stats(pmalloc_numa_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->nnodes = nnodes_;
+
+    std::lock_guard<std::mutex> lock(threadheapsmtx_);
+    for (size_t i=0; i<threadheaps_.size(); i++) {
+        ThreadHeap* thp = threadheaps_[i];
+        stats->local[thp->node()] += thp->nlocal();
+        stats->remote[thp->node()] += thp->nremote();
+    }
+}
+
+void Heap::stats(pmalloc_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->nregions = exheap_->nregions();
+    for (int r=0; r<stats->nregions; r++) {
+        stats->heap_bytes += exheap_->region_size(r);
+    }
+
+    std::lock_guard<std::mutex> lock(threadheapsmtx_);
+    for (size_t i=0; i<threadheaps_.size(); i++) {
+        ThreadHeap* thp = threadheaps_[i];
+        stats->allocated_bytes += thp->nbytes();
+        stats->nallocs += thp->nallocs();
+        stats->nfrees += thp->nfrees();
+    }
+}
+
+/*
+ * Count whether ptr came from the arena of this heap's node. Threads 
+ * that migrate keep counting against the node they started on.
+ */
+void ThreadHeap::account(void* ptr)
+{
+    if (heap_->nnodes() == 1) {
+        return;
+    }
+    std::atomic<uint64_t>& n = heap_->node_of(ptr) == node_ ? nlocal_ : nremote_;
+    n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void ThreadHeap::count_alloc(Context& ctx, void* ptr)
+{
+    nbytes_.store(nbytes_.load(std::memory_order_relaxed) + hheap_->getsize(ctx, ptr), 
+                  std::memory_order_relaxed);
+    nallocs_.store(nallocs_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void ThreadHeap::count_free(Context& ctx, void* ptr)
+{
+    nbytes_.store(nbytes_.load(std::memory_order_relaxed) - hheap_->getsize(ctx, ptr), 
+                  std::memory_order_relaxed);
+    nfrees_.store(nfrees_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
 void* ThreadHeap::pmalloc(size_t sz)
 {
     Context ctx(true, true);
     
     alps::TPtr<void> ptr;
-    alps::ErrorCode rc = hheap_->malloc(ctx, sz, &ptr);
-    if (rc != alps::kErrorCodeOk) {
+    for (;;) {
+        int nregions = heap_->nregions();
+        alps::ErrorCode rc = hheap_->malloc(ctx, sz, &ptr);
+        if (rc == alps::kErrorCodeOk) {
+            break;
+        }
+        if (rc != alps::kErrorCodeOutofmemory || heap_->grow(nregions, sz, node_) != 0) {
+            return NULL;
+        }
+    }
+    account(ptr.get());
+    count_alloc(ctx, ptr.get());
+    return ptr.get();
+}
+
+/*
+ * Zero size bytes at addr with streaming stores fenced before returning.
+ * The stores bypass the transaction's write set and log, which is only 
+ * safe for memory the transaction has just allocated: if it aborts the 
+ * memory is released anyway, and if it commits the zeroes are already 
+ * durable.
+ */
+static void pzero(void* addr, size_t size)
+{
+    pcm_storeset_t* set = pcm_storeset_get();
+    volatile pcm_word_t* word = (volatile pcm_word_t*) addr;
+    size_t nwords = (size + sizeof(pcm_word_t) - 1) / sizeof(pcm_word_t);
+
+    PCM_SEQSTREAM_INIT(set);
+    for (size_t i=0; i<nwords; i++) {
+        PCM_SEQSTREAM_STORE(set, &word[i], 0);
+    }
+    PCM_SEQSTREAM_FLUSH(set);
+}
+
+/*
+ * Extents on the free space map that were never handed out since their
+ * region was formatted are still zero, so only the part the heap reports
+ * as possibly dirty is cleared.
+ */
+void* ThreadHeap::pcalloc(size_t nelem, size_t elsize)
+{
+    Context ctx(true, true);
+    size_t sz;
+    size_t dirty;
+
+    if (__builtin_mul_overflow(nelem, elsize, &sz)) {
         return NULL;
     }
+    alps::TPtr<void> ptr;
+    for (;;) {
+        int nregions = heap_->nregions();
+        alps::ErrorCode rc = hheap_->malloc(ctx, sz, &ptr, &dirty);
+        if (rc == alps::kErrorCodeOk) {
+            break;
+        }
+        if (rc != alps::kErrorCodeOutofmemory || heap_->grow(nregions, sz, node_) != 0) {
+            return NULL;
+        }
+    }
+    account(ptr.get());
+    count_alloc(ctx, ptr.get());
+    pzero(ptr.get(), dirty);
     return ptr.get();
 }
 
+struct PreallocUndo {
+    ThreadHeap* heap;
+    alps::ExtentInterval tail;
+    size_t nbytes;
+};
+
+static void _ITM_CALL_CONVENTION prealloc_undo_action(void* arg)
+{
+    PreallocUndo* undo = (PreallocUndo*) arg;
+    undo->heap->prealloc_undo(undo->tail, undo->nbytes);
+    delete undo;
+}
+
+static void _ITM_CALL_CONVENTION prealloc_commit_action(void* arg)
+{
+    delete (PreallocUndo*) arg;
+}
+
+/*
+ * Grow ptr in place to sz bytes by taking the free space right after it.
+ * Returns ptr, or NULL if the object has to move. The blocks taken are 
+ * marked part of the extent through the transaction; an undo action 
+ * gives them back to the free space map if it aborts.
+ */
+void* ThreadHeap::prealloc(void* ptr, size_t sz)
+{
+    Context ctx(true, true);
+    alps::ExtentInterval tail;
+    size_t oldsize = hheap_->getsize(ctx, ptr);
+
+    if (hheap_->extend(ctx, ptr, sz, &tail) != alps::kErrorCodeOk) {
+        return NULL;
+    }
+    size_t nbytes = hheap_->getsize(ctx, ptr) - oldsize;
+    nbytes_.store(nbytes_.load(std::memory_order_relaxed) + nbytes, std::memory_order_relaxed);
+    if (ctx.td && tail.len() > 0) {
+        PreallocUndo* undo = new PreallocUndo;
+        undo->heap = this;
+        undo->tail = tail;
+        undo->nbytes = nbytes;
+        _ITM_addUserUndoAction(prealloc_undo_action, undo);
+        _ITM_addUserCommitAction(prealloc_commit_action, _ITM_getTransactionId(), undo);
+    }
+    return ptr;
+}
+
+void ThreadHeap::prealloc_undo(const alps::ExtentInterval& tail, size_t nbytes)
+{
+    nbytes_.store(nbytes_.load(std::memory_order_relaxed) - nbytes, std::memory_order_relaxed);
+    hheap_->retract(tail);
+}
+
+/*
+ * Undo and commit actions run once the outcome of the transaction is known,
+ * so they see the heap directly rather than through its write set.
+ */
 void ThreadHeap::pmalloc_undo(void* ptr) 
 {
-    Context ctx(true, false);
+    Context ctx = Context(true, false).direct();
     
+    count_free(ctx, ptr);
     hheap_->free(ctx, ptr);
 }
 
@@ -95,8 +457,9 @@ void ThreadHeap::pfree_prepare(void* ptr)
 
 void ThreadHeap::pfree_commit(void* ptr) 
 {
-    Context ctx(true, false);
+    Context ctx = Context(true, false).direct();
     
+    count_free(ctx, ptr);
     hheap_->free(ctx, ptr);
 }
 
@@ -105,5 +468,5 @@ size_t ThreadHeap::getsize(void* ptr)
 {
     Context ctx(true, true);
 
-    return hheap_->getsize(ptr);
+    return hheap_->getsize(ctx, ptr);
 }
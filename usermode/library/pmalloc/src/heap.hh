@@ -4,15 +4,22 @@
 #include <alps/layers/pointer.hh>
 #include <alps/layers/slabheap.hh>
 #include <alps/layers/extentheap.hh>
+#include <alps/layers/largeheap.hh>
 #include <alps/layers/hybridheap.hh>
 
+#include <atomic>
+#include <mutex>
+#include <vector>
+
 #include <mnemosyne.h>
+#include <pmalloc.h>
 #include <mtm.h>
 #include <mtm_i.h>
 #include <itm.h>
 
 extern "C" void _ITM_nl_load_bytes(const void *src, void *dest, size_t size);
 extern "C" void _ITM_nl_store_bytes(const void *src, void *dest, size_t size);
+extern "C" void _ITM_nl_store_masked(void *dest, uint64_t value, uint64_t mask);
 
 class Context {
 public:
@@ -45,31 +52,94 @@ public:
         }
     }
 
+    // Stores the bits of value selected by mask into *dest, leaving the
+    // remaining bits of the word as they are at commit time
+    void store_masked(uint64_t* dest, uint64_t value, uint64_t mask)
+    {
+        if (td) {
+            _ITM_nl_store_masked(dest, value, mask);
+        } else {
+            uint64_t old = __atomic_load_n(dest, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(dest, &old, (old & ~mask) | (value & mask),
+                                                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) { }
+        }
+    }
+
+    // Returns a context whose stores bypass the enclosing transaction.
+    // Used for structural metadata (slab formatting) that other threads may
+    // depend on before this transaction commits.
+    Context direct() const
+    {
+        Context ctx(*this);
+        ctx.td = NULL;
+        return ctx;
+    }
+
     bool do_v;
     bool do_nv;
 
     _ITM_transaction * td;
 };
 
+typedef alps::nvSlabHeader<Context, alps::TPtr> SlabHeader_t;
 typedef alps::SlabHeap<Context, alps::TPtr, alps::PPtr> SlabHeap_t;
 typedef alps::ExtentHeap<Context, alps::TPtr, alps::PPtr> ExtentHeap_t;
-typedef alps::HybridHeap<Context, alps::TPtr, alps::PPtr, SlabHeap_t, ExtentHeap_t> HybridHeap_t;
+typedef alps::LargeHeap<Context, alps::TPtr, alps::PPtr> LargeHeap_t;
+typedef alps::HybridHeap<Context, alps::TPtr, alps::PPtr, SlabHeap_t, LargeHeap_t> HybridHeap_t;
+
+class Heap;
 
 class ThreadHeap
 {
 public:
-    ThreadHeap(HybridHeap_t* hheap)
-        : hheap_(hheap)
+    ThreadHeap(HybridHeap_t* hheap, Heap* heap, int node)
+        : hheap_(hheap),
+          heap_(heap),
+          node_(node),
+          nlocal_(0),
+          nremote_(0),
+          nbytes_(0),
+          nallocs_(0),
+          nfrees_(0)
     { }
 
     void* pmalloc(size_t sz);
+    void* pcalloc(size_t nelem, size_t elsize);
+    void* prealloc(void* ptr, size_t sz);
+    void prealloc_undo(const alps::ExtentInterval& tail, size_t nbytes);
     void pmalloc_undo(void* ptr);
     void pfree_prepare(void* ptr);
     void pfree_commit(void* ptr);
     size_t getsize(void* ptr);
 
+    int node() const { return node_; }
+    uint64_t nlocal() const { return nlocal_.load(std::memory_order_relaxed); }
+    uint64_t nremote() const { return nremote_.load(std::memory_order_relaxed); }
+    uint64_t nbytes() const { return nbytes_.load(std::memory_order_relaxed); }
+    uint64_t nallocs() const { return nallocs_.load(std::memory_order_relaxed); }
+    uint64_t nfrees() const { return nfrees_.load(std::memory_order_relaxed); }
+
 private:
+    void account(void* ptr);
+    void count_alloc(Context& ctx, void* ptr);
+    void count_free(Context& ctx, void* ptr);
+
     HybridHeap_t* hheap_;
+    Heap* heap_;
+    int node_;  // NUMA node whose arena this heap allocates from
+
+    // allocations served from the local and from other nodes' arenas,
+    // written only by the owning thread
+    std::atomic<uint64_t> nlocal_;
+    std::atomic<uint64_t> nremote_;
+
+    // bytes and number of objects allocated and freed through this heap, 
+    // written only by the owning thread. Objects may be freed by another 
+    // thread than the one that allocated them, so only the sum over all
+    // heaps is meaningful; nbytes_ wraps around in a single heap.
+    std::atomic<uint64_t> nbytes_;
+    std::atomic<uint64_t> nallocs_;
+    std::atomic<uint64_t> nfrees_;
 };
 
 class Heap {
@@ -77,12 +147,27 @@ public:
 
     int init();
     ThreadHeap* threadheap();
+    int nregions();
+    int grow(int nregions, size_t sz, int node);
+    void reclaim();
+    int nnodes() const { return nnodes_; }
+    int node_of(void* ptr);
+    void numa_stats(pmalloc_numa_stats_t* stats);
+    void stats(pmalloc_stats_t* stats);
 
 private:
+    int add_region(int node, unsigned long long region_size);
+
+    std::mutex growmtx_;
     ExtentHeap_t* exheap_;
+    LargeHeap_t* lgheap_[alps::kMaxExtentHeapArenas]; // one per NUMA node
     SlabHeap_t* slheap_;
     size_t bigsize_;
     size_t slabsize_;
+    int nnodes_;
+
+    std::mutex threadheapsmtx_;
+    std::vector<ThreadHeap*> threadheaps_;
 };
 
 #endif // _MNEMOSYNE_HEAP_HEAP_HH
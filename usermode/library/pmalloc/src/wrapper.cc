@@ -7,11 +7,14 @@
 
 #include <mtm_i.h>
 #include <itm.h>
+#include <statsrv.h>
 
 thread_local ThreadHeap* threadheap = NULL;
 static Heap* heap;
 std::mutex heapmtx;
 
+static void stats_report(FILE* fout);
+
 inline static Heap * getHeap (void) 
 {
     heapmtx.lock();
@@ -21,6 +24,7 @@ inline static Heap * getHeap (void)
     }
     heap = new Heap();
     heap->init();
+    m_statsrv_register("pmalloc", stats_report);
     heapmtx.unlock();
     return heap;
 }
@@ -57,10 +61,8 @@ void mtm_pmalloc_undo (void* ptr)
 extern "C"
 void * mtm_pcalloc (size_t nelem, size_t elsize)
 {
-    void* addr;
-    // TODO
-
-	return addr;
+    ThreadHeap* heap = getThreadHeap();
+    return heap->pcalloc(nelem, elsize);
 }
 
 
@@ -94,9 +96,43 @@ size_t mtm_get_obj_size(void *ptr)
     return heap->getsize(ptr);
 }
 
+/*
+ * Resizes ptr in place, returning NULL if the object has to move
+ */
 extern "C" void * mtm_prealloc (void * ptr, size_t sz)
 {
-    //TODO
+    ThreadHeap* heap = getThreadHeap();
+    return heap->prealloc(ptr, sz);
+}
+
+extern "C" void pmalloc_numa_stats(pmalloc_numa_stats_t* stats)
+{
+    Heap* heap = getHeap();
+    heap->numa_stats(stats);
+}
 
-	return NULL;
+extern "C" void pmalloc_stats(pmalloc_stats_t* stats)
+{
+    Heap* heap = getHeap();
+    heap->stats(stats);
+}
+
+static void stats_report(FILE* fout)
+{
+    pmalloc_stats_t stats;
+    pmalloc_numa_stats_t numa;
+
+    heap->stats(&stats);
+    fprintf(fout, "pmalloc_regions %d\n", stats.nregions);
+    fprintf(fout, "pmalloc_heap_bytes %llu\n", (unsigned long long) stats.heap_bytes);
+    fprintf(fout, "pmalloc_allocated_bytes %llu\n", (unsigned long long) stats.allocated_bytes);
+    fprintf(fout, "pmalloc_allocs_total %llu\n", (unsigned long long) stats.nallocs);
+    fprintf(fout, "pmalloc_frees_total %llu\n", (unsigned long long) stats.nfrees);
+    heap->numa_stats(&numa);
+    for (int n=0; numa.nnodes > 1 && n<numa.nnodes; n++) {
+        fprintf(fout, "pmalloc_numa_local_allocs_total{node=\"%d\"} %llu\n", n, 
+                (unsigned long long) numa.local[n]);
+        fprintf(fout, "pmalloc_numa_remote_allocs_total{node=\"%d\"} %llu\n", n, 
+                (unsigned long long) numa.remote[n]);
+    }
 }
@@ -5,7 +5,8 @@ import xml
 def runUnitTests(source, target, env):
     results = []
     for test in env['UNIT_TEST_CMDS']:
-        osenv = os.environ 
+        # copy so that the settings of one test do not leak into the next
+        osenv = dict(os.environ)
         osenv.update(test[0])
         path = test[1]
         args = test[2]
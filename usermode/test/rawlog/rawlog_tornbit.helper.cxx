@@ -48,10 +48,12 @@ m_rawlog_tornbit_init(pcm_storeset_t *set, m_log_t *log, m_log_dsc_t *log_dsc)
 	m_phlog_tornbit_format(set, 
 	                       (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
 	                       log_dsc->nvphlog, 
+	                       log_dsc->nvphlog_nentries,
 	                       LF_TYPE_TM_TORNBIT);
 	m_phlog_tornbit_init(phlog_tornbit, 
 	                     (m_phlog_tornbit_nvmd_t *) log_dsc->nvmd, 
-	                     log_dsc->nvphlog);
+	                     log_dsc->nvphlog,
+	                     log_dsc->nvphlog_nentries);
 
 	return M_R_SUCCESS;
 }
@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * Crashes with aborted transactions in the logs and checks that recovery 
+ * and truncation skip them.
+ *
+ * Every other transaction writes several cachelines and a few bytes and 
+ * then cancels. Its records reach the log before it aborts and are 
+ * followed by an abort marker. With TMLOG_TYPE_COMPACT this covers the 
+ * run records and masked runs of the compact log.
+ */
+#include <stdint.h>
+#include <mnemosyne.h>
+#include <UnitTest++/UnitTest++.h>
+#include "stats.helper.h"
+#include "recovery.helper.h"
+
+#define NITERATIONS     3000
+#define NLINES          4
+#define LINE_NWORDS     8
+#define NBYTES          8
+
+MNEMOSYNE_PERSISTENT uint64_t abort_data[NLINES][LINE_NWORDS];
+MNEMOSYNE_PERSISTENT uint8_t  abort_bytes[NBYTES];
+MNEMOSYNE_PERSISTENT uint64_t abort_ncommitted;
+
+static void checkCommitted()
+{
+	/* odd iterations abort, so the last commit is the last even one */
+	uint64_t last = (NITERATIONS - 1) & ~1ULL;
+	int      line;
+	int      i;
+
+	CHECK_EQUAL(NITERATIONS / 2, abort_ncommitted);
+	for (line=0; line<NLINES; line++) {
+		for (i=0; i<LINE_NWORDS; i++) {
+			CHECK_EQUAL(last + 1, abort_data[line][i]);
+		}
+	}
+	for (i=0; i<NBYTES; i++) {
+		CHECK_EQUAL((uint8_t) (last + i), abort_bytes[i]);
+	}
+}
+
+SUITE(SuiteAbortCrash)
+{
+	TEST(Test1)
+	{
+		uint64_t iter;
+		int      line;
+		int      i;
+
+		for (iter=0; iter<NITERATIONS; iter++) {
+			__transaction_atomic {
+				for (line=0; line<NLINES; line++) {
+					for (i=0; i<LINE_NWORDS; i++) {
+						abort_data[line][i] = iter + 1;
+					}
+				}
+				/* sub-word writes are logged with a mask */
+				for (i=0; i<NBYTES; i++) {
+					abort_bytes[i] = (uint8_t) (iter + i);
+				}
+				if (iter % 2) {
+					__transaction_cancel;
+				}
+				abort_ncommitted++;
+			}
+		}
+		checkCommitted();
+		/* Truncation must have gone over logs holding abort markers */
+		CHECK(getStat("mcore_trunc_rounds_total") > 0);
+	}
+
+	TEST(Test2)
+	{
+		recoverLogs();
+		checkCommitted();
+	}
+}
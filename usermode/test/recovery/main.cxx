@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * Runs one test of a crash series. Every test ends in a crash: the process 
+ * exits without the clean shutdown that would truncate the logs, so the 
+ * next test of the series starts with a recovery of whatever the logs 
+ * still hold.
+ */
+#include <unistd.h>
+#include "../common/unittest.h"
+
+int main(int argc, char **argv)
+{
+	char         *suiteName;
+	char         *testName;
+	int          ret;
+
+	getTest(argc, argv, &suiteName, &testName);
+	ret = runTests(suiteName, testName);
+	_exit(ret);
+}
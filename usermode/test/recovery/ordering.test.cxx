@@ -0,0 +1,140 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * Crashes with conflicting transactions of several threads in the logs 
+ * and checks that recovery replays them in commit order.
+ *
+ * Every other transaction increments a shared counter and stores its new
+ * value in one of a few slots, so each slot is overwritten by transactions
+ * of all threads. Truncation never runs, so recovery replays every commit
+ * and replaying any two of them out of order leaves a stale value behind.
+ *
+ * Every transaction also writes a cacheline of its own thread. Fragments 
+ * of different threads that leave the counter alone commute, so recovery
+ * can replay them in the same batch.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <mnemosyne.h>
+#include <UnitTest++/UnitTest++.h>
+#include "stats.helper.h"
+#include "recovery.helper.h"
+
+#define NTHREADS        4
+#define NITERATIONS     2000
+#define NSLOTS          64
+#define LINE_NWORDS     8
+
+MNEMOSYNE_PERSISTENT uint64_t order_counter;
+MNEMOSYNE_PERSISTENT uint64_t order_slots[NSLOTS];
+MNEMOSYNE_PERSISTENT uint64_t order_own[NTHREADS][LINE_NWORDS] __attribute__((aligned(64)));
+
+/* 
+ * Writers start together and yield after every transaction so that their
+ * commits interleave even on a single processor.
+ */
+static pthread_barrier_t order_barrier;
+
+static inline uint64_t ownValue(uint64_t tid, uint64_t iter)
+{
+	return (tid << 32) | (iter + 1);
+}
+
+static void *orderWriter(void *arg)
+{
+	uint64_t tid = (uint64_t) arg;
+	uint64_t c;
+	uint64_t iter;
+
+	pthread_barrier_wait(&order_barrier);
+	for (iter=0; iter<NITERATIONS; iter++) {
+		__transaction_atomic {
+			order_own[tid][iter % LINE_NWORDS] = ownValue(tid, iter);
+			if (iter % 2 == 0) {
+				c = order_counter + 1;
+				order_counter = c;
+				order_slots[c % NSLOTS] = c;
+			}
+		}
+		sched_yield();
+	}
+	return NULL;
+}
+
+SUITE(SuiteOrderedRecovery)
+{
+	TEST(Test1)
+	{
+		pthread_t threads[NTHREADS];
+		uint64_t  tid;
+
+		pthread_barrier_init(&order_barrier, NULL, NTHREADS);
+		for (tid=0; tid<NTHREADS; tid++) {
+			pthread_create(&threads[tid], NULL, orderWriter, (void *) tid);
+		}
+		for (tid=0; tid<NTHREADS; tid++) {
+			pthread_join(threads[tid], NULL);
+		}
+		CHECK_EQUAL(NTHREADS * NITERATIONS / 2, order_counter);
+	}
+
+	TEST(Test2)
+	{
+		uint64_t total = NTHREADS * NITERATIONS / 2;
+		uint64_t s;
+		uint64_t tid;
+		uint64_t i;
+
+		recoverLogs();
+		CHECK(getStat("mcore_recovery_fragments") > 0);
+		/* 
+		 * Some fragments must have been replayed concurrently. This needs a
+		 * log type that decodes its fragments, such as the torn-bit log.
+		 */
+		CHECK(getStat("mcore_recovery_batches") < getStat("mcore_recovery_fragments"));
+		CHECK_EQUAL(total, order_counter);
+		for (s=0; s<NSLOTS; s++) {
+			/* the last value stored in the slot */
+			CHECK_EQUAL(total - (total - s) % NSLOTS, order_slots[s]);
+		}
+		for (tid=0; tid<NTHREADS; tid++) {
+			for (i=0; i<LINE_NWORDS; i++) {
+				/* the last iteration that wrote this word */
+				CHECK_EQUAL(ownValue(tid, NITERATIONS - LINE_NWORDS + i), order_own[tid][i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+#ifndef _RECOVERY_RECOVERY_HELPER_H
+#define _RECOVERY_RECOVERY_HELPER_H
+
+#include <stdint.h>
+
+static uint64_t recover_ntransactions;
+
+/**
+ * \brief Runs a transaction so that the transactional runtime starts and
+ * recovers the logs left behind by the previous run.
+ *
+ * The runtime starts with the first transaction of the process, so a test
+ * must call this before it checks recovered state or recovery statistics.
+ */
+static inline void recoverLogs()
+{
+	__transaction_atomic {
+		recover_ntransactions++;
+	}
+}
+
+#endif /* _RECOVERY_RECOVERY_HELPER_H */
@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+#ifndef _RECOVERY_STATS_HELPER_H
+#define _RECOVERY_STATS_HELPER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <statsrv.h>
+
+/**
+ * \brief Returns the sum of all samples of the statistic name, over all
+ * its label sets, as written by m_statsrv_report.
+ */
+static inline unsigned long long getStat(const char *name)
+{
+	FILE               *fout;
+	char               line[256];
+	char               *value;
+	size_t             len = strlen(name);
+	unsigned long long total = 0;
+
+	if (!(fout = tmpfile())) {
+		return 0;
+	}
+	m_statsrv_report(fout);
+	rewind(fout);
+	while (fgets(line, sizeof(line), fout)) {
+		if (strncmp(line, name, len) == 0 && 
+		    (line[len] == ' ' || line[len] == '{')) 
+		{
+			value = strrchr(line, ' ');
+			total += strtoull(value + 1, NULL, 10);
+		}
+	}
+	fclose(fout);
+	return total;
+}
+
+#endif /* _RECOVERY_STATS_HELPER_H */
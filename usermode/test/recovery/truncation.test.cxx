@@ -0,0 +1,127 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/*!
+ * \file
+ *
+ * Crashes while writers are held back by asynchronous log truncation and
+ * checks that recovery brings back every committed transaction.
+ *
+ * Runs with logs small enough and watermarks low enough that writers 
+ * cross the high watermark every few transactions.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <mnemosyne.h>
+#include <UnitTest++/UnitTest++.h>
+#include "stats.helper.h"
+#include "recovery.helper.h"
+
+#define NTHREADS        4
+#define NITERATIONS     2000
+#define NLINES          8
+#define LINE_NWORDS     8
+
+MNEMOSYNE_PERSISTENT uint64_t trunc_data[NTHREADS][NLINES][LINE_NWORDS];
+MNEMOSYNE_PERSISTENT uint64_t trunc_ncommitted[NTHREADS];
+
+/* Holds the writers, and so their logs, until their statistics are read */
+static pthread_barrier_t trunc_barrier;
+
+static inline uint64_t truncValue(uint64_t tid, uint64_t iter)
+{
+	return (tid << 32) | (iter + 1);
+}
+
+static void *truncWriter(void *arg)
+{
+	uint64_t tid = (uint64_t) arg;
+	uint64_t iter;
+	int      i;
+
+	for (iter=0; iter<NITERATIONS; iter++) {
+		__transaction_atomic {
+			for (i=0; i<LINE_NWORDS; i++) {
+				trunc_data[tid][iter % NLINES][i] = truncValue(tid, iter);
+			}
+			trunc_ncommitted[tid] = iter + 1;
+		}
+	}
+	pthread_barrier_wait(&trunc_barrier);
+	pthread_barrier_wait(&trunc_barrier);
+	return NULL;
+}
+
+SUITE(SuiteTruncationCrash)
+{
+	TEST(Test1)
+	{
+		pthread_t threads[NTHREADS];
+		uint64_t  tid;
+
+		pthread_barrier_init(&trunc_barrier, NULL, NTHREADS + 1);
+		for (tid=0; tid<NTHREADS; tid++) {
+			pthread_create(&threads[tid], NULL, truncWriter, (void *) tid);
+		}
+		pthread_barrier_wait(&trunc_barrier);
+		for (tid=0; tid<NTHREADS; tid++) {
+			CHECK_EQUAL(NITERATIONS, trunc_ncommitted[tid]);
+		}
+		/* Writers must have waited on truncation at least once */
+		CHECK(getStat("mcore_log_trunc_waits_total") > 0);
+		CHECK(getStat("mcore_trunc_rounds_total") > 0);
+		pthread_barrier_wait(&trunc_barrier);
+		for (tid=0; tid<NTHREADS; tid++) {
+			pthread_join(threads[tid], NULL);
+		}
+	}
+
+	TEST(Test2)
+	{
+		uint64_t tid;
+		uint64_t iter;
+		int      line;
+		int      i;
+
+		recoverLogs();
+		for (tid=0; tid<NTHREADS; tid++) {
+			CHECK_EQUAL(NITERATIONS, trunc_ncommitted[tid]);
+			for (line=0; line<NLINES; line++) {
+				/* the last iteration that wrote this line */
+				iter = NITERATIONS - NLINES + line;
+				for (i=0; i<LINE_NWORDS; i++) {
+					CHECK_EQUAL(truncValue(tid, iter), trunc_data[tid][line][i]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,217 @@
+/*
+    Copyright (C) 2011 Computer Sciences Department, 
+    University of Wisconsin -- Madison
+
+    ----------------------------------------------------------------------
+
+    This file is part of Mnemosyne: Lightweight Persistent Memory, 
+    originally developed at the University of Wisconsin -- Madison.
+
+    Mnemosyne was originally developed primarily by Haris Volos
+    with contributions from Andres Jaan Tack.
+
+    ----------------------------------------------------------------------
+
+    Mnemosyne is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation, version 2
+    of the License.
+ 
+    Mnemosyne is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, 
+    Boston, MA  02110-1301, USA.
+
+### END HEADER ###
+*/
+
+/**
+ * \file
+ *
+ * \brief Decodes a binary trace written by the PM_* trace rings into the
+ * text format of pm_instr.h.
+ *
+ * Events of all threads are merged in TSC order. Times are in 
+ * microseconds since tracing started, converted from TSC using the 
+ * first and last time synchronization points of the trace.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "pm_trace.h"
+
+typedef struct event_s {
+	pm_trace_rec_t rec;
+	uint64_t       seq;
+	int            tid;
+} event_t;
+
+static char     **strings;
+static uint64_t nstrings;
+static event_t  *events;
+static uint64_t nevents;
+static uint64_t maxevents;
+
+
+static void
+usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s TRACE_FILE\n", prog);
+	exit(1);
+}
+
+
+static void
+read_or_die(void *buf, size_t size, FILE *fp)
+{
+	if (fread(buf, 1, size, fp) != size) {
+		fprintf(stderr, "truncated trace\n");
+		exit(1);
+	}
+}
+
+
+static const char *
+string(uint32_t id)
+{
+	return id < nstrings && strings[id] ? strings[id] : "?";
+}
+
+
+static void
+add_string(uint64_t id, char *str)
+{
+	uint64_t n;
+
+	if (id >= nstrings) {
+		n = nstrings ? nstrings : 64;
+		while (n <= id) {
+			n *= 2;
+		}
+		strings = (char **) realloc(strings, n * sizeof(*strings));
+		memset(strings + nstrings, 0, (n - nstrings) * sizeof(*strings));
+		nstrings = n;
+	}
+	strings[id] = str;
+}
+
+
+static int
+event_cmp(const void *a, const void *b)
+{
+	const event_t *ea = (const event_t *) a;
+	const event_t *eb = (const event_t *) b;
+
+	if (ea->rec.tsc != eb->rec.tsc) {
+		return ea->rec.tsc < eb->rec.tsc ? -1 : 1;
+	}
+	return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	pm_trace_file_hdr_t hdr;
+	pm_trace_chunk_t    chunk;
+	pm_trace_chunk_t    sync_first;
+	pm_trace_chunk_t    sync_last;
+	uint64_t            dropped = 0;
+	uint64_t            i;
+	double              us_per_cycle = 0;
+	unsigned long long  us;
+	pm_trace_rec_t      *rec;
+	char                *str;
+	FILE                *fp;
+
+	if (argc != 2) {
+		usage(argv[0]);
+	}
+	if ((fp = fopen(argv[1], "r")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	read_or_die(&hdr, sizeof(hdr), fp);
+	if (hdr.magic != PM_TRACE_MAGIC || hdr.rec_size != sizeof(pm_trace_rec_t)) {
+		fprintf(stderr, "%s: not a trace file of this version\n", argv[1]);
+		return 1;
+	}
+
+	memset(&sync_first, 0, sizeof(sync_first));
+	memset(&sync_last, 0, sizeof(sync_last));
+	while (fread(&chunk, sizeof(chunk), 1, fp) == 1) {
+		switch (chunk.type) {
+			case PM_TRACE_CHUNK_EVENTS:
+				if (nevents + chunk.n > maxevents) {
+					maxevents = 2 * (nevents + chunk.n);
+					events = (event_t *) realloc(events, maxevents * sizeof(*events));
+				}
+				for (i = 0; i < chunk.n; i++) {
+					read_or_die(&events[nevents].rec, sizeof(pm_trace_rec_t), fp);
+					events[nevents].seq = nevents;
+					events[nevents].tid = chunk.tid;
+					nevents++;
+				}
+				break;
+			case PM_TRACE_CHUNK_STRING:
+				str = (char *) malloc(chunk.n + 1);
+				read_or_die(str, chunk.n, fp);
+				str[chunk.n] = '\0';
+				add_string(chunk.arg[0], str);
+				break;
+			case PM_TRACE_CHUNK_DROPS:
+				fprintf(stderr, "thread %u dropped %llu events\n", chunk.tid, 
+				        (unsigned long long) chunk.n);
+				dropped += chunk.n;
+				break;
+			case PM_TRACE_CHUNK_SYNC:
+				if (sync_first.type == 0) {
+					sync_first = chunk;
+				}
+				sync_last = chunk;
+				break;
+			default:
+				fprintf(stderr, "unknown chunk type %u\n", chunk.type);
+				return 1;
+		}
+	}
+	fclose(fp);
+
+	if (sync_last.arg[0] > sync_first.arg[0]) {
+		us_per_cycle = (double) (sync_last.arg[1] - sync_first.arg[1]) / 
+		               (double) (sync_last.arg[0] - sync_first.arg[0]);
+	}
+	qsort(events, nevents, sizeof(*events), event_cmp);
+	for (i = 0; i < nevents; i++) {
+		rec = &events[i].rec;
+		us = rec->tsc > sync_first.arg[0] ? 
+		     (unsigned long long) ((rec->tsc - sync_first.arg[0]) * us_per_cycle) : 0;
+		switch (rec->nargs) {
+			case 1:
+				printf("%d:%llu:%s:%p:%lu:%s:%d\n", events[i].tid, us, 
+				       string(rec->marker), (void *) rec->addr, 
+				       (unsigned long) rec->arg[0], string(rec->func), rec->line);
+				break;
+			case 2:
+				printf("%d:%llu:%s:%p:%lu:%lu:%s:%d\n", events[i].tid, us, 
+				       string(rec->marker), (void *) rec->addr, 
+				       (unsigned long) rec->arg[0], (unsigned long) rec->arg[1], 
+				       string(rec->func), rec->line);
+				break;
+			default:
+				printf("%d:%llu:%s:%s:%d\n", events[i].tid, us, 
+				       string(rec->marker), string(rec->func), rec->line);
+		}
+	}
+	if (dropped) {
+		fprintf(stderr, "%llu events dropped in total\n", (unsigned long long) dropped);
+	}
+	return 0;
+}